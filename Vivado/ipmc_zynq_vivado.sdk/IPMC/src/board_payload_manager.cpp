@@ -16,17 +16,80 @@
  */
 
 #include <core.h>
+#include <string.h>
+#include <algorithm>
 #include <libs/printf.h>
 
 #include "board_payload_manager.h"
+#include "board_zones.h"
+#include <adc_capture/adc_capture.h>
+#include <power_timeline/power_timeline.h>
+#include <soft_fault_policy/soft_fault_policy.h>
+#include <adaptive_sampler/adaptive_sampler.h>
+#include <hires_timer/hires_timer.h>
+#include "ipmc.h"
 
 BoardPayloadManager::BoardPayloadManager(MStateMachine *mstate_machine, FaultLog *faultlog, LogTree &log) :
-	PayloadManager(mstate_machine, faultlog, log) {
+	PayloadManager(mstate_machine, faultlog, log), pending_from_shelf(false), deferred_dropped(0), led_level(0) {
+	memset(&this->pending, 0, sizeof(this->pending));
+	memset(&this->force_off_mz, 0, sizeof(this->force_off_mz)); // No shadow to verify until config()
+
+	this->deferred_queue = xQueueCreate(8, sizeof(ActivationRecord));
+	configASSERT(this->deferred_queue);
+	this->stats_mutex = xSemaphoreCreateMutex();
+	configASSERT(this->stats_mutex);
+
+	// Logging and LED updates are kept off the activation path.
+	this->deferred_task = runTask("pyld_deferred", TASK_PRIORITY_BACKGROUND, [this]() -> void { this->runDeferred(); });
 }
 
 BoardPayloadManager::~BoardPayloadManager() {
 }
 
+/// A console command to show the power level change latency histograms.
+class BoardPayloadManager::ActivationStats : public CommandParser::Command {
+public:
+	ActivationStats(BoardPayloadManager &payload) : payload(payload) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [reset]\n\n"
+				"Show histograms of the power level change latency, from the request to each stage.\n"
+				"The M-state stage is the shelf command to M4 (or M1) latency.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const char *stage_names[STAGE_COUNT] = {"command", "locked", "zones", "contexts", "mstate"};
+		std::string action;
+
+		if (parameters.nargs() > 1 && (!parameters.parseParameters(1, true, &action) || action != "reset")) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		MutexGuard<false> lock(this->payload.stats_mutex, true);
+		if (action == "reset") {
+			for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+				this->payload.activation_latency[stage].reset();
+				this->payload.deactivation_latency[stage].reset();
+			}
+			return;
+		}
+
+		std::string out;
+		for (int stage = STAGE_LOCKED; stage < STAGE_COUNT; ++stage)
+			out += this->payload.activation_latency[stage].format(std::string("Power up, ") + stage_names[stage]);
+		for (int stage = STAGE_LOCKED; stage < STAGE_COUNT; ++stage)
+			out += this->payload.deactivation_latency[stage].format(std::string("Power down, ") + stage_names[stage]);
+		out += stdsprintf("Deferred records dropped: %lu\n", this->payload.deferred_dropped);
+		lock.release();
+
+		console->write(out);
+	}
+
+private:
+	BoardPayloadManager &payload;
+};
+
 void BoardPayloadManager::config() {
 	/* Here we define E-Keying links.  These will be checked by the Shelf Manager
 	 * and enabled with an IPMI command which routes to the update_link_enable
@@ -49,11 +112,30 @@ void BoardPayloadManager::config() {
 
 	ZoneController *zonectrl = new ZoneController(XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID);
 	zonectrl->registerConsoleCommands(console_command_parser, "zonectrl.");
+	console_command_parser.registerCommand("payload.activation", std::make_shared<BoardPayloadManager::ActivationStats>(*this));
 
 	// Set up Management Zones
 	for (int i = 0; i < XPAR_MGMT_ZONE_CTRL_0_MZ_CNT; ++i)
 		this->mgmt_zones[i] = new ZoneController::Zone(*zonectrl, i);
 
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+	// Groups are sequenced by the IP's per pin timers, after the zones on power up.
+	this->pwr_ctrl = new PayloadPowerController(XPAR_PYLD_PWR_CTRL_0_DEVICE_ID, this->log["pwrctrl"]);
+	this->pwr_ctrl->registerConsoleCommands(console_command_parser, "pwrctrl.");
+#endif
+
+	// Soft fault rules with ACTION_FORCE_OFF power down straight from the sensor processor interrupt.
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->force_off_mz, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID))
+		throw std::runtime_error("Unable to initialize Mgmt_Zone_Ctrl for the soft fault force off");
+	if (soft_faults) {
+		soft_faults->setForceOff(BoardPayloadManager::_ForceOff, this);
+		soft_faults->setReconcile([this](const SoftFaultPolicy::Rule &rule) -> void { this->reconcileSoftFault(rule); });
+	}
+
+	// Hard fault snapshots are kept in the persistent fault log.
+	if (hardfault_capture && this->faultlog)
+		hardfault_capture->setSink([this](const HardFaultCapture::Snapshot &snapshot) -> void { this->logHardFault(snapshot); });
+
 	SuspendGuard suspend(true);
 	this->mstate_machine->deactivate_payload = [this]() -> void {
 		// Turn off power.
@@ -74,122 +156,30 @@ void BoardPayloadManager::config() {
 	};
 	suspend.release();
 
-	auto calc_hf_mask = [this](std::vector<std::string> sensors) -> uint64_t {
-		uint64_t mask = 0;
-		for (std::string& name : sensors) {
-			try {
-				ADCSensor &sensor = PayloadManager::adc_sensors.at(name);
-				if (sensor.sensor_processor_id >= 0)
-					mask |= 1 << sensor.sensor_processor_id;
-			}
-			catch (std::out_of_range) {
-				this->log.log(stdsprintf("Unable find sensor %s in payload_manager->adc_sensors: No hardfault protection available.", name.c_str()), LogTree::LOG_ERROR);
-			}
-		}
-		return mask;
+	/* Zone configurations are resolved at compile time from the tables in
+	 * board_zones.h, here they are only committed to the zone controller.
+	 */
+	static constexpr MZ_config mz_images[] = {
+		BoardZones::image(0), BoardZones::image(1), BoardZones::image(2), BoardZones::image(3), BoardZones::image(4),
 	};
+	static_assert(sizeof(mz_images) / sizeof(mz_images[0]) == BoardZones::ZONE_COUNT, "Every zone needs an image");
 
 	std::vector<ZoneController::Zone::OutputConfig> pen_config;
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
-	const uint64_t hfm_TEMP = calc_hf_mask({"T_TOP", "T_BOT"});
-	const uint64_t hfm_PWRENA_0 = calc_hf_mask({"+12VPYLD"}); // PWREN_12VPYLD
-	const uint64_t hfm_PWRENA_1 = calc_hf_mask({"+2.5VETH"}); // PWREN_2V5ETH
-	const uint64_t hfm_PWRENA_2 = calc_hf_mask({"+1.0VETH"}); // PWREN_1V0ETH
-	const uint64_t hfm_PWRENA_3 = calc_hf_mask({"+3.3VPYLD"}); // PWREN_3V3PYLD
-	const uint64_t hfm_PWRENA_4 = calc_hf_mask({"+5VPYLD"}); // PWREN_5V0PYLD
-	const uint64_t hfm_PWRENA_5 = calc_hf_mask({"+1.2VPHY"}); // PWREN_1V2PHY
-	const uint64_t hfm_PWRENA_6 = calc_hf_mask({"+12VPYLD"}); // ELM_PWR_EN
-
-#pragma GCC diagnostic pop
-
-	this->mz_hf_vectors[0] = hfm_TEMP | hfm_PWRENA_0;
-	this->mz_hf_vectors[1] = this->mz_hf_vectors[0] | hfm_PWRENA_1 | hfm_PWRENA_2; // Ethernet Switch
-	this->mz_hf_vectors[2] = this->mz_hf_vectors[0] | hfm_PWRENA_3 | hfm_PWRENA_4; // Peripherals
-	this->mz_hf_vectors[3] = this->mz_hf_vectors[0] | hfm_PWRENA_5; // 10G Phy
-
-	// Zone 0 and 2 need to be on for ELM to turn on
-	this->mz_hf_vectors[4] = this->mz_hf_vectors[0] | this->mz_hf_vectors[2];
-
-	{
-		// Management Zone 0, +12V power
-		this->mgmt_zones[0]->setName("+12V Power");
-		this->mgmt_zones[0]->setHardfaultMask(this->mz_hf_vectors[0], 0);
-		this->mgmt_zones[0]->getPowerEnableConfig(pen_config);
-
-		// PWRENA_0#: +12VPYLD
-		pen_config[0].drive_enabled = true;
-		pen_config[0].active_high = true;
-		pen_config[0].enable_delay = 0;
-
-		this->mgmt_zones[0]->setPowerEnableConfig(pen_config);
-	}
-
-	{
-		// Management Zone 1, Ethernet Switch power
-		this->mgmt_zones[1]->setName("Ethernet Switch");
-		this->mgmt_zones[1]->setHardfaultMask(this->mz_hf_vectors[1], 0);
-		this->mgmt_zones[1]->getPowerEnableConfig(pen_config);
-
-		// PWRENA_1: +2.5VETH
-		pen_config[1].drive_enabled = true;
-		pen_config[1].active_high = true;
-		pen_config[1].enable_delay = 10;
-
-		// PWRENA_2: +1.0VETH
-		pen_config[2].drive_enabled = true;
-		pen_config[2].active_high = true;
-		pen_config[2].enable_delay = 10;
-
-		this->mgmt_zones[1]->setPowerEnableConfig(pen_config);
-	}
-
-	{
-		// Management Zone 2, SSD, Firefly and USB power
-		this->mgmt_zones[2]->setName("SSD/Firefly/USB");
-		this->mgmt_zones[2]->setHardfaultMask(this->mz_hf_vectors[2], 0);
-		this->mgmt_zones[2]->getPowerEnableConfig(pen_config);
-
-		// PWRENA_3: +3.3VPYLD
-		pen_config[3].drive_enabled = true;
-		pen_config[3].active_high = true;
-		pen_config[3].enable_delay = 20;
-
-		// PWRENA_4: +5VPYLD
-		pen_config[4].drive_enabled = true;
-		pen_config[4].active_high = true;
-		pen_config[4].enable_delay = 20;
-
-		this->mgmt_zones[2]->setPowerEnableConfig(pen_config);
-	}
-
-	{
-		// Management Zone 3, 10G PHY power
-		this->mgmt_zones[3]->setName("10G PHY");
-		this->mgmt_zones[3]->setHardfaultMask(this->mz_hf_vectors[3], 0);
-		this->mgmt_zones[3]->getPowerEnableConfig(pen_config);
-
-		// PWRENA_5: +1.2VPHY
-		pen_config[5].drive_enabled = true;
-		pen_config[5].active_high = true;
-		pen_config[5].enable_delay = 30;
-
-		this->mgmt_zones[3]->setPowerEnableConfig(pen_config);
-	}
-
-	{
-		// Management Zone 4, ELM power enable
-		this->mgmt_zones[4]->setName("ELM Power Enable");
-		this->mgmt_zones[4]->setHardfaultMask(this->mz_hf_vectors[4], 0);
-		this->mgmt_zones[4]->getPowerEnableConfig(pen_config);
-
-		// PWRENA_6: ELM_PWR_EN
-		pen_config[6].drive_enabled = true;
-		pen_config[6].active_high = true;
-		pen_config[6].enable_delay = 40;
-
-		this->mgmt_zones[4]->setPowerEnableConfig(pen_config);
+	for (size_t i = 0; i < BoardZones::ZONE_COUNT; ++i) {
+		const MZ_config &image = mz_images[i];
+		this->mz_hf_vectors[i] = image.hardfault_mask;
+
+		this->mgmt_zones[i]->setName(BoardZones::zones[i].name);
+		this->mgmt_zones[i]->setHardfaultMask(image.hardfault_mask, image.fault_holdoff);
+		this->mgmt_zones[i]->getPowerEnableConfig(pen_config);
+		for (size_t pin = 0; pin < pen_config.size() && pin < 32; ++pin) {
+			if (!image.pwren_cfg[pin])
+				continue;
+			pen_config[pin].drive_enabled = image.pwren_cfg[pin] & (1 << 17);
+			pen_config[pin].active_high = image.pwren_cfg[pin] & (1 << 16);
+			pen_config[pin].enable_delay = image.pwren_cfg[pin] & 0xFFFF;
+		}
+		this->mgmt_zones[i]->setPowerEnableConfig(pen_config);
 	}
 
 	// Finalize configuration
@@ -247,31 +237,38 @@ PowerProperties BoardPayloadManager::getPowerProperties(uint8_t fru, bool recomp
  * Set the power utilization for the specified FRU to the value previously
  * calculated for the selected level.
  *
+ * Only the hardware critical steps and the M-state change happen here,
+ * logging and LED updates are deferred to a background task.
+ *
  * @param fru The FRU to manage.
  * @param level The pre-calculated power level to set.
  */
 void BoardPayloadManager::setPowerLevel(uint8_t fru, uint8_t level) {
+	const uint64_t command = HiResTimer::now();
+
 	if (fru != 0)
 		throw std::domain_error("This FRU is not known.");
+	if (level > 1) // We only support one non-off power state.
+		throw std::domain_error(stdsprintf("Power level %hhu is not supported.", level));
 
 	MutexGuard<true> lock(this->mutex, true);
 
+	memset(&this->pending, 0, sizeof(this->pending));
+	this->pending.stamp[STAGE_COMMAND] = command;
+	this->pending.from_shelf = true;
+	this->pending_from_shelf = true;
+
 	this->power_properties.current_power_level = level;
+	this->implementPowerLevel(level);
+
+	// Activation completes in implementPowerLevel(), as for any other caller.
 	if (level == 0) {
-		// Power OFF!
-		this->log.log("Power Level set to 0 by shelf.", LogTree::LOG_INFO);
-		this->implementPowerLevel(0);
 		this->mstate_machine->payloadDeactivationComplete();
+		this->stamp(STAGE_MSTATE);
 	}
-	else if (level == 1) {
-		// We only support one non-off power state.
-		this->log.log("Power Level set to 1 by shelf.", LogTree::LOG_INFO);
-		this->implementPowerLevel(1);
-		this->mstate_machine->payloadActivationComplete();
-	}
-	else {
-		throw std::domain_error(stdsprintf("Power level %hhu is not supported.", level));
-	}
+
+	this->pending_from_shelf = false;
+	this->finishActivation();
 }
 
 /**
@@ -280,16 +277,40 @@ void BoardPayloadManager::setPowerLevel(uint8_t fru, uint8_t level) {
  * @param level The level to apply
  */
 void BoardPayloadManager::implementPowerLevel(uint8_t level) {
+	const uint64_t command = HiResTimer::now();
+
 	MutexGuard<true> lock(this->mutex, true);
+	if (!this->pending_from_shelf) {
+		// Called directly, not through setPowerLevel().
+		memset(&this->pending, 0, sizeof(this->pending));
+		this->pending.stamp[STAGE_COMMAND] = command;
+	}
+	this->stamp(STAGE_LOCKED);
+	this->pending.level = level;
 
 	if (level == 0) {
 		// Power OFF!
-		this->log.log("Implement Power Level 0: Shutting down.", LogTree::LOG_DIAGNOSTIC);
+
+		// Let an armed waveform capture see the transition.
+		if (adc_capture)
+			adc_capture->trigger(ADCCapture::TRIGGER_ZONE);
+		if (power_timeline)
+			power_timeline->arm(0);
+		if (adaptive_sampler)
+			adaptive_sampler->boost();
+
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+		// Highest group first, completion is reported by the controller task.
+		std::vector<uint8_t> groups = this->pwr_ctrl->getConfiguredGroups();
+		std::reverse(groups.begin(), groups.end());
+		this->pwr_ctrl->sequence(groups, PayloadPowerController::DOWN);
+#endif
 
 		// We need to put things out of context in advance, so they don't fault at the start of the sequence.
 		for (int i = 4; i >= 0; --i)
 			this->mgmt_zones[i]->resetLastTransitionStart();
 		this->updateSensorProcessorContexts();
+		this->stamp(STAGE_CONTEXTS);
 
 		for (int i = 4; i >= 0; --i) {
 			/* These are sequenced with delays in firmware so that all can be
@@ -297,31 +318,198 @@ void BoardPayloadManager::implementPowerLevel(uint8_t level) {
 			 */
 			this->mgmt_zones[i]->setPowerState(ZoneController::Zone::OFF);
 		}
-		this->log.log("Implement Power Level 0: Shutdown complete.", LogTree::LOG_DIAGNOSTIC);
-
-		struct IPMILED::Action ledstate;
-		ledstate.min_duration = 0;
-		ledstate.effect = IPMILED::OFF;
-		ipmi_leds[2]->submit(ledstate);
+		this->stamp(STAGE_ZONES);
 	} else if (level == 1) {
 		// We only support one non-off power state.
-		this->log.log("Implement Power Level 1: Powering up backend.", LogTree::LOG_DIAGNOSTIC);
+		if (adc_capture)
+			adc_capture->trigger(ADCCapture::TRIGGER_ZONE);
+		if (power_timeline)
+			power_timeline->arm(1);
+		if (adaptive_sampler)
+			adaptive_sampler->boost();
 		for (int i = 0; i <= 4; ++i) {
 			/* These are sequenced with delays in firmware so that all can be
 			 * enabled at once and the right things will happen.
 			 */
 			this->mgmt_zones[i]->setPowerState(ZoneController::Zone::ON);
 		}
+		this->stamp(STAGE_ZONES);
+
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+		this->pwr_ctrl->sequence(this->pwr_ctrl->getConfiguredGroups(), PayloadPowerController::UP);
+#endif
+
 		// We need to start the clock on putting these zones back into context for fault detection.
 		this->updateSensorProcessorContexts();
+		this->stamp(STAGE_CONTEXTS);
+
 		// If we were waiting in M3, go to M4. (Skipping E-Keying for now)
-		this->log.log("Implement Power Level 1: Backend powered up.", LogTree::LOG_DIAGNOSTIC);
-		struct IPMILED::Action ledstate;
-		ledstate.min_duration = 0;
-		ledstate.effect = IPMILED::ON;
-		ipmi_leds[2]->submit(ledstate);
 		this->mstate_machine->payloadActivationComplete();
+		this->stamp(STAGE_MSTATE);
 	}
 
 	this->power_properties.current_power_level = level;
+
+	if (!this->pending_from_shelf)
+		this->finishActivation();
+}
+
+//! Timestamp a stage of the pending power level change.
+void BoardPayloadManager::stamp(ActivationStage stage) {
+	this->pending.stamp[stage] = HiResTimer::now();
+}
+
+/**
+ * Hand the pending record to the deferred task, never blocks.
+ *
+ * The LED follows a single latest state slot rather than the records, so it
+ * is still updated when the queue is full and only statistics are lost.
+ */
+void BoardPayloadManager::finishActivation() {
+	this->led_level = this->pending.level;
+	if (pdTRUE != xQueueSend(this->deferred_queue, &this->pending, 0))
+		this->deferred_dropped++;
+	xTaskNotifyGive(this->deferred_task);
+}
+
+/**
+ * Compare the zone controller shadow with the hardware.
+ *
+ * A divergence is only reported, and the shadow dropped so that every later
+ * access reads the hardware again.  Writing the shadow back could undo a
+ * change made behind the driver's back on purpose, that is left to a person.
+ *
+ * @return Bitmap of the diverged MZs.
+ */
+uint32_t BoardPayloadManager::verifyShadow() {
+	uint32_t diverged = Mgmt_Zone_Ctrl_Verify_Shadow(&this->force_off_mz, false);
+	if (diverged) {
+		Mgmt_Zone_Ctrl_Invalidate_Shadow(&this->force_off_mz);
+		this->log.log(stdsprintf("Management zone configuration diverged from its shadow on zones 0x%04lx, shadow dropped.", diverged), LogTree::LOG_WARNING);
+	}
+	return diverged;
+}
+
+/**
+ * Everything that doesn't need to happen before the M-state change: LEDs,
+ * logging and latency statistics.  Also checks the zone controller shadow
+ * against the hardware every SHADOW_VERIFY_PERIOD ms.
+ */
+void BoardPayloadManager::runDeferred() {
+	ActivationRecord record;
+	int led_shown = -1;
+	TickType_t next_verify = xTaskGetTickCount() + pdMS_TO_TICKS(SHADOW_VERIFY_PERIOD);
+
+	while (true) {
+		TickType_t now = xTaskGetTickCount();
+		if ((int32_t)(next_verify - now) <= 0) {
+			this->verifyShadow();
+			next_verify = now + pdMS_TO_TICKS(SHADOW_VERIFY_PERIOD);
+			continue;
+		}
+
+		if (!ulTaskNotifyTake(pdTRUE, next_verify - now))
+			continue;
+
+		// Only the latest level matters, so repeated or coalesced wakeups are harmless.
+		const uint8_t led_level = this->led_level;
+		if (led_level != led_shown) {
+			struct IPMILED::Action ledstate;
+			ledstate.min_duration = 0;
+			ledstate.effect = led_level ? IPMILED::ON : IPMILED::OFF;
+			ipmi_leds[2]->submit(ledstate);
+			led_shown = led_level;
+		}
+
+		while (pdTRUE == xQueueReceive(this->deferred_queue, &record, 0))
+			this->reportActivation(record);
+	}
+}
+
+//! Log a finished power level change and add it to the latency statistics.
+void BoardPayloadManager::reportActivation(const ActivationRecord &record) {
+	uint64_t us[STAGE_COUNT] = {0};
+	for (int stage = STAGE_LOCKED; stage < STAGE_COUNT; ++stage)
+		if (record.stamp[stage])
+			us[stage] = HiResTimer::countsToUs(record.stamp[stage] - record.stamp[STAGE_COMMAND]);
+
+	MutexGuard<false> lock(this->stats_mutex, true);
+	LatencyHistogram *histograms = record.level ? this->activation_latency : this->deactivation_latency;
+	for (int stage = STAGE_LOCKED; stage < STAGE_COUNT; ++stage)
+		if (record.stamp[stage])
+			histograms[stage].add(us[stage]);
+	lock.release();
+
+	if (record.from_shelf)
+		this->log.log(stdsprintf("Power Level set to %hhu by shelf: M-state notified after %llu us (lock %llu us, zones %llu us, contexts %llu us).",
+				record.level, us[STAGE_MSTATE], us[STAGE_LOCKED], us[STAGE_ZONES], us[STAGE_CONTEXTS]), LogTree::LOG_INFO);
+	else
+		this->log.log(stdsprintf("Implemented Power Level %hhu in %llu us.", record.level,
+				std::max(us[STAGE_ZONES], us[STAGE_CONTEXTS])), LogTree::LOG_DIAGNOSTIC);
+}
+
+/**
+ * Record a hard fault snapshot in the FaultLog, from the capture task.
+ *
+ * The record holds the newly raised hard fault bits and the zone states, two
+ * bits per zone.  The readings stay in the log tree message of the capture.
+ */
+void BoardPayloadManager::logHardFault(const HardFaultCapture::Snapshot &snapshot) {
+	uint32_t zones = 0;
+	for (size_t mz = 0; mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz)
+		zones |= (snapshot.zones[mz] & 3) << (2 * mz);
+
+	uint8_t data[12];
+	for (size_t i = 0; i < 8; ++i)
+		data[i] = snapshot.raised >> (8 * i);
+	for (size_t i = 0; i < 4; ++i)
+		data[8 + i] = zones >> (8 * i);
+
+	FaultLog::fault fault;
+	memset(&fault, 0, sizeof(fault));
+	fault.fault_type = FAULT_TYPE_HARDFAULT;
+	memcpy(fault.raw_data, data, std::min(sizeof(data), sizeof(fault.raw_data)));
+	this->faultlog->submit(fault);
+}
+
+/**
+ * Power down every zone, highest first, for soft fault rules with
+ * ACTION_FORCE_OFF.  Runs in interrupt context, so it only writes the soft
+ * fault registers and leaves the payload manager to reconcileSoftFault().
+ */
+void BoardPayloadManager::_ForceOff(void *ref) {
+	BoardPayloadManager *payload = reinterpret_cast<BoardPayloadManager*>(ref);
+
+	for (int z = payload->force_off_mz.mz_cnt - 1; z >= 0; --z)
+		Mgmt_Zone_Ctrl_Dispatch_Soft_Fault(&payload->force_off_mz, z);
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+	payload->pwr_ctrl->forcePowerDown();
+#endif
+}
+
+/**
+ * Align the power state with a soft fault trip, from the policy task.
+ *
+ * A trip that took every zone down leaves the payload at power level 0, which
+ * is recorded and shown on the LED.  The sensor processor contexts are updated
+ * either way, so zones that went down are no longer checked for faults.
+ */
+void BoardPayloadManager::reconcileSoftFault(const SoftFaultPolicy::Rule &rule) {
+	const uint32_t all_zones = (1 << BoardZones::ZONE_COUNT) - 1;
+	const bool all_off = rule.action == SoftFaultPolicy::ACTION_FORCE_OFF || (rule.zones & all_zones) == all_zones;
+
+	MutexGuard<true> lock(this->mutex, true);
+	const uint8_t level = this->power_properties.current_power_level;
+	if (all_off)
+		this->power_properties.current_power_level = 0;
+	this->updateSensorProcessorContexts();
+	lock.release();
+
+	if (all_off && level) {
+		this->led_level = 0;
+		xTaskNotifyGive(this->deferred_task);
+		this->log.log(stdsprintf("Soft fault %s powered the payload down from power level %hhu.", rule.name.c_str(), level), LogTree::LOG_WARNING);
+	} else if (!all_off) {
+		this->log.log(stdsprintf("Soft fault %s powered down zones 0x%02lx, the payload stays at power level %hhu.", rule.name.c_str(), rule.zones, level), LogTree::LOG_WARNING);
+	}
 }
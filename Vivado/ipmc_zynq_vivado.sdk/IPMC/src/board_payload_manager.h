@@ -19,6 +19,12 @@
 #define SRC_BOARD_PAYLOAD_MANAGER_H_
 
 #include <payload_manager.h>
+#include <latency_histogram/latency_histogram.h>
+#include <payload_power_ctrl/payload_power_ctrl.h>
+#include <hardfault_capture/hardfault_capture.h>
+#include <soft_fault_policy/soft_fault_policy.h>
+#include "mgmt_zone_ctrl.h"
+#include "xparameters.h"
 
 /**
  * This class implements all the default payload manager operations and
@@ -46,12 +52,61 @@ public:
 	// Optional/overridden public implementations of PayloadManager:
 	// None
 
+	/**
+	 * Stages of a power level change, timestamped on the critical path.
+	 * Latencies of each stage are measured from STAGE_COMMAND.
+	 */
+	enum ActivationStage {
+		STAGE_COMMAND,	///< Power level change requested.
+		STAGE_LOCKED,	///< Payload manager mutex acquired.
+		STAGE_ZONES,	///< All management zones commanded.
+		STAGE_CONTEXTS,	///< Sensor processor contexts updated.
+		STAGE_MSTATE,	///< M-state machine notified.
+		STAGE_COUNT,
+	};
+
 protected:
 	// Mandatory protected implementations of PayloadManager:
 	virtual void implementPowerLevel(uint8_t level);
 
 	// Optional protected implementations of PayloadManager:
 	// None
+
+private:
+	static const uint8_t FAULT_TYPE_HARDFAULT = 0x80;	///< Board specific FaultLog record type for hard fault snapshots.
+	static const uint32_t SHADOW_VERIFY_PERIOD = 10000;	///< Interval between zone controller shadow checks, in ms.
+
+	//! Timestamps of one power level change, handed to the deferred task.
+	struct ActivationRecord {
+		uint8_t level;					///< Power level applied.
+		bool from_shelf;				///< Requested by the shelf through setPowerLevel().
+		uint64_t stamp[STAGE_COUNT];	///< Global timer counts, 0 if the stage wasn't reached.
+	};
+
+	ActivationRecord pending;			///< Power level change in progress, protected by the mutex.
+	bool pending_from_shelf;			///< setPowerLevel() will finish the pending record.
+	QueueHandle_t deferred_queue;		///< Records waiting for the deferred task.
+	TaskHandle_t deferred_task;			///< The deferred task, notified for every record.
+	uint32_t deferred_dropped;			///< Records dropped because the queue was full, the LED still follows.
+	volatile uint8_t led_level;			///< Latest power level, shown on the LED by the deferred task.
+	SemaphoreHandle_t stats_mutex;		///< Protects the histograms.
+	LatencyHistogram activation_latency[STAGE_COUNT];	///< Power up latency per stage.
+	LatencyHistogram deactivation_latency[STAGE_COUNT];	///< Power down latency per stage.
+	Mgmt_Zone_Ctrl force_off_mz;		///< Zone controller driver for the soft fault force off, used from interrupt context, and the shadow checks.
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+	PayloadPowerController *pwr_ctrl;	///< Hardware timed group sequencing, on boards with the IP.
+#endif
+
+	void stamp(ActivationStage stage);
+	void finishActivation();
+	void runDeferred();
+	uint32_t verifyShadow();
+	void reportActivation(const ActivationRecord &record);
+	void logHardFault(const HardFaultCapture::Snapshot &snapshot);
+	static void _ForceOff(void *ref);
+	void reconcileSoftFault(const SoftFaultPolicy::Rule &rule);
+
+	class ActivationStats;	///< Console command to show the latency histograms.
 };
 
 #endif /* SRC_BOARD_PAYLOAD_MANAGER_H_ */
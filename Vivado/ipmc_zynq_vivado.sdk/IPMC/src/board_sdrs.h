@@ -0,0 +1,312 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_BOARD_SDRS_H_
+#define SRC_BOARD_SDRS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Declarative description of the board's threshold sensor records.
+ *
+ * Sensors are given in engineering units, the same inputs as doc/SDR
+ * Calculator.html.  The M/B/Bexp/Rexp conversion, the raw thresholds and the
+ * complete Full Sensor Record (type 01h) byte images are computed and
+ * validated at compile time, following the calculator's algorithm in integer
+ * math, so initDeviceSDRs() only hands the images to the repository.
+ *
+ * @warning This is application specific and should be adjusted!
+ */
+namespace BoardSDRs {
+
+constexpr uint8_t ENTITY_ID = 0xA0;			///< Entity of all sensors.
+constexpr uint8_t ENTITY_INSTANCE = 0x60;	///< Entity instance of all sensors.
+constexpr uint8_t HOTSWAP_NUMBER = 1;		///< Taken by the Hotswap sensor record.
+constexpr double UNSET = -1e300;			///< Marks a threshold or nominal reading as unspecified.
+
+//! Sensor type codes, IPMI v2.0 Table 42-3.
+enum SensorType : uint8_t {
+	TYPE_TEMPERATURE	= 0x01,
+	TYPE_VOLTAGE		= 0x02,
+};
+
+//! Sensor unit type codes, IPMI v2.0 Table 43-15.
+enum Unit : uint8_t {
+	UNIT_DEGREES_C	= 1,
+	UNIT_VOLTS		= 4,
+};
+
+//! Sensor rate units, IPMI v2.0 Table 43-1 byte 21.
+enum Rate : uint8_t {
+	RATE_NONE		= 0,
+	RATE_PER_SECOND	= 3,
+};
+
+//! A linear, unsigned threshold sensor.
+struct Full {
+	const char *name;		///< ID string, also the PayloadManager sensor name for ADC sensors.
+	uint8_t number;			///< Sensor number.
+	SensorType type;		///< Sensor type.
+	Unit unit;				///< Base unit.
+	Rate rate;				///< Rate unit.
+	uint8_t precision;		///< Decimal places the conversion is computed with.
+	double min;				///< Value of raw 0.
+	double granularity;		///< Value of one raw step.
+	double nominal;			///< Nominal reading, or UNSET.
+	double lnr;				///< Lower non-recoverable threshold, or UNSET.
+	double lcr;				///< Lower critical threshold, or UNSET.
+	double lnc;				///< Lower non-critical threshold, or UNSET.
+	double unc;				///< Upper non-critical threshold, or UNSET.
+	double ucr;				///< Upper critical threshold, or UNSET.
+	double unr;				///< Upper non-recoverable threshold, or UNSET.
+	double hysteresis;		///< Positive and negative going hysteresis.
+};
+
+constexpr Full sensors[] = {
+	// name				number	type				unit			rate				prec	min		gran	nominal	lnr		lcr		lnc		unc		ucr		unr		hyst
+	{"+12VPYLD",		2,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			3,		0,		0.06,	12,		10.8,	11.1,	11.4,	12.6,	12.9,	13.2,	0.06},
+	{"+5VPYLD",			3,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.0226,	5,		4.5,	4.625,	4.75,	5.25,	5.375,	5.5,	0.0226},
+	{"+3.3VPYLD",		4,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.0149,	3.3,	2.97,	3.0525,	3.135,	3.465,	3.5475,	3.63,	0.0149},
+	{"+3.3VMP",			5,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.0149,	3.3,	2.97,	3.0525,	3.135,	3.465,	3.5475,	3.63,	0.0149},
+	{"+1.0VETH",		6,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.02,	1,		0.9,	0.925,	0.95,	1.05,	1.075,	1.1,	0.02},
+	{"+2.5VETH",		7,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.0113,	2.5,	2.25,	2.3125,	2.375,	2.625,	2.6875,	2.75,	0.0113},
+	{"+1.2VPHY",		8,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_NONE,			4,		0,		0.0055,	1.2,	1.08,	1.11,	1.14,	1.26,	1.29,	1.32,	0.0055},
+	{"T_TOP",			9,		TYPE_TEMPERATURE,	UNIT_DEGREES_C,	RATE_NONE,			4,		0,		0.5,	30,		UNSET,	UNSET,	UNSET,	40,		45,		50,		0.5},
+	{"T_BOT",			10,		TYPE_TEMPERATURE,	UNIT_DEGREES_C,	RATE_NONE,			4,		0,		0.5,	30,		UNSET,	UNSET,	UNSET,	40,		45,		50,		0.5},
+	// Derived sensors, evaluated by DerivedSensors.
+	{"T_DELTA",			11,		TYPE_TEMPERATURE,	UNIT_DEGREES_C,	RATE_NONE,			1,		-64,	0.5,	0,		-20,	-15,	-10,	10,		15,		20,		0.5},
+	{"+12VPYLD dV/dt",	12,		TYPE_VOLTAGE,		UNIT_VOLTS,		RATE_PER_SECOND,	0,		-1280,	10,		0,		UNSET,	UNSET,	-1000,	1000,	UNSET,	UNSET,	10},
+};
+
+constexpr size_t SENSOR_COUNT = sizeof(sensors) / sizeof(sensors[0]);
+constexpr size_t IMAGE_SIZE = 48 + 16;	///< Fixed part plus the longest ID string.
+
+/* Conversion, C++11 constexpr functions are single expressions so these recurse. */
+
+constexpr double pow10f(int e) {
+	return (e <= 0) ? 1 : 10 * pow10f(e - 1);
+}
+
+constexpr int64_t pow10i(int e) {
+	return (e <= 0) ? 1 : 10 * pow10i(e - 1);
+}
+
+//! A value in units of 10^-precision, rounded.
+constexpr int64_t scaled(double value, int precision) {
+	return (int64_t)(value * pow10f(precision) + (value < 0 ? -0.5 : 0.5));
+}
+
+constexpr bool isSet(double value) {
+	return value != UNSET;
+}
+
+//! IPMI linear conversion factors, y = (M*x + B*10^Bexp) * 10^Rexp.
+struct Conversion {
+	int64_t m;
+	int64_t b;
+	int b_exp;
+	int r_exp;
+};
+
+//! Move trailing zeros of M into Rexp, compensating B or Bexp.
+constexpr Conversion shaveM(Conversion c) {
+	return (c.m > 0 && c.m % 10 == 0 && c.r_exp < 7 && c.b_exp > -8) ?
+			shaveM(Conversion{c.m / 10, (c.b % 10 == 0) ? c.b / 10 : c.b, (c.b % 10 == 0) ? c.b_exp : c.b_exp - 1, c.r_exp + 1}) : c;
+}
+
+//! Move trailing zeros of B into Bexp.
+constexpr Conversion shaveB(Conversion c) {
+	return (c.b != 0 && c.b % 10 == 0 && c.b_exp < 7) ? shaveB(Conversion{c.m, c.b / 10, c.b_exp + 1, c.r_exp}) : c;
+}
+
+//! The conversion of a sensor, as doc/SDR Calculator.html computes it.
+constexpr Conversion conversion(const Full &s) {
+	return shaveB(shaveM(Conversion{scaled(s.granularity, s.precision), scaled(s.min, s.precision), 0, -s.precision}));
+}
+
+//! x for a value, truncated like the calculator.  Without base, for hysteresis.
+constexpr int64_t raw(const Full &s, double value, bool base = true) {
+	return (scaled(value, s.precision) -
+				(base ? conversion(s).b * pow10i(conversion(s).b_exp + s.precision + conversion(s).r_exp) : 0)) /
+			(conversion(s).m * pow10i(s.precision + conversion(s).r_exp));
+}
+
+//! A threshold's raw value, unset upper thresholds read 0xFF and lower ones 0.
+constexpr uint8_t threshold(const Full &s, double value, bool upper) {
+	return isSet(value) ? raw(s, value) : (upper ? 0xFF : 0x00);
+}
+
+//! Threshold assertion and deassertion event mask, both directions of every set threshold.
+constexpr uint16_t eventMask(const Full &s) {
+	return (isSet(s.lnc) ? 0x0003 : 0) | (isSet(s.lcr) ? 0x000c : 0) | (isSet(s.lnr) ? 0x0030 : 0) |
+			(isSet(s.unc) ? 0x00c0 : 0) | (isSet(s.ucr) ? 0x0300 : 0) | (isSet(s.unr) ? 0x0c00 : 0);
+}
+
+constexpr size_t nameLength(const char *name, size_t i = 0) {
+	return name[i] ? nameLength(name, i + 1) : i;
+}
+
+/* Images, IPMI v2.0 Table 43-1 with the 5 byte record header. */
+
+/**
+ * One byte of the Full Sensor Record of a sensor.
+ *
+ * The record ID is left 0 for the repository to assign, the owner fields 0
+ * for "self".  All comparisons are returned, all thresholds are readable and
+ * settable, events are enabled for both directions of every set threshold.
+ */
+constexpr uint8_t recordByte(const Full &s, size_t i) {
+	return
+		(i == 2) ? 0x51 :									// SDR version
+		(i == 3) ? 0x01 :									// Record type
+		(i == 4) ? 43 + nameLength(s.name) :				// Remaining record length
+		(i == 7) ? s.number :
+		(i == 8) ? ENTITY_ID :
+		(i == 9) ? ENTITY_INSTANCE :
+		(i == 10) ? 0x03 :									// Events and scanning enabled by default
+		(i == 11) ? 0xe8 :									// Ignore if absent, auto re-arm, settable hysteresis and thresholds, granular events
+		(i == 12) ? s.type :
+		(i == 13) ? 0x01 :									// Threshold event/reading type
+		(i == 14) ? eventMask(s) & 0xFF :
+		(i == 15) ? (eventMask(s) >> 8) | 0x70 :			// LNR, LCR, LNC comparisons returned
+		(i == 16) ? eventMask(s) & 0xFF :
+		(i == 17) ? (eventMask(s) >> 8) | 0x70 :			// UNR, UCR, UNC comparisons returned
+		(i == 18) ? 0x3f :									// Settable thresholds
+		(i == 19) ? 0x3f :									// Readable thresholds
+		(i == 20) ? s.rate << 3 :							// Unsigned, no modifier unit
+		(i == 21) ? s.unit :
+		(i == 24) ? conversion(s).m & 0xFF :
+		(i == 25) ? ((conversion(s).m >> 8) & 3) << 6 :
+		(i == 26) ? conversion(s).b & 0xFF :
+		(i == 27) ? ((conversion(s).b >> 8) & 3) << 6 :
+		(i == 29) ? ((conversion(s).r_exp & 0xF) << 4) | (conversion(s).b_exp & 0xF) :
+		(i == 30) ? (isSet(s.nominal) ? 0x01 : 0x00) :
+		(i == 31) ? (isSet(s.nominal) ? raw(s, s.nominal) : 0) :
+		(i == 34) ? 0xFF :									// Sensor maximum reading
+		(i == 36) ? threshold(s, s.unr, true) :
+		(i == 37) ? threshold(s, s.ucr, true) :
+		(i == 38) ? threshold(s, s.unc, true) :
+		(i == 39) ? threshold(s, s.lnr, false) :
+		(i == 40) ? threshold(s, s.lcr, false) :
+		(i == 41) ? threshold(s, s.lnc, false) :
+		(i == 42) ? raw(s, s.hysteresis, false) :
+		(i == 43) ? raw(s, s.hysteresis, false) :
+		(i == 47) ? 0xC0 | nameLength(s.name) :				// 8-bit ASCII ID string
+		(i >= 48 && i < 48 + nameLength(s.name)) ? s.name[i - 48] :
+		0;
+}
+
+//! A record image, the record is the first length() bytes.
+struct Image {
+	uint8_t bytes[IMAGE_SIZE];
+};
+
+constexpr size_t length(const Image &image) {
+	return 5 + image.bytes[4];
+}
+
+template <size_t... I> struct Indices {};
+template <size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template <size_t... B>
+constexpr Image buildImage(const Full &s, Indices<B...>) {
+	return Image{{recordByte(s, B)...}};
+}
+
+//! All record images, in sensors[] order.
+struct Images {
+	Image images[SENSOR_COUNT];
+};
+
+template <size_t... I>
+constexpr Images buildImages(Indices<I...>) {
+	return Images{{buildImage(sensors[I], MakeIndices<IMAGE_SIZE>::type())...}};
+}
+
+constexpr Images images = buildImages(MakeIndices<SENSOR_COUNT>::type());
+
+/* Validation */
+
+//! ID strings fit the record.
+constexpr bool namesValid(size_t i = 0) {
+	return (i >= SENSOR_COUNT) || (nameLength(sensors[i].name) > 0 && nameLength(sensors[i].name) <= 16 && namesValid(i + 1));
+}
+
+//! No sensor number is used twice, or by the Hotswap sensor.
+constexpr bool numberUnique(size_t i, size_t j) {
+	return (j >= SENSOR_COUNT) || (sensors[i].number != sensors[j].number && numberUnique(i, j + 1));
+}
+constexpr bool numbersUnique(size_t i = 0) {
+	return (i >= SENSOR_COUNT) || (sensors[i].number != HOTSWAP_NUMBER && numberUnique(i, i + 1) && numbersUnique(i + 1));
+}
+
+//! The granularity and minimum are exact at the given precision.
+constexpr bool exact(double value, int precision) {
+	return (value * pow10f(precision) - scaled(value, precision)) < 1e-6 &&
+			(value * pow10f(precision) - scaled(value, precision)) > -1e-6;
+}
+constexpr bool precisionsValid(size_t i = 0) {
+	return (i >= SENSOR_COUNT) ||
+			(sensors[i].precision <= 8 && sensors[i].granularity > 0 &&
+			exact(sensors[i].granularity, sensors[i].precision) && exact(sensors[i].min, sensors[i].precision) && precisionsValid(i + 1));
+}
+
+//! M and B fit 10 bit two's complement, the exponents 4 bit two's complement.
+constexpr bool conversionFits(const Conversion &c, int precision) {
+	return c.m >= 1 && c.m <= 511 && c.b >= -512 && c.b <= 511 &&
+			c.r_exp >= -8 && c.r_exp <= 7 && c.b_exp >= -8 && c.b_exp <= 7 && c.b_exp + precision + c.r_exp >= 0;
+}
+constexpr bool conversionsValid(size_t i = 0) {
+	return (i >= SENSOR_COUNT) || (conversionFits(conversion(sensors[i]), sensors[i].precision) && conversionsValid(i + 1));
+}
+
+//! A set value lies within the raw range.
+constexpr bool inRange(const Full &s, double value) {
+	return !isSet(value) || (raw(s, value) >= 0 && raw(s, value) <= 255);
+}
+constexpr bool rangesValid(size_t i = 0) {
+	return (i >= SENSOR_COUNT) ||
+			(inRange(sensors[i], sensors[i].nominal) &&
+			inRange(sensors[i], sensors[i].lnr) && inRange(sensors[i], sensors[i].lcr) && inRange(sensors[i], sensors[i].lnc) &&
+			inRange(sensors[i], sensors[i].unc) && inRange(sensors[i], sensors[i].ucr) && inRange(sensors[i], sensors[i].unr) &&
+			raw(sensors[i], sensors[i].hysteresis, false) >= 0 && raw(sensors[i], sensors[i].hysteresis, false) <= 255 &&
+			rangesValid(i + 1));
+}
+
+//! Set thresholds are ordered lnr <= lcr <= lnc < unc <= ucr <= unr.
+constexpr bool ordered(double low, double high) {
+	return !isSet(low) || !isSet(high) || low <= high;
+}
+constexpr bool thresholdsOrdered(size_t i = 0) {
+	return (i >= SENSOR_COUNT) ||
+			(ordered(sensors[i].lnr, sensors[i].lcr) && ordered(sensors[i].lcr, sensors[i].lnc) && ordered(sensors[i].lnc, sensors[i].unc) &&
+			ordered(sensors[i].lnr, sensors[i].lnc) && ordered(sensors[i].unc, sensors[i].ucr) && ordered(sensors[i].ucr, sensors[i].unr) &&
+			ordered(sensors[i].unc, sensors[i].unr) && thresholdsOrdered(i + 1));
+}
+
+static_assert(namesValid(), "A sensor ID string is empty or longer than 16 characters");
+static_assert(numbersUnique(), "A sensor number is assigned twice");
+static_assert(precisionsValid(), "A granularity or minimum has more decimals than its precision");
+static_assert(conversionsValid(), "A conversion does not fit the record, adjust its granularity, minimum or precision");
+static_assert(rangesValid(), "A threshold, nominal reading or hysteresis falls outside the raw range");
+static_assert(thresholdsOrdered(), "Thresholds are out of order");
+
+} // namespace BoardSDRs
+
+#endif /* SRC_BOARD_SDRS_H_ */
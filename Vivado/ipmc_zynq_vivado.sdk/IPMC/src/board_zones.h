@@ -0,0 +1,182 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_BOARD_ZONES_H_
+#define SRC_BOARD_ZONES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xparameters.h"
+#include "mgmt_zone_ctrl.h"
+
+/**
+ * Declarative description of the board's management zones.
+ *
+ * Zones, their power enables, delays, active levels and the sensor processor
+ * channels they depend on are plain data.  The hard fault masks and the
+ * MZ_config register images are resolved and validated at compile time, so
+ * porting a board means editing the tables below.
+ *
+ * @warning This is application specific and should be adjusted!
+ */
+namespace BoardZones {
+
+/**
+ * Sensor processor channels, which are also the zone controller hard fault
+ * inputs.  These are passed to PayloadManager::addADCSensor() in ipmc.cpp.
+ */
+enum HardFault : uint8_t {
+	HF_12VPYLD	= 0,
+	HF_5VPYLD	= 4,
+	HF_3V3PYLD	= 6,
+	HF_3V3MP	= 7,
+	HF_T_BOT	= 8,
+	HF_1V0ETH	= 10,
+	HF_2V5ETH	= 12,
+	HF_1V2PHY	= 13,
+	HF_T_TOP	= 15,
+};
+
+//! The mask bit of a hard fault input, refuses to compile for inputs the firmware doesn't have.
+constexpr uint64_t hf(uint8_t ch) {
+	return (ch < XPAR_MGMT_ZONE_CTRL_0_HF_CNT) ? (UINT64_C(1) << ch) : throw "hard fault input out of range";
+}
+
+//! The mask bit of a zone, for Zone::parents.
+constexpr uint32_t zone(uint8_t mz) {
+	return UINT32_C(1) << mz;
+}
+
+//! A management zone.
+struct Zone {
+	const char *name;		///< Zone name.
+	uint64_t hardfaults;	///< Hard faults of the zone itself, besides those of its enables.
+	uint32_t parents;		///< Zones that must be on, their hard faults apply too.  Lower numbered only.
+	uint16_t holdoff_ms;	///< Hard faults are ignored this long after power up starts.
+};
+
+//! A power enable output.
+struct Enable {
+	uint8_t zone;			///< Owning zone.
+	uint8_t pin;			///< PWRENA_x output.
+	uint16_t delay_ms;		///< Sequencing delay.
+	bool active_high;		///< Output polarity.
+	bool drive_enabled;		///< Drive the output, tri-stated otherwise.
+	uint64_t hardfaults;	///< Hard faults of the rail behind it.
+	const char *rail;		///< Rail name.
+};
+
+constexpr Zone zones[] = {
+	{"+12V Power",			hf(HF_T_TOP) | hf(HF_T_BOT),	0,							0},
+	{"Ethernet Switch",		0,								zone(0),					0},
+	{"SSD/Firefly/USB",		0,								zone(0),					0},
+	{"10G PHY",				0,								zone(0),					0},
+	{"ELM Power Enable",	0,								zone(0) | zone(2),			0}, // Zone 0 and 2 need to be on for ELM to turn on
+};
+
+constexpr Enable enables[] = {
+	{0, 0,  0, true, true, hf(HF_12VPYLD),	"+12VPYLD"},	// PWREN_12VPYLD
+	{1, 1, 10, true, true, hf(HF_2V5ETH),	"+2.5VETH"},	// PWREN_2V5ETH
+	{1, 2, 10, true, true, hf(HF_1V0ETH),	"+1.0VETH"},	// PWREN_1V0ETH
+	{2, 3, 20, true, true, hf(HF_3V3PYLD),	"+3.3VPYLD"},	// PWREN_3V3PYLD
+	{2, 4, 20, true, true, hf(HF_5VPYLD),	"+5VPYLD"},		// PWREN_5V0PYLD
+	{3, 5, 30, true, true, hf(HF_1V2PHY),	"+1.2VPHY"},	// PWREN_1V2PHY
+	{4, 6, 40, true, true, hf(HF_12VPYLD),	"ELM"},			// ELM_PWR_EN
+};
+
+constexpr size_t ZONE_COUNT = sizeof(zones) / sizeof(zones[0]);
+constexpr size_t ENABLE_COUNT = sizeof(enables) / sizeof(enables[0]);
+
+/* Resolution, C++11 constexpr functions are single expressions so these recurse. */
+
+//! Hard faults of all enables owned by a zone.
+constexpr uint64_t enableFaults(size_t mz, size_t i = 0) {
+	return (i >= ENABLE_COUNT) ? 0 :
+			((enables[i].zone == mz ? enables[i].hardfaults : 0) | enableFaults(mz, i + 1));
+}
+
+constexpr uint64_t zoneFaults(size_t mz);
+
+//! Hard faults of the parent zones, recursively.
+constexpr uint64_t parentFaults(uint32_t parents, size_t mz = 0) {
+	return (mz >= ZONE_COUNT) ? 0 :
+			((((parents >> mz) & 1) ? zoneFaults(mz) : 0) | parentFaults(parents, mz + 1));
+}
+
+//! The complete hard fault mask of a zone.
+constexpr uint64_t zoneFaults(size_t mz) {
+	return zones[mz].hardfaults | enableFaults(mz) | parentFaults(zones[mz].parents);
+}
+
+//! The PWREN_cfg_t of a pin within a zone, 0 if the zone doesn't own it.
+constexpr PWREN_cfg_t pwrenCfg(size_t mz, size_t pin, size_t i = 0) {
+	return (i >= ENABLE_COUNT) ? 0 :
+			(enables[i].zone == mz && enables[i].pin == pin) ?
+				((enables[i].drive_enabled ? (1 << 17) : 0) | (enables[i].active_high ? (1 << 16) : 0) | enables[i].delay_ms) :
+				pwrenCfg(mz, pin, i + 1);
+}
+
+template <size_t... I> struct Indices {};
+template <size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template <size_t... Pin>
+constexpr MZ_config buildImage(size_t mz, Indices<Pin...>) {
+	return MZ_config{zoneFaults(mz), zones[mz].holdoff_ms, {pwrenCfg(mz, Pin)...}};
+}
+
+//! The MZ_config register image of a zone.
+constexpr MZ_config image(size_t mz) {
+	return buildImage(mz, MakeIndices<32>::type());
+}
+
+/* Validation */
+
+//! Every enable is owned by an existing zone and drives a pin the firmware has.
+constexpr bool enablesValid(size_t i = 0) {
+	return (i >= ENABLE_COUNT) ||
+			(enables[i].zone < ZONE_COUNT && enables[i].pin < XPAR_MGMT_ZONE_CTRL_0_PWREN_CNT && enablesValid(i + 1));
+}
+
+//! Every enable encodes to a non-zero PWREN_cfg_t, zero means not owned.
+constexpr bool enablesEncodable(size_t i = 0) {
+	return (i >= ENABLE_COUNT) ||
+			((enables[i].drive_enabled || enables[i].active_high || enables[i].delay_ms) && enablesEncodable(i + 1));
+}
+
+//! No pin is claimed twice.
+constexpr bool pinUnique(size_t i, size_t j) {
+	return (j >= ENABLE_COUNT) || (enables[i].pin != enables[j].pin && pinUnique(i, j + 1));
+}
+constexpr bool pinsUnique(size_t i = 0) {
+	return (i >= ENABLE_COUNT) || (pinUnique(i, i + 1) && pinsUnique(i + 1));
+}
+
+//! Parents are lower numbered zones, which also keeps zoneFaults() from looping.
+constexpr bool parentsValid(size_t mz = 0) {
+	return (mz >= ZONE_COUNT) || ((zones[mz].parents >> mz) == 0 && parentsValid(mz + 1));
+}
+
+static_assert(ZONE_COUNT <= XPAR_MGMT_ZONE_CTRL_0_MZ_CNT, "More zones than the zone controller supports");
+static_assert(enablesValid(), "An enable refers to a missing zone or power enable output");
+static_assert(enablesEncodable(), "A tri-stated active low enable needs a non-zero delay");
+static_assert(pinsUnique(), "A power enable output is assigned twice");
+static_assert(parentsValid(), "Zones may only depend on lower numbered zones");
+
+} // namespace BoardZones
+
+#endif /* SRC_BOARD_ZONES_H_ */
@@ -0,0 +1,255 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "adaptive_sampler.h"
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+
+#define UPPER_ASSERT_EVENTS	0x0FC0	///< UNC, UCR and UNR assertion event enables.
+#define LOWER_ASSERT_EVENTS	0x003F	///< LNC, LCR and LNR assertion event enables.
+
+const AdaptiveSampler::Config AdaptiveSampler::default_config = {1000, MAX_RATE_HZ, 10, 2000};
+
+static const char *reason_names[] = {"steady", "proximity", "transition", "boost", "hold"};
+
+AdaptiveSampler::AdaptiveSampler(const std::vector<uint16_t> &adc_device_ids, uint16_t proc_device_id, uint16_t zone_device_id,
+		LogTree &log, const Config &config) :
+	log(log), rate(0), reason(REASON_STEADY), hold_until(0), near_channels(0), rate_changes(0),
+	last_eval(0), last_conv(0), bucket_rate_us(0), bucket_us(0), total_us(0), total_conv(0) {
+	if (adc_device_ids.empty())
+		throw std::domain_error("AdaptiveSampler needs at least one ADC");
+
+	this->adcs.resize(adc_device_ids.size());
+	for (size_t i = 0; i < adc_device_ids.size(); ++i)
+		if (XST_SUCCESS != AD7689_S_Initialize(&this->adcs[i], adc_device_ids[i]))
+			throw std::runtime_error(stdsprintf("Unable to initialize AD7689_S(%hu)", adc_device_ids[i]));
+	if (XST_SUCCESS != IPMI_Sensor_Proc_Initialize(&this->proc, proc_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize IPMI_Sensor_Proc(%hu)", proc_device_id));
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->zones, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	this->setConfig(config);
+	this->rate = AD7689_S_Measure_Conv_Freq(&this->adcs[0]);
+	this->log.log(stdsprintf("Sequencers were converting at %hu Hz.", this->rate), LogTree::LOG_DIAGNOSTIC);
+
+	MutexGuard<false> lock(this->mutex, true);
+	this->program(this->config.low_hz, REASON_STEADY);
+}
+
+AdaptiveSampler::~AdaptiveSampler() {
+	vSemaphoreDelete(this->mutex);
+}
+
+void AdaptiveSampler::setConfig(const Config &config) {
+	if (!config.low_hz || config.low_hz > config.high_hz || config.high_hz > MAX_RATE_HZ)
+		throw std::domain_error(stdsprintf("Rates must satisfy 0 < %hu <= %hu <= %hu Hz", config.low_hz, config.high_hz, MAX_RATE_HZ));
+	if (config.margin_percent > 50)
+		throw std::domain_error("The proximity margin can't exceed half the threshold span");
+
+	MutexGuard<false> lock(this->mutex, true);
+	this->config = config;
+}
+
+AdaptiveSampler::Config AdaptiveSampler::getConfig() {
+	MutexGuard<false> lock(this->mutex, true);
+	return this->config;
+}
+
+std::vector<uint16_t> AdaptiveSampler::getHistory() {
+	MutexGuard<false> lock(this->mutex, true);
+	return std::vector<uint16_t>(this->history.begin(), this->history.end());
+}
+
+void AdaptiveSampler::boost() {
+	MutexGuard<false> lock(this->mutex, true);
+	this->hold_until = HiResTimer::now() + HiResTimer::usToCounts(this->config.hold_ms * 1000ULL);
+	this->program(this->config.high_hz, REASON_BOOST);
+}
+
+void AdaptiveSampler::evaluate() {
+	const uint64_t now = HiResTimer::now();
+	MutexGuard<false> lock(this->mutex, true);
+
+	// Account the time since the last evaluation at the rate that was programmed.
+	const u32 conv = AD7689_S_Get_Conv_Cnt(&this->adcs[0]);
+	if (this->last_eval) {
+		const uint64_t us = HiResTimer::countsToUs(now - this->last_eval);
+		this->bucket_rate_us += this->rate * us;
+		this->bucket_us += us;
+		this->total_us += us;
+		this->total_conv += conv - this->last_conv;
+
+		if (this->bucket_us >= 1000000) {
+			this->history.push_back(this->bucket_rate_us / this->bucket_us);
+			if (this->history.size() > HISTORY)
+				this->history.pop_front();
+			this->bucket_rate_us = 0;
+			this->bucket_us = 0;
+		}
+	}
+	this->last_eval = now;
+	this->last_conv = conv;
+
+	uint32_t near = 0;
+	for (u32 ch = 0; ch < this->proc.sensor_ch_cnt && ch < 32; ++ch) {
+		u16 assert_en, deassert_en;
+		IPMI_Sensor_Proc_Get_Event_Enable(&this->proc, ch, &assert_en, &deassert_en);
+		const bool upper = assert_en & UPPER_ASSERT_EVENTS;
+		const bool lower = assert_en & LOWER_ASSERT_EVENTS;
+		if (!upper && !lower)
+			continue; // Out of context, e.g. the rail is off.
+
+		Thr_Cfg thr;
+		IPMI_Sensor_Proc_Get_Thr(&this->proc, ch, &thr);
+		if (thr.UNC <= thr.LNC)
+			continue;
+
+		u16 reading;
+		u8 thr_status;
+		IPMI_Sensor_Proc_Get_Sensor_Reading(&this->proc, ch, &reading, &thr_status);
+		const u32 margin = (u32)(thr.UNC - thr.LNC) * this->config.margin_percent / 100;
+		if ((upper && (u32)reading + margin >= thr.UNC) || (lower && reading <= (u32)thr.LNC + margin))
+			near |= 1UL << ch;
+	}
+	this->near_channels = near;
+
+	bool transition = false;
+	for (u32 mz = 0; mz < this->zones.mz_cnt && !transition; ++mz) {
+		MZ_pwr state = Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, mz);
+		transition = state == MZ_PWR_TRANS_ON || state == MZ_PWR_TRANS_OFF;
+	}
+
+	Reason reason = near ? REASON_PROXIMITY : (transition ? REASON_TRANSITION : REASON_STEADY);
+	if (reason != REASON_STEADY)
+		this->hold_until = now + HiResTimer::usToCounts(this->config.hold_ms * 1000ULL);
+	else if (now < this->hold_until)
+		reason = (this->reason == REASON_BOOST) ? REASON_BOOST : REASON_HOLD;
+
+	this->program((reason == REASON_STEADY) ? this->config.low_hz : this->config.high_hz, reason);
+}
+
+/**
+ * Program the sequencers, skipping unchanged rates.
+ * @note Must be called with the mutex held.
+ */
+void AdaptiveSampler::program(uint16_t rate, Reason reason) {
+	if (rate != this->rate) {
+		for (AD7689_S &adc : this->adcs)
+			AD7689_S_Set_Conv_Freq(&adc, rate);
+		this->log.log(stdsprintf("Conversion rate %hu Hz -> %hu Hz (%s).", this->rate, rate, reason_names[reason]), LogTree::LOG_DIAGNOSTIC);
+		this->rate = rate;
+		this->rate_changes++;
+	}
+	this->reason = reason;
+}
+
+/// A console command to show the effective rate and the conversions saved.
+class AdaptiveSampler::Status : public CommandParser::Command {
+public:
+	Status(AdaptiveSampler &sampler) : sampler(sampler) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the AD7689 conversion rate, why it was chosen, the effective rate over\n"
+				"the last minute and the conversions saved versus always converting at the\n"
+				"maximum rate.  Every conversion saved is an SPI frame and a sensor processor\n"
+				"update the fabric doesn't have to run.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		AdaptiveSampler &s = this->sampler;
+
+		MutexGuard<false> lock(s.mutex, true);
+		std::string out = stdsprintf("Rate: %hu Hz (%s", s.rate, reason_names[s.reason]);
+		if (s.near_channels)
+			out += stdsprintf(", channels 0x%08lx", s.near_channels);
+		out += stdsprintf("), %lu changes\n", s.rate_changes);
+		out += stdsprintf("Policy: %hu Hz to %hu Hz, %hhu%% margin, %lu ms hold\n",
+				s.config.low_hz, s.config.high_hz, s.config.margin_percent, s.config.hold_ms);
+
+		out += "Measured:";
+		for (size_t i = 0; i < s.adcs.size(); ++i)
+			out += stdsprintf(" adc_%u %hu Hz", i, AD7689_S_Measure_Conv_Freq(&s.adcs[i]));
+		out += "\n";
+
+		const uint64_t at_max = s.total_us * MAX_RATE_HZ / 1000000;
+		if (at_max) {
+			const uint64_t avg = s.total_conv * 1000000 / s.total_us;
+			out += stdsprintf("Since start: %llu conversions per channel, average %llu Hz, %llu%% fewer than at %hu Hz\n",
+					s.total_conv, avg, (s.total_conv < at_max) ? 100 - s.total_conv * 100 / at_max : 0, MAX_RATE_HZ);
+		}
+
+		if (!s.history.empty()) {
+			out += "Last minute (Hz per second, oldest first):\n";
+			for (size_t i = 0; i < s.history.size(); ++i)
+				out += stdsprintf("%6hu%s", s.history[i], (i % 10 == 9) ? "\n" : "");
+			if (s.history.size() % 10)
+				out += "\n";
+		}
+		lock.release();
+
+		console->write(out);
+	}
+
+private:
+	AdaptiveSampler &sampler;
+};
+
+/// A console command to change the rate policy.
+class AdaptiveSampler::SetConfig : public CommandParser::Command {
+public:
+	SetConfig(AdaptiveSampler &sampler) : sampler(sampler) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $low_hz $high_hz [$margin_percent [$hold_ms]]\n\n"
+				"Change the steady state and high conversion rates, the threshold proximity\n"
+				"margin and how long the high rate is held.  Setting both rates equal fixes the rate.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		AdaptiveSampler::Config config = this->sampler.getConfig();
+
+		if (!parameters.parseParameters(1, false, &config.low_hz, &config.high_hz)
+				|| (parameters.nargs() > 3 && !parameters.parseParameters(3, false, &config.margin_percent))
+				|| (parameters.nargs() > 4 && !parameters.parseParameters(4, true, &config.hold_ms))) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		try {
+			this->sampler.setConfig(config);
+		} catch (std::exception &e) {
+			console->write(std::string(e.what()) + "\n");
+		}
+	}
+
+private:
+	AdaptiveSampler &sampler;
+};
+
+void AdaptiveSampler::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<AdaptiveSampler::Status>(*this));
+	parser.registerCommand(prefix + "config", std::make_shared<AdaptiveSampler::SetConfig>(*this));
+}
+
+void AdaptiveSampler::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "config", nullptr);
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_ADAPTIVE_SAMPLER_ADAPTIVE_SAMPLER_H_
+#define SRC_COMPONENTS_ADAPTIVE_SAMPLER_ADAPTIVE_SAMPLER_H_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include "ad7689_s.h"
+#include "ipmi_sensor_proc.h"
+#include "mgmt_zone_ctrl.h"
+
+/**
+ * Adapts the AD7689_S conversion rate to how close the rails are to trouble.
+ *
+ * The sequencers normally convert at a low rate.  They are raised to the high
+ * rate while any in-context sensor processor channel is within a margin of
+ * its UNC or LNC threshold (or beyond it), while a zone is transitioning, or
+ * for a while after boost().  The high rate is held for hold_ms after the
+ * last reason went away.  The thresholds are those sdr_init.cpp configured
+ * into the sensor processor, read from the driver shadow, and a channel is in
+ * context when its upper or lower assertion events are enabled.
+ *
+ * evaluate() is meant to run as a COST_REGISTER SamplingScheduler source.  It
+ * also accounts the effective rate per second and the conversions actually
+ * run against running at the maximum all the time.
+ */
+class AdaptiveSampler final : public ConsoleCommandSupport {
+public:
+	static const uint16_t MAX_RATE_HZ = 30000;	///< Sequencer cap, see AD7689_S_Set_Conv_Freq().
+	static const size_t HISTORY = 60;			///< Seconds of effective rate history kept.
+
+	//! Rate policy.
+	struct Config {
+		uint16_t low_hz;		///< Steady state rate.
+		uint16_t high_hz;		///< Rate near thresholds and during transitions.
+		uint8_t margin_percent;	///< Proximity margin, as a percentage of the UNC to LNC span.
+		uint32_t hold_ms;		///< Time the high rate is held after the last reason.
+	};
+
+	//! Why the current rate was chosen.
+	enum Reason : uint8_t {
+		REASON_STEADY,		///< Nothing of interest, low rate.
+		REASON_PROXIMITY,	///< A channel is near a threshold.
+		REASON_TRANSITION,	///< A zone is transitioning.
+		REASON_BOOST,		///< boost() was called.
+		REASON_HOLD,		///< Holding the high rate.
+	};
+
+	static const Config default_config;	///< 1 kHz to 30 kHz, 10% margin, 2 s hold.
+
+	/**
+	 * @param adc_device_ids The AD7689_S device IDs to drive, at the same rate.
+	 * @param proc_device_id The IPMI_Sensor_Proc device ID.
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID.
+	 * @param log The log tree to report to.
+	 * @param config The initial rate policy.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	AdaptiveSampler(const std::vector<uint16_t> &adc_device_ids, uint16_t proc_device_id, uint16_t zone_device_id,
+			LogTree &log, const Config &config = default_config);
+	virtual ~AdaptiveSampler();
+
+	//! Re-evaluate the rate and update the accounting.
+	void evaluate();
+
+	//! Run at the high rate right away, for at least hold_ms.  Call before a power level change.
+	void boost();
+
+	/**
+	 * Replace the rate policy.
+	 * @throw std::domain_error on invalid rates.
+	 */
+	void setConfig(const Config &config);
+	Config getConfig();
+
+	//! The rate currently programmed.
+	inline uint16_t getRate() const { return this->rate; };
+
+	//! Average rate of each of the last HISTORY seconds, oldest first.
+	std::vector<uint16_t> getHistory();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	std::vector<AD7689_S> adcs;		///< Low level ADC drivers.
+	IPMI_Sensor_Proc proc;			///< Low level sensor processor driver, read only.
+	Mgmt_Zone_Ctrl zones;			///< Low level zone controller driver, read only.
+	LogTree &log;					///< Log target.
+	SemaphoreHandle_t mutex;		///< Protects everything below.
+
+	Config config;					///< Rate policy.
+	uint16_t rate;					///< Programmed rate.
+	Reason reason;					///< Reason for the programmed rate.
+	uint64_t hold_until;			///< Keep the high rate until this global timer count.
+	uint32_t near_channels;			///< Channels near a threshold at the last evaluation.
+	uint32_t rate_changes;			///< Rate changes since boot.
+
+	uint64_t last_eval;				///< Global timer count of the last evaluation.
+	uint32_t last_conv;				///< Conversion counter of the first ADC at the last evaluation.
+	uint64_t bucket_rate_us;		///< Sum of rate * microseconds in the current second.
+	uint64_t bucket_us;				///< Microseconds accounted in the current second.
+	std::deque<uint16_t> history;	///< Average rate per second.
+	uint64_t total_us;				///< Microseconds accounted since boot.
+	uint64_t total_conv;			///< Conversions run since boot.
+
+	void program(uint16_t rate, Reason reason);
+
+	class Status;		///< Console command to show the rate and savings.
+	class SetConfig;	///< Console command to change the policy.
+};
+
+#endif /* SRC_COMPONENTS_ADAPTIVE_SAMPLER_ADAPTIVE_SAMPLER_H_ */
@@ -0,0 +1,417 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "adc_capture.h"
+#include <string.h>
+#include <algorithm>
+#include <libs/printf.h>
+#include "xscugic.h"
+#include "xil_cache.h"
+
+extern XScuGic xInterruptController;
+
+//! Done interrupts of the DMA channels we support (the first four share a contiguous range).
+static const u32 dma_done_intr[] = {
+	XPAR_XDMAPS_0_DONE_INTR_0, XPAR_XDMAPS_0_DONE_INTR_1,
+	XPAR_XDMAPS_0_DONE_INTR_2, XPAR_XDMAPS_0_DONE_INTR_3,
+};
+
+//! Matching driver done ISRs.
+static void (* const dma_done_isr[])(XDmaPs*) = {
+	XDmaPs_DoneISR_0, XDmaPs_DoneISR_1,
+	XDmaPs_DoneISR_2, XDmaPs_DoneISR_3,
+};
+
+ADCCapture::ADCCapture(uint16_t adc_device_id, uint16_t dma_device_id, uint8_t dma_channel, HiResTimer &timer, size_t capacity) :
+	dma_channel(dma_channel), timer(timer), timer_handle(-1),
+	capacity(capacity), period_us(0), state(IDLE), pre(0), post(0),
+	head(0), landed(0), post_remaining(0), trigger_landed(0),
+	trigger_source(TRIGGER_NONE), trigger_timestamp(0),
+	threshold_enabled(false), threshold_channel(0), threshold_level(0),
+	threshold_rising(true), threshold_above(false),
+	overruns(0), dma_errors(0), kick_max(0) {
+	if (dma_channel >= sizeof(dma_done_intr) / sizeof(dma_done_intr[0]))
+		throw std::domain_error(stdsprintf("DMA channel %hhu is not supported for captures", dma_channel));
+
+	if (XST_SUCCESS != AD7689_S_Initialize(&this->adc, adc_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize AD7689_S(%hu)", adc_device_id));
+	this->source = AD7689_S_Get_Readings_Addr(&this->adc, 0);
+	if (!this->source)
+		throw std::runtime_error(stdsprintf("AD7689_S(%hu) has no slaves", adc_device_id));
+
+	XDmaPs_Config *config = XDmaPs_LookupConfig(dma_device_id);
+	if (!config || XST_SUCCESS != XDmaPs_CfgInitialize(&this->dma, config, config->BaseAddress))
+		throw std::runtime_error(stdsprintf("Unable to initialize XDmaPs(%hu)", dma_device_id));
+
+	XDmaPs_SetDoneHandler(&this->dma, dma_channel, ADCCapture::_DoneHandler, (void*)this);
+	XDmaPs_SetFaultHandler(&this->dma, ADCCapture::_FaultHandler, (void*)this);
+
+	u32 done_intr = dma_done_intr[dma_channel];
+	if (XST_SUCCESS != XScuGic_Connect(&xInterruptController, done_intr, (Xil_InterruptHandler)dma_done_isr[dma_channel], (void*)&this->dma) ||
+			XST_SUCCESS != XScuGic_Connect(&xInterruptController, XPAR_XDMAPS_0_FAULT_INTR, (Xil_InterruptHandler)XDmaPs_FaultISR, (void*)&this->dma))
+		throw std::runtime_error("Unable to connect the DMA interrupts");
+	XScuGic_Enable(&xInterruptController, done_intr);
+	XScuGic_Enable(&xInterruptController, XPAR_XDMAPS_0_FAULT_INTR);
+
+	/* The ring must not share a cache line with anything else: the CPU only
+	 * ever invalidates it, so the lines at either end must be ours.
+	 */
+	const size_t line = 32;
+	this->ring_alloc = new uint8_t[capacity * sizeof(Sample) + 2 * line];
+	this->ring = reinterpret_cast<Sample*>(((uintptr_t)this->ring_alloc + line - 1) & ~(uintptr_t)(line - 1));
+	memset(this->ring, 0, capacity * sizeof(Sample));
+	Xil_DCacheFlushRange((INTPTR)this->ring, capacity * sizeof(Sample));
+
+	// The same single block command is reused for every sample, only the destination moves.
+	memset(&this->cmd, 0, sizeof(this->cmd));
+	this->cmd.ChanCtrl.SrcBurstSize = 4;
+	this->cmd.ChanCtrl.SrcBurstLen = 1;
+	this->cmd.ChanCtrl.SrcInc = 1;
+	this->cmd.ChanCtrl.DstBurstSize = 4;
+	this->cmd.ChanCtrl.DstBurstLen = 1;
+	this->cmd.ChanCtrl.DstInc = 1;
+	this->cmd.BD.SrcAddr = (u32)this->source;
+	this->cmd.BD.Length = sizeof(Sample);
+}
+
+ADCCapture::~ADCCapture() {
+	this->stop();
+	XScuGic_Disable(&xInterruptController, dma_done_intr[this->dma_channel]);
+	XScuGic_Disconnect(&xInterruptController, dma_done_intr[this->dma_channel]);
+	XScuGic_Disable(&xInterruptController, XPAR_XDMAPS_0_FAULT_INTR);
+	XScuGic_Disconnect(&xInterruptController, XPAR_XDMAPS_0_FAULT_INTR);
+	delete[] this->ring_alloc;
+}
+
+bool ADCCapture::arm(size_t pre, size_t post, uint32_t period_us) {
+	this->stop();
+
+	if (post == 0 || pre + post > this->capacity)
+		return false;
+
+	if (period_us == 0) {
+		// Follow the sequencer, rounding the period up so that we never sample the same scan twice.
+		u16 freq = AD7689_S_Measure_Conv_Freq(&this->adc);
+		if (freq == 0)
+			return false;
+		period_us = (1000000 + freq - 1) / freq;
+	}
+
+	// Make sure no dirty lines can be evicted over DMA'd samples.
+	Xil_DCacheFlushRange((INTPTR)this->ring, this->capacity * sizeof(Sample));
+
+	CriticalGuard critical(true);
+	this->pre = pre;
+	this->post = post;
+	this->period_us = period_us;
+	this->head = 0;
+	this->landed = 0;
+	this->post_remaining = 0;
+	this->trigger_landed = 0;
+	this->trigger_source = TRIGGER_NONE;
+	this->trigger_timestamp = 0;
+	this->threshold_above = false; // The first sample after arming sets the baseline.
+	this->overruns = 0;
+	this->dma_errors = 0;
+	this->kick_max = 0;
+	this->state = ARMED;
+
+	this->timer_handle = this->timer.addPeriodic(period_us, ADCCapture::_TimerCallback, (void*)this);
+	if (this->timer_handle < 0) {
+		this->state = IDLE;
+		return false;
+	}
+	return true;
+}
+
+void ADCCapture::stop() {
+	CriticalGuard critical(true);
+	if (this->timer_handle >= 0)
+		this->timer.removePeriodic(this->timer_handle);
+	this->timer_handle = -1;
+	if (this->state != DONE)
+		this->state = IDLE;
+	critical.release();
+
+	// Let an in flight transfer land before the ring is reused.
+	while (XDmaPs_IsActive(&this->dma, this->dma_channel))
+		vTaskDelay(1);
+}
+
+void ADCCapture::trigger(TriggerSource source) {
+	CriticalGuard critical(true);
+	this->triggerFromISR(source);
+}
+
+void ADCCapture::triggerFromISR(TriggerSource source) {
+	if (this->state != ARMED)
+		return;
+
+	this->trigger_landed = this->landed;
+	this->trigger_source = source;
+	this->trigger_timestamp = HiResTimer::now();
+	this->post_remaining = this->post;
+	this->state = TRIGGERED;
+}
+
+void ADCCapture::setThreshold(uint8_t channel, uint16_t level, bool rising) {
+	if (channel >= AD7689_S_CH_CNT)
+		throw std::domain_error(stdsprintf("Channel %hhu is out of range", channel));
+
+	CriticalGuard critical(true);
+	this->threshold_channel = channel;
+	this->threshold_level = level;
+	this->threshold_rising = rising;
+	this->threshold_enabled = true;
+}
+
+void ADCCapture::clearThreshold() {
+	CriticalGuard critical(true);
+	this->threshold_enabled = false;
+}
+
+bool ADCCapture::_TimerCallback(void *p) {
+	ADCCapture &self = *reinterpret_cast<ADCCapture*>(p);
+
+	if (self.state != ARMED && self.state != TRIGGERED) {
+		self.timer_handle = -1;
+		return false;
+	}
+
+	uint64_t start = HiResTimer::now();
+	if (XDmaPs_IsActive(&self.dma, self.dma_channel)) {
+		// The previous sample hasn't landed yet, drop this one rather than queueing.
+		self.overruns++;
+		return true;
+	}
+
+	self.cmd.BD.DstAddr = (u32)(UINTPTR)&self.ring[self.head];
+	if (XST_SUCCESS != XDmaPs_Start(&self.dma, self.dma_channel, &self.cmd, 0))
+		self.dma_errors++;
+
+	uint32_t kick = HiResTimer::now() - start;
+	if (kick > self.kick_max)
+		self.kick_max = kick;
+	return true;
+}
+
+void ADCCapture::_DoneHandler(unsigned int channel, XDmaPs_Cmd *cmd, void *p) {
+	ADCCapture &self = *reinterpret_cast<ADCCapture*>(p);
+
+	size_t slot = self.head;
+	self.head = (slot + 1) % self.capacity;
+	self.landed++;
+
+	if (self.state == TRIGGERED) {
+		if (--self.post_remaining == 0)
+			self.state = DONE;
+	}
+	else if (self.state == ARMED && self.threshold_enabled) {
+		// This is the only time the CPU looks at samples while capturing.
+		Xil_DCacheInvalidateRange((INTPTR)&self.ring[slot], sizeof(Sample));
+		bool above = (uint16_t)self.ring[slot][self.threshold_channel] >= self.threshold_level;
+		if (self.landed > 1 && above != self.threshold_above && above == self.threshold_rising)
+			self.triggerFromISR(TRIGGER_THRESHOLD);
+		self.threshold_above = above;
+	}
+}
+
+void ADCCapture::_FaultHandler(unsigned int channel, XDmaPs_Cmd *cmd, void *p) {
+	ADCCapture &self = *reinterpret_cast<ADCCapture*>(p);
+	self.dma_errors++;
+}
+
+VFS::File ADCCapture::createFile() {
+	const size_t file_size = sizeof(FileHeader) + this->capacity * AD7689_S_CH_CNT * sizeof(uint16_t);
+
+	return VFS::File(
+		[this, file_size](uint8_t *buffer, size_t size) -> size_t {
+			if (size < file_size)
+				return 0;
+			memset(buffer, 0, file_size);
+
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "ADCC", 4);
+			header.version = 1;
+			header.channels = AD7689_S_CH_CNT;
+			header.period_us = this->period_us;
+			header.counts_per_second = COUNTS_PER_SECOND;
+
+			if (this->state == DONE) {
+				size_t pre = std::min(this->pre, this->trigger_landed);
+				size_t first = this->trigger_landed - pre;
+
+				header.samples = pre + this->post;
+				header.trigger_sample = pre;
+				header.trigger_source = this->trigger_source;
+				header.trigger_timestamp = this->trigger_timestamp;
+				header.overruns = this->overruns;
+
+				Xil_DCacheInvalidateRange((INTPTR)this->ring, this->capacity * sizeof(Sample));
+				uint16_t *out = reinterpret_cast<uint16_t*>(buffer + sizeof(FileHeader));
+				for (size_t i = 0; i < header.samples; ++i) {
+					const Sample &sample = this->ring[(first + i) % this->capacity];
+					for (size_t ch = 0; ch < AD7689_S_CH_CNT; ++ch)
+						*out++ = (uint16_t)sample[ch];
+				}
+			}
+
+			memcpy(buffer, &header, sizeof(header));
+			return file_size;
+		},
+		[](uint8_t *buffer, size_t size) -> size_t {
+			return 0; // Read only.
+		},
+		file_size);
+}
+
+/// A console command to arm a capture.
+class ADCCapture::Arm : public CommandParser::Command {
+public:
+	Arm(ADCCapture &capture) : capture(capture) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [$pre $post [$period_us]]\n\n"
+				"Arm a waveform capture keeping $pre samples before and $post samples after the trigger.\n"
+				"The sample period follows the measured conversion rate unless $period_us is given.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		uint32_t pre = this->capture.capacity / 4, post = this->capture.capacity - pre, period_us = 0;
+
+		if (parameters.nargs() == 3) {
+			if (!parameters.parseParameters(1, true, &pre, &post)) {
+				console->write("Invalid parameters, see help.\n");
+				return;
+			}
+		} else if (parameters.nargs() == 4) {
+			if (!parameters.parseParameters(1, true, &pre, &post, &period_us)) {
+				console->write("Invalid parameters, see help.\n");
+				return;
+			}
+		} else if (parameters.nargs() != 1) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		if (!this->capture.arm(pre, post, period_us)) {
+			console->write(stdsprintf("Unable to arm, the ring holds %u samples.\n", this->capture.capacity));
+			return;
+		}
+		console->write(stdsprintf("Armed: %lu pre, %lu post, %lu us/sample.\n", pre, post, this->capture.period_us));
+	}
+
+private:
+	ADCCapture &capture;
+};
+
+/// A console command to trigger a capture.
+class ADCCapture::Trigger : public CommandParser::Command {
+public:
+	Trigger(ADCCapture &capture) : capture(capture) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Trigger an armed capture.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		if (this->capture.getState() != ARMED) {
+			console->write("The capture is not armed.\n");
+			return;
+		}
+		this->capture.trigger(TRIGGER_MANUAL);
+	}
+
+private:
+	ADCCapture &capture;
+};
+
+/// A console command to configure the threshold trigger.
+class ADCCapture::Threshold : public CommandParser::Command {
+public:
+	Threshold(ADCCapture &capture) : capture(capture) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $channel $level rising|falling\n" +
+				command + " off\n\n"
+				"Trigger armed captures when a channel crosses a raw level.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		uint8_t channel;
+		uint16_t level;
+		std::string edge;
+
+		if (parameters.nargs() == 2 && parameters.parameters[1] == "off") {
+			this->capture.clearThreshold();
+			return;
+		}
+
+		if (!parameters.parseParameters(1, true, &channel, &level, &edge) || (edge != "rising" && edge != "falling") || channel >= AD7689_S_CH_CNT) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		this->capture.setThreshold(channel, level, edge == "rising");
+	}
+
+private:
+	ADCCapture &capture;
+};
+
+/// A console command to show the capture status.
+class ADCCapture::Status : public CommandParser::Command {
+public:
+	Status(ADCCapture &capture) : capture(capture) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the waveform capture status.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const char *states[] = {"idle", "armed", "triggered", "done"};
+		static const char *sources[] = {"none", "manual", "zone", "threshold"};
+		ADCCapture &c = this->capture;
+
+		std::string out = stdsprintf("State: %s, %u samples landed, %lu us/sample\n", states[c.state], c.landed, c.period_us);
+		out += stdsprintf("Trigger: %s at %llu\n", sources[c.trigger_source], c.trigger_timestamp);
+		if (c.threshold_enabled)
+			out += stdsprintf("Threshold: ch%hhu %s %hu\n", c.threshold_channel, c.threshold_rising ? "rising" : "falling", c.threshold_level);
+		out += stdsprintf("Overruns: %lu, DMA errors: %lu, longest kick: %llu us\n", c.overruns, c.dma_errors, HiResTimer::countsToUs(c.kick_max));
+		console->write(out);
+	}
+
+private:
+	ADCCapture &capture;
+};
+
+void ADCCapture::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "arm", std::make_shared<ADCCapture::Arm>(*this));
+	parser.registerCommand(prefix + "trigger", std::make_shared<ADCCapture::Trigger>(*this));
+	parser.registerCommand(prefix + "threshold", std::make_shared<ADCCapture::Threshold>(*this));
+	parser.registerCommand(prefix + "status", std::make_shared<ADCCapture::Status>(*this));
+}
+
+void ADCCapture::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "arm", nullptr);
+	parser.registerCommand(prefix + "trigger", nullptr);
+	parser.registerCommand(prefix + "threshold", nullptr);
+	parser.registerCommand(prefix + "status", nullptr);
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_ADC_CAPTURE_ADC_CAPTURE_H_
+#define SRC_COMPONENTS_ADC_CAPTURE_ADC_CAPTURE_H_
+
+#include <stdint.h>
+#include <string>
+#include <core.h>
+#include <services/console/command_parser.h>
+#include <services/ftp/ftp.h>
+#include <hires_timer/hires_timer.h>
+#include "xparameters.h"
+#include "xdmaps.h"
+#include "ad7689_s.h"
+
+/**
+ * Waveform capture of one AD7689_S sequencer into a DDR ring buffer.
+ *
+ * Each sample period the global timer kicks a PS DMA (PL330) transfer that
+ * copies the whole result register block of the device into the next ring
+ * slot, so the CPU never touches the sample data while capturing.  Like an
+ * oscilloscope the ring runs continuously once armed, a trigger (software,
+ * zone transition or threshold) marks a point in it and the capture stops
+ * once the post trigger window has been filled.
+ *
+ * The finished capture is exported as a binary file through the VFS, see
+ * createFile() for the format.
+ */
+class ADCCapture final : public ConsoleCommandSupport {
+public:
+	//! Things that can trigger a capture.
+	enum TriggerSource {
+		TRIGGER_NONE = 0,
+		TRIGGER_MANUAL = 1,
+		TRIGGER_ZONE = 2,
+		TRIGGER_THRESHOLD = 3,
+	};
+
+	//! Capture state.
+	enum State {
+		IDLE,		///< Not capturing.
+		ARMED,		///< Filling the ring, waiting for a trigger.
+		TRIGGERED,	///< Filling the post trigger window.
+		DONE,		///< Capture complete and ready for download.
+	};
+
+	//! Header of the exported capture file, all fields little endian.
+	struct __attribute__((packed)) FileHeader {
+		char magic[4];				///< "ADCC"
+		uint16_t version;			///< File format version, currently 1.
+		uint16_t channels;			///< Channels per sample.
+		uint32_t period_us;			///< Sample period in microseconds.
+		uint32_t samples;			///< Number of valid samples that follow.
+		uint32_t trigger_sample;	///< Index of the first sample after the trigger.
+		uint32_t trigger_source;	///< The TriggerSource that fired.
+		uint64_t trigger_timestamp;	///< Global timer count at the trigger.
+		uint32_t counts_per_second;	///< Global timer frequency.
+		uint32_t overruns;			///< Sample periods lost because the DMA was still busy.
+	};
+
+	/**
+	 * Create a capture engine.
+	 *
+	 * @param adc_device_id AD7689_S device to capture (slave 0).
+	 * @param dma_device_id XDmaPs device to use.
+	 * @param dma_channel DMA channel to use, its done interrupt must be wired.
+	 * @param timer The timer used to pace the capture.
+	 * @param capacity Ring size in samples.
+	 * @throw std::runtime_error on driver initialization failures.
+	 */
+	ADCCapture(uint16_t adc_device_id, uint16_t dma_device_id, uint8_t dma_channel, HiResTimer &timer, size_t capacity = 16384);
+	virtual ~ADCCapture();
+
+	/**
+	 * Start filling the ring and wait for a trigger.
+	 *
+	 * @param pre Samples to keep before the trigger.
+	 * @param post Samples to take after the trigger.
+	 * @param period_us Sample period, 0 to follow the measured conversion rate.
+	 * @return false if the windows don't fit in the ring or the timer is full.
+	 */
+	bool arm(size_t pre, size_t post, uint32_t period_us = 0);
+
+	//! Abort a capture in progress.
+	void stop();
+
+	/**
+	 * Trigger the capture if it is armed, otherwise do nothing.
+	 * @param source What caused the trigger.
+	 * @note This may be called from any task.
+	 */
+	void trigger(TriggerSource source);
+
+	/**
+	 * Trigger when a channel crosses a level.
+	 *
+	 * @param channel The channel to watch.
+	 * @param level The raw level.
+	 * @param rising true to trigger on a rising crossing, false for falling.
+	 */
+	void setThreshold(uint8_t channel, uint16_t level, bool rising);
+
+	//! Disable the threshold trigger.
+	void clearThreshold();
+
+	//! Current capture state.
+	inline State getState() const { return this->state; };
+
+	/**
+	 * Create a VFS file exporting the last completed capture.
+	 *
+	 * The file is a FileHeader followed by FileHeader::samples samples of
+	 * FileHeader::channels uint16_t raw readings, oldest first.  It is empty of
+	 * samples unless the capture is DONE.
+	 */
+	VFS::File createFile();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! One ring slot, the raw register block as copied by the DMA.
+	typedef uint32_t Sample[AD7689_S_CH_CNT];
+
+	AD7689_S adc;					///< The device being captured.
+	UINTPTR source;					///< Bus address of its result registers.
+	XDmaPs dma;						///< PS DMA driver instance.
+	uint8_t dma_channel;			///< DMA channel in use.
+	XDmaPs_Cmd cmd;					///< The DMA command, reused every sample.
+	HiResTimer &timer;				///< Pacing timer.
+	int timer_handle;				///< Our HiResTimer client handle, or -1.
+
+	uint8_t *ring_alloc;			///< Ring allocation (unaligned).
+	Sample *ring;					///< Cache line aligned ring.
+	size_t capacity;				///< Ring size in samples.
+	uint32_t period_us;				///< Current sample period.
+
+	volatile State state;			///< Capture state.
+	size_t pre;						///< Requested pre trigger window.
+	size_t post;					///< Requested post trigger window.
+	volatile size_t head;			///< Slot the next sample lands in.
+	volatile size_t landed;			///< Samples landed since arming.
+	volatile size_t post_remaining;	///< Samples left in the post trigger window.
+	size_t trigger_landed;			///< Value of landed at the trigger.
+	TriggerSource trigger_source;	///< What triggered the capture.
+	uint64_t trigger_timestamp;		///< When the capture was triggered.
+
+	bool threshold_enabled;			///< Threshold trigger enabled.
+	uint8_t threshold_channel;		///< Threshold trigger channel.
+	uint16_t threshold_level;		///< Threshold trigger raw level.
+	bool threshold_rising;			///< Threshold trigger direction.
+	bool threshold_above;			///< Last sample was above the level.
+
+	volatile uint32_t overruns;		///< Sample periods skipped, DMA still busy.
+	volatile uint32_t dma_errors;	///< DMA start failures and faults.
+	volatile uint32_t kick_max;		///< Longest timer ISR kick, in global timer counts.
+
+	void triggerFromISR(TriggerSource source);
+	static bool _TimerCallback(void *p);
+	static void _DoneHandler(unsigned int channel, XDmaPs_Cmd *cmd, void *p);
+	static void _FaultHandler(unsigned int channel, XDmaPs_Cmd *cmd, void *p);
+
+	class Arm;			///< Console command to arm a capture.
+	class Trigger;		///< Console command to trigger a capture.
+	class Threshold;	///< Console command to configure the threshold trigger.
+	class Status;		///< Console command to show the capture status.
+};
+
+#endif /* SRC_COMPONENTS_ADC_CAPTURE_ADC_CAPTURE_H_ */
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "adc_frame.h"
+#include <libs/printf.h>
+#include "xtime_l.h"
+
+ADCFrameReader::ADCFrameReader(const std::vector<uint16_t> &device_ids) :
+	device_count(0),
+	frames("adc_frame.frames"),
+	torn_retries("adc_frame.torn_retries"),
+	failures("adc_frame.failures") {
+	if (device_ids.size() > MAX_DEVICES)
+		throw std::domain_error(stdsprintf("ADCFrameReader supports at most %u devices.", MAX_DEVICES));
+
+	for (uint16_t device_id : device_ids) {
+		AD7689_S &dev = this->devices[this->device_count];
+		if (XST_SUCCESS != AD7689_S_Initialize(&dev, device_id))
+			throw std::runtime_error(stdsprintf("Unable to initialize AD7689_S(%hu)", device_id));
+		if (dev.SlaveCount != 1)
+			throw std::runtime_error(stdsprintf("AD7689_S(%hu) has %lu slaves, frames support exactly one", device_id, dev.SlaveCount));
+		this->device_count++;
+	}
+}
+
+ADCFrameReader::~ADCFrameReader() {
+}
+
+bool ADCFrameReader::readFrame(Frame &frame) {
+	bool coherent = true;
+
+	for (size_t i = 0; i < this->device_count; ++i) {
+		u32 retries = 0;
+		if (XST_SUCCESS != AD7689_S_Get_Readings(&this->devices[i], frame.raw[i], AD7689_S_CH_CNT, &frame.conv_cnt[i], &retries))
+			coherent = false;
+		if (retries)
+			this->torn_retries.increment(retries);
+	}
+
+	XTime now;
+	XTime_GetTime(&now);
+	frame.timestamp = now;
+	frame.devices = this->device_count;
+
+	this->frames.increment();
+	if (!coherent)
+		this->failures.increment();
+
+	return coherent;
+}
+
+/// A console command to print a coherent frame.
+class ADCFrameReader::Snapshot : public CommandParser::Command {
+public:
+	Snapshot(ADCFrameReader &reader) : reader(reader) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Read a coherent snapshot of every channel of every AD7689 and print the raw codes.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		ADCFrameReader::Frame frame;
+		bool coherent = this->reader.readFrame(frame);
+
+		std::string out = stdsprintf("Frame at %llu (%s):\n", frame.timestamp, coherent ? "coherent" : "TORN");
+		for (size_t dev = 0; dev < frame.devices; ++dev) {
+			out += stdsprintf("  adc_%u [cnt %lu]:", dev, frame.conv_cnt[dev]);
+			for (size_t ch = 0; ch < AD7689_S_CH_CNT; ++ch)
+				out += stdsprintf(" %5hu", frame.get(dev, ch));
+			out += "\n";
+		}
+		console->write(out);
+	}
+
+private:
+	ADCFrameReader &reader;
+};
+
+void ADCFrameReader::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "snapshot", std::make_shared<ADCFrameReader::Snapshot>(*this));
+}
+
+void ADCFrameReader::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "snapshot", nullptr);
+}
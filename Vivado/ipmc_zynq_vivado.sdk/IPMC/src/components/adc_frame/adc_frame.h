@@ -0,0 +1,94 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_ADC_FRAME_ADC_FRAME_H_
+#define SRC_COMPONENTS_ADC_FRAME_ADC_FRAME_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <services/console/command_parser.h>
+#include "xparameters.h"
+#include "ad7689_s.h"
+
+/**
+ * Coherent, lock-free bulk reader for all AD7689_S sequencers on the board.
+ *
+ * Each device is read in a single pass bracketed by its ch0 conversion
+ * counter so that torn scans are detected and retried by the low level
+ * driver.  The sampling scheduler feeds the sensor history from frames, the
+ * per-channel AD7689 driver is still used by ADC::Channel for single readings.
+ */
+class ADCFrameReader final : public ConsoleCommandSupport {
+public:
+	//! Maximum number of AD7689_S devices covered by a frame.
+	static const size_t MAX_DEVICES = XPAR_AD7689_S_NUM_INSTANCES;
+
+	/**
+	 * A snapshot of every channel of every device.
+	 *
+	 * Aligned to the Cortex-A9 cache line so that frames can be copied
+	 * around (and DMA'd into) without false sharing.
+	 */
+	struct alignas(32) Frame {
+		uint64_t timestamp;                            ///< Global timer count at frame completion (COUNTS_PER_SECOND).
+		uint32_t conv_cnt[MAX_DEVICES];                ///< Conversion counter each device scan belongs to.
+		uint16_t raw[MAX_DEVICES][AD7689_S_CH_CNT];    ///< Raw 16-bit readings, [device][channel].
+		uint8_t devices;                               ///< Number of valid devices in this frame.
+
+		//! Retrieve a raw reading from the frame.
+		inline uint16_t get(size_t device, size_t channel) const { return this->raw[device][channel]; };
+	};
+
+	/**
+	 * Instantiate a frame reader covering the listed AD7689_S devices.
+	 * @param device_ids The AD7689_S device IDs, in frame order.
+	 * @throw std::runtime_error if a device can't be initialized.
+	 */
+	ADCFrameReader(const std::vector<uint16_t> &device_ids);
+	virtual ~ADCFrameReader();
+
+	/**
+	 * Read a coherent frame from all devices.
+	 *
+	 * @note Safe to call from any task, no locks are taken.
+	 *
+	 * @param frame The frame to fill.
+	 * @return true if every device produced a coherent snapshot, else false.
+	 */
+	bool readFrame(Frame &frame);
+
+	//! Number of devices covered by each frame.
+	inline size_t getDeviceCount() const { return this->device_count; };
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	AD7689_S devices[MAX_DEVICES];	///< Low level driver instances.
+	size_t device_count;			///< Number of devices in use.
+
+	StatCounter frames;				///< Frames read.
+	StatCounter torn_retries;		///< Device scans that had to be retried.
+	StatCounter failures;			///< Frames that could not be made coherent.
+
+	class Snapshot;	///< Console command to print a frame.
+};
+
+#endif /* SRC_COMPONENTS_ADC_FRAME_ADC_FRAME_H_ */
@@ -0,0 +1,34 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "crc32.h"
+
+//! Reflected polynomial 0xEDB88320, one entry per nibble value.
+static const uint32_t crc32_nibble_table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc) {
+	crc = ~crc;
+	for (size_t i = 0; i < len; ++i) {
+		crc ^= data[i];
+		crc = crc32_nibble_table[crc & 0x0f] ^ (crc >> 4);
+		crc = crc32_nibble_table[crc & 0x0f] ^ (crc >> 4);
+	}
+	return ~crc;
+}
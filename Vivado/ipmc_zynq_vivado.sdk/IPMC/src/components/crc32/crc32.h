@@ -0,0 +1,39 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_CRC32_CRC32_H_
+#define SRC_COMPONENTS_CRC32_CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Compute the CRC-32 (IEEE 802.3, as used by zlib) of a span of bytes.
+ *
+ * A 16 entry table is used, processing a nibble per step, which keeps the
+ * table out of the way of the cache while still being several times faster
+ * than the bitwise form.
+ *
+ * @param data The bytes to checksum.
+ * @param len Number of bytes.
+ * @param crc The result of a previous call, to continue a checksum over
+ *            several spans, or 0 to start a new one.
+ * @return The CRC-32 of all bytes so far.
+ */
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+
+#endif /* SRC_COMPONENTS_CRC32_CRC32_H_ */
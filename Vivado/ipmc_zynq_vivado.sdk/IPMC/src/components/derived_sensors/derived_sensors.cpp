@@ -0,0 +1,380 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "derived_sensors.h"
+#include <math.h>
+#include <algorithm>
+#include <payload_manager.h>
+#include <libs/printf.h>
+#include <services/ipmi/sensor/sensor_set.h>
+#include <services/ipmi/sensor/threshold_sensor.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_lut/sensor_lut.h>
+#include <sensor_history/sensor_history.h>
+#include "ipmc.h"
+
+//! Clamp a wide intermediate into Fixed.
+static inline DerivedSensors::Fixed saturate(int64_t value) {
+	if (value > INT32_MAX)
+		return INT32_MAX;
+	if (value < INT32_MIN)
+		return INT32_MIN;
+	return value;
+}
+
+DerivedSensors::DerivedSensors(LogTree &log) :
+	log(log), last_pass(0), passes(0), recomputed(0), pushed(0), cost_max(0), cost_sum(0) {
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+}
+
+DerivedSensors::~DerivedSensors() {
+	vSemaphoreDelete(this->mutex);
+}
+
+DerivedSensors::Fixed DerivedSensors::toFixed(double value) {
+	const double scaled = round(value * (1 << FRACTION_BITS));
+	if (scaled >= INT32_MAX)
+		return INT32_MAX;
+	if (scaled <= INT32_MIN)
+		return INT32_MIN;
+	return scaled;
+}
+
+DerivedSensors::Node DerivedSensors::add(const NodeInfo &node) {
+	if (this->nodes.size() >= MAX_NODES)
+		throw std::domain_error("No room left for another derived sensor node");
+	this->nodes.push_back(node);
+	return this->nodes.size() - 1;
+}
+
+DerivedSensors::Node DerivedSensors::input(const std::string &sensor) {
+	auto it = PayloadManager::adc_sensors.find(sensor);
+	if (it == PayloadManager::adc_sensors.end())
+		throw std::domain_error(stdsprintf("Unknown ADC sensor %s", sensor.c_str()));
+
+	if (!sensor_history)
+		throw std::domain_error("Derived sensor inputs are read from the sensor history");
+	const std::vector<std::string> history_names = sensor_history->getSensorNames();
+	const size_t history = std::find(history_names.begin(), history_names.end(), sensor) - history_names.begin();
+	if (history == history_names.size())
+		throw std::domain_error(stdsprintf("ADC sensor %s has no history", sensor.c_str()));
+
+	MutexGuard<false> lock(this->mutex, true);
+	for (size_t i = 0; i < this->nodes.size(); ++i)
+		if (this->nodes[i].op == OP_INPUT && this->nodes[i].name == sensor)
+			return i;
+
+	// The channel scaling may be any function, sample it once into a table.
+	const ADC::Channel &adc = it->second.adc;
+	NodeInfo node = {OP_INPUT, 0, 0, 0, sensor, history, -1, std::vector<Fixed>(CURVE_POINTS), 0};
+	for (size_t i = 0; i < CURVE_POINTS; ++i)
+		node.curve[i] = DerivedSensors::toFixed(adc.rawToFloat(std::min<uint32_t>(i << CURVE_SHIFT, 0xFFFF)));
+	return this->add(node);
+}
+
+DerivedSensors::Node DerivedSensors::constant(double value) {
+	MutexGuard<false> lock(this->mutex, true);
+	NodeInfo node = {OP_CONST, 0, 0, DerivedSensors::toFixed(value), "", 0, -1, {}, 0};
+	return this->add(node);
+}
+
+DerivedSensors::Node DerivedSensors::op(Op op, Node a, Node b) {
+	MutexGuard<false> lock(this->mutex, true);
+	if (op == OP_INPUT || op == OP_CONST || op > OP_DERIVATIVE)
+		throw std::domain_error("Use input() and constant() for leaf nodes");
+	if (a >= this->nodes.size() || (op != OP_DERIVATIVE && b >= this->nodes.size()))
+		throw std::domain_error("Derived sensor operands must be added first");
+
+	NodeInfo node = {op, a, (op == OP_DERIVATIVE) ? a : b, 0, "", 0, -1, {}, 0};
+	return this->add(node);
+}
+
+void DerivedSensors::output(const std::string &name, Node node) {
+	MutexGuard<false> lock(this->mutex, true);
+	if (node >= this->nodes.size())
+		throw std::domain_error(stdsprintf("Invalid node %hhu for derived sensor %s", node, name.c_str()));
+	this->outputs.push_back({name, node, nullptr, false});
+}
+
+void DerivedSensors::linkSensors(const std::vector<uint8_t> &sdrs) {
+	std::vector<SensorLUT::SDR01Info> infos = SensorLUT::parseSDR01s(sdrs);
+
+	MutexGuard<false> lock(this->mutex, true);
+	for (Output &output : this->outputs) {
+		output.sensor = nullptr;
+		for (const SensorLUT::SDR01Info &info : infos) {
+			if (info.name != output.name)
+				continue;
+			output.sensor = std::dynamic_pointer_cast<ThresholdSensor>(ipmc_sensors.get(info.sensor_number));
+			break;
+		}
+		if (!output.sensor)
+			this->log.log(stdsprintf("No threshold sensor for derived sensor %s.", output.name.c_str()), LogTree::LOG_WARNING);
+		output.stale = true;
+	}
+}
+
+/**
+ * Compute one node from the current values of its operands.
+ *
+ * @param nodes All nodes, the operands must be up to date.
+ * @param node The node to compute.
+ * @param dt Time since the previous pass in global timer counts, 0 on the first.
+ * @return The new value.
+ */
+DerivedSensors::Fixed DerivedSensors::compute(const std::vector<NodeInfo> &nodes, NodeInfo &node, uint64_t dt) {
+	const Fixed a = nodes[node.a].value;
+	const Fixed b = nodes[node.b].value;
+
+	switch (node.op) {
+	case OP_INPUT: {
+		const uint32_t segment = node.code >> CURVE_SHIFT;
+		const int64_t fraction = node.code & ((1 << CURVE_SHIFT) - 1);
+		const Fixed low = node.curve[segment];
+		const Fixed high = node.curve[segment + 1];
+		return saturate(low + ((((int64_t)high - low) * fraction) >> CURVE_SHIFT));
+	}
+	case OP_CONST:
+		return node.value;
+	case OP_ADD:
+		return saturate((int64_t)a + b);
+	case OP_SUB:
+		return saturate((int64_t)a - b);
+	case OP_MUL:
+		return saturate(((int64_t)a * b) >> FRACTION_BITS);
+	case OP_DIV:
+		if (!b)
+			return (a < 0) ? INT32_MIN : INT32_MAX;
+		return saturate(((int64_t)a << FRACTION_BITS) / b);
+	case OP_MIN:
+		return std::min(a, b);
+	case OP_MAX:
+		return std::max(a, b);
+	case OP_DERIVATIVE: {
+		const Fixed last = node.last;
+		node.last = a;
+		if (!dt)
+			return 0;
+		return saturate((((int64_t)a - last) * COUNTS_PER_SECOND) / (int64_t)dt);
+	}
+	}
+	return 0;
+}
+
+/**
+ * Run one pass over a node array.
+ *
+ * @param nodes The nodes, in evaluation order.
+ * @param dt Time since the previous pass in global timer counts, 0 on the first.
+ * @param full Recompute every node.
+ * @param recomputed Incremented for every node recomputed.
+ * @return A mask of the nodes whose value changed.
+ */
+uint64_t DerivedSensors::pass(std::vector<NodeInfo> &nodes, uint64_t dt, bool full, uint32_t &recomputed) {
+	uint64_t changed = 0;
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		NodeInfo &node = nodes[i];
+		const uint64_t operands = (UINT64_C(1) << node.a) | (UINT64_C(1) << node.b);
+
+		switch (node.op) {
+		case OP_INPUT: {
+			// The sampling scheduler has already read the ADC for the history.
+			SensorHistory::Bucket sample;
+			if (!sensor_history->getBuckets(node.history, 0, &sample, 1))
+				continue;
+			const int32_t code = sample.mean();
+			if (!full && code == node.code)
+				continue;
+			node.code = code;
+			break;
+		}
+		case OP_CONST:
+			continue;
+		case OP_DERIVATIVE:
+			// A settled input decays the slope to zero once, then costs nothing.
+			if (!full && !(changed & operands) && !node.value) {
+				node.last = nodes[node.a].value;
+				continue;
+			}
+			break;
+		default:
+			if (!full && !(changed & operands))
+				continue;
+			break;
+		}
+
+		recomputed++;
+		const Fixed value = DerivedSensors::compute(nodes, node, dt);
+		if (value != node.value) {
+			node.value = value;
+			changed |= UINT64_C(1) << i;
+		}
+	}
+	return changed;
+}
+
+void DerivedSensors::evaluate(bool full) {
+	struct Update {
+		std::shared_ptr<ThresholdSensor> sensor;
+		float value;
+	};
+	std::vector<Update> updates;
+
+	MutexGuard<false> lock(this->mutex, true);
+	const uint64_t start = HiResTimer::now();
+	const uint64_t dt = this->last_pass ? start - this->last_pass : 0;
+	this->last_pass = start;
+
+	uint32_t recomputed = 0;
+	const uint64_t changed = DerivedSensors::pass(this->nodes, dt, full, recomputed);
+	const uint64_t elapsed = HiResTimer::now() - start;
+
+	this->passes++;
+	this->recomputed += recomputed;
+	this->cost_sum += elapsed;
+	if (elapsed > this->cost_max)
+		this->cost_max = elapsed;
+
+	for (Output &output : this->outputs) {
+		if (!output.sensor || !(output.stale || (changed & (UINT64_C(1) << output.node))))
+			continue;
+		output.stale = false;
+		updates.push_back({output.sensor, (float)DerivedSensors::toDouble(this->nodes[output.node].value)});
+	}
+	this->pushed += updates.size();
+	lock.release();
+
+	// Sensor updates may send events, keep them out of the lock.
+	for (const Update &update : updates)
+		update.sensor->updateValue(update.value);
+}
+
+/// A console command to show the derived sensors.
+class DerivedSensors::Status : public CommandParser::Command {
+public:
+	Status(DerivedSensors &derived) : derived(derived) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [nodes]\n\n"
+				"Show the derived sensors and their evaluation statistics.\n"
+				"With 'nodes', show the whole expression graph.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const char *ops[] = {"input", "const", "add", "sub", "mul", "div", "min", "max", "d/dt"};
+
+		std::string action;
+		if (parameters.nargs() > 1 && (!parameters.parseParameters(1, true, &action) || action != "nodes")) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		MutexGuard<false> lock(this->derived.mutex, true);
+		std::string out = "sensor,value,linked\n";
+		for (const Output &output : this->derived.outputs)
+			out += stdsprintf("%s,%.3f,%s\n", output.name.c_str(),
+					DerivedSensors::toDouble(this->derived.nodes[output.node].value), output.sensor ? "yes" : "no");
+
+		if (!action.empty()) {
+			out += "\nnode,op,a,b,value\n";
+			for (size_t i = 0; i < this->derived.nodes.size(); ++i) {
+				const NodeInfo &node = this->derived.nodes[i];
+				if (node.op == OP_INPUT)
+					out += stdsprintf("%u,%s,%s,-,%.3f\n", i, ops[node.op], node.name.c_str(), DerivedSensors::toDouble(node.value));
+				else
+					out += stdsprintf("%u,%s,%hhu,%hhu,%.3f\n", i, ops[node.op], node.a, node.b, DerivedSensors::toDouble(node.value));
+			}
+		}
+
+		const uint32_t passes = this->derived.passes;
+		out += stdsprintf("\n%lu passes, %llu sensor updates", passes, this->derived.pushed);
+		if (passes)
+			out += stdsprintf(", %llu of %u nodes recomputed per pass on average, %llu us mean, %llu us max per pass",
+					this->derived.recomputed / passes, this->derived.nodes.size(),
+					HiResTimer::countsToUs(this->derived.cost_sum / passes), HiResTimer::countsToUs(this->derived.cost_max));
+		out += ".\n";
+		console->write(out);
+	}
+
+private:
+	DerivedSensors &derived;
+};
+
+/// A console command to benchmark full evaluation passes.
+class DerivedSensors::Bench : public CommandParser::Command {
+public:
+	Bench(DerivedSensors &derived) : derived(derived) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [$passes]\n\n"
+				"Time full evaluation passes, every node recomputed and every input fetched, on a\n"
+				"copy of the graph.  Reports the cost per pass and per node, to size how many\n"
+				"derived sensors fit at the ADC update rate.  Defaults to 1000 passes.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		uint32_t passes = 1000;
+		if (parameters.nargs() > 1 && !parameters.parseParameters(1, true, &passes)) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+		if (!passes) {
+			console->write("At least one pass is required.\n");
+			return;
+		}
+
+		MutexGuard<false> lock(this->derived.mutex, true);
+		std::vector<NodeInfo> nodes = this->derived.nodes;
+		lock.release();
+		if (nodes.empty()) {
+			console->write("No derived sensors defined.\n");
+			return;
+		}
+
+		uint32_t recomputed = 0;
+		uint64_t cost_max = 0;
+		uint64_t cost_sum = 0;
+		const uint64_t dt = HiResTimer::usToCounts(1000);
+		for (uint32_t i = 0; i < passes; ++i) {
+			const uint64_t start = HiResTimer::now();
+			DerivedSensors::pass(nodes, dt, true, recomputed);
+			const uint64_t elapsed = HiResTimer::now() - start;
+			cost_sum += elapsed;
+			if (elapsed > cost_max)
+				cost_max = elapsed;
+		}
+
+		const uint64_t total_ns = HiResTimer::countsToUs(cost_sum) * 1000;
+		console->write(stdsprintf("%lu passes over %u nodes: %llu ns mean, %llu us max per pass, %llu ns per node.\n",
+				passes, nodes.size(), total_ns / passes, HiResTimer::countsToUs(cost_max), recomputed ? total_ns / recomputed : 0));
+	}
+
+private:
+	DerivedSensors &derived;
+};
+
+void DerivedSensors::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<DerivedSensors::Status>(*this));
+	parser.registerCommand(prefix + "bench", std::make_shared<DerivedSensors::Bench>(*this));
+}
+
+void DerivedSensors::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "bench", nullptr);
+}
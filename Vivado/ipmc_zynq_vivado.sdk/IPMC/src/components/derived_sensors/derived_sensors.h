@@ -0,0 +1,171 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_DERIVED_SENSORS_DERIVED_SENSORS_H_
+#define SRC_COMPONENTS_DERIVED_SENSORS_DERIVED_SENSORS_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <drivers/generics/adc.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+
+class ThresholdSensor;
+
+/**
+ * Virtual sensors computed from PayloadManager ADC sensors.
+ *
+ * A derived sensor is a small expression graph over ADC sensor readings,
+ * built with input(), constant() and op().  Operands must exist before the
+ * nodes using them, so the node array is always in evaluation order.  All
+ * math is Q16.16 fixed point: inputs are converted from ADC codes through a
+ * piecewise linear table built once from the channel scaling.
+ *
+ * Inputs take the latest SensorHistory sample of their sensor rather than
+ * reading the ADC again, so evaluation never touches the ADC bus.
+ *
+ * Evaluation is incremental, a pass only recomputes the nodes whose operands
+ * changed, and only pushes outputs that changed to their IPMI threshold
+ * sensors, which are matched to their SDRs by ID string in linkSensors().
+ */
+class DerivedSensors final : public ConsoleCommandSupport {
+public:
+	typedef int32_t Fixed;							///< Q16.16 signed fixed point.
+	static const int FRACTION_BITS = 16;			///< Fractional bits of Fixed.
+	static const size_t MAX_NODES = 64;				///< Nodes across all derived sensors.
+	static const size_t CURVE_SHIFT = 8;			///< log2 of ADC codes per input table segment.
+	static const size_t CURVE_POINTS = (65536 >> CURVE_SHIFT) + 1;	///< Input table points.
+
+	//! Node operations.
+	enum Op {
+		OP_INPUT,		///< An ADC sensor reading.
+		OP_CONST,		///< A constant.
+		OP_ADD,			///< a + b
+		OP_SUB,			///< a - b
+		OP_MUL,			///< a * b
+		OP_DIV,			///< a / b, saturating on division by zero.
+		OP_MIN,			///< min(a, b)
+		OP_MAX,			///< max(a, b)
+		OP_DERIVATIVE,	///< da/dt per second, over the last evaluation interval.
+	};
+
+	//! A node handle.
+	typedef uint8_t Node;
+
+	DerivedSensors(LogTree &log);
+	virtual ~DerivedSensors();
+
+	/**
+	 * Add an input node, or return the existing one for this sensor.
+	 * @param sensor The PayloadManager ADC sensor name, it must have a SensorHistory.
+	 * @throw std::domain_error if the sensor is unknown or there is no room left.
+	 */
+	Node input(const std::string &sensor);
+
+	/**
+	 * Add a constant node.
+	 * @throw std::domain_error if there is no room left.
+	 */
+	Node constant(double value);
+
+	/**
+	 * Add an operation node.
+	 * @param op The operation, OP_DERIVATIVE only uses a.
+	 * @param a First operand.
+	 * @param b Second operand.
+	 * @throw std::domain_error on invalid operands or if there is no room left.
+	 */
+	Node op(Op op, Node a, Node b = 0);
+
+	/**
+	 * Publish a node as an IPMI threshold sensor.
+	 * @param name The ID string of the sensor's SDR.
+	 * @param node The node.
+	 * @throw std::domain_error on an invalid node.
+	 */
+	void output(const std::string &name, Node node);
+
+	/**
+	 * Bind the outputs to their sensors, matched by SDR ID string.  This is
+	 * meant to be called whenever the SDR repository was (re)loaded.
+	 *
+	 * @param sdrs The exported SDR repository, as by SensorDataRepository::u8export().
+	 */
+	void linkSensors(const std::vector<uint8_t> &sdrs);
+
+	/**
+	 * Run one evaluation pass, meant to be called at the ADC update rate.
+	 * @param full Recompute every node, not only those with changed inputs.
+	 */
+	void evaluate(bool full = false);
+
+	//! Convert to and from Fixed, saturating.
+	///@{
+	static Fixed toFixed(double value);
+	static inline double toDouble(Fixed value) { return (double)value / (1 << FRACTION_BITS); };
+	///@}
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! A graph node.
+	struct NodeInfo {
+		Op op;							///< Operation.
+		Node a;							///< First operand.
+		Node b;							///< Second operand.
+		Fixed value;					///< Current value.
+		std::string name;				///< Sensor name, for inputs.
+		size_t history;					///< Input SensorHistory sensor index.
+		int32_t code;					///< Last input code, -1 before the first read.
+		std::vector<Fixed> curve;		///< Input conversion table, CURVE_POINTS long.
+		Fixed last;						///< Operand at the previous pass, for derivatives.
+	};
+
+	//! A derived sensor published over IPMI.
+	struct Output {
+		std::string name;						///< SDR ID string.
+		Node node;								///< Source node.
+		std::shared_ptr<ThresholdSensor> sensor;	///< Linked sensor, if any.
+		bool stale;								///< Push on the next pass even if unchanged.
+	};
+
+	SemaphoreHandle_t mutex;		///< Protects the graph and statistics.
+	LogTree &log;					///< Log target.
+	std::vector<NodeInfo> nodes;	///< Nodes in evaluation order.
+	std::vector<Output> outputs;	///< Published nodes.
+	uint64_t last_pass;				///< Time of the previous pass, 0 before the first.
+
+	uint32_t passes;				///< Evaluation passes.
+	uint64_t recomputed;			///< Nodes recomputed over all passes.
+	uint64_t pushed;				///< Sensor updates sent.
+	uint64_t cost_max;				///< Longest pass, in global timer counts.
+	uint64_t cost_sum;				///< Sum of pass durations.
+
+	Node add(const NodeInfo &node);
+	static uint64_t pass(std::vector<NodeInfo> &nodes, uint64_t dt, bool full, uint32_t &recomputed);
+	static Fixed compute(const std::vector<NodeInfo> &nodes, NodeInfo &node, uint64_t dt);
+
+	class Status;	///< Console command to show the derived sensors.
+	class Bench;	///< Console command to benchmark evaluation.
+};
+
+#endif /* SRC_COMPONENTS_DERIVED_SENSORS_DERIVED_SENSORS_H_ */
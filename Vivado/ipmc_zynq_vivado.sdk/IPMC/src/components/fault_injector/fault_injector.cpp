@@ -0,0 +1,406 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fault_injector.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <libs/printf.h>
+#include <payload_manager.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_event_dispatcher/sensor_event_dispatcher.h>
+#include "ipmc.h"
+
+FaultInjector::FaultInjector(const std::vector<uint16_t> &adc_device_ids, uint16_t zone_device_id, HiResTimer &timer, LogTree &log) :
+	timer(timer), log(log), task(nullptr), length(0), mark(0),
+	running(false), handle(-1), adc(nullptr), channel(0), watched_zones(0),
+	position(0), settle_ticks(0), mark_time(0), overruns_start(0) {
+	this->adcs.resize(adc_device_ids.size());
+	for (size_t i = 0; i < adc_device_ids.size(); ++i)
+		if (XST_SUCCESS != AD7689_S_Initialize(&this->adcs[i], adc_device_ids[i]))
+			throw std::runtime_error(stdsprintf("Unable to initialize AD7689_S(%hu)", adc_device_ids[i]));
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->zones, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->waveform = new uint16_t[MAX_SAMPLES];
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	this->task = runTask("fault_inject", TASK_PRIORITY_SERVICE, [this]() -> void { this->run(); });
+}
+
+FaultInjector::~FaultInjector() {
+	this->stop();
+	vTaskDelete(this->task);
+	vSemaphoreDelete(this->mutex);
+	delete[] this->waveform;
+}
+
+bool FaultInjector::loadRamp(uint16_t from, uint16_t to, size_t samples) {
+	if (this->running || samples < 2 || samples > MAX_SAMPLES)
+		return false;
+	for (size_t i = 0; i < samples; ++i)
+		this->waveform[i] = from + ((int32_t)to - from) * (int32_t)i / (int32_t)(samples - 1);
+	this->length = samples;
+	this->mark = 0;
+	return true;
+}
+
+bool FaultInjector::loadSpike(uint16_t base, uint16_t peak, size_t at, size_t width, size_t samples) {
+	if (this->running || samples == 0 || samples > MAX_SAMPLES || at >= samples)
+		return false;
+	for (size_t i = 0; i < samples; ++i)
+		this->waveform[i] = (i >= at && i < at + width) ? peak : base;
+	this->length = samples;
+	this->mark = at;
+	return true;
+}
+
+bool FaultInjector::loadNoise(uint16_t base, uint16_t amplitude, size_t samples, uint32_t seed) {
+	if (this->running || samples == 0 || samples > MAX_SAMPLES)
+		return false;
+	uint32_t x = seed ? seed : 1;
+	for (size_t i = 0; i < samples; ++i) {
+		// xorshift32, reproducible for a given seed.
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		int32_t v = (int32_t)base + (int32_t)(x % (2 * amplitude + 1)) - amplitude;
+		this->waveform[i] = std::min<int32_t>(std::max<int32_t>(v, 0), UINT16_MAX);
+	}
+	this->length = samples;
+	this->mark = 0;
+	return true;
+}
+
+bool FaultInjector::play(const std::string &sensor, uint32_t period_us, uint32_t settle_ms) {
+	auto it = PayloadManager::adc_sensors.find(sensor);
+	if (it == PayloadManager::adc_sensors.end() || it->second.sensor_processor_id < 0)
+		throw std::domain_error(stdsprintf("Sensor %s has no sensor processor channel", sensor.c_str()));
+	const uint8_t ch = it->second.sensor_processor_id;
+	if (ch / 8 >= this->adcs.size())
+		throw std::domain_error(stdsprintf("Sensor %s is not on an overridable ADC", sensor.c_str()));
+
+	if (this->running || this->length == 0 || period_us == 0)
+		return false;
+
+	// Watch the zones that are on and would be shut down by this channel's hard fault.
+	uint32_t watched = 0;
+	for (u32 mz = 0; mz < this->zones.mz_cnt; ++mz) {
+		MZ_config cfg;
+		Mgmt_Zone_Ctrl_Get_MZ_Cfg(&this->zones, mz, &cfg);
+		if ((cfg.hardfault_mask & (1ULL << ch)) && Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, mz) == MZ_PWR_ON)
+			watched |= 1 << mz;
+	}
+
+	this->adc = &this->adcs[ch / 8];
+	this->channel = ch;
+	this->watched_zones = watched;
+	this->position = 0;
+	this->settle_ticks = (uint64_t)settle_ms * 1000 / period_us;
+	this->mark_time = 0;
+	this->overruns_start = this->timer.getOverruns();
+
+	this->current.sensor = sensor;
+	this->current.period_us = period_us;
+	this->current.samples = this->length;
+	this->current.overruns = 0;
+	this->current.irq_us = 0;
+	this->current.hardfault_us = 0;
+	this->current.shutdown_us = 0;
+	this->current.event_us = 0;
+
+	this->running = true;
+	this->handle = this->timer.addPeriodic(period_us, FaultInjector::_TimerCallback, this);
+	if (this->handle < 0) {
+		this->running = false;
+		return false;
+	}
+
+	if (!watched)
+		this->log.log(stdsprintf("Replaying into %s, no powered zone uses its hard fault.", sensor.c_str()), LogTree::LOG_WARNING);
+	return true;
+}
+
+void FaultInjector::stop() {
+	CriticalGuard critical(true);
+	if (!this->running)
+		return;
+	this->timer.removePeriodic(this->handle);
+	this->release();
+	this->running = false;
+}
+
+//! Hand the channel back to the ADC.
+void FaultInjector::release() {
+	const u32 bit = 1 << (this->channel % 8);
+	AD7689_S_Set_Ch_Ovrrd_Enables(this->adc, AD7689_S_Get_Ch_Ovrrd_Enables(this->adc) & ~bit);
+}
+
+uint64_t FaultInjector::sinceMark(uint64_t when) const {
+	// 0 means not observed, so round anything observed up to 1us.
+	return std::max<uint64_t>(HiResTimer::countsToUs(when - this->mark_time), 1);
+}
+
+bool FaultInjector::_TimerCallback(void *p) {
+	return reinterpret_cast<FaultInjector*>(p)->tick();
+}
+
+/**
+ * Write the next sample and poll the zone controller, runs in interrupt context.
+ * @return false once the replay is over.
+ */
+bool FaultInjector::tick() {
+	const uint64_t now = HiResTimer::now();
+
+	if (this->position < this->length) {
+		AD7689_S_Set_Ovrrd_Val(this->adc, 0, this->channel % 8, this->waveform[this->position]);
+		if (this->position == 0)
+			AD7689_S_Set_Ch_Ovrrd_Enables(this->adc, AD7689_S_Get_Ch_Ovrrd_Enables(this->adc) | (1 << (this->channel % 8)));
+		if (this->position == this->mark)
+			this->mark_time = now;
+		this->position++;
+	} else if (this->settle_ticks) {
+		this->settle_ticks--;
+	} else {
+		this->release();
+		this->current.overruns = this->timer.getOverruns() - this->overruns_start;
+		this->running = false;
+		vTaskNotifyGiveFromISR(this->task, nullptr);
+		return false;
+	}
+
+	if (this->mark_time) {
+		if (!this->current.hardfault_us && (Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&this->zones) & (1ULL << this->channel)))
+			this->current.hardfault_us = this->sinceMark(now);
+
+		if (!this->current.shutdown_us) {
+			for (uint32_t zones = this->watched_zones; zones; zones &= zones - 1) {
+				if (Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, __builtin_ctz(zones)) != MZ_PWR_ON) {
+					this->current.shutdown_us = this->sinceMark(now);
+					break;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void FaultInjector::_EventProbe(uint32_t ch, uint64_t irq_time, uint64_t sent_time, void *ref) {
+	FaultInjector &self = *reinterpret_cast<FaultInjector*>(ref);
+
+	CriticalGuard critical(true);
+	if (!self.running || ch != self.channel || !self.mark_time || irq_time < self.mark_time)
+		return;
+	if (!self.current.irq_us)
+		self.current.irq_us = self.sinceMark(irq_time);
+	if (!self.current.event_us)
+		self.current.event_us = self.sinceMark(sent_time);
+}
+
+void FaultInjector::run() {
+	if (sensor_events)
+		sensor_events->setEventProbe(FaultInjector::_EventProbe, this);
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		const Result r = this->current;
+		this->log.log(stdsprintf("Fault injection into %s: IRQ %llu us, hard fault %llu us, zone shutdown %llu us, IPMI event %llu us (0: not observed, %lu overruns).",
+				r.sensor.c_str(), r.irq_us, r.hardfault_us, r.shutdown_us, r.event_us, r.overruns), LogTree::LOG_NOTICE);
+
+		MutexGuard<false> lock(this->mutex, true);
+		this->results.push_back(r);
+		if (this->results.size() > MAX_RESULTS)
+			this->results.erase(this->results.begin());
+	}
+}
+
+std::vector<FaultInjector::Result> FaultInjector::getResults() {
+	MutexGuard<false> lock(this->mutex, true);
+	return this->results;
+}
+
+VFS::File FaultInjector::createFile() {
+	return VFS::File(
+		[this](uint8_t *buffer, size_t size) -> size_t {
+			const size_t bytes = this->length * sizeof(uint16_t);
+			if (size < bytes)
+				return 0;
+			memcpy(buffer, this->waveform, bytes);
+			return bytes;
+		},
+		[this](uint8_t *buffer, size_t size) -> size_t {
+			const size_t samples = size / sizeof(uint16_t);
+			if (this->running || samples == 0 || samples > MAX_SAMPLES)
+				return 0;
+			memcpy(this->waveform, buffer, samples * sizeof(uint16_t));
+			this->length = samples;
+			this->mark = 0;
+			return samples * sizeof(uint16_t);
+		},
+		MAX_SAMPLES * sizeof(uint16_t));
+}
+
+/// A console command to load a synthetic waveform and replay it.
+class FaultInjector::Generate : public CommandParser::Command {
+public:
+	Generate(FaultInjector &injector) : injector(injector) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $sensor ramp $from $to $ms [$period_us]\n"
+				+ command + " $sensor spike $base $peak $width_ms $ms [$period_us]\n"
+				+ command + " $sensor noise $base $amplitude $ms [$period_us]\n\n"
+				"Generate a waveform in sensor units and replay it into the sensor's ADC override.\n"
+				"Spikes start a quarter into the waveform.  The default period is 1000us.\n"
+				"WARNING: This trips the hard faults and powers down the affected zones.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string sensor, shape;
+		double a = 0, b = 0, c = 0, d = 0;
+		uint32_t period_us = 1000;
+
+		const size_t n = parameters.nargs();
+		bool ok = parameters.parseParameters(1, false, &sensor, &shape);
+		if (ok && shape == "spike")
+			ok = (n == 7 && parameters.parseParameters(3, true, &a, &b, &c, &d)) ||
+				 (n == 8 && parameters.parseParameters(3, true, &a, &b, &c, &d, &period_us));
+		else if (ok && (shape == "ramp" || shape == "noise"))
+			ok = (n == 6 && parameters.parseParameters(3, true, &a, &b, &d)) ||
+				 (n == 7 && parameters.parseParameters(3, true, &a, &b, &d, &period_us));
+		else
+			ok = false;
+
+		auto it = PayloadManager::adc_sensors.find(sensor);
+		if (!ok || period_us == 0 || it == PayloadManager::adc_sensors.end()) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		const ADC::Channel &adc = it->second.adc;
+		const size_t samples = (size_t)(d * 1000 / period_us);
+		bool loaded;
+		if (shape == "ramp")
+			loaded = this->injector.loadRamp(adc.floatToRaw(a), adc.floatToRaw(b), samples);
+		else if (shape == "spike")
+			loaded = this->injector.loadSpike(adc.floatToRaw(a), adc.floatToRaw(b), samples / 4, (size_t)(c * 1000 / period_us), samples);
+		else
+			loaded = this->injector.loadNoise(adc.floatToRaw(a), std::abs(adc.floatToRaw(a + b) - adc.floatToRaw(a)), samples, xTaskGetTickCount());
+		if (!loaded) {
+			console->write(stdsprintf("Unable to load, a replay is running or the waveform is not 1-%u samples.\n", MAX_SAMPLES));
+			return;
+		}
+
+		try {
+			if (!this->injector.play(sensor, period_us))
+				console->write("Unable to start the replay.\n");
+			else
+				console->write(stdsprintf("Replaying %u samples into %s.\n", samples, sensor.c_str()));
+		} catch (std::domain_error &e) {
+			console->write(std::string(e.what()) + ".\n");
+		}
+	}
+
+private:
+	FaultInjector &injector;
+};
+
+/// A console command to replay an uploaded waveform.
+class FaultInjector::Play : public CommandParser::Command {
+public:
+	Play(FaultInjector &injector) : injector(injector) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $sensor [$period_us]\n"
+				+ command + " stop\n\n"
+				"Replay the waveform uploaded to virtual/fault_waveform.bin into the sensor's ADC override,\n"
+				"or abort a replay.\n"
+				"WARNING: This trips the hard faults and powers down the affected zones.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string sensor;
+		uint32_t period_us = 1000;
+
+		if (!parameters.parseParameters(1, true, &sensor) && !parameters.parseParameters(1, true, &sensor, &period_us)) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+		if (sensor == "stop") {
+			this->injector.stop();
+			return;
+		}
+
+		try {
+			if (!this->injector.play(sensor, period_us))
+				console->write("Unable to start the replay, is a waveform loaded?\n");
+		} catch (std::domain_error &e) {
+			console->write(std::string(e.what()) + ".\n");
+		}
+	}
+
+private:
+	FaultInjector &injector;
+};
+
+/// A console command to report, and optionally check, measured latencies.
+class FaultInjector::Results : public CommandParser::Command {
+public:
+	Results(FaultInjector &injector) : injector(injector) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [$max_shutdown_us]\n\n"
+				"List the latencies of the last replays, from the marked sample, in microseconds.\n"
+				"With a limit, the last run is checked and PASS or FAIL is printed for regression scripts.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		uint32_t limit = 0;
+		if (parameters.nargs() > 1 && !parameters.parseParameters(1, true, &limit)) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		std::vector<Result> results = this->injector.getResults();
+		std::string out = "sensor,period_us,samples,overruns,irq_us,hardfault_us,shutdown_us,event_us\n";
+		for (const Result &r : results)
+			out += stdsprintf("%s,%lu,%lu,%lu,%llu,%llu,%llu,%llu\n", r.sensor.c_str(), r.period_us, r.samples,
+					r.overruns, r.irq_us, r.hardfault_us, r.shutdown_us, r.event_us);
+
+		if (limit) {
+			bool pass = !results.empty() && results.back().shutdown_us && results.back().shutdown_us <= limit;
+			out += pass ? "PASS\n" : "FAIL\n";
+		}
+		console->write(out);
+	}
+
+private:
+	FaultInjector &injector;
+};
+
+void FaultInjector::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "generate", std::make_shared<FaultInjector::Generate>(*this));
+	parser.registerCommand(prefix + "play", std::make_shared<FaultInjector::Play>(*this));
+	parser.registerCommand(prefix + "results", std::make_shared<FaultInjector::Results>(*this));
+}
+
+void FaultInjector::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "generate", nullptr);
+	parser.registerCommand(prefix + "play", nullptr);
+	parser.registerCommand(prefix + "results", nullptr);
+}
@@ -0,0 +1,150 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_FAULT_INJECTOR_FAULT_INJECTOR_H_
+#define SRC_COMPONENTS_FAULT_INJECTOR_FAULT_INJECTOR_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <services/ftp/ftp.h>
+#include "ad7689_s.h"
+#include "mgmt_zone_ctrl.h"
+
+class HiResTimer;
+
+/**
+ * Replays waveforms into the AD7689_S channel overrides and times the fault path.
+ *
+ * A waveform of raw ADC codes is written to one channel's override register
+ * from a HiResTimer callback at a fixed rate.  Each tick also polls the
+ * management zone controller, so the latency of every stage is measured from
+ * the waveform's marked excursion sample:
+ *  - the sensor processor IRQ and the IPMI event, through the SensorEventDispatcher probe,
+ *  - the hard fault input of the zone controller,
+ *  - the first watched zone leaving MZ_PWR_ON.
+ *
+ * Sensor processor channels follow the ADC channels: channel N is AD7689_S
+ * device N/8, slave 0, input N%8, which is also the hard fault bit.
+ *
+ * @warning Injected faults trip real management zones and power down the payload.
+ */
+class FaultInjector final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_SAMPLES = 8192;	///< Waveform capacity.
+	static const size_t MAX_RESULTS = 16;	///< Results kept for reporting.
+
+	//! Measured latencies of one run, in microseconds from the marked sample, 0 if not observed.
+	struct Result {
+		std::string sensor;			///< Injected sensor.
+		uint32_t period_us;			///< Replay period.
+		uint32_t samples;			///< Samples replayed.
+		uint32_t overruns;			///< Timer overruns during replay.
+		uint64_t irq_us;			///< Sensor processor IRQ.
+		uint64_t hardfault_us;		///< Hard fault input asserted.
+		uint64_t shutdown_us;		///< A watched zone left MZ_PWR_ON.
+		uint64_t event_us;			///< IPMI event handed over.
+	};
+
+	/**
+	 * @param adc_device_ids AD7689_S device IDs, in sensor processor channel order.
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID.
+	 * @param timer The timer pacing the replay.
+	 * @param log The log tree to report to.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	FaultInjector(const std::vector<uint16_t> &adc_device_ids, uint16_t zone_device_id, HiResTimer &timer, LogTree &log);
+	virtual ~FaultInjector();
+
+	/**
+	 * Waveform generators, in raw ADC codes.
+	 * @return false if a replay is in progress or the waveform doesn't fit.
+	 */
+	///@{
+	//! Load a ramp from one code to another, marked at the first sample.
+	bool loadRamp(uint16_t from, uint16_t to, size_t samples);
+	//! Load a rectangular spike, marked at its leading edge.
+	bool loadSpike(uint16_t base, uint16_t peak, size_t at, size_t width, size_t samples);
+	//! Load uniform noise around a code, marked at the first sample.
+	bool loadNoise(uint16_t base, uint16_t amplitude, size_t samples, uint32_t seed);
+	///@}
+
+	/**
+	 * Start replaying the loaded waveform.
+	 *
+	 * @param sensor PayloadManager ADC sensor to inject into.
+	 * @param period_us Replay period.
+	 * @param settle_ms Time to hold the last sample and keep observing after the waveform ends.
+	 * @throw std::domain_error if the sensor has no sensor processor channel.
+	 * @return false if a replay is in progress, nothing is loaded or the timer is full.
+	 */
+	bool play(const std::string &sensor, uint32_t period_us = 1000, uint32_t settle_ms = 500);
+
+	//! Abort a replay and release the override.
+	void stop();
+
+	//! Results of the last runs, oldest first.
+	std::vector<Result> getResults();
+
+	//! Create a VFS file to upload a recorded waveform (raw little endian u16 codes) and read it back.
+	VFS::File createFile();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	std::vector<AD7689_S> adcs;		///< Low level ADC drivers.
+	Mgmt_Zone_Ctrl zones;			///< Low level zone controller driver, read only.
+	HiResTimer &timer;				///< Replay timer.
+	LogTree &log;					///< Log target.
+	TaskHandle_t task;				///< Result reporting task.
+	SemaphoreHandle_t mutex;		///< Protects the results.
+
+	uint16_t *waveform;				///< Waveform codes.
+	size_t length;					///< Waveform samples.
+	size_t mark;					///< Excursion sample, latencies are measured from it.
+
+	volatile bool running;			///< A replay is in progress.
+	int handle;						///< Timer registration.
+	AD7689_S *adc;					///< ADC of the injected channel.
+	uint8_t channel;				///< Sensor processor channel / hard fault bit.
+	uint32_t watched_zones;			///< Zones that were on and use the hard fault.
+	size_t position;				///< Next sample.
+	size_t settle_ticks;			///< Ticks left after the waveform ended.
+	uint64_t mark_time;				///< When the marked sample was written.
+	uint32_t overruns_start;		///< Timer overruns before the replay.
+
+	Result current;					///< Result being measured.
+	std::vector<Result> results;	///< Last results.
+
+	static bool _TimerCallback(void *p);
+	bool tick();
+	void release();
+	void run();
+	static void _EventProbe(uint32_t ch, uint64_t irq_time, uint64_t sent_time, void *ref);
+	uint64_t sinceMark(uint64_t when) const;
+
+	class Generate;	///< Console command to load a synthetic waveform.
+	class Play;		///< Console command to replay the waveform.
+	class Results;	///< Console command to report and check latencies.
+};
+
+#endif /* SRC_COMPONENTS_FAULT_INJECTOR_FAULT_INJECTOR_H_ */
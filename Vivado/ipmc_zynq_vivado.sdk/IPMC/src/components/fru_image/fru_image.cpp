@@ -0,0 +1,200 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fru_image.h"
+#include <stdexcept>
+
+/*
+ * Common header:  format version, internal use, chassis, board, product and
+ * multirecord area offsets (in 8 byte units, 0 if absent), pad, checksum.
+ */
+static const size_t COMMON_HEADER_SIZE = 8;
+static const size_t COMMON_HEADER_BOARD = 3;
+static const size_t COMMON_HEADER_PRODUCT = 4;
+static const size_t COMMON_HEADER_MULTIRECORD = 5;
+
+//! Multirecord header: type, EOL and format, data length, data checksum, header checksum.
+static const size_t MULTIRECORD_HEADER_SIZE = 5;
+
+FRUImage::FRUImage(size_t capacity) : open(false), has_records(false), last_record(0) {
+	this->buffer.reserve(capacity);
+	this->buffer.assign(COMMON_HEADER_SIZE, 0);
+	this->buffer[0] = 0x01; // Common Header Format Version
+}
+
+uint8_t FRUImage::checksum(const uint8_t *data, size_t len) {
+	uint8_t sum = 0;
+	for (size_t i = 0; i < len; ++i)
+		sum += data[i];
+	return -sum;
+}
+
+//! Claim the compiler for a builder.
+void FRUImage::begin() {
+	if (this->open)
+		throw std::logic_error("Another FRU image builder is still open");
+	this->open = true;
+}
+
+void FRUImage::put(uint8_t byte) {
+	this->buffer.push_back(byte);
+}
+
+void FRUImage::put(const uint8_t *data, size_t len) {
+	this->buffer.insert(this->buffer.end(), data, data + len);
+}
+
+FRUImage::InfoArea FRUImage::boardArea(uint8_t language, uint32_t mfg_time) {
+	if (this->has_records)
+		throw std::logic_error("Info areas must precede the multirecord area");
+	this->begin();
+
+	const size_t start = this->buffer.size();
+	this->buffer[COMMON_HEADER_BOARD] = start / 8;
+	this->put(0x01); // Format Version
+	this->put(0x00); // Length (set on close)
+	this->put(language);
+	this->put(mfg_time & 0xff);
+	this->put((mfg_time >> 8) & 0xff);
+	this->put((mfg_time >> 16) & 0xff);
+	return InfoArea(*this, start);
+}
+
+FRUImage::InfoArea FRUImage::productArea(uint8_t language) {
+	if (this->has_records)
+		throw std::logic_error("Info areas must precede the multirecord area");
+	this->begin();
+
+	const size_t start = this->buffer.size();
+	this->buffer[COMMON_HEADER_PRODUCT] = start / 8;
+	this->put(0x01); // Format Version
+	this->put(0x00); // Length (set on close)
+	this->put(language);
+	return InfoArea(*this, start);
+}
+
+FRUImage::PICMGRecord FRUImage::picmgRecord(uint8_t record_id, uint8_t record_version, uint8_t record_format) {
+	this->begin();
+	if (!this->has_records) {
+		this->buffer[COMMON_HEADER_MULTIRECORD] = this->buffer.size() / 8;
+		this->has_records = true;
+	}
+	return PICMGRecord(*this, record_id, record_version, record_format);
+}
+
+std::vector<uint8_t> FRUImage::finish() {
+	if (this->open)
+		throw std::logic_error("A FRU image builder is still open");
+
+	if (this->has_records) {
+		uint8_t *header = this->buffer.data() + this->last_record;
+		header[1] |= 0x80; // End of list
+		header[4] = FRUImage::checksum(header, MULTIRECORD_HEADER_SIZE - 1);
+	}
+	this->buffer[COMMON_HEADER_SIZE - 1] = FRUImage::checksum(this->buffer.data(), COMMON_HEADER_SIZE - 1);
+
+	std::vector<uint8_t> image(std::move(this->buffer));
+	this->buffer.assign(COMMON_HEADER_SIZE, 0);
+	this->buffer[0] = 0x01;
+	this->has_records = false;
+	this->last_record = 0;
+	return image;
+}
+
+FRUImage::InfoArea& FRUImage::InfoArea::field(const std::string &value) {
+	if (value.size() > 63)
+		throw std::domain_error("FRU type/length fields are limited to 63 bytes");
+	this->image.put(0xC0 | value.size());
+	this->image.put(reinterpret_cast<const uint8_t*>(value.data()), value.size());
+	return *this;
+}
+
+void FRUImage::InfoArea::close() {
+	std::vector<uint8_t> &buffer = this->image.buffer;
+	buffer.push_back(0xC1); // End of fields
+	while ((buffer.size() + 1 - this->start) % 8)
+		buffer.push_back(0); // Pad, leaving room for the checksum.
+
+	const size_t length = buffer.size() + 1 - this->start;
+	if (length / 8 > 0xff)
+		throw std::length_error("FRU info area exceeds 2040 bytes");
+	buffer[this->start + 1] = length / 8;
+	buffer.push_back(FRUImage::checksum(buffer.data() + this->start, length - 1));
+	this->image.open = false;
+}
+
+FRUImage::PICMGRecord::PICMGRecord(FRUImage &image, uint8_t record_id, uint8_t record_version, uint8_t record_format)
+	: image(image), record_id(record_id), record_version(record_version), record_format(record_format), start(0) {
+	this->begin();
+}
+
+//! Write the header of a new record.
+void FRUImage::PICMGRecord::begin() {
+	this->start = this->image.buffer.size();
+	const uint8_t header[] = {
+		0xC0, // OEM record type
+		this->record_format, // End of list is set by finish()
+		0, // Data length (set on close)
+		0, // Data checksum (set on close)
+		0, // Header checksum (set on close)
+		0x5A, 0x31, 0x00, // Manufacturer: PICMG
+		this->record_id,
+		this->record_version,
+	};
+	this->image.put(header, sizeof(header));
+}
+
+//! Complete the current record.
+void FRUImage::PICMGRecord::end() {
+	uint8_t *header = this->image.buffer.data() + this->start;
+	const size_t length = this->image.buffer.size() - this->start - MULTIRECORD_HEADER_SIZE;
+	header[2] = length;
+	header[3] = FRUImage::checksum(header + MULTIRECORD_HEADER_SIZE, length);
+	header[4] = FRUImage::checksum(header, MULTIRECORD_HEADER_SIZE - 1);
+	this->image.last_record = this->start;
+}
+
+//! Data bytes left in the current record.
+size_t FRUImage::PICMGRecord::space() const {
+	return MAX_RECORD_DATA - (this->image.buffer.size() - this->start - MULTIRECORD_HEADER_SIZE);
+}
+
+FRUImage::PICMGRecord& FRUImage::PICMGRecord::put(const uint8_t *data, size_t len) {
+	if (len > this->space())
+		throw std::length_error("PICMG record data exceeds 255 bytes");
+	this->image.put(data, len);
+	return *this;
+}
+
+FRUImage::PICMGRecord& FRUImage::PICMGRecord::continueWith(const std::vector<uint8_t> &data) {
+	this->repeat = data;
+	return *this;
+}
+
+FRUImage::PICMGRecord& FRUImage::PICMGRecord::item(const std::vector<uint8_t> &data) {
+	if (data.size() > this->space()) {
+		this->end();
+		this->begin();
+		this->put(this->repeat);
+	}
+	return this->put(data);
+}
+
+void FRUImage::PICMGRecord::close() {
+	this->end();
+	this->image.open = false;
+}
@@ -0,0 +1,156 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_FRU_IMAGE_FRU_IMAGE_H_
+#define SRC_COMPONENTS_FRU_IMAGE_FRU_IMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/**
+ * Compiler for IPMI FRU Data images.
+ *
+ * Everything is written in place into one buffer, reserved up front: the
+ * common header first, then the areas and records in the order they are
+ * opened.  Builders only hold offsets into that buffer, and lengths and
+ * checksums are filled in over the written bytes when a builder is closed,
+ * so nothing is copied or inserted at the front.
+ *
+ * PICMG multirecords split by themselves at the 255 byte record data limit,
+ * and the last record written gets the end of list flag in finish().
+ *
+ * Nothing here depends on FreeRTOS or the IPMI services, so the compiler
+ * runs as is on a host.  Errors are reported as exceptions, as they are
+ * programming errors in the image description.
+ *
+ * Only one builder may be open at a time.
+ */
+class FRUImage final {
+public:
+	static const size_t DEFAULT_CAPACITY = 512;	///< Default buffer reservation.
+	static const uint8_t LANGUAGE_ENGLISH = 25;	///< IPMI language code for English.
+	static const size_t MAX_RECORD_DATA = 255;	///< Multirecord data length limit.
+
+	class InfoArea;
+	class PICMGRecord;
+
+	//! @param capacity Bytes to reserve, the image may grow past it at the cost of a reallocation.
+	FRUImage(size_t capacity = DEFAULT_CAPACITY);
+
+	/**
+	 * Open the Board Info Area.
+	 * @param language IPMI language code.
+	 * @param mfg_time Manufacturing time, in minutes since 1996-01-01, or 0 if unspecified.
+	 */
+	InfoArea boardArea(uint8_t language = LANGUAGE_ENGLISH, uint32_t mfg_time = 0);
+
+	//! Open the Product Info Area. @param language IPMI language code.
+	InfoArea productArea(uint8_t language = LANGUAGE_ENGLISH);
+
+	/**
+	 * Open a PICMG multirecord, in the multirecord area.
+	 * @param record_id PICMG Record ID.
+	 * @param record_version PICMG Record Format Version.
+	 * @param record_format Multirecord header Record Format version.
+	 */
+	PICMGRecord picmgRecord(uint8_t record_id, uint8_t record_version, uint8_t record_format = 2);
+
+	/**
+	 * Complete the common header and the last multirecord and hand out the image.
+	 * The compiler is empty afterwards.
+	 * @return The image, moved out of the compiler.
+	 */
+	std::vector<uint8_t> finish();
+
+	//! Compute the IPMI zero checksum of a span.
+	static uint8_t checksum(const uint8_t *data, size_t len);
+
+private:
+	std::vector<uint8_t> buffer;	///< The image so far.
+	bool open;						///< A builder is open.
+	bool has_records;				///< The multirecord area was started.
+	size_t last_record;				///< Offset of the last multirecord header.
+
+	void begin();
+	void put(uint8_t byte);
+	void put(const uint8_t *data, size_t len);
+};
+
+/// A Board or Product Info Area being written.
+class FRUImage::InfoArea final {
+public:
+	/**
+	 * Add an 8-bit ASCII+Latin1 type/length field.
+	 * @throw std::domain_error if longer than 63 bytes.
+	 */
+	InfoArea& field(const std::string &value);
+
+	//! Close the area, adding the end of fields marker, padding, length and checksum.
+	void close();
+
+private:
+	InfoArea(FRUImage &image, size_t start) : image(image), start(start) {};
+	FRUImage &image;	///< The image written to.
+	size_t start;		///< Offset of the area.
+	friend class FRUImage;
+};
+
+/// A PICMG multirecord being written, possibly spanning several records.
+class FRUImage::PICMGRecord final {
+public:
+	/**
+	 * Add bytes to the current record.
+	 * @throw std::length_error if they do not fit.
+	 */
+	PICMGRecord& put(const uint8_t *data, size_t len);
+	inline PICMGRecord& put(const std::vector<uint8_t> &data) { return this->put(data.data(), data.size()); };
+	inline PICMGRecord& put(std::initializer_list<uint8_t> data) { return this->put(data.begin(), data.size()); };
+
+	/**
+	 * Set the bytes that start the data of each record this one is split
+	 * into, after the PICMG Record ID and version.
+	 */
+	PICMGRecord& continueWith(const std::vector<uint8_t> &data);
+
+	/**
+	 * Add an item that must not be split, starting a new record first if
+	 * it does not fit in the current one.
+	 */
+	PICMGRecord& item(const std::vector<uint8_t> &data);
+
+	//! Close the current record, filling in its length and checksums.
+	void close();
+
+private:
+	PICMGRecord(FRUImage &image, uint8_t record_id, uint8_t record_version, uint8_t record_format);
+	FRUImage &image;				///< The image written to.
+	uint8_t record_id;				///< PICMG Record ID.
+	uint8_t record_version;			///< PICMG Record Format Version.
+	uint8_t record_format;			///< Multirecord header Record Format.
+	std::vector<uint8_t> repeat;	///< Data starting each continuation record.
+	size_t start;					///< Offset of the current record header.
+
+	void begin();
+	void end();
+	size_t space() const;
+	friend class FRUImage;
+};
+
+#endif /* SRC_COMPONENTS_FRU_IMAGE_FRU_IMAGE_H_ */
@@ -0,0 +1,229 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file fru_image_test.cpp
+ *
+ * Host comparison of FRUImage with the vector insert construction it
+ * replaced in fru_data_init.cpp, not part of the firmware build.
+ *
+ * Build and run from this directory with:
+ *   g++ -std=c++11 -Wall fru_image.cpp fru_image_test.cpp -o fru_image_test && ./fru_image_test
+ */
+
+#include "fru_image.h"
+#include <stdio.h>
+#include <iterator>
+#include <stdexcept>
+
+static unsigned failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("%s:%d: %s failed: ", __FILE__, __LINE__, #cond); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+//! The board's FRU strings, as fru_data_init.cpp fills them in.
+static const char *MFGR = "University of Wisconsin";
+static const char *PRODUCT = "ZYNQ IPMC";
+static const char *SERIAL = "42";
+static const char *PART = "IPMC Rev1";
+static const char *VERSION = "1";
+static const char *FILE_ID = "v2.1.0-17-gabcdef0";
+
+/* The old construction, kept as it was apart from the helpers it took from
+ * the IPMI services.
+ */
+
+static uint8_t oldChecksum(const std::vector<uint8_t> &data) {
+	uint8_t sum = 0;
+	for (uint8_t byte : data)
+		sum += byte;
+	return -sum;
+}
+
+static std::vector<uint8_t> encodeIpmiTypeLengthField(const std::string &data) {
+	std::vector<uint8_t> out{static_cast<uint8_t>(0xC0 | data.size())};
+	out.insert(out.end(), data.begin(), data.end());
+	return out;
+}
+
+static void addPICMGMultirecord(std::vector<uint8_t> &fruarea, std::vector<uint8_t> mrdata, bool last_record, uint8_t record_format = 2) {
+	static const std::vector<uint8_t> mrheader{0xC0, 0x00, 0, 0, 0, 0x5A, 0x31, 0x00};
+
+	mrdata.insert(mrdata.begin(), mrheader.begin(), mrheader.end());
+	mrdata[1] = (last_record ? 0x80 : 0) | record_format;
+	mrdata[2] = mrdata.size() - 5;
+	mrdata[3] = oldChecksum(std::vector<uint8_t>(std::next(mrdata.begin(), 5), mrdata.end()));
+	mrdata[4] = oldChecksum(std::vector<uint8_t>(mrdata.begin(), std::next(mrdata.begin(), 5)));
+
+	fruarea.insert(fruarea.end(), mrdata.begin(), mrdata.end());
+}
+
+static void addField(std::vector<uint8_t> &area, const std::string &value) {
+	std::vector<uint8_t> tlstring = encodeIpmiTypeLengthField(value);
+	area.insert(area.end(), tlstring.begin(), tlstring.end());
+}
+
+static void closeArea(std::vector<uint8_t> &area) {
+	area.push_back(0xC1);
+	area.push_back(0);
+	while (area.size() % 8)
+		area.push_back(0);
+	area[1] = area.size()/8;
+	area.pop_back();
+	area.push_back(oldChecksum(area));
+}
+
+static std::vector<uint8_t> oldImage(const std::vector< std::vector<uint8_t> > &guids, const std::vector< std::vector<uint8_t> > &links) {
+	std::vector<uint8_t> board_info{0x01, 0x00, 25, 0x00, 0x00, 0x00};
+	addField(board_info, MFGR);
+	addField(board_info, PRODUCT);
+	addField(board_info, SERIAL);
+	addField(board_info, PART);
+	addField(board_info, FILE_ID);
+	closeArea(board_info);
+
+	std::vector<uint8_t> product_info{0x01, 0x00, 25};
+	addField(product_info, MFGR);
+	addField(product_info, PRODUCT);
+	addField(product_info, PART);
+	addField(product_info, VERSION);
+	addField(product_info, SERIAL);
+	product_info.push_back(0xC0);
+	addField(product_info, FILE_ID);
+	closeArea(product_info);
+
+	std::vector<uint8_t> fru_data(8);
+	fru_data[0] = 0x01;
+	fru_data[3] = 0x01;
+	fru_data[4] = 0x01 + board_info.size()/8;
+	fru_data[5] = 0x01 + board_info.size()/8 + product_info.size()/8;
+	fru_data[7] = oldChecksum(fru_data);
+
+	fru_data.insert(fru_data.end(), board_info.begin(), board_info.end());
+	fru_data.insert(fru_data.end(), product_info.begin(), product_info.end());
+
+	std::vector<uint8_t> bp2pcr{0x14, 0, 0};
+	for (const std::vector<uint8_t> &guid : guids) {
+		bp2pcr[2]++;
+		bp2pcr.insert(bp2pcr.end(), guid.begin(), guid.end());
+	}
+	for (const std::vector<uint8_t> &link : links) {
+		if (bp2pcr.size() > 255 - 3 - 4 - 1) {
+			addPICMGMultirecord(fru_data, bp2pcr, false);
+			bp2pcr = std::vector<uint8_t>{0x14, 0, 0};
+		}
+		bp2pcr.insert(bp2pcr.end(), link.begin(), link.end());
+	}
+	addPICMGMultirecord(fru_data, bp2pcr, false);
+
+	addPICMGMultirecord(fru_data, std::vector<uint8_t>{0x17, 0, 0x3f, 0, 5, 0}, true);
+	return fru_data;
+}
+
+//! The same image through FRUImage, as fru_data_init.cpp builds it now.
+static std::vector<uint8_t> newImage(const std::vector< std::vector<uint8_t> > &guids, const std::vector< std::vector<uint8_t> > &links) {
+	FRUImage image;
+
+	image.boardArea(FRUImage::LANGUAGE_ENGLISH, 0).field(MFGR).field(PRODUCT).field(SERIAL).field(PART).field(FILE_ID).close();
+	image.productArea(FRUImage::LANGUAGE_ENGLISH).field(MFGR).field(PRODUCT).field(PART).field(VERSION).field(SERIAL).field("").field(FILE_ID).close();
+
+	FRUImage::PICMGRecord bp2pcr = image.picmgRecord(0x14, 0);
+	bp2pcr.put({static_cast<uint8_t>(guids.size())});
+	for (const std::vector<uint8_t> &guid : guids)
+		bp2pcr.put(guid);
+	bp2pcr.continueWith({0});
+	for (const std::vector<uint8_t> &link : links)
+		bp2pcr.item(link);
+	bp2pcr.close();
+
+	image.picmgRecord(0x17, 0).put({0x3f, 0, 5, 0}).close();
+	return image.finish();
+}
+
+//! Every checksum in the image must hold, and the multirecords must chain up to one end of list.
+static void checkStructure(const std::vector<uint8_t> &image, const char *label) {
+	CHECK(image.size() >= 8 && FRUImage::checksum(image.data(), 8) == 0, "%s: common header checksum", label);
+	if (image.size() < 8)
+		return;
+
+	for (size_t area = 3; area <= 4; ++area) {
+		const size_t offset = image[area] * 8;
+		const size_t length = offset + 1 < image.size() ? image[offset + 1] * 8 : 0;
+		CHECK(length && offset + length <= image.size() && FRUImage::checksum(&image[offset], length) == 0,
+				"%s: area at %u checksum", label, (unsigned)offset);
+	}
+
+	size_t offset = image[5] * 8;
+	unsigned records = 0;
+	while (offset + 5 <= image.size()) {
+		const size_t length = image[offset + 2];
+		CHECK(FRUImage::checksum(&image[offset], 5) == 0, "%s: record %u header checksum", label, records);
+		CHECK(offset + 5 + length <= image.size(), "%s: record %u overruns the image", label, records);
+		if (offset + 5 + length > image.size())
+			return;
+		CHECK(FRUImage::checksum(&image[offset + 5], length) == image[offset + 3], "%s: record %u data checksum", label, records);
+		records++;
+		offset += 5 + length;
+		if (image[offset - 5 - length + 1] & 0x80)
+			break;
+	}
+	CHECK(offset == image.size(), "%s: end of list at %u of %u bytes", label, (unsigned)offset, (unsigned)image.size());
+}
+
+int main() {
+	for (size_t guid_count = 0; guid_count <= 3; ++guid_count) {
+		std::vector< std::vector<uint8_t> > guids;
+		for (size_t g = 0; g < guid_count; ++g) {
+			std::vector<uint8_t> guid(16);
+			for (size_t i = 0; i < guid.size(); ++i)
+				guid[i] = 0x10 * g + i;
+			guids.push_back(guid);
+		}
+
+		for (size_t link_count = 0; link_count <= 150; ++link_count) {
+			std::vector< std::vector<uint8_t> > links;
+			for (size_t l = 0; l < link_count; ++l)
+				links.push_back({static_cast<uint8_t>(l), static_cast<uint8_t>(l >> 8), 0x01, static_cast<uint8_t>(guid_count ? 0xF0 + l % guid_count : 0x01)});
+
+			char label[32];
+			snprintf(label, sizeof(label), "%u GUIDs, %u links", (unsigned)guid_count, (unsigned)link_count);
+
+			const std::vector<uint8_t> expected = oldImage(guids, links);
+			const std::vector<uint8_t> built = newImage(guids, links);
+			CHECK(built == expected, "%s: images differ (%u and %u bytes)", label, (unsigned)built.size(), (unsigned)expected.size());
+			checkStructure(built, label);
+		}
+	}
+
+	bool threw = false;
+	try {
+		FRUImage().boardArea().field(std::string(64, 'x'));
+	}
+	catch (std::domain_error &e) {
+		threw = true;
+	}
+	CHECK(threw, "a 64 byte field was accepted");
+
+	printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? 1 : 0;
+}
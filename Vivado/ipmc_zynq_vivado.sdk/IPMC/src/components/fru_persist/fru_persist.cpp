@@ -0,0 +1,221 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fru_persist.h"
+#include <string.h>
+#include <libs/printf.h>
+#include <crc32/crc32.h>
+
+/*
+ * Allocation layout, multibyte fields little endian:
+ *
+ *   "FRUP", format version, 3 reserved bytes, length of the FRU Data (32 bit),
+ *   CRC-32 of the FRU Data (32 bit), then the FRU Data itself.
+ */
+static const uint8_t FRUP_MAGIC[4] = { 'F', 'R', 'U', 'P' };
+static const uint8_t FRUP_VERSION = 1;
+static const size_t FRUP_HEADER_SIZE = 16;
+
+static inline uint32_t get32(const std::vector<uint8_t> &data, size_t offset) {
+	return data[offset] | (data[offset+1] << 8) | (data[offset+2] << 16) | (static_cast<uint32_t>(data[offset+3]) << 24);
+}
+
+static inline void put32(std::vector<uint8_t> &data, size_t offset, uint32_t value) {
+	for (int i = 0; i < 4; ++i)
+		data[offset+i] = (value >> (8*i)) & 0xff;
+}
+
+FRUPersistence::FRUPersistence(PersistentStorage &storage, uint16_t allocation, std::vector<uint8_t> &data, SemaphoreHandle_t data_mutex, LogTree &log) :
+	allocation(storage, allocation), data(data), data_mutex(data_mutex), log(log), task(nullptr),
+	loaded(false), stored_valid(false), stored_digest(0), stored_length(0),
+	pending(false), seen_digest(0), seen_length(0), changed_at(0),
+	writes("fru_persist.writes"), bytes_written("fru_persist.bytes_written"), skipped("fru_persist.skipped"),
+	edits("fru_persist.edits"), corrupt("fru_persist.corrupt") {
+	configASSERT(this->data_mutex);
+	this->task = runTask("fru_persist", TASK_PRIORITY_BACKGROUND, [this]() -> void { this->run(); });
+}
+
+FRUPersistence::~FRUPersistence() {
+	vTaskDelete(this->task);
+}
+
+void FRUPersistence::load(bool reinit) {
+	MutexGuard<false> lock(this->data_mutex, true);
+
+	const std::vector<uint8_t> stored = this->allocation.getData();
+	std::vector<uint8_t> payload;
+	this->stored_valid = false;
+
+	if (stored.size() >= FRUP_HEADER_SIZE && memcmp(stored.data(), FRUP_MAGIC, sizeof(FRUP_MAGIC)) == 0) {
+		const size_t length = get32(stored, 8);
+		const uint32_t digest = get32(stored, 12);
+		if (stored[4] != FRUP_VERSION) {
+			this->log.log(stdsprintf("Stored FRU Data is in unknown format version %hhu, ignoring it.", stored[4]), LogTree::LOG_WARNING);
+		}
+		else if (FRUP_HEADER_SIZE + length != stored.size() || crc32(stored.data() + FRUP_HEADER_SIZE, length) != digest) {
+			this->log.log("Stored FRU Data fails its digest, ignoring it.", LogTree::LOG_ERROR);
+			this->corrupt.increment();
+		}
+		else {
+			payload.assign(stored.begin() + FRUP_HEADER_SIZE, stored.end());
+			this->stored_valid = true;
+			this->stored_digest = digest;
+			this->stored_length = length;
+		}
+	}
+	else if (stored.size()) {
+		this->log.log("Stored FRU Data is in the unchecked legacy format, loading as is.", LogTree::LOG_NOTICE);
+		payload = stored;
+	}
+
+	// If not reinitializing, and there's an area to read, replace ours, else write.
+	if (payload.size() && !reinit)
+		this->data = payload;
+
+	this->loaded = true;
+	this->flushLocked();
+}
+
+void FRUPersistence::markDirty() {
+	xTaskNotifyGive(this->task);
+}
+
+bool FRUPersistence::flush() {
+	MutexGuard<false> lock(this->data_mutex, true);
+	return this->flushLocked();
+}
+
+//! Write the FRU Data if the stored copy differs, called with the data mutex held.
+bool FRUPersistence::flushLocked() {
+	const uint32_t digest = crc32(this->data.data(), this->data.size());
+	this->pending = false;
+
+	if (this->stored_valid && digest == this->stored_digest && this->data.size() == this->stored_length) {
+		this->skipped.increment();
+		return false;
+	}
+
+	std::vector<uint8_t> image(FRUP_HEADER_SIZE, 0);
+	memcpy(image.data(), FRUP_MAGIC, sizeof(FRUP_MAGIC));
+	image[4] = FRUP_VERSION;
+	put32(image, 8, this->data.size());
+	put32(image, 12, digest);
+	image.insert(image.end(), this->data.begin(), this->data.end());
+
+	this->allocation.setData(image);
+	this->stored_valid = true;
+	this->stored_digest = digest;
+	this->stored_length = this->data.size();
+
+	this->writes.increment();
+	this->bytes_written.increment(image.size());
+	this->log.log(stdsprintf("Stored %u bytes of FRU Data.", this->data.size()), LogTree::LOG_INFO);
+	return true;
+}
+
+/**
+ * Poll the FRU Data for changes and flush it once it has been stable for
+ * SETTLE_MS.  Only the RAM copy is hashed, the allocation is never read back.
+ */
+void FRUPersistence::run() {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(this->pending ? SETTLE_MS / 4 : POLL_MS));
+
+		MutexGuard<false> lock(this->data_mutex, true);
+		if (!this->loaded)
+			continue; // The stored digest isn't known yet.
+
+		const uint32_t digest = crc32(this->data.data(), this->data.size());
+		const size_t length = this->data.size();
+		if (this->stored_valid && digest == this->stored_digest && length == this->stored_length) {
+			this->pending = false; // Edited back to what is stored.
+			continue;
+		}
+
+		if (!this->pending || digest != this->seen_digest || length != this->seen_length) {
+			// A new edit, (re)start the settle window.
+			this->pending = true;
+			this->seen_digest = digest;
+			this->seen_length = length;
+			this->changed_at = xTaskGetTickCount();
+			this->edits.increment();
+			continue;
+		}
+
+		if (xTaskGetTickCount() - this->changed_at >= pdMS_TO_TICKS(SETTLE_MS))
+			this->flushLocked();
+	}
+}
+
+/// A console command to show the persistence state.
+class FRUPersistence::Status : public CommandParser::Command {
+public:
+	Status(FRUPersistence &persist) : persist(persist) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the stored FRU Data digest, whether the FRU Data has unsaved edits,\n"
+				"and the write counters.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		MutexGuard<false> lock(this->persist.data_mutex, true);
+		std::string out;
+		if (this->persist.stored_valid)
+			out += stdsprintf("Stored: %u bytes, CRC-32 %08lx\n", this->persist.stored_length, this->persist.stored_digest);
+		else
+			out += "Stored: nothing valid\n";
+		out += stdsprintf("Current: %u bytes, CRC-32 %08lx, %s\n", this->persist.data.size(),
+				crc32(this->persist.data.data(), this->persist.data.size()), this->persist.pending ? "dirty, waiting to settle" : "clean");
+		out += stdsprintf("Writes: %llu (%llu bytes), skipped: %llu, edits seen: %llu, corrupt images: %llu\n",
+				this->persist.writes.get(), this->persist.bytes_written.get(), this->persist.skipped.get(),
+				this->persist.edits.get(), this->persist.corrupt.get());
+		console->write(out);
+	}
+
+private:
+	FRUPersistence &persist;
+};
+
+/// A console command to write pending FRU Data now.
+class FRUPersistence::Flush : public CommandParser::Command {
+public:
+	Flush(FRUPersistence &persist) : persist(persist) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Write the FRU Data now if it differs from the stored copy, without waiting\n"
+				"for it to settle.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		console->write(this->persist.flush() ? "FRU Data written.\n" : "FRU Data already up to date.\n");
+	}
+
+private:
+	FRUPersistence &persist;
+};
+
+void FRUPersistence::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<FRUPersistence::Status>(*this));
+	parser.registerCommand(prefix + "flush", std::make_shared<FRUPersistence::Flush>(*this));
+}
+
+void FRUPersistence::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "flush", nullptr);
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_FRU_PERSIST_FRU_PERSIST_H_
+#define SRC_COMPONENTS_FRU_PERSIST_FRU_PERSIST_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <services/persistentstorage/persistent_storage.h>
+
+/**
+ * FRU Data persistence with dirty tracking and deferred, coalesced writes.
+ *
+ * The allocation holds a small header with the length and CRC-32 digest of
+ * the FRU Data, followed by the data itself.  The digest of what is stored is
+ * kept in RAM once read, so whether the FRU Data is dirty is decided by
+ * hashing the RAM copy alone, without reading the allocation back.
+ *
+ * A background task polls the FRU Data for changes.  Once it is dirty, the
+ * write is held back until the data has been stable for SETTLE_MS, so a
+ * burst of Write FRU Data commands from the shelf manager ends up as a single
+ * write.  Writers that know they changed the data can call markDirty() to
+ * start that window right away instead of at the next poll.
+ *
+ * Allocations still holding raw FRU Data, from before this format, are
+ * loaded as they are and migrated by the first flush.
+ */
+class FRUPersistence final : public ConsoleCommandSupport {
+public:
+	static const uint32_t POLL_MS = 1000;	///< FRU Data change polling period.
+	static const uint32_t SETTLE_MS = 3000;	///< Time dirty data must be stable before it is written.
+
+	/**
+	 * @param storage The persistent storage holding the FRU Data.
+	 * @param allocation The allocation ID within storage.
+	 * @param data The FRU Data.
+	 * @param data_mutex The mutex protecting data, already created.
+	 * @param log Log target.
+	 */
+	FRUPersistence(PersistentStorage &storage, uint16_t allocation, std::vector<uint8_t> &data, SemaphoreHandle_t data_mutex, LogTree &log);
+	virtual ~FRUPersistence();
+
+	/**
+	 * Read the stored FRU Data and bring the allocation up to date.
+	 *
+	 * @param reinit If false, valid stored FRU Data replaces the current data,
+	 *               else the current data is kept and overwrites the stored one.
+	 * @note The data mutex must not be held by the caller.
+	 */
+	void load(bool reinit);
+
+	//! Notify that the FRU Data was edited, starting the settle window now.
+	void markDirty();
+
+	/**
+	 * Write the FRU Data now if it differs from the stored one.
+	 * @return true if the allocation was written.
+	 * @note The data mutex must not be held by the caller.
+	 */
+	bool flush();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	VariablePersistentAllocation allocation;	///< The backing allocation.
+	std::vector<uint8_t> &data;					///< The FRU Data.
+	SemaphoreHandle_t data_mutex;				///< Protects data and all state below.
+	LogTree &log;								///< Log target.
+	TaskHandle_t task;							///< Change polling task.
+
+	bool loaded;								///< load() has run, the stored digest is known.
+	bool stored_valid;							///< The allocation holds FRU Data in the current format.
+	uint32_t stored_digest;						///< CRC-32 of the stored FRU Data.
+	size_t stored_length;						///< Length of the stored FRU Data.
+	bool pending;								///< The FRU Data is dirty and waiting to settle.
+	uint32_t seen_digest;						///< CRC-32 of the FRU Data when last polled.
+	size_t seen_length;							///< Length of the FRU Data when last polled.
+	TickType_t changed_at;						///< When the FRU Data last changed while pending.
+
+	StatCounter writes;							///< Allocation writes.
+	StatCounter bytes_written;					///< Bytes handed to the allocation.
+	StatCounter skipped;						///< Flushes skipped, data already stored.
+	StatCounter edits;							///< Distinct FRU Data changes seen, coalesced into writes.
+	StatCounter corrupt;						///< Stored images that failed their digest.
+
+	bool flushLocked();
+	void run();
+
+	class Status;	///< Console command to show the persistence state.
+	class Flush;	///< Console command to write pending FRU Data now.
+};
+
+#endif /* SRC_COMPONENTS_FRU_PERSIST_FRU_PERSIST_H_ */
@@ -0,0 +1,235 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hardfault_capture.h"
+#include <string.h>
+#include <libs/printf.h>
+#include <payload_manager.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_event_dispatcher/sensor_event_dispatcher.h>
+#include <sensor_lut/sensor_lut.h>
+#include "ipmc.h"
+
+HardFaultCapture::HardFaultCapture(uint16_t proc_device_id, uint16_t zone_device_id, SensorEventDispatcher *dispatcher,
+		HiResTimer &timer, LogTree &log, uint32_t poll_us) :
+	dispatcher(dispatcher), timer(timer), log(log), handle(-1), task(nullptr),
+	last_hardfaults(0), captures(0) {
+	if (XST_SUCCESS != IPMI_Sensor_Proc_Initialize(&this->proc, proc_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize IPMI_Sensor_Proc(%hu)", proc_device_id));
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->zones, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	// Faults already present at boot are not news.
+	this->last_hardfaults = Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&this->zones);
+
+	this->task = runTask("hardfault_cap", TASK_PRIORITY_SERVICE, [this]() -> void { this->run(); });
+
+	if (this->dispatcher)
+		this->dispatcher->addIrqHook(HardFaultCapture::_IrqHook, this);
+	if (poll_us) {
+		this->handle = this->timer.addPeriodic(poll_us, HardFaultCapture::_TimerCallback, this);
+		if (this->handle < 0)
+			throw std::runtime_error("No free HiResTimer slot for the hard fault poll");
+	}
+}
+
+HardFaultCapture::~HardFaultCapture() {
+	if (this->dispatcher)
+		this->dispatcher->removeIrqHook(HardFaultCapture::_IrqHook, this);
+	this->timer.removePeriodic(this->handle);
+	vTaskDelete(this->task);
+	vSemaphoreDelete(this->mutex);
+}
+
+void HardFaultCapture::setSink(Sink sink) {
+	MutexGuard<false> lock(this->mutex, true);
+	this->sink = sink;
+}
+
+std::vector<HardFaultCapture::Snapshot> HardFaultCapture::getHistory() {
+	MutexGuard<false> lock(this->mutex, true);
+	return this->history;
+}
+
+/**
+ * Snapshot the hard fault context if a hard fault was raised, runs in
+ * interrupt context.
+ */
+void HardFaultCapture::capture(Source source, uint32_t irq_status, uint64_t time) {
+	const uint64_t start = HiResTimer::now();
+
+	const u64 hardfaults = Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&this->zones);
+	const u64 raised = hardfaults & ~this->last_hardfaults;
+	this->last_hardfaults = hardfaults;
+	if (!raised)
+		return;
+
+	Snapshot *snapshot = this->ring.reserve();
+	if (snapshot) {
+		snapshot->time = time;
+		snapshot->hardfaults = hardfaults;
+		snapshot->raised = raised;
+		snapshot->irq_status = irq_status;
+		snapshot->source = source;
+
+		memset(snapshot->readings, 0, sizeof(snapshot->readings));
+		memset(snapshot->thresholds, 0, sizeof(snapshot->thresholds));
+		for (u32 ch = 0; ch < this->proc.sensor_ch_cnt && ch < MAX_CHANNELS; ++ch)
+			IPMI_Sensor_Proc_Get_Sensor_Reading(&this->proc, ch, &snapshot->readings[ch], &snapshot->thresholds[ch]);
+
+		memset(snapshot->zones, 0, sizeof(snapshot->zones));
+		for (u32 mz = 0; mz < this->zones.mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz)
+			snapshot->zones[mz] = Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, mz);
+
+		snapshot->capture_counts = HiResTimer::now() - start;
+		this->ring.commit();
+		this->captures++;
+	}
+
+	// Wake the task even when full, so it reports the drop.
+	vTaskNotifyGiveFromISR(this->task, nullptr);
+}
+
+void HardFaultCapture::_IrqHook(uint32_t status, uint64_t irq_time, void *ref) {
+	reinterpret_cast<HardFaultCapture*>(ref)->capture(SOURCE_SENSOR_IRQ, status, irq_time);
+}
+
+bool HardFaultCapture::_TimerCallback(void *p) {
+	reinterpret_cast<HardFaultCapture*>(p)->capture(SOURCE_POLL, 0, HiResTimer::now());
+	return true;
+}
+
+void HardFaultCapture::run() {
+	uint32_t dropped_reported = 0;
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		while (const Snapshot *queued = this->ring.front()) {
+			const Snapshot snapshot = *queued;
+			this->ring.pop();
+
+			const uint64_t cost_us = HiResTimer::countsToUs(snapshot.capture_counts);
+			this->log.log(this->format(snapshot), LogTree::LOG_ERROR);
+			if (cost_us > BUDGET_US)
+				this->log.log(stdsprintf("Hard fault capture took %llu us, over its %lu us budget.", cost_us, BUDGET_US), LogTree::LOG_WARNING);
+
+			MutexGuard<false> lock(this->mutex, true);
+			this->capture_cost.add(cost_us);
+			this->history.push_back(snapshot);
+			if (this->history.size() > HISTORY)
+				this->history.erase(this->history.begin());
+			Sink sink = this->sink;
+			lock.release();
+
+			if (sink)
+				sink(snapshot);
+		}
+
+		const uint32_t dropped = this->ring.getDropped();
+		if (dropped != dropped_reported) {
+			this->log.log(stdsprintf("%lu hard fault snapshots lost, the ring was full.", dropped - dropped_reported), LogTree::LOG_WARNING);
+			dropped_reported = dropped;
+		}
+	}
+}
+
+//! Describe a snapshot, naming channels after their PayloadManager ADC sensors.
+std::string HardFaultCapture::format(const Snapshot &snapshot) const {
+	static const char *zone_states[] = {"off", "turning off", "turning on", "on"};
+	static const char *thresholds[] = {"LNC", "LCR", "LNR", "UNC", "UCR", "UNR"};
+
+	std::string out = stdsprintf("Hard fault 0x%016llx raised (vector 0x%016llx), captured from the %s in %llu us.",
+			snapshot.raised, snapshot.hardfaults, snapshot.source == SOURCE_POLL ? "poll" : "sensor IRQ",
+			HiResTimer::countsToUs(snapshot.capture_counts));
+
+	for (size_t ch = 0; ch < MAX_CHANNELS; ++ch) {
+		if (!((snapshot.raised >> ch) & 1) && !snapshot.thresholds[ch])
+			continue;
+
+		// Readings are reported as the shelf sees them when the sensor has conversion tables.
+		std::shared_ptr<const SensorLUT::Table> table;
+		if (sensor_luts)
+			table = sensor_luts->getBySensorProcessorId(ch);
+
+		std::string name = stdsprintf("ch%u", ch);
+		std::string value = stdsprintf("0x%04hx", snapshot.readings[ch]);
+		for (auto &it : PayloadManager::adc_sensors) {
+			if (it.second.sensor_processor_id == (int)ch) {
+				name = it.first;
+				if (table) {
+					const uint8_t raw = table->toIPMI(snapshot.readings[ch]);
+					value = stdsprintf("%.3f (0x%02hhx)", table->getLinear().toFloat(raw), raw);
+				} else {
+					value = stdsprintf("%.3f", it.second.adc.rawToFloat(snapshot.readings[ch]));
+				}
+				break;
+			}
+		}
+
+		out += stdsprintf(" %s%s=%s", ((snapshot.raised >> ch) & 1) ? "*" : "", name.c_str(), value.c_str());
+		for (size_t bit = 0; bit < 6; ++bit)
+			if (snapshot.thresholds[ch] & (1 << bit))
+				out += std::string(" ") + thresholds[bit];
+		out += ",";
+	}
+
+	out += " zones:";
+	for (u32 mz = 0; mz < this->zones.mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz)
+		out += stdsprintf(" %lu=%s", mz, zone_states[snapshot.zones[mz] & 3]);
+	return out;
+}
+
+/// A console command to show hard fault captures.
+class HardFaultCapture::Status : public CommandParser::Command {
+public:
+	Status(HardFaultCapture &capture) : capture(capture) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the hard fault snapshots taken in interrupt context and the capture cost.\n"
+				"Channels that raised the hard fault are marked with *.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string out = stdsprintf("Captures: %lu, lost: %lu, queued: %u\n",
+				this->capture.captures, this->capture.ring.getDropped(), this->capture.ring.size());
+
+		MutexGuard<false> lock(this->capture.mutex, true);
+		out += this->capture.capture_cost.format("Capture cost");
+		std::vector<Snapshot> history = this->capture.history;
+		lock.release();
+
+		for (const Snapshot &snapshot : history)
+			out += stdsprintf("[%llu us] ", HiResTimer::countsToUs(snapshot.time)) + this->capture.format(snapshot) + "\n";
+		console->write(out);
+	}
+
+private:
+	HardFaultCapture &capture;
+};
+
+void HardFaultCapture::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<HardFaultCapture::Status>(*this));
+}
+
+void HardFaultCapture::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+}
@@ -0,0 +1,129 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_HARDFAULT_CAPTURE_HARDFAULT_CAPTURE_H_
+#define SRC_COMPONENTS_HARDFAULT_CAPTURE_HARDFAULT_CAPTURE_H_
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <spsc_ring/spsc_ring.h>
+#include <latency_histogram/latency_histogram.h>
+#include "ipmi_sensor_proc.h"
+#include "mgmt_zone_ctrl.h"
+
+class HiResTimer;
+class SensorEventDispatcher;
+
+/**
+ * Snapshots the hard fault context in interrupt context, at the instant a
+ * management zone hard fault is raised.
+ *
+ * The zone controller IRQ is not routed to the GIC, so captures are triggered
+ * from the sensor processor interrupt, through the SensorEventDispatcher IRQ
+ * hook, and from a HiResTimer poll of the hard fault status for faults that
+ * don't raise a sensor event.  Only newly raised hard fault bits trigger.
+ *
+ * A snapshot holds the 64-bit hard fault vector, every sensor processor
+ * reading with its threshold status and the zone states.  It is written in
+ * place into a lock-free SPSC ring, a task drains the ring into the log and
+ * the optional sink.  The cost of each capture is measured, and is bounded
+ * by a fixed number of register reads.
+ */
+class HardFaultCapture final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_CHANNELS = 16;	///< Sensor processor channels captured.
+	static const size_t RING_SIZE = 16;		///< Snapshots in flight, power of two.
+	static const size_t HISTORY = 8;		///< Drained snapshots kept for the console.
+	static const uint32_t BUDGET_US = 20;	///< Capture cost that is reported as excessive.
+
+	//! What triggered a capture.
+	enum Source : uint8_t {
+		SOURCE_SENSOR_IRQ	= 0,	///< Sensor processor interrupt.
+		SOURCE_POLL			= 1,	///< Hard fault status poll.
+	};
+
+	//! The hard fault context at the instant of capture.
+	struct Snapshot {
+		uint64_t time;								///< Global timer count of the trigger.
+		uint64_t hardfaults;						///< Hard fault vector.
+		uint64_t raised;							///< Newly raised hard fault bits.
+		uint32_t irq_status;						///< Sensor processor IRQ bitmap, 0 when polled.
+		uint32_t capture_counts;					///< Capture cost, in global timer counts.
+		uint16_t readings[MAX_CHANNELS];			///< Raw sensor processor readings.
+		uint8_t thresholds[MAX_CHANNELS];			///< Threshold comparison status per channel.
+		uint8_t zones[MGMT_ZONE_CTRL_SHADOW_MAX_MZ];	///< MZ_pwr per zone.
+		uint8_t source;								///< Source.
+	};
+
+	//! Receives every drained snapshot, from task context.
+	typedef std::function<void(const Snapshot &snapshot)> Sink;
+
+	/**
+	 * @param proc_device_id The IPMI_Sensor_Proc device ID.
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID.
+	 * @param dispatcher The dispatcher owning the sensor processor interrupt, may be nullptr.
+	 * @param timer The timer driving the poll.
+	 * @param log The log tree to report to.
+	 * @param poll_us Hard fault status poll period, 0 to rely on the sensor IRQ alone.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	HardFaultCapture(uint16_t proc_device_id, uint16_t zone_device_id, SensorEventDispatcher *dispatcher,
+			HiResTimer &timer, LogTree &log, uint32_t poll_us = 250);
+	virtual ~HardFaultCapture();
+
+	//! Forward drained snapshots, e.g. into the FaultLog.
+	void setSink(Sink sink);
+
+	//! The last drained snapshots, oldest first.
+	std::vector<Snapshot> getHistory();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	IPMI_Sensor_Proc proc;				///< Low level sensor processor driver, read only.
+	Mgmt_Zone_Ctrl zones;				///< Low level zone controller driver, read only.
+	SensorEventDispatcher *dispatcher;	///< Sensor processor interrupt owner.
+	HiResTimer &timer;					///< Poll timer.
+	LogTree &log;						///< Log target.
+	int handle;							///< Poll timer registration.
+	TaskHandle_t task;					///< Draining task.
+	SemaphoreHandle_t mutex;			///< Protects history, sink and the cost histogram.
+
+	SPSCRing<Snapshot, RING_SIZE> ring;	///< Snapshots from interrupt context.
+	u64 last_hardfaults;				///< Hard fault vector at the last check, ISR owned.
+	volatile uint32_t captures;			///< Snapshots taken.
+
+	std::vector<Snapshot> history;		///< Last drained snapshots.
+	Sink sink;							///< Snapshot consumer, may be empty.
+	LatencyHistogram capture_cost;		///< Capture cost, in us.
+
+	void capture(Source source, uint32_t irq_status, uint64_t time);
+	static void _IrqHook(uint32_t status, uint64_t irq_time, void *ref);
+	static bool _TimerCallback(void *p);
+	void run();
+	std::string format(const Snapshot &snapshot) const;
+
+	class Status;	///< Console command to show captures.
+};
+
+#endif /* SRC_COMPONENTS_HARDFAULT_CAPTURE_HARDFAULT_CAPTURE_H_ */
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hires_timer.h"
+#include <libs/printf.h>
+#include "xparameters.h"
+#include "xscugic.h"
+#include "xil_io.h"
+
+// Global timer registers not covered by xtime_l.h
+#define GTIMER_INT_STATUS_OFFSET	0x0CU
+#define GTIMER_COMPARATOR_LOWER_OFFSET	0x10U
+#define GTIMER_COMPARATOR_UPPER_OFFSET	0x14U
+
+#define GTIMER_CONTROL_TIMER_ENABLE	0x01U
+#define GTIMER_CONTROL_COMP_ENABLE	0x02U
+#define GTIMER_CONTROL_IRQ_ENABLE	0x04U
+#define GTIMER_INT_STATUS_EVENT		0x01U
+
+extern XScuGic xInterruptController;
+
+HiResTimer::HiResTimer(uint8_t priority) :
+	overruns(0), interrupts(0) {
+	for (size_t i = 0; i < MAX_CLIENTS; ++i)
+		this->clients[i].callback = nullptr;
+
+	// Never reset the counter, only the comparator belongs to us.
+	u32 ctrl = Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET) | GTIMER_CONTROL_TIMER_ENABLE;
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET, ctrl & ~(GTIMER_CONTROL_COMP_ENABLE | GTIMER_CONTROL_IRQ_ENABLE));
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_INT_STATUS_OFFSET, GTIMER_INT_STATUS_EVENT);
+
+	if (XST_SUCCESS != XScuGic_Connect(&xInterruptController, XPAR_GLOBAL_TMR_INTR, HiResTimer::_InterruptHandler, (void*)this))
+		throw std::runtime_error("Unable to connect the global timer interrupt");
+	XScuGic_SetPriorityTriggerType(&xInterruptController, XPAR_GLOBAL_TMR_INTR, priority, 0x3);
+	XScuGic_Enable(&xInterruptController, XPAR_GLOBAL_TMR_INTR);
+}
+
+HiResTimer::~HiResTimer() {
+	XScuGic_Disable(&xInterruptController, XPAR_GLOBAL_TMR_INTR);
+	XScuGic_Disconnect(&xInterruptController, XPAR_GLOBAL_TMR_INTR);
+
+	u32 ctrl = Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET);
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET, ctrl & ~(GTIMER_CONTROL_COMP_ENABLE | GTIMER_CONTROL_IRQ_ENABLE));
+}
+
+int HiResTimer::addPeriodic(uint32_t period_us, Callback callback, void *ref) {
+	if (!callback || !period_us)
+		throw std::domain_error("A periodic client needs a callback and a non-zero period");
+
+	CriticalGuard critical(true);
+	return this->addClient(period_us, callback, ref);
+}
+
+int HiResTimer::addPeriodicFromISR(uint32_t period_us, Callback callback, void *ref) {
+	if (!callback || !period_us)
+		return -1;
+	return this->addClient(period_us, callback, ref);
+}
+
+/**
+ * Claim a client slot and reprogram the comparator.
+ * @note Must be called with the comparator interrupt masked.
+ */
+int HiResTimer::addClient(uint32_t period_us, Callback callback, void *ref) {
+	for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+		Client &client = this->clients[i];
+		if (client.callback)
+			continue;
+
+		client.ref = ref;
+		client.period = HiResTimer::usToCounts(period_us);
+		if (!client.period)
+			client.period = 1;
+		client.next = HiResTimer::now() + client.period;
+		client.callback = callback;
+		this->program();
+		return i;
+	}
+	return -1;
+}
+
+void HiResTimer::removePeriodic(int handle) {
+	if (handle < 0 || (size_t)handle >= MAX_CLIENTS)
+		return;
+
+	CriticalGuard critical(true);
+	this->clients[handle].callback = nullptr;
+	this->program();
+}
+
+/**
+ * Program the comparator with the earliest pending deadline.
+ *
+ * @note Must be called with the comparator interrupt masked.
+ * @return The deadline programmed, or UINT64_MAX if there are no clients.
+ */
+uint64_t HiResTimer::program() {
+	uint64_t earliest = UINT64_MAX;
+	for (size_t i = 0; i < MAX_CLIENTS; ++i)
+		if (this->clients[i].callback && this->clients[i].next < earliest)
+			earliest = this->clients[i].next;
+
+	// The comparator must be disabled while it is being updated.
+	u32 ctrl = Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET) & ~(GTIMER_CONTROL_COMP_ENABLE | GTIMER_CONTROL_IRQ_ENABLE);
+	Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET, ctrl);
+
+	if (earliest != UINT64_MAX) {
+		Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_COMPARATOR_LOWER_OFFSET, (u32)earliest);
+		Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_COMPARATOR_UPPER_OFFSET, (u32)(earliest >> 32));
+		Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_CONTROL_OFFSET, ctrl | GTIMER_CONTROL_COMP_ENABLE | GTIMER_CONTROL_IRQ_ENABLE);
+	}
+	return earliest;
+}
+
+void HiResTimer::_InterruptHandler(void *p) {
+	reinterpret_cast<HiResTimer*>(p)->interruptHandler();
+}
+
+void HiResTimer::interruptHandler() {
+	this->interrupts++;
+
+	while (true) {
+		Xil_Out32(GLOBAL_TMR_BASEADDR + GTIMER_INT_STATUS_OFFSET, GTIMER_INT_STATUS_EVENT);
+
+		uint64_t now = HiResTimer::now();
+		for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+			Client &client = this->clients[i];
+			if (!client.callback || client.next > now)
+				continue;
+
+			if (!client.callback(client.ref)) {
+				client.callback = nullptr;
+				continue;
+			}
+			client.next += client.period;
+
+			if (client.next <= now) {
+				// We fell behind, skip the missed periods rather than bursting.
+				uint64_t missed = (now - client.next) / client.period + 1;
+				client.next += missed * client.period;
+				this->overruns += missed;
+			}
+		}
+
+		/* If the earliest deadline already passed while we were busy the
+		 * comparator may not fire for it, so service it here instead.
+		 */
+		if (this->program() > HiResTimer::now())
+			break;
+	}
+}
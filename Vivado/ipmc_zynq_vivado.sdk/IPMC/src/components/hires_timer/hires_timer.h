@@ -0,0 +1,117 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_HIRES_TIMER_HIRES_TIMER_H_
+#define SRC_COMPONENTS_HIRES_TIMER_HIRES_TIMER_H_
+
+#include <stdint.h>
+#include <core.h>
+#include "xtime_l.h"
+
+/**
+ * Microsecond resolution periodic callbacks driven by the Cortex-A9 global
+ * timer comparator.
+ *
+ * The FreeRTOS tick (1 kHz, SCU private timer) is too coarse for pacing ADC
+ * captures or timing power sequencing, so this multiplexes the otherwise
+ * unused global timer comparator between a small fixed number of periodic
+ * clients.  The global timer counter itself is never modified, so XTime and
+ * every timestamp derived from it keep working.
+ *
+ * Callbacks run in interrupt context and must be short and ISR safe.  A
+ * callback may unregister itself from the ISR by returning false.
+ */
+class HiResTimer final {
+public:
+	//! Maximum number of simultaneously registered periodic clients.
+	static const size_t MAX_CLIENTS = 8;
+
+	//! An ISR context periodic callback, returning false unregisters it.
+	typedef bool (*Callback)(void *ref);
+
+	/**
+	 * Set up the global timer comparator and connect its interrupt.
+	 * @param priority GIC priority of the comparator interrupt.
+	 */
+	HiResTimer(uint8_t priority = 0xA0);
+	virtual ~HiResTimer();
+
+	/**
+	 * Register a periodic callback.
+	 *
+	 * @param period_us Callback period in microseconds.
+	 * @param callback The ISR context callback.
+	 * @param ref An opaque pointer passed to the callback.
+	 * @return A handle for removePeriodic(), or -1 if no slots are free.
+	 */
+	int addPeriodic(uint32_t period_us, Callback callback, void *ref);
+
+	/**
+	 * Register a periodic callback from interrupt context.
+	 *
+	 * @note The calling interrupt must not be preempted by the timer interrupt,
+	 *       i.e. it must be of the same or higher priority.
+	 * @see addPeriodic()
+	 * @return A handle for removePeriodic(), or -1 if no slots are free or the arguments are invalid.
+	 */
+	int addPeriodicFromISR(uint32_t period_us, Callback callback, void *ref);
+
+	/**
+	 * Unregister a periodic callback.
+	 * @param handle The handle returned by addPeriodic().
+	 */
+	void removePeriodic(int handle);
+
+	//! Number of periods that were skipped because a client fell behind.
+	inline uint32_t getOverruns() const { return this->overruns; };
+
+	//! Number of comparator interrupts serviced.
+	inline uint32_t getInterrupts() const { return this->interrupts; };
+
+	//! The current global timer count.
+	static inline uint64_t now() {
+		XTime t;
+		XTime_GetTime(&t);
+		return t;
+	};
+
+	//! Convert microseconds to global timer counts.
+	static inline uint64_t usToCounts(uint64_t us) { return us * COUNTS_PER_SECOND / 1000000; };
+
+	//! Convert global timer counts to microseconds.
+	static inline uint64_t countsToUs(uint64_t counts) { return counts * 1000000 / COUNTS_PER_SECOND; };
+
+private:
+	//! A registered periodic client.
+	struct Client {
+		Callback callback;	///< The callback, nullptr if the slot is free.
+		void *ref;			///< Opaque callback argument.
+		uint64_t period;	///< Period in global timer counts.
+		uint64_t next;		///< Next deadline in global timer counts.
+	};
+
+	Client clients[MAX_CLIENTS];	///< Client slots.
+	volatile uint32_t overruns;		///< Missed periods, updated from ISR context.
+	volatile uint32_t interrupts;	///< Comparator interrupts serviced.
+
+	int addClient(uint32_t period_us, Callback callback, void *ref);	///< Claim a client slot.
+	uint64_t program();				///< Program the comparator for the earliest deadline.
+	static void _InterruptHandler(void *p);
+	void interruptHandler();
+};
+
+#endif /* SRC_COMPONENTS_HIRES_TIMER_HIRES_TIMER_H_ */
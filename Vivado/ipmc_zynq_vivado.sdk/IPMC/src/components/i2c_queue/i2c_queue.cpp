@@ -0,0 +1,349 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "i2c_queue.h"
+#include <algorithm>
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+#include "xiic.h"
+#include "xiic_l.h"
+#include "xscugic.h"
+
+extern XScuGic xInterruptController;
+
+I2CQueue::I2CQueue(uint16_t device_id, uint32_t intr_id, size_t depth, uint8_t priority) :
+	intr_id(intr_id), depth(depth), head(0), count(0),
+	active(nullptr), tx_pos(0), tx_total(0), started(0), isr_woken(pdFALSE),
+	succeeded(0), naks(0), arb_lost(0), aborted(0), rejected(0),
+	bytes(0), busy(0), busy_since(0), latency_max(0), latency_sum(0), wire_max(0) {
+	XIic_Config *config = XIic_LookupConfig(device_id);
+	if (!config)
+		throw std::runtime_error(stdsprintf("Unable to find XIic(%hu)", device_id));
+	this->base = config->BaseAddress;
+
+	this->queue = new Transaction*[depth];
+	this->sync_mutex = xSemaphoreCreateMutex();
+	this->sync_done = xSemaphoreCreateBinary();
+	configASSERT(this->sync_mutex && this->sync_done);
+
+	this->reset();
+	this->busy_since = HiResTimer::now();
+
+	if (XST_SUCCESS != XScuGic_Connect(&xInterruptController, intr_id, I2CQueue::_InterruptHandler, (void*)this))
+		throw std::runtime_error("Unable to connect the IIC interrupt");
+	XScuGic_SetPriorityTriggerType(&xInterruptController, intr_id, priority, 0x1);
+	XScuGic_Enable(&xInterruptController, intr_id);
+	XIic_IntrGlobalEnable(this->base);
+}
+
+I2CQueue::~I2CQueue() {
+	XIic_IntrGlobalDisable(this->base);
+	XScuGic_Disable(&xInterruptController, this->intr_id);
+	XScuGic_Disconnect(&xInterruptController, this->intr_id);
+	vSemaphoreDelete(this->sync_mutex);
+	vSemaphoreDelete(this->sync_done);
+	delete[] this->queue;
+}
+
+/**
+ * Reset the controller to an idle, enabled master with all interrupts masked.
+ * @note Call with interrupts masked or from the ISR.
+ */
+void I2CQueue::reset() {
+	XIic_WriteReg(this->base, XIIC_RESETR_OFFSET, XIIC_RESET_MASK);
+	XIic_WriteReg(this->base, XIIC_IIER_OFFSET, 0);
+	XIic_WriteReg(this->base, XIIC_IISR_OFFSET, XIic_ReadReg(this->base, XIIC_IISR_OFFSET));
+	XIic_WriteReg(this->base, XIIC_RFD_REG_OFFSET, FIFO_DEPTH - 1);
+	XIic_WriteReg(this->base, XIIC_CR_REG_OFFSET, XIIC_CR_ENABLE_DEVICE_MASK | XIIC_CR_TX_FIFO_RESET_MASK);
+	XIic_WriteReg(this->base, XIIC_CR_REG_OFFSET, XIIC_CR_ENABLE_DEVICE_MASK);
+}
+
+bool I2CQueue::submit(Transaction &transaction) {
+	if ((transaction.wlen == 0 && transaction.rlen == 0) || transaction.rlen > 255 ||
+		(transaction.wlen && !transaction.wbuf) || (transaction.rlen && !transaction.rbuf)) {
+		CriticalGuard critical(true); // The ISR and other submitters update the counters too.
+		this->rejected++;
+		return false;
+	}
+
+	transaction.status = STATUS_PENDING;
+	transaction.received = 0;
+	transaction.submitted = HiResTimer::now();
+	transaction.completed = 0;
+
+	CriticalGuard critical(true);
+	if (!this->active) {
+		this->start(transaction);
+		return true;
+	}
+	if (this->count == this->depth) {
+		this->rejected++;
+		return false;
+	}
+	this->queue[(this->head + this->count++) % this->depth] = &transaction;
+	return true;
+}
+
+void I2CQueue::abort(Transaction &transaction) {
+	CriticalGuard critical(true);
+	if (transaction.status != STATUS_PENDING)
+		return;
+
+	if (this->active == &transaction) {
+		this->reset();
+		this->finish(STATUS_ABORTED);
+		return;
+	}
+
+	// Still queued, close the gap in the ring.
+	for (size_t i = 0; i < this->count; ++i) {
+		if (this->queue[(this->head + i) % this->depth] != &transaction)
+			continue;
+		for (size_t j = i; j + 1 < this->count; ++j)
+			this->queue[(this->head + j) % this->depth] = this->queue[(this->head + j + 1) % this->depth];
+		this->count--;
+		break;
+	}
+	transaction.status = STATUS_ABORTED;
+	transaction.completed = HiResTimer::now();
+	this->aborted++;
+	if (transaction.callback)
+		transaction.callback(transaction, transaction.ref);
+}
+
+/**
+ * The dynamic mode TX FIFO word at a position of the active transaction.
+ *
+ * The stream is [START|addr W] data... for the write phase, then
+ * [START|addr R] [STOP|rlen] for the read phase.  The last write byte
+ * carries the STOP if there is no read phase.
+ */
+uint16_t I2CQueue::txWord(size_t pos) const {
+	const Transaction &t = *this->active;
+	if (t.wlen) {
+		if (pos == 0)
+			return XIIC_TX_DYN_START_MASK | (t.addr << 1);
+		if (pos <= t.wlen)
+			return t.wbuf[pos - 1] | ((pos == t.wlen && !t.rlen) ? XIIC_TX_DYN_STOP_MASK : 0);
+		pos -= t.wlen + 1;
+	}
+	if (pos == 0)
+		return XIIC_TX_DYN_START_MASK | (t.addr << 1) | 1;
+	return XIIC_TX_DYN_STOP_MASK | t.rlen;
+}
+
+/**
+ * Put the next transaction on the bus.
+ * @note Call with interrupts masked or from the ISR.
+ */
+void I2CQueue::start(Transaction &transaction) {
+	this->active = &transaction;
+	this->tx_pos = 0;
+	this->tx_total = (transaction.wlen ? transaction.wlen + 1 : 0) + (transaction.rlen ? 2 : 0);
+	this->started = HiResTimer::now();
+
+	u32 rfd = std::min<size_t>(transaction.rlen, FIFO_DEPTH);
+	XIic_WriteReg(this->base, XIIC_RFD_REG_OFFSET, rfd ? rfd - 1 : 0);
+	XIic_WriteReg(this->base, XIIC_IISR_OFFSET, XIic_ReadReg(this->base, XIIC_IISR_OFFSET));
+	this->fill();
+
+	u32 ier = XIIC_INTR_ARB_LOST_MASK | XIIC_INTR_TX_ERROR_MASK | XIIC_INTR_BNB_MASK;
+	if (transaction.rlen)
+		ier |= XIIC_INTR_RX_FULL_MASK;
+	if (this->tx_pos < this->tx_total)
+		ier |= XIIC_INTR_TX_HALF_MASK;
+	XIic_WriteReg(this->base, XIIC_IIER_OFFSET, ier);
+}
+
+void I2CQueue::fill() {
+	while (this->tx_pos < this->tx_total && !(XIic_ReadReg(this->base, XIIC_SR_REG_OFFSET) & XIIC_SR_TX_FIFO_FULL_MASK))
+		XIic_WriteReg(this->base, XIIC_DTR_REG_OFFSET, this->txWord(this->tx_pos++));
+
+	if (this->tx_pos == this->tx_total)
+		XIic_WriteReg(this->base, XIIC_IIER_OFFSET, XIic_ReadReg(this->base, XIIC_IIER_OFFSET) & ~XIIC_INTR_TX_HALF_MASK);
+}
+
+void I2CQueue::drain() {
+	Transaction &t = *this->active;
+	while (t.received < t.rlen && !(XIic_ReadReg(this->base, XIIC_SR_REG_OFFSET) & XIIC_SR_RX_FIFO_EMPTY_MASK))
+		t.rbuf[t.received++] = XIic_ReadReg(this->base, XIIC_DRR_REG_OFFSET);
+
+	size_t remaining = t.rlen - t.received;
+	if (remaining)
+		XIic_WriteReg(this->base, XIIC_RFD_REG_OFFSET, std::min(remaining, FIFO_DEPTH) - 1);
+	else
+		XIic_WriteReg(this->base, XIIC_IIER_OFFSET, XIic_ReadReg(this->base, XIIC_IIER_OFFSET) & ~XIIC_INTR_RX_FULL_MASK);
+}
+
+/**
+ * Complete the active transaction and chain the next one.
+ * @note Call with interrupts masked or from the ISR.
+ */
+void I2CQueue::finish(Status status) {
+	Transaction &t = *this->active;
+	const uint64_t now = HiResTimer::now();
+
+	XIic_WriteReg(this->base, XIIC_IIER_OFFSET, 0);
+	if (status != STATUS_OK && status != STATUS_ABORTED)
+		this->reset();
+
+	t.completed = now;
+	const uint64_t wire = now - this->started;
+	const uint64_t latency = now - t.submitted;
+	this->busy += wire;
+	this->wire_max = std::max(this->wire_max, wire);
+	this->latency_max = std::max(this->latency_max, latency);
+	this->latency_sum += latency;
+	switch (status) {
+	case STATUS_OK: this->succeeded++; this->bytes += t.wlen + t.rlen; break;
+	case STATUS_NAK: this->naks++; break;
+	case STATUS_ARB_LOST: this->arb_lost++; break;
+	default: this->aborted++; break;
+	}
+
+	this->active = nullptr;
+	if (this->count) {
+		Transaction &next = *this->queue[this->head];
+		this->head = (this->head + 1) % this->depth;
+		this->count--;
+		this->start(next);
+	}
+
+	// Publish the status last, a blocking caller may reuse the descriptor right away.
+	t.status = status;
+	if (t.callback)
+		t.callback(t, t.ref);
+}
+
+void I2CQueue::_InterruptHandler(void *p) {
+	reinterpret_cast<I2CQueue*>(p)->interruptHandler();
+}
+
+void I2CQueue::interruptHandler() {
+	// The status register toggles on write, so clear exactly what we are about to handle, first.
+	u32 isr = XIic_ReadReg(this->base, XIIC_IISR_OFFSET) & XIic_ReadReg(this->base, XIIC_IIER_OFFSET);
+	XIic_WriteReg(this->base, XIIC_IISR_OFFSET, isr);
+
+	if (!this->active) {
+		XIic_WriteReg(this->base, XIIC_IIER_OFFSET, 0);
+	} else if (isr & XIIC_INTR_ARB_LOST_MASK) {
+		this->finish(STATUS_ARB_LOST);
+	} else if (isr & XIIC_INTR_TX_ERROR_MASK) {
+		this->finish(STATUS_NAK);
+	} else {
+		if (isr & XIIC_INTR_RX_FULL_MASK)
+			this->drain();
+		if (isr & XIIC_INTR_TX_HALF_MASK)
+			this->fill();
+
+		// Bus not busy also fires before the start condition went out, only trust it once everything moved.
+		if (isr & XIIC_INTR_BNB_MASK) {
+			u32 sr = XIic_ReadReg(this->base, XIIC_SR_REG_OFFSET);
+			if (this->tx_pos == this->tx_total && this->active->received == this->active->rlen &&
+				(sr & XIIC_SR_TX_FIFO_EMPTY_MASK) && !(sr & XIIC_SR_BUS_BUSY_MASK))
+				this->finish(STATUS_OK);
+		}
+	}
+
+	BaseType_t woken = this->isr_woken;
+	this->isr_woken = pdFALSE;
+	portYIELD_FROM_ISR(woken);
+}
+
+void I2CQueue::_SyncCallback(Transaction &transaction, void *ref) {
+	I2CQueue &self = *reinterpret_cast<I2CQueue*>(ref);
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR(self.sync_done, &woken);
+	self.requestYield(woken);
+}
+
+I2CQueue::Status I2CQueue::transfer(uint8_t addr, const uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen, TickType_t timeout) {
+	MutexGuard<false> lock(this->sync_mutex, true);
+
+	Transaction t;
+	t.addr = addr;
+	t.wbuf = wbuf;
+	t.wlen = wlen;
+	t.rbuf = rbuf;
+	t.rlen = rlen;
+	t.callback = I2CQueue::_SyncCallback;
+	t.ref = this;
+	if (!this->submit(t))
+		return STATUS_ABORTED;
+
+	if (!xSemaphoreTake(this->sync_done, timeout)) {
+		this->abort(t);
+		xSemaphoreTake(this->sync_done, 0); // The abort gave it, don't leave it for the next caller.
+	}
+	return t.status;
+}
+
+size_t I2CQueue::read(uint8_t addr, uint8_t *buf, size_t len, TickType_t timeout) {
+	if (len > 255)
+		throw std::domain_error("I2C reads are limited to 255 bytes");
+	return (this->transfer(addr, nullptr, 0, buf, len, timeout) == STATUS_OK) ? len : 0;
+}
+
+size_t I2CQueue::write(uint8_t addr, const uint8_t *buf, size_t len, TickType_t timeout) {
+	return (this->transfer(addr, buf, len, nullptr, 0, timeout) == STATUS_OK) ? len : 0;
+}
+
+/// A console command to report bus statistics.
+class I2CQueue::Stats : public CommandParser::Command {
+public:
+	Stats(I2CQueue &queue) : queue(queue) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show bus utilization since the last call, transaction latency and error counts.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		I2CQueue &q = this->queue;
+
+		CriticalGuard critical(true);
+		const uint64_t now = HiResTimer::now();
+		const uint64_t window = now - q.busy_since;
+		const uint64_t busy = q.busy;
+		q.busy = 0;
+		q.busy_since = now;
+		const uint32_t total = q.succeeded + q.naks + q.arb_lost + q.aborted;
+		const uint64_t latency_sum = q.latency_sum, latency_max = q.latency_max, wire_max = q.wire_max;
+		const size_t queued = q.count;
+		critical.release();
+
+		std::string out = stdsprintf("Utilization %llu%% over the last %llu ms, %u queued\n",
+				window ? busy * 100 / window : 0, HiResTimer::countsToUs(window) / 1000, queued);
+		out += stdsprintf("%lu ok, %lu NAK, %lu arbitration lost, %lu aborted, %lu rejected, %llu bytes\n",
+				q.succeeded, q.naks, q.arb_lost, q.aborted, q.rejected, q.bytes);
+		if (total)
+			out += stdsprintf("Latency avg %llu us, max %llu us, longest on the bus %llu us\n",
+					HiResTimer::countsToUs(latency_sum / total), HiResTimer::countsToUs(latency_max), HiResTimer::countsToUs(wire_max));
+		console->write(out);
+	}
+
+private:
+	I2CQueue &queue;
+};
+
+void I2CQueue::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "stats", std::make_shared<I2CQueue::Stats>(*this));
+}
+
+void I2CQueue::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "stats", nullptr);
+}
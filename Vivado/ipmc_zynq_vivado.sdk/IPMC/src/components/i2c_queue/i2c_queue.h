@@ -0,0 +1,180 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_I2C_QUEUE_I2C_QUEUE_H_
+#define SRC_COMPONENTS_I2C_QUEUE_I2C_QUEUE_H_
+
+#include <stdint.h>
+#include "xil_types.h"
+#include <string>
+#include <core.h>
+#include <drivers/generics/i2c.h>
+#include <services/console/command_parser.h>
+
+/**
+ * Interrupt driven, queued transaction engine for the AXI IIC controller.
+ *
+ * Callers submit Transaction descriptors: a write, a read, or a write then
+ * read with a repeated start.  The controller runs in dynamic mode and the
+ * ISR feeds and drains its FIFOs, completes the transaction and starts the
+ * next queued one, so a busy bus never wakes a task between transactions.
+ *
+ * The blocking I2C interface is implemented on top of the queue, so existing
+ * drivers (e.g. PIM400) share the bus with asynchronous users.
+ */
+class I2CQueue final : public I2C, public ConsoleCommandSupport {
+public:
+	//! Transaction outcome.
+	enum Status {
+		STATUS_PENDING,		///< Queued or on the bus.
+		STATUS_OK,			///< Completed.
+		STATUS_NAK,			///< The address or a written byte was not acknowledged.
+		STATUS_ARB_LOST,	///< Arbitration was lost to another master.
+		STATUS_ABORTED,		///< Aborted by abort(), usually after a timeout.
+	};
+
+	struct Transaction;
+
+	/**
+	 * Completion callback.
+	 *
+	 * This runs in interrupt context, or in the aborting task with interrupts
+	 * masked, so only FromISR APIs may be used.  A context switch can be
+	 * requested through requestYield().
+	 */
+	typedef void (*Callback)(Transaction &transaction, void *ref);
+
+	//! A transaction descriptor, owned by the caller until completion.
+	struct Transaction {
+		uint8_t addr;					///< 7 bit slave address.
+		const uint8_t *wbuf;			///< Data to write first, may be nullptr.
+		size_t wlen;					///< Bytes to write.
+		uint8_t *rbuf;					///< Read buffer, may be nullptr.
+		size_t rlen;					///< Bytes to read after a (repeated) start, at most 255.
+		Callback callback;				///< Completion callback, may be nullptr.
+		void *ref;						///< Opaque callback argument.
+
+		volatile Status status;			///< Outcome, STATUS_PENDING until completion.
+		size_t received;				///< Bytes read so far.
+		uint64_t submitted;				///< Global timer count at submit().
+		uint64_t completed;				///< Global timer count at completion.
+	};
+
+	/**
+	 * Take over an AXI IIC controller.
+	 *
+	 * @param device_id The XIic device ID.
+	 * @param intr_id The controller interrupt ID.
+	 * @param depth Maximum number of queued transactions.
+	 * @param priority GIC priority of the interrupt.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	I2CQueue(uint16_t device_id, uint32_t intr_id, size_t depth = 32, uint8_t priority = 0xA0);
+	virtual ~I2CQueue();
+
+	/**
+	 * Queue a transaction.
+	 *
+	 * @param transaction The descriptor, which must stay valid until completion.
+	 * @return false if the queue is full or the descriptor invalid.
+	 */
+	bool submit(Transaction &transaction);
+
+	/**
+	 * Abort a transaction that did not complete yet.
+	 *
+	 * A transaction on the bus is cut short by resetting the controller.
+	 * The callback runs with STATUS_ABORTED.
+	 *
+	 * @param transaction The descriptor.
+	 */
+	void abort(Transaction &transaction);
+
+	/**
+	 * Run a transaction and wait for it.
+	 *
+	 * @param addr 7 bit slave address.
+	 * @param wbuf Data to write first, may be nullptr.
+	 * @param wlen Bytes to write.
+	 * @param rbuf Read buffer, may be nullptr.
+	 * @param rlen Bytes to read, at most 255.
+	 * @param timeout Ticks to wait before aborting.
+	 * @return The transaction outcome.
+	 */
+	Status transfer(uint8_t addr, const uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen, TickType_t timeout = portMAX_DELAY);
+
+	//! Ask for a context switch on return from the interrupt, for use in callbacks.
+	inline void requestYield(BaseType_t woken) { if (woken) this->isr_woken = pdTRUE; };
+
+	// From base class I2C:
+	/**
+	 * Read from a slave.
+	 * @throw std::domain_error if len is above 255, the controller's read count limit.
+	 */
+	virtual size_t read(uint8_t addr, uint8_t *buf, size_t len, TickType_t timeout = portMAX_DELAY);
+	virtual size_t write(uint8_t addr, const uint8_t *buf, size_t len, TickType_t timeout = portMAX_DELAY);
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	static const size_t FIFO_DEPTH = 16;	///< AXI IIC FIFO depth.
+
+	UINTPTR base;						///< Controller base address.
+	uint32_t intr_id;					///< Controller interrupt ID.
+
+	Transaction **queue;				///< Ring of queued transactions.
+	size_t depth;						///< Ring size.
+	size_t head;						///< Next transaction to start.
+	size_t count;						///< Transactions in the ring.
+
+	Transaction *active;				///< Transaction on the bus, nullptr if idle.
+	size_t tx_pos;						///< Next dynamic mode TX FIFO word of the active transaction.
+	size_t tx_total;					///< TX FIFO words of the active transaction.
+	uint64_t started;					///< Global timer count the active transaction started.
+	BaseType_t isr_woken;				///< A callback woke a higher priority task.
+
+	SemaphoreHandle_t sync_mutex;		///< Serializes blocking callers.
+	SemaphoreHandle_t sync_done;		///< Given when a blocking transaction completes.
+
+	uint32_t succeeded;					///< Transactions completed successfully.
+	uint32_t naks;						///< Transactions not acknowledged.
+	uint32_t arb_lost;					///< Transactions that lost arbitration.
+	uint32_t aborted;					///< Transactions aborted.
+	uint32_t rejected;					///< Transactions rejected by submit().
+	uint64_t bytes;						///< Payload bytes transferred.
+	uint64_t busy;						///< Time spent on the bus, in global timer counts.
+	uint64_t busy_since;				///< Start of the utilization window.
+	uint64_t latency_max;				///< Longest submit to completion latency.
+	uint64_t latency_sum;				///< Sum of submit to completion latencies.
+	uint64_t wire_max;					///< Longest time on the bus.
+
+	void reset();
+	void start(Transaction &transaction);
+	uint16_t txWord(size_t pos) const;
+	void fill();
+	void drain();
+	void finish(Status status);
+	static void _InterruptHandler(void *p);
+	void interruptHandler();
+	static void _SyncCallback(Transaction &transaction, void *ref);
+
+	class Stats;	///< Console command to report bus statistics.
+};
+
+#endif /* SRC_COMPONENTS_I2C_QUEUE_I2C_QUEUE_H_ */
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "latency_histogram.h"
+#include <string.h>
+#include <algorithm>
+#include <libs/printf.h>
+
+void LatencyHistogram::add(uint64_t us) {
+	size_t bucket = us ? 64 - __builtin_clzll(us) : 0;
+	if (bucket >= BUCKETS)
+		bucket = BUCKETS - 1;
+
+	this->buckets[bucket]++;
+	this->count++;
+	this->sum += us;
+	if (us < this->min)
+		this->min = us;
+	if (us > this->max)
+		this->max = us;
+}
+
+void LatencyHistogram::reset() {
+	memset(this->buckets, 0, sizeof(this->buckets));
+	this->count = 0;
+	this->min = UINT64_MAX;
+	this->max = 0;
+	this->sum = 0;
+}
+
+uint64_t LatencyHistogram::getPercentile(unsigned int percent) const {
+	if (!this->count)
+		return 0;
+
+	const uint64_t target = ((uint64_t)this->count * percent + 99) / 100;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKETS - 1; ++i) {
+		seen += this->buckets[i];
+		if (seen >= target)
+			return std::min<uint64_t>(UINT64_C(1) << i, this->max);
+	}
+	return this->max;
+}
+
+std::string LatencyHistogram::format(const std::string &name) const {
+	std::string out = stdsprintf("%s: %lu samples, min %llu us, mean %llu us, p99 <%llu us, max %llu us\n",
+			name.c_str(), this->count, this->getMin(), this->getMean(), this->getPercentile(99), this->max);
+
+	for (size_t i = 0; i < BUCKETS; ++i) {
+		if (!this->buckets[i])
+			continue;
+		const uint64_t low = i ? UINT64_C(1) << (i - 1) : 0;
+		if (i == BUCKETS - 1)
+			out += stdsprintf("  >= %8llu us: %lu\n", low, this->buckets[i]);
+		else
+			out += stdsprintf("  %8llu-%-8llu us: %lu\n", low, UINT64_C(1) << i, this->buckets[i]);
+	}
+	return out;
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_LATENCY_HISTOGRAM_LATENCY_HISTOGRAM_H_
+#define SRC_COMPONENTS_LATENCY_HISTOGRAM_LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * A log2 bucketed histogram of microsecond latencies.
+ *
+ * Bucket 0 counts latencies below 1us, bucket n counts [2^(n-1), 2^n) us and
+ * the last bucket everything above.  Adding is constant time with no
+ * allocation.  Not thread safe, the owner provides locking.
+ */
+class LatencyHistogram final {
+public:
+	static const size_t BUCKETS = 24;	///< Up to ~4s, the last bucket is open ended.
+
+	LatencyHistogram() { this->reset(); };
+
+	//! Add a latency.
+	void add(uint64_t us);
+
+	//! Clear all statistics.
+	void reset();
+
+	inline uint32_t getCount() const { return this->count; };	///< Latencies added.
+	inline uint64_t getMin() const { return this->count ? this->min : 0; };	///< Smallest latency.
+	inline uint64_t getMax() const { return this->max; };	///< Largest latency.
+	inline uint64_t getMean() const { return this->count ? this->sum / this->count : 0; };	///< Average latency.
+
+	//! Upper bound of the bucket holding the given percentile, in us.
+	uint64_t getPercentile(unsigned int percent) const;
+
+	//! A one line summary followed by the non-empty buckets.
+	std::string format(const std::string &name) const;
+
+private:
+	uint32_t buckets[BUCKETS];	///< Latency counts.
+	uint32_t count;				///< Latencies added.
+	uint64_t min;				///< Smallest latency.
+	uint64_t max;				///< Largest latency.
+	uint64_t sum;				///< Sum of all latencies, for the mean.
+};
+
+#endif /* SRC_COMPONENTS_LATENCY_HISTOGRAM_LATENCY_HISTOGRAM_H_ */
@@ -0,0 +1,382 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "payload_power_ctrl.h"
+
+// Only include driver if payload power controller is detected in the BSP.
+#if XSDK_INDEXING || __has_include("pyld_pwr_ctrl.h")
+
+#include <algorithm>
+#include <libs/printf.h>
+
+#define PPC_EVENT_IDLE		(1 << 0)	///< No group in flight or queued.
+#define PPC_EVENT_FAILED	(1 << 1)	///< A group timed out since the last sequence() from idle.
+
+PayloadPowerController::PayloadPowerController(uint16_t device_id, LogTree &log) :
+	log(log), task(nullptr), busy(false), pe_status(0), pg_status(0) {
+	if (XST_SUCCESS != Pyld_Pwr_Ctrl_Initialize(&this->ctrl, device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Pyld_Pwr_Ctrl(%hu)", device_id));
+
+	this->pe_count = std::min<uint32_t>(Pyld_Pwr_Ctrl_Get_PE_Cnt(&this->ctrl), MAX_PINS);
+	this->pg_count = std::min<uint32_t>(Pyld_Pwr_Ctrl_Get_PG_Cnt(&this->ctrl), MAX_PINS);
+
+	// Start from whatever the gateware or a previous boot configured.
+	for (uint32_t pin = 0; pin < MAX_PINS; ++pin) {
+		PinConfig &config = this->pins[pin];
+		config = {0, 0, false, false, -1};
+		if (pin >= this->pe_count)
+			continue;
+
+		PE_cfg_t cfg;
+		Pyld_Pwr_Ctrl_Get_Pin_Cfg(&this->ctrl, pin, &cfg);
+		config.group = cfg.group;
+		config.sequence_ms = cfg.seq_tmr;
+		config.sw_pd_en = cfg.sw_pd_en;
+		config.ext_pd_en = cfg.ext_pd_en;
+	}
+	this->pe_status = Pyld_Pwr_Ctrl_Get_PE_Status(&this->ctrl);
+	this->pg_status = Pyld_Pwr_Ctrl_Get_PG_Status(&this->ctrl);
+
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+	this->events = xEventGroupCreate();
+	configASSERT(this->events);
+	xEventGroupSetBits(this->events, PPC_EVENT_IDLE);
+
+	this->task = runTask("pyld_pwr", TASK_PRIORITY_SERVICE, [this]() -> void { this->run(); });
+}
+
+PayloadPowerController::~PayloadPowerController() {
+	vTaskDelete(this->task);
+	vEventGroupDelete(this->events);
+	vSemaphoreDelete(this->mutex);
+}
+
+void PayloadPowerController::setPinConfig(uint32_t pin, const PinConfig &config) {
+	if (pin >= this->pe_count)
+		throw std::domain_error(stdsprintf("Power enable %lu is out of range", pin));
+	if (config.group > MAX_GROUP)
+		throw std::domain_error(stdsprintf("Group %hhu is out of range", config.group));
+	if (config.sequence_ms > MAX_SEQUENCE_MS)
+		throw std::domain_error(stdsprintf("Sequence timer of %lu ms exceeds %lu ms", config.sequence_ms, MAX_SEQUENCE_MS));
+	if (config.power_good >= (int)this->pg_count)
+		throw std::domain_error(stdsprintf("Power good %hhd is out of range", config.power_good));
+
+	PE_cfg_t cfg;
+	cfg.group = config.group;
+	cfg.seq_tmr = config.sequence_ms;
+	cfg.sw_pd_en = config.sw_pd_en;
+	cfg.ext_pd_en = config.ext_pd_en;
+
+	MutexGuard<false> lock(this->mutex, true);
+	Pyld_Pwr_Ctrl_Set_Pin_Cfg(&this->ctrl, pin, cfg);
+	this->pins[pin] = config;
+}
+
+PayloadPowerController::PinConfig PayloadPowerController::getPinConfig(uint32_t pin) {
+	if (pin >= this->pe_count)
+		throw std::domain_error(stdsprintf("Power enable %lu is out of range", pin));
+
+	MutexGuard<false> lock(this->mutex, true);
+	return this->pins[pin];
+}
+
+std::vector<uint8_t> PayloadPowerController::getConfiguredGroups() {
+	MutexGuard<false> lock(this->mutex, true);
+	std::vector<uint8_t> groups;
+	for (uint8_t group = 1; group <= MAX_GROUP; ++group) {
+		for (uint32_t pin = 0; pin < this->pe_count; ++pin) {
+			if (this->pins[pin].group == group) {
+				groups.push_back(group);
+				break;
+			}
+		}
+	}
+	return groups;
+}
+
+void PayloadPowerController::sequence(const std::vector<uint8_t> &groups, Direction direction, uint32_t margin_ms) {
+	for (uint8_t group : groups)
+		if (group < 1 || group > MAX_GROUP)
+			throw std::domain_error(stdsprintf("Group %hhu is out of range", group));
+	if (groups.empty())
+		return;
+
+	MutexGuard<false> lock(this->mutex, true);
+	if (!this->busy && this->queue.empty())
+		xEventGroupClearBits(this->events, PPC_EVENT_IDLE | PPC_EVENT_FAILED);
+	else
+		xEventGroupClearBits(this->events, PPC_EVENT_IDLE);
+	for (uint8_t group : groups)
+		this->queue.push_back({group, direction, margin_ms});
+	lock.release();
+
+	xTaskNotifyGive(this->task);
+}
+
+bool PayloadPowerController::waitIdle(TickType_t timeout) {
+	EventBits_t bits = xEventGroupWaitBits(this->events, PPC_EVENT_IDLE, pdFALSE, pdTRUE, timeout);
+	return (bits & PPC_EVENT_IDLE) && !(bits & PPC_EVENT_FAILED);
+}
+
+void PayloadPowerController::setCallback(Callback callback) {
+	MutexGuard<false> lock(this->mutex, true);
+	this->callback = callback;
+}
+
+void PayloadPowerController::releasePowerDown() {
+	Pyld_Pwr_Ctrl_PDown_Release(&this->ctrl);
+	xTaskNotifyGive(this->task);
+}
+
+uint32_t PayloadPowerController::getPEStatus(bool fresh) {
+	if (fresh)
+		this->pe_status = Pyld_Pwr_Ctrl_Get_PE_Status(&this->ctrl);
+	return this->pe_status;
+}
+
+uint32_t PayloadPowerController::getPGStatus(bool fresh) {
+	if (fresh)
+		this->pg_status = Pyld_Pwr_Ctrl_Get_PG_Status(&this->ctrl);
+	return this->pg_status;
+}
+
+/**
+ * Kick the next queued group.
+ * @note Must be called with the mutex held and nothing in flight.
+ */
+void PayloadPowerController::kick() {
+	Active &active = this->active;
+	active.step = this->queue.front();
+	this->queue.pop_front();
+
+	uint32_t slowest = 0;
+	active.pe_mask = 0;
+	active.pg_mask = 0;
+	for (uint32_t pin = 0; pin < this->pe_count; ++pin) {
+		const PinConfig &config = this->pins[pin];
+		if (config.group != active.step.group)
+			continue;
+
+		active.pe_mask |= 1UL << pin;
+		if (active.step.direction == UP && config.power_good >= 0)
+			active.pg_mask |= 1UL << config.power_good;
+		slowest = std::max(slowest, config.sequence_ms);
+	}
+	active.timeout = pdMS_TO_TICKS(slowest + active.step.margin_ms);
+	active.start = xTaskGetTickCount();
+	this->busy = true;
+
+	if (active.step.direction == UP)
+		Pyld_Pwr_Ctrl_Init_PUp_Seq(&this->ctrl, active.step.group);
+	else
+		Pyld_Pwr_Ctrl_Init_PDown_Seq(&this->ctrl, active.step.group);
+}
+
+/**
+ * Refresh the status cache and check the group in flight.
+ * @note Must be called with the mutex held.
+ * @return true if the group in flight finished, successfully or not.
+ */
+bool PayloadPowerController::poll() {
+	this->pe_status = Pyld_Pwr_Ctrl_Get_PE_Status(&this->ctrl);
+	this->pg_status = Pyld_Pwr_Ctrl_Get_PG_Status(&this->ctrl);
+	if (!this->busy)
+		return false;
+
+	const Active &active = this->active;
+	const uint32_t target = active.step.direction == UP ? active.pe_mask : 0;
+	const bool done = (this->pe_status & active.pe_mask) == target
+			&& (this->pg_status & active.pg_mask) == active.pg_mask;
+	return done || xTaskGetTickCount() - active.start > active.timeout;
+}
+
+void PayloadPowerController::run() {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(this->busy ? BUSY_POLL_MS : IDLE_POLL_MS));
+
+		MutexGuard<false> lock(this->mutex, true);
+		bool finished = this->poll();
+		Completion completion;
+		if (finished) {
+			const Active &active = this->active;
+			const uint32_t target = active.step.direction == UP ? active.pe_mask : 0;
+			completion.group = active.step.group;
+			completion.direction = active.step.direction;
+			completion.success = (this->pe_status & active.pe_mask) == target
+					&& (this->pg_status & active.pg_mask) == active.pg_mask;
+			completion.elapsed_ms = (xTaskGetTickCount() - active.start) * portTICK_PERIOD_MS;
+			completion.pe_status = this->pe_status;
+			completion.pg_status = this->pg_status;
+			this->busy = false;
+
+			if (!completion.success) {
+				// Don't carry on with a sequence that depends on a missing rail.
+				this->queue.clear();
+				xEventGroupSetBits(this->events, PPC_EVENT_FAILED);
+			}
+		}
+
+		if (!this->busy) {
+			if (!this->queue.empty())
+				this->kick();
+			else
+				xEventGroupSetBits(this->events, PPC_EVENT_IDLE);
+		}
+		Callback callback = this->callback;
+		lock.release();
+
+		if (!finished)
+			continue;
+
+		if (completion.success)
+			this->log.log(stdsprintf("Group %hhu powered %s in %lu ms.", completion.group,
+					completion.direction == UP ? "up" : "down", completion.elapsed_ms), LogTree::LOG_INFO);
+		else
+			this->log.log(stdsprintf("Group %hhu failed to power %s within %lu ms (PE 0x%08lx, PG 0x%08lx), remaining groups aborted.",
+					completion.group, completion.direction == UP ? "up" : "down", completion.elapsed_ms,
+					completion.pe_status, completion.pg_status), LogTree::LOG_ERROR);
+
+		if (callback)
+			callback(completion);
+	}
+}
+
+/// A console command to show the power enable configuration and status.
+class PayloadPowerController::Status : public CommandParser::Command {
+public:
+	Status(PayloadPowerController &ctrl) : ctrl(ctrl) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the power enable pins, their groups, sequence timers and status.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		const uint32_t pe = this->ctrl.getPEStatus(true);
+		const uint32_t pg = this->ctrl.getPGStatus(true);
+
+		std::string out = stdsprintf("Core version 0x%08lx, PE 0x%08lx, PG 0x%08lx\n",
+				Pyld_Pwr_Ctrl_Get_Core_Ver(&this->ctrl.ctrl), pe, pg);
+		out += "PIN  GROUP  SEQ_MS  SW_PD  EXT_PD  PG  STATE\n";
+		for (uint32_t pin = 0; pin < this->ctrl.getPinCount(); ++pin) {
+			PinConfig config = this->ctrl.getPinConfig(pin);
+			std::string good = "-";
+			if (config.power_good >= 0)
+				good = stdsprintf("%hhd%s", config.power_good, (pg & (1UL << config.power_good)) ? "+" : "");
+			out += stdsprintf("%3lu  %5hhu  %6lu  %5s  %6s  %-3s %s\n", pin, config.group, config.sequence_ms,
+					config.sw_pd_en ? "yes" : "no", config.ext_pd_en ? "yes" : "no", good.c_str(),
+					(pe & (1UL << pin)) ? "ON" : "OFF");
+		}
+		console->write(out);
+	}
+
+private:
+	PayloadPowerController &ctrl;
+};
+
+/// A console command to sequence groups.
+class PayloadPowerController::Sequence : public CommandParser::Command {
+public:
+	Sequence(PayloadPowerController &ctrl) : ctrl(ctrl) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " up|down [$group ...]\n\n"
+				"Sequence the given groups in order, or all configured groups (ascending\n"
+				"for up, descending for down), and wait for completion.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string action;
+		if (!parameters.parseParameters(1, false, &action) || (action != "up" && action != "down")) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+		const Direction direction = action == "up" ? UP : DOWN;
+
+		std::vector<uint8_t> groups;
+		for (size_t i = 2; i < parameters.nargs(); ++i) {
+			uint8_t group;
+			if (!parameters.parseParameters(i, false, &group)) {
+				console->write("Invalid parameters, see help.\n");
+				return;
+			}
+			groups.push_back(group);
+		}
+		if (groups.empty()) {
+			groups = this->ctrl.getConfiguredGroups();
+			if (direction == DOWN)
+				std::reverse(groups.begin(), groups.end());
+		}
+
+		try {
+			this->ctrl.sequence(groups, direction);
+		} catch (std::exception &e) {
+			console->write(std::string(e.what()) + "\n");
+			return;
+		}
+
+		if (this->ctrl.waitIdle(pdMS_TO_TICKS(MAX_SEQUENCE_MS)))
+			console->write("Sequence complete.\n");
+		else
+			console->write("Sequence failed or timed out, see the log.\n");
+	}
+
+private:
+	PayloadPowerController &ctrl;
+};
+
+/// A console command to force or release the emergency power down.
+class PayloadPowerController::Force : public CommandParser::Command {
+public:
+	Force(PayloadPowerController &ctrl) : ctrl(ctrl) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " on|off\n\n"
+				"Force an immediate power down of every pin with SW_PD enabled, or release it.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string action;
+		if (!parameters.parseParameters(1, true, &action) || (action != "on" && action != "off")) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		if (action == "on")
+			this->ctrl.forcePowerDown();
+		else
+			this->ctrl.releasePowerDown();
+	}
+
+private:
+	PayloadPowerController &ctrl;
+};
+
+void PayloadPowerController::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<PayloadPowerController::Status>(*this));
+	parser.registerCommand(prefix + "sequence", std::make_shared<PayloadPowerController::Sequence>(*this));
+	parser.registerCommand(prefix + "force_off", std::make_shared<PayloadPowerController::Force>(*this));
+}
+
+void PayloadPowerController::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "sequence", nullptr);
+	parser.registerCommand(prefix + "force_off", nullptr);
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_PAYLOAD_POWER_CTRL_PAYLOAD_POWER_CTRL_H_
+#define SRC_COMPONENTS_PAYLOAD_POWER_CTRL_PAYLOAD_POWER_CTRL_H_
+
+// Only include driver if payload power controller is detected in the BSP.
+#if XSDK_INDEXING || __has_include("pyld_pwr_ctrl.h")
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <core.h>
+#include <event_groups.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include "pyld_pwr_ctrl.h"
+
+/**
+ * Group based power sequencing on top of the Pyld_Pwr_Ctrl IP.
+ *
+ * Every power enable pin belongs to one of seven groups and carries its own
+ * sequence timer, so the IP times the bring-up and tear-down of a group in
+ * hardware once the group is kicked.  This class chains groups into ordered
+ * sequences, caches the PE/PG status and reports sequence completion.
+ *
+ * The IP has no interrupt output, the status is cached by a service task that
+ * polls quickly while a sequence is in flight and slowly otherwise.  A group
+ * is complete once all of its enables reached the target state and, when
+ * powering up, the power good inputs mapped to them are asserted.
+ *
+ * forcePowerDown() is a single register write and may be used from
+ * interrupt context.
+ */
+class PayloadPowerController final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_PINS = 32;				///< Enables and power goods addressable by the status registers.
+	static const uint8_t MAX_GROUP = 7;				///< Groups are numbered 1 to MAX_GROUP, 0 is unassigned.
+	static const uint32_t MAX_SEQUENCE_MS = 85000;	///< Longest sequence timer the IP supports.
+	static const uint32_t BUSY_POLL_MS = 1;			///< Status poll period while sequencing.
+	static const uint32_t IDLE_POLL_MS = 100;		///< Status poll period otherwise.
+
+	//! Sequencing direction.
+	enum Direction {
+		UP,		///< Power up.
+		DOWN,	///< Power down.
+	};
+
+	//! Configuration of one power enable pin.
+	struct PinConfig {
+		uint8_t group;			///< Group, 0 if the pin isn't sequenced.
+		uint32_t sequence_ms;	///< Delay from the group kick to the pin changing.
+		bool sw_pd_en;			///< Follows forcePowerDown().
+		bool ext_pd_en;			///< Follows the PL emergency power down.
+		int8_t power_good;		///< Power good input confirming this enable, -1 if none.
+	};
+
+	//! Result of one group sequence, passed to the completion callback.
+	struct Completion {
+		uint8_t group;			///< Group sequenced.
+		Direction direction;	///< Direction sequenced.
+		bool success;			///< false if the group timed out.
+		uint32_t elapsed_ms;	///< Time from the kick to completion or timeout.
+		uint32_t pe_status;		///< Power enable status at completion.
+		uint32_t pg_status;		///< Power good status at completion.
+	};
+
+	//! Completion callback, runs in the controller task.
+	typedef std::function<void(const Completion &completion)> Callback;
+
+	/**
+	 * @param device_id The Pyld_Pwr_Ctrl device ID.
+	 * @param log The log tree to report to.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	PayloadPowerController(uint16_t device_id, LogTree &log);
+	virtual ~PayloadPowerController();
+
+	//! Number of power enable outputs.
+	inline uint32_t getPinCount() const { return this->pe_count; };
+	//! Number of power good inputs.
+	inline uint32_t getPowerGoodCount() const { return this->pg_count; };
+
+	/**
+	 * Configure a power enable pin.
+	 * @throw std::domain_error on an invalid pin, group, timer or power good.
+	 */
+	void setPinConfig(uint32_t pin, const PinConfig &config);
+	//! Read back a power enable pin configuration.
+	PinConfig getPinConfig(uint32_t pin);
+
+	//! Groups that have at least one pin, in ascending order.
+	std::vector<uint8_t> getConfiguredGroups();
+
+	/**
+	 * Queue an ordered sequence of groups.  Each group is kicked once the
+	 * previous one completed, a group timing out aborts the rest.
+	 *
+	 * @param groups Groups in sequencing order.
+	 * @param direction Direction to sequence.
+	 * @param margin_ms Time allowed past the slowest sequence timer of a group.
+	 * @throw std::domain_error on an invalid group.
+	 */
+	void sequence(const std::vector<uint8_t> &groups, Direction direction, uint32_t margin_ms = 100);
+
+	//! Sequence a single group.
+	inline void sequence(uint8_t group, Direction direction, uint32_t margin_ms = 100) {
+		this->sequence(std::vector<uint8_t>{group}, direction, margin_ms);
+	};
+
+	/**
+	 * Wait for all queued sequences to finish.
+	 * @param timeout Maximum time to wait.
+	 * @return true if idle, false on timeout or if a group failed.
+	 */
+	bool waitIdle(TickType_t timeout = portMAX_DELAY);
+
+	//! Set the completion callback, nullptr to clear.
+	void setCallback(Callback callback);
+
+	//! Immediately power down all pins with sw_pd_en, ISR safe.
+	inline void forcePowerDown() { Pyld_Pwr_Ctrl_PDown_Force(&this->ctrl); };
+	//! Release a forced power down.
+	void releasePowerDown();
+
+	/**
+	 * Power enable status.
+	 * @param fresh Read the IP rather than the cached status.
+	 */
+	uint32_t getPEStatus(bool fresh = false);
+
+	/**
+	 * Power good status.
+	 * @param fresh Read the IP rather than the cached status.
+	 */
+	uint32_t getPGStatus(bool fresh = false);
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! A queued group sequence.
+	struct Step {
+		uint8_t group;			///< Group to kick.
+		Direction direction;	///< Direction.
+		uint32_t margin_ms;		///< Allowed time past the slowest timer.
+	};
+
+	//! The group sequence in flight.
+	struct Active {
+		Step step;				///< What was kicked.
+		uint32_t pe_mask;		///< Enables in the group.
+		uint32_t pg_mask;		///< Power goods that must assert, UP only.
+		TickType_t start;		///< Kick time.
+		TickType_t timeout;		///< Ticks allowed from the kick.
+	};
+
+	Pyld_Pwr_Ctrl ctrl;					///< Low level driver instance.
+	LogTree &log;						///< Log target.
+	uint32_t pe_count;					///< Power enable outputs.
+	uint32_t pg_count;					///< Power good inputs.
+
+	SemaphoreHandle_t mutex;			///< Protects everything below.
+	EventGroupHandle_t events;			///< Idle and failure flags.
+	TaskHandle_t task;					///< Polling and sequencing task.
+	PinConfig pins[MAX_PINS];			///< Pin configuration, pins map to the IP readback.
+	std::deque<Step> queue;				///< Groups waiting to be kicked.
+	Active active;						///< Valid if busy.
+	bool busy;							///< A group is in flight.
+	Callback callback;					///< Completion callback.
+
+	volatile uint32_t pe_status;		///< Cached power enable status.
+	volatile uint32_t pg_status;		///< Cached power good status.
+
+	void run();
+	void kick();
+	bool poll();
+
+	class Status;	///< Console command to show the pins and status.
+	class Sequence;	///< Console command to sequence groups.
+	class Force;	///< Console command to force or release the power down.
+};
+
+#endif
+
+#endif /* SRC_COMPONENTS_PAYLOAD_POWER_CTRL_PAYLOAD_POWER_CTRL_H_ */
@@ -0,0 +1,333 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pg_monitor.h"
+#include <string.h>
+#include <algorithm>
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+
+PowerGoodMonitor::PowerGoodMonitor(uint16_t zone_device_id, HiResTimer &timer, LogTree &log, uint32_t period_us, uint32_t glitch_max_us) :
+	timer(timer), log(log), task(nullptr), handle(-1), period_us(period_us), glitch_max_us(glitch_max_us),
+	glitch_max(HiResTimer::usToCounts(glitch_max_us)), source_count(0), rail_count(0), head(0), pending_glitches(0) {
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->zones, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	memset(this->readers, 0, sizeof(this->readers));
+	memset(this->reader_refs, 0, sizeof(this->reader_refs));
+	memset(this->edges, 0, sizeof(this->edges));
+	this->addSource(PowerGoodMonitor::readEnables, this);
+	this->addSource(PowerGoodMonitor::readHardFaults, this);
+
+	this->task = runTask("pg_monitor", TASK_PRIORITY_BACKGROUND, [this]() -> void { this->run(); });
+
+	this->handle = this->timer.addPeriodic(period_us, PowerGoodMonitor::_TimerCallback, this);
+	if (this->handle < 0)
+		throw std::runtime_error("No free HiResTimer slot for the power good monitor");
+}
+
+PowerGoodMonitor::~PowerGoodMonitor() {
+	this->timer.removePeriodic(this->handle);
+	vTaskDelete(this->task);
+	vSemaphoreDelete(this->mutex);
+}
+
+size_t PowerGoodMonitor::addSource(Reader reader, void *ref) {
+	MutexGuard<false> lock(this->mutex, true);
+	const size_t source = this->source_count;
+	if (source >= MAX_SOURCES)
+		throw std::domain_error("No room left for another power good source");
+
+	this->readers[source] = reader;
+	this->reader_refs[source] = ref;
+	CriticalGuard critical(true);
+	this->source_count = source + 1;
+	return source;
+}
+
+size_t PowerGoodMonitor::addRail(const std::string &name, size_t source, uint8_t bit, bool active_high) {
+	MutexGuard<false> lock(this->mutex, true);
+	const size_t index = this->rail_count;
+	if (index >= MAX_RAILS)
+		throw std::domain_error("No room left for another power good rail");
+	if (source >= this->source_count || bit >= 32)
+		throw std::domain_error(stdsprintf("Invalid source %u bit %hhu for rail %s", source, bit, name.c_str()));
+
+	// The sampler only looks at rails below rail_count, fill this one in first.
+	Rail &rail = this->rails[index];
+	rail.name = name;
+	rail.source = source;
+	rail.bit = bit;
+	rail.active_high = active_high;
+	memset(&rail.stats, 0, sizeof(rail.stats));
+
+	CriticalGuard critical(true);
+	const bool set = (this->readers[source](this->reader_refs[source]) >> bit) & 1;
+	rail.stats.good = set == active_high;
+	this->rail_count = index + 1;
+	return index;
+}
+
+#ifdef PG_MONITOR_PYLD_PWR_CTRL
+size_t PowerGoodMonitor::addPowerControllerSource(uint16_t device_id) {
+	if (XST_SUCCESS != Pyld_Pwr_Ctrl_Initialize(&this->pwr_ctrl, device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Pyld_Pwr_Ctrl(%hu)", device_id));
+
+	const size_t source = this->addSource(PowerGoodMonitor::readPowerGoods, this);
+	const uint32_t pg_count = std::min<uint32_t>(Pyld_Pwr_Ctrl_Get_PG_Cnt(&this->pwr_ctrl), 32);
+	uint32_t pin;
+	for (pin = 0; pin < pg_count && this->rail_count < MAX_RAILS; ++pin)
+		this->addRail(stdsprintf("PG %lu", pin), source, pin);
+	if (pin < pg_count)
+		this->log.log(stdsprintf("No room left to monitor power goods %lu to %lu.", pin, pg_count - 1), LogTree::LOG_WARNING);
+	return source;
+}
+#endif
+
+PowerGoodMonitor::RailStats PowerGoodMonitor::getStats(size_t rail) {
+	if (rail >= this->rail_count)
+		throw std::domain_error(stdsprintf("Invalid power good rail %u", rail));
+
+	CriticalGuard critical(true);
+	return this->rails[rail].stats;
+}
+
+void PowerGoodMonitor::reset() {
+	CriticalGuard critical(true);
+	for (size_t i = 0; i < this->rail_count; ++i) {
+		RailStats &stats = this->rails[i].stats;
+		const bool good = stats.good;
+		memset(&stats, 0, sizeof(stats));
+		stats.good = good;
+	}
+	this->head = 0;
+	this->pending_glitches = 0;
+}
+
+uint32_t PowerGoodMonitor::readEnables(void *ref) {
+	return Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&reinterpret_cast<PowerGoodMonitor*>(ref)->zones);
+}
+
+uint32_t PowerGoodMonitor::readHardFaults(void *ref) {
+	return Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&reinterpret_cast<PowerGoodMonitor*>(ref)->zones);
+}
+
+#ifdef PG_MONITOR_PYLD_PWR_CTRL
+uint32_t PowerGoodMonitor::readPowerGoods(void *ref) {
+	return Pyld_Pwr_Ctrl_Get_PG_Status(&reinterpret_cast<PowerGoodMonitor*>(ref)->pwr_ctrl);
+}
+#endif
+
+bool PowerGoodMonitor::_TimerCallback(void *p) {
+	return reinterpret_cast<PowerGoodMonitor*>(p)->sample();
+}
+
+/**
+ * Sample every source and account the rails that changed, runs in interrupt
+ * context at the sampling rate.
+ */
+bool PowerGoodMonitor::sample() {
+	const uint64_t now = HiResTimer::now();
+
+	uint32_t values[MAX_SOURCES];
+	const uint32_t sources = this->source_count;
+	for (uint32_t i = 0; i < sources; ++i)
+		values[i] = this->readers[i](this->reader_refs[i]);
+
+	bool glitched = false;
+	const uint32_t rails = this->rail_count;
+	for (uint32_t i = 0; i < rails; ++i) {
+		Rail &rail = this->rails[i];
+		const bool good = (((values[rail.source] >> rail.bit) & 1) != 0) == rail.active_high;
+		RailStats &stats = rail.stats;
+		if (good == stats.good)
+			continue;
+		stats.good = good;
+
+		Edge &edge = this->edges[this->head % MAX_EDGES];
+		edge.time = now;
+		edge.rail = i;
+		edge.good = good;
+		edge.reserved0 = 0;
+		edge.reserved1 = 0;
+		this->head++;
+
+		if (!good) {
+			stats.falls++;
+			stats.fell = now;
+		} else if (stats.fell && now - stats.fell <= this->glitch_max) {
+			const uint64_t width = now - stats.fell;
+			if (!stats.glitches || width < stats.min_pulse)
+				stats.min_pulse = width;
+			stats.glitches++;
+			stats.last_glitch = now;
+			this->pending_glitches |= 1UL << i;
+			glitched = true;
+		}
+	}
+
+	if (glitched)
+		vTaskNotifyGiveFromISR(this->task, nullptr);
+	return true;
+}
+
+void PowerGoodMonitor::run() {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		CriticalGuard critical(true);
+		const uint32_t pending = this->pending_glitches;
+		this->pending_glitches = 0;
+		critical.release();
+
+		for (uint32_t bits = pending; bits; bits &= bits - 1) {
+			const size_t i = __builtin_ctz(bits);
+			const RailStats stats = this->getStats(i);
+			this->log.log(stdsprintf("Rail %s glitched, narrowest pulse %llu us, %lu glitches so far.",
+					this->rails[i].name.c_str(), HiResTimer::countsToUs(stats.min_pulse), stats.glitches), LogTree::LOG_WARNING);
+		}
+
+		// A chattering rail is reported at most every 100 ms.
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+}
+
+VFS::File PowerGoodMonitor::createFile() {
+	const size_t file_size = sizeof(FileHeader) + MAX_RAILS * sizeof(RailRecord) + MAX_EDGES * sizeof(Edge);
+
+	return VFS::File(
+		[this, file_size](uint8_t *buffer, size_t size) -> size_t {
+			if (size < file_size)
+				return 0;
+			memset(buffer, 0, file_size);
+
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "PGMN", 4);
+			header.version = 1;
+			header.rail_size = sizeof(RailRecord);
+			header.edge_size = sizeof(Edge);
+			header.period_us = this->period_us;
+			header.glitch_max_us = this->glitch_max_us;
+			header.counts_per_second = COUNTS_PER_SECOND;
+
+			uint8_t *ptr = buffer + sizeof(header);
+			const uint32_t rails = this->rail_count;
+			for (uint32_t i = 0; i < rails; ++i, ptr += sizeof(RailRecord)) {
+				const Rail &rail = this->rails[i];
+				const RailStats stats = this->getStats(i);
+
+				RailRecord record;
+				memset(&record, 0, sizeof(record));
+				strncpy(record.name, rail.name.c_str(), NAME_LENGTH);
+				record.falls = stats.falls;
+				record.glitches = stats.glitches;
+				record.min_pulse_us = HiResTimer::countsToUs(stats.min_pulse);
+				record.good = stats.good;
+				record.source = rail.source;
+				record.bit = rail.bit;
+				record.last_glitch = stats.last_glitch;
+				memcpy(ptr, &record, sizeof(record));
+			}
+			header.rails = rails;
+
+			// Oldest first, copied out in one go so the ring can't move underneath.
+			CriticalGuard critical(true);
+			const uint32_t head = this->head;
+			const uint32_t count = std::min<uint32_t>(head, MAX_EDGES);
+			for (uint32_t i = head - count; i != head; ++i, ptr += sizeof(Edge))
+				memcpy(ptr, &this->edges[i % MAX_EDGES], sizeof(Edge));
+			critical.release();
+			header.edges = count;
+
+			memcpy(buffer, &header, sizeof(header));
+			return file_size;
+		},
+		[](uint8_t *buffer, size_t size) -> size_t {
+			return 0; // Read only.
+		},
+		file_size);
+}
+
+/// A console command to show the per rail statistics.
+class PowerGoodMonitor::Status : public CommandParser::Command {
+public:
+	Status(PowerGoodMonitor &monitor) : monitor(monitor) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the state, edge and glitch statistics of each monitored rail.  A dropout\n"
+				"that recovers within the glitch window counts as a glitch.\n"
+				"The binary statistics and recent edges are available as virtual/pg_monitor.bin.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		const uint32_t rails = this->monitor.rail_count;
+		if (!rails) {
+			console->write("No rails monitored.\n");
+			return;
+		}
+
+		std::string out = stdsprintf("Sampling every %lu us, glitch window %lu us, %lu edges seen.\n",
+				this->monitor.period_us, this->monitor.glitch_max_us, this->monitor.head);
+		out += "rail,state,falls,glitches,min_pulse_us,since_glitch_ms\n";
+		const uint64_t now = HiResTimer::now();
+		for (uint32_t i = 0; i < rails; ++i) {
+			const RailStats stats = this->monitor.getStats(i);
+			out += stdsprintf("%s,%s,%lu,%lu,", this->monitor.rails[i].name.c_str(), stats.good ? "good" : "bad", stats.falls, stats.glitches);
+			if (stats.glitches)
+				out += stdsprintf("%llu,%llu\n", HiResTimer::countsToUs(stats.min_pulse), HiResTimer::countsToUs(now - stats.last_glitch) / 1000);
+			else
+				out += "-,-\n";
+		}
+		console->write(out);
+	}
+
+private:
+	PowerGoodMonitor &monitor;
+};
+
+/// A console command to clear the statistics.
+class PowerGoodMonitor::Reset : public CommandParser::Command {
+public:
+	Reset(PowerGoodMonitor &monitor) : monitor(monitor) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Clear the glitch statistics and the edge ring of all rails.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		this->monitor.reset();
+	}
+
+private:
+	PowerGoodMonitor &monitor;
+};
+
+void PowerGoodMonitor::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<PowerGoodMonitor::Status>(*this));
+	parser.registerCommand(prefix + "reset", std::make_shared<PowerGoodMonitor::Reset>(*this));
+}
+
+void PowerGoodMonitor::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "reset", nullptr);
+}
@@ -0,0 +1,214 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_PG_MONITOR_PG_MONITOR_H_
+#define SRC_COMPONENTS_PG_MONITOR_PG_MONITOR_H_
+
+#include <stdint.h>
+#include <string>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <services/ftp/ftp.h>
+#include "mgmt_zone_ctrl.h"
+
+// The payload power controller power goods are only a source if its driver is in the BSP.
+#if XSDK_INDEXING || __has_include("pyld_pwr_ctrl.h")
+#define PG_MONITOR_PYLD_PWR_CTRL
+#include "pyld_pwr_ctrl.h"
+#endif
+
+class HiResTimer;
+
+/**
+ * Power good and power enable edge monitor with per rail glitch statistics.
+ *
+ * None of the power good or enable inputs raise interrupts, so a HiResTimer
+ * callback samples every source at a high rate and timestamps the edges of
+ * every rail into a fixed ring.  A rail dropping out and recovering within
+ * the glitch window counts as a glitch, with its width tracked, anything
+ * longer is a regular power cycle.  Nothing is allocated per edge.
+ *
+ * The zone controller's power enables and hard fault inputs are built in
+ * sources, as are the Pyld_Pwr_Ctrl power goods on boards with that IP.
+ * Others can be added with an ISR safe reader.  Glitches are logged from a background task, statistics
+ * and edges are exported through createFile().
+ */
+class PowerGoodMonitor final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_SOURCES = 4;	///< Input sources.
+	static const size_t MAX_RAILS = 32;		///< Monitored rails.
+	static const size_t MAX_EDGES = 256;	///< Edge ring capacity.
+	static const size_t NAME_LENGTH = 16;	///< Rail name length in the exported file.
+
+	//! Built in sources.
+	enum Source {
+		SOURCE_PWREN		= 0,	///< Zone controller power enable logical states.
+		SOURCE_HARDFAULT	= 1,	///< Zone controller hard fault inputs, low word.
+	};
+
+	//! Reads a source, called from interrupt context.
+	typedef uint32_t (*Reader)(void *ref);
+
+	//! Statistics of one rail, all times in global timer counts.
+	struct RailStats {
+		uint32_t falls;			///< Transitions to not good, glitches included.
+		uint32_t glitches;		///< Dropouts that recovered within the glitch window.
+		uint64_t min_pulse;		///< Narrowest glitch, 0 if none.
+		uint64_t last_glitch;	///< Time of the last glitch, 0 if none.
+		uint64_t fell;			///< Time of the last dropout start, 0 if none.
+		bool good;				///< Current state.
+	};
+
+	//! An edge, also the record format of the exported file.
+	struct __attribute__((packed)) Edge {
+		uint64_t time;		///< Global timer count.
+		uint8_t rail;		///< Rail index.
+		uint8_t good;		///< New state.
+		uint16_t reserved0;	///< Zero.
+		uint32_t reserved1;	///< Zero.
+	};
+
+	//! Rail record of the exported file.
+	struct __attribute__((packed)) RailRecord {
+		char name[NAME_LENGTH];	///< Rail name, NUL padded.
+		uint32_t falls;			///< Transitions to not good.
+		uint32_t glitches;		///< Glitch count.
+		uint32_t min_pulse_us;	///< Narrowest glitch, 0 if none.
+		uint8_t good;			///< Current state.
+		uint8_t source;			///< Source index.
+		uint8_t bit;			///< Bit within the source.
+		uint8_t reserved;		///< Zero.
+		uint64_t last_glitch;	///< Global timer count of the last glitch, 0 if none.
+	};
+
+	//! Header of the exported file, all fields little endian.
+	struct __attribute__((packed)) FileHeader {
+		char magic[4];				///< "PGMN"
+		uint16_t version;			///< File format version, currently 1.
+		uint16_t rail_size;			///< sizeof(RailRecord)
+		uint16_t edge_size;			///< sizeof(Edge)
+		uint16_t rails;				///< Number of rail records following.
+		uint32_t edges;				///< Number of edges following the rails, oldest first.
+		uint32_t period_us;			///< Sampling period.
+		uint32_t glitch_max_us;		///< Glitch window.
+		uint64_t counts_per_second;	///< Global timer frequency.
+	};
+
+	/**
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID for the built in sources.
+	 * @param timer The timer pacing the sampling.
+	 * @param log The log tree to report to.
+	 * @param period_us Sampling period, the narrowest pulse that can be seen.
+	 * @param glitch_max_us Dropouts up to this long count as glitches.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	PowerGoodMonitor(uint16_t zone_device_id, HiResTimer &timer, LogTree &log, uint32_t period_us = 100, uint32_t glitch_max_us = 10000);
+	virtual ~PowerGoodMonitor();
+
+	/**
+	 * Add a source.
+	 * @param reader ISR safe reader.
+	 * @param ref Opaque reader argument.
+	 * @return The source index.
+	 * @throw std::domain_error if there is no room left.
+	 */
+	size_t addSource(Reader reader, void *ref);
+
+#ifdef PG_MONITOR_PYLD_PWR_CTRL
+	/**
+	 * Add the power good inputs of a Pyld_Pwr_Ctrl as a source, with a rail
+	 * named "PG <pin>" for each of them as long as there is room.
+	 * @param device_id The Pyld_Pwr_Ctrl device ID.
+	 * @return The source index.
+	 * @throw std::runtime_error if the driver fails to initialize.
+	 * @throw std::domain_error if there is no room left for the source.
+	 */
+	size_t addPowerControllerSource(uint16_t device_id);
+#endif
+
+	/**
+	 * Add a rail, may be called while sampling.
+	 * @param name Rail name.
+	 * @param source Source index.
+	 * @param bit Bit within the source.
+	 * @param active_high The rail is good when the bit is set.
+	 * @return The rail index.
+	 * @throw std::domain_error on an invalid source or if there is no room left.
+	 */
+	size_t addRail(const std::string &name, size_t source, uint8_t bit, bool active_high = true);
+
+	//! Statistics of a rail.
+	RailStats getStats(size_t rail);
+
+	//! Clear all counters and the edge ring.
+	void reset();
+
+	//! Create a read only VFS file with the statistics and edges.
+	VFS::File createFile();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! A monitored rail.
+	struct Rail {
+		std::string name;		///< Rail name.
+		uint8_t source;			///< Source index.
+		uint8_t bit;			///< Bit within the source.
+		bool active_high;		///< Good when set.
+		RailStats stats;		///< Statistics, updated from interrupt context.
+	};
+
+	Mgmt_Zone_Ctrl zones;				///< Low level zone controller driver, read only.
+#ifdef PG_MONITOR_PYLD_PWR_CTRL
+	Pyld_Pwr_Ctrl pwr_ctrl;				///< Low level payload power controller driver, read only.
+#endif
+	HiResTimer &timer;					///< Sampling timer.
+	LogTree &log;						///< Log target.
+	SemaphoreHandle_t mutex;			///< Serializes addSource() and addRail().
+	TaskHandle_t task;					///< Glitch reporting task.
+	int handle;							///< Timer handle.
+	const uint32_t period_us;			///< Sampling period.
+	const uint32_t glitch_max_us;		///< Glitch window.
+	const uint64_t glitch_max;			///< Glitch window in global timer counts.
+
+	Reader readers[MAX_SOURCES];		///< Source readers.
+	void *reader_refs[MAX_SOURCES];		///< Source reader arguments.
+	volatile uint32_t source_count;		///< Valid sources.
+	Rail rails[MAX_RAILS];				///< Rails.
+	volatile uint32_t rail_count;		///< Valid rails.
+
+	Edge edges[MAX_EDGES];				///< Edge ring.
+	volatile uint32_t head;				///< Edges written since the last reset.
+	volatile uint32_t pending_glitches;	///< Rails that glitched since the task last looked.
+
+	static uint32_t readEnables(void *ref);
+	static uint32_t readHardFaults(void *ref);
+#ifdef PG_MONITOR_PYLD_PWR_CTRL
+	static uint32_t readPowerGoods(void *ref);
+#endif
+	static bool _TimerCallback(void *p);
+	bool sample();
+	void run();
+
+	class Status;	///< Console command to show the statistics.
+	class Reset;	///< Console command to clear the statistics.
+};
+
+#endif /* SRC_COMPONENTS_PG_MONITOR_PG_MONITOR_H_ */
@@ -0,0 +1,328 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "power_timeline.h"
+#include <string.h>
+#include <algorithm>
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+
+PowerTimeline::PowerTimeline(uint16_t zone_device_id, HiResTimer &timer, LogTree &log) :
+	timer(timer), log(log), head(0), recording(false), window_end(0),
+	last_enables(0), last_hardfaults(0), last_irqs(0) {
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->zones, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->ring = new Event[MAX_EVENTS];
+	this->settle = HiResTimer::usToCounts(SETTLE_MS * 1000);
+	memset(this->last_zone, 0, sizeof(this->last_zone));
+	memset(this->owner, -1, sizeof(this->owner));
+	memset(this->configured, 0, sizeof(this->configured));
+}
+
+PowerTimeline::~PowerTimeline() {
+	// The callback unregisters itself once the window is over, wait for that.
+	while (this->recording)
+		vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+	delete[] this->ring;
+}
+
+bool PowerTimeline::arm(uint8_t level, uint32_t window_ms) {
+	// Snapshot the configured delays, served from the driver shadow.
+	int8_t owner[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN];
+	uint16_t configured[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN];
+	memset(owner, -1, sizeof(owner));
+	memset(configured, 0, sizeof(configured));
+	for (u32 mz = 0; mz < this->zones.mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz) {
+		MZ_config cfg;
+		Mgmt_Zone_Ctrl_Get_MZ_Cfg(&this->zones, mz, &cfg);
+		for (size_t i = 0; i < MGMT_ZONE_CTRL_SHADOW_MAX_PWREN; ++i) {
+			if (cfg.pwren_cfg[i]) {
+				owner[i] = mz;
+				configured[i] = cfg.pwren_cfg[i] & 0xFFFF;
+			}
+		}
+	}
+
+	// The baseline the first poll compares against.
+	const u32 enables = Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&this->zones);
+	const u64 hardfaults = Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&this->zones);
+	const u32 irqs = Mgmt_Zone_Ctrl_Get_IRQ_Status(&this->zones);
+	uint8_t zone_state[MGMT_ZONE_CTRL_SHADOW_MAX_MZ] = {0};
+	for (u32 mz = 0; mz < this->zones.mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz)
+		zone_state[mz] = Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, mz);
+
+	CriticalGuard critical(true);
+	const uint64_t now = HiResTimer::now();
+	memcpy(this->owner, owner, sizeof(owner));
+	memcpy(this->configured, configured, sizeof(configured));
+	if (!this->recording) {
+		// Only record the command once there is a timer to follow it up.
+		if (this->timer.addPeriodic(POLL_US, PowerTimeline::_TimerCallback, this) < 0)
+			return false;
+		this->last_enables = enables;
+		this->last_hardfaults = hardfaults;
+		this->last_irqs = irqs;
+		memcpy(this->last_zone, zone_state, sizeof(zone_state));
+		this->recording = true;
+	}
+	this->window_end = now + HiResTimer::usToCounts((uint64_t)window_ms * 1000);
+	this->record(now, EVENT_COMMAND, 0, level);
+	return true;
+}
+
+//! Append an event, overwriting the oldest once full.  Call with interrupts masked.
+void PowerTimeline::record(uint64_t time, EventType type, uint8_t index, uint16_t value) {
+	Event &event = this->ring[this->head % MAX_EVENTS];
+	event.time = time;
+	event.type = type;
+	event.index = index;
+	event.value = value;
+	event.reserved = 0;
+	this->head++;
+}
+
+bool PowerTimeline::_TimerCallback(void *p) {
+	return reinterpret_cast<PowerTimeline*>(p)->tick();
+}
+
+/**
+ * Poll the zone controller and record what changed, runs in interrupt context.
+ * @return false once the recording is over.
+ */
+bool PowerTimeline::tick() {
+	const uint64_t now = HiResTimer::now();
+	const uint32_t head = this->head;
+
+	const u32 enables = Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&this->zones);
+	for (u32 changed = enables ^ this->last_enables; changed; changed &= changed - 1) {
+		const int bit = __builtin_ctz(changed);
+		this->record(now, EVENT_ENABLE, bit, (enables >> bit) & 1);
+	}
+	this->last_enables = enables;
+
+	const u64 hardfaults = Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(&this->zones);
+	for (u64 changed = hardfaults ^ this->last_hardfaults; changed; changed &= changed - 1) {
+		const int bit = __builtin_ctzll(changed);
+		this->record(now, EVENT_HARDFAULT, bit, (hardfaults >> bit) & 1);
+	}
+	this->last_hardfaults = hardfaults;
+
+	// The IRQ is left for its owner to acknowledge, only newly raised bits are recorded.
+	const u32 irqs = Mgmt_Zone_Ctrl_Get_IRQ_Status(&this->zones);
+	for (u32 raised = irqs & ~this->last_irqs; raised; raised &= raised - 1)
+		this->record(now, EVENT_IRQ, __builtin_ctz(raised), 1);
+	this->last_irqs = irqs;
+
+	for (u32 mz = 0; mz < this->zones.mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; ++mz) {
+		const uint8_t state = Mgmt_Zone_Ctrl_Get_MZ_Status(&this->zones, mz);
+		if (state != this->last_zone[mz]) {
+			this->record(now, EVENT_ZONE, mz, state);
+			this->last_zone[mz] = state;
+		}
+	}
+
+	// Keep going while things are still moving.
+	if (this->head != head && this->window_end < now + this->settle)
+		this->window_end = now + this->settle;
+
+	if (now >= this->window_end) {
+		this->recording = false;
+		return false;
+	}
+	return true;
+}
+
+std::vector<PowerTimeline::Event> PowerTimeline::getEvents(bool last_command_only) {
+	std::vector<Event> events;
+	events.reserve(MAX_EVENTS);
+
+	CriticalGuard critical(true);
+	const uint32_t head = this->head;
+	const uint32_t count = std::min<uint32_t>(head, MAX_EVENTS);
+	for (uint32_t i = head - count; i != head; ++i)
+		events.push_back(this->ring[i % MAX_EVENTS]);
+	critical.release();
+
+	if (last_command_only) {
+		for (auto it = events.rbegin(); it != events.rend(); ++it) {
+			if (it->type == EVENT_COMMAND) {
+				events.erase(events.begin(), it.base() - 1);
+				break;
+			}
+		}
+	}
+	return events;
+}
+
+std::vector<PowerTimeline::Delay> PowerTimeline::getDelays() {
+	std::vector<Event> events = this->getEvents(true);
+	std::vector<Delay> delays;
+	if (events.empty() || events.front().type != EVENT_COMMAND)
+		return delays;
+
+	const Event &command = events.front();
+	const uint16_t direction = command.value ? 1 : 0;
+	for (size_t i = 0; i < MGMT_ZONE_CTRL_SHADOW_MAX_PWREN; ++i) {
+		if (this->owner[i] < 0)
+			continue;
+
+		Delay delay;
+		delay.enable = i;
+		delay.zone = this->owner[i];
+		delay.configured_ms = this->configured[i];
+		delay.actual_us = -1;
+		for (const Event &event : events) {
+			if (event.type == EVENT_ENABLE && event.index == i && event.value == direction) {
+				delay.actual_us = HiResTimer::countsToUs(event.time - command.time);
+				break;
+			}
+		}
+		delays.push_back(delay);
+	}
+	return delays;
+}
+
+VFS::File PowerTimeline::createFile() {
+	const size_t file_size = sizeof(FileHeader) + MAX_EVENTS * sizeof(Event);
+
+	return VFS::File(
+		[this, file_size](uint8_t *buffer, size_t size) -> size_t {
+			if (size < file_size)
+				return 0;
+			memset(buffer, 0, file_size);
+
+			std::vector<Event> events = this->getEvents(false);
+
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "PTML", 4);
+			header.version = 1;
+			header.event_size = sizeof(Event);
+			header.events = events.size();
+			header.dropped = this->head > MAX_EVENTS ? this->head - MAX_EVENTS : 0;
+			header.counts_per_second = COUNTS_PER_SECOND;
+
+			memcpy(buffer, &header, sizeof(header));
+			memcpy(buffer + sizeof(header), events.data(), events.size() * sizeof(Event));
+			return file_size;
+		},
+		[](uint8_t *buffer, size_t size) -> size_t {
+			return 0; // Read only.
+		},
+		file_size);
+}
+
+/// A console command to show the last timeline, or arm a recording.
+class PowerTimeline::Timeline : public CommandParser::Command {
+public:
+	Timeline(PowerTimeline &timeline) : timeline(timeline) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [all]\n"
+				+ command + " arm [$window_ms]\n\n"
+				"Show the zone controller events since the last power level change, and the\n"
+				"configured-vs-actual delay of each power enable.  With 'all', show the whole ring.\n"
+				"'arm' records without changing the power level, e.g. around a fault injection.\n"
+				"The binary timeline is available as virtual/power_timeline.bin.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string action;
+		uint32_t window_ms = 1000;
+
+		if (parameters.nargs() > 1 && !parameters.parseParameters(1, false, &action)) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		if (action == "arm") {
+			if (parameters.nargs() > 2 && !parameters.parseParameters(2, true, &window_ms)) {
+				console->write("Invalid parameters, see help.\n");
+				return;
+			}
+			// Level 0xFF marks a manual recording.
+			if (!this->timeline.arm(0xFF, window_ms))
+				console->write("Unable to arm, no free timer slot.\n");
+			return;
+		} else if (!action.empty() && action != "all") {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		static const char *zone_states[] = {"off", "turning off", "turning on", "on"};
+
+		std::vector<Event> events = this->timeline.getEvents(action.empty());
+		if (events.empty()) {
+			console->write("Nothing recorded.\n");
+			return;
+		}
+
+		std::string out;
+		const uint64_t origin = events.front().time;
+		for (const Event &event : events) {
+			out += stdsprintf("%10llu us  ", HiResTimer::countsToUs(event.time - origin));
+			switch (event.type) {
+			case EVENT_COMMAND:
+				if (event.value == 0xFF)
+					out += "armed manually\n";
+				else
+					out += stdsprintf("power level %hu\n", event.value);
+				break;
+			case EVENT_ZONE:
+				out += stdsprintf("zone %hhu %s\n", event.index, zone_states[event.value & 3]);
+				break;
+			case EVENT_ENABLE:
+				out += stdsprintf("PWRENA_%hhu %s\n", event.index, event.value ? "asserted" : "released");
+				break;
+			case EVENT_HARDFAULT:
+				out += stdsprintf("hard fault %hhu %s\n", event.index, event.value ? "raised" : "cleared");
+				break;
+			case EVENT_IRQ:
+				out += stdsprintf("zone %hhu IRQ\n", event.index);
+				break;
+			}
+		}
+
+		std::vector<Delay> delays = this->timeline.getDelays();
+		if (!delays.empty()) {
+			out += "\nenable,zone,configured_ms,actual_us,delta_us\n";
+			for (const Delay &delay : delays) {
+				if (delay.actual_us < 0)
+					out += stdsprintf("%hhu,%hhu,%hu,-,-\n", delay.enable, delay.zone, delay.configured_ms);
+				else
+					out += stdsprintf("%hhu,%hhu,%hu,%lld,%lld\n", delay.enable, delay.zone, delay.configured_ms,
+							delay.actual_us, delay.actual_us - (int64_t)delay.configured_ms * 1000);
+			}
+		}
+
+		if (this->timeline.isRecording())
+			out += "(still recording)\n";
+		console->write(out);
+	}
+
+private:
+	PowerTimeline &timeline;
+};
+
+void PowerTimeline::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "timeline", std::make_shared<PowerTimeline::Timeline>(*this));
+}
+
+void PowerTimeline::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "timeline", nullptr);
+}
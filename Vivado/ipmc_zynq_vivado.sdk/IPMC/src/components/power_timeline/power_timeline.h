@@ -0,0 +1,149 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_POWER_TIMELINE_POWER_TIMELINE_H_
+#define SRC_COMPONENTS_POWER_TIMELINE_POWER_TIMELINE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <services/ftp/ftp.h>
+#include "mgmt_zone_ctrl.h"
+
+class HiResTimer;
+
+/**
+ * Records the management zone controller's power sequencing with global timer timestamps.
+ *
+ * Once armed by a power level change, a HiResTimer callback polls the zone
+ * controller and stores every zone state transition, power enable pin change,
+ * hard fault input change and newly raised controller IRQ into a fixed ring.
+ * Recording stops once nothing has changed for a while after the arming
+ * window.
+ *
+ * The power enables' configured delays are captured when armed, so the
+ * timeline can be reduced to configured-vs-actual delays per enable.
+ *
+ * The zone controller IRQ is not routed to the GIC in this design, so
+ * IRQ_STATUS is polled with the rest.
+ */
+class PowerTimeline final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_EVENTS = 1024;		///< Ring capacity.
+	static const uint32_t POLL_US = 100;		///< Polling period while recording.
+	static const uint32_t SETTLE_MS = 50;		///< Quiet time before recording stops.
+
+	//! Recorded event types.
+	enum EventType : uint8_t {
+		EVENT_COMMAND	= 0,	///< Armed, value is the power level.
+		EVENT_ZONE		= 1,	///< Zone state change, value is the MZ_pwr.
+		EVENT_ENABLE	= 2,	///< Power enable logical state change, value is 0 or 1.
+		EVENT_HARDFAULT	= 3,	///< Hard fault input change, value is 0 or 1.
+		EVENT_IRQ		= 4,	///< Zone IRQ raised, index is the zone.
+	};
+
+	//! A timeline entry, also the record format of the exported file.
+	struct __attribute__((packed)) Event {
+		uint64_t time;		///< Global timer count.
+		uint8_t type;		///< EventType.
+		uint8_t index;		///< Zone, power enable or hard fault bit.
+		uint16_t value;		///< New state.
+		uint32_t reserved;	///< Zero.
+	};
+
+	//! Configured and measured delay of one power enable.
+	struct Delay {
+		uint8_t enable;			///< Power enable.
+		uint8_t zone;			///< Owning zone.
+		uint16_t configured_ms;	///< Configured delay.
+		int64_t actual_us;		///< Delay from the command to the change, -1 if not observed.
+	};
+
+	//! Header of the exported file, all fields little endian.
+	struct __attribute__((packed)) FileHeader {
+		char magic[4];				///< "PTML"
+		uint16_t version;			///< File format version, currently 1.
+		uint16_t event_size;		///< sizeof(Event)
+		uint32_t events;			///< Number of events following, oldest first.
+		uint32_t dropped;			///< Events overwritten since boot.
+		uint64_t counts_per_second;	///< Global timer frequency.
+	};
+
+	/**
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID.
+	 * @param timer The timer pacing the polling.
+	 * @param log The log tree to report to.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	PowerTimeline(uint16_t zone_device_id, HiResTimer &timer, LogTree &log);
+	virtual ~PowerTimeline();
+
+	/**
+	 * Start or extend a recording.  Call right before commanding the zones.
+	 *
+	 * @param level The power level being applied, recorded with the command event.
+	 * @param window_ms Minimum recording time.
+	 * @return false if the timer has no free slot.
+	 */
+	bool arm(uint8_t level, uint32_t window_ms = 200);
+
+	//! True while recording.
+	inline bool isRecording() const { return this->recording; };
+
+	//! Events, oldest first, optionally only those since the last command.
+	std::vector<Event> getEvents(bool last_command_only = true);
+
+	//! Configured-vs-actual delays of the enables owned by a zone, for the last command.
+	std::vector<Delay> getDelays();
+
+	//! Create a read only VFS file with the whole ring.
+	VFS::File createFile();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	Mgmt_Zone_Ctrl zones;			///< Low level zone controller driver, read only.
+	HiResTimer &timer;				///< Polling timer.
+	LogTree &log;					///< Log target.
+
+	Event *ring;					///< Event ring.
+	volatile uint32_t head;			///< Events written since boot.
+
+	volatile bool recording;		///< The timer callback is registered.
+	uint64_t window_end;			///< Recording runs at least until this count.
+	uint64_t settle;				///< SETTLE_MS in global timer counts.
+
+	u32 last_enables;				///< Power enable states at the last poll.
+	u64 last_hardfaults;			///< Hard fault inputs at the last poll.
+	u32 last_irqs;					///< IRQ status at the last poll.
+	uint8_t last_zone[MGMT_ZONE_CTRL_SHADOW_MAX_MZ];	///< Zone states at the last poll.
+
+	int8_t owner[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN];		///< Owning zone per enable, -1 if none.
+	uint16_t configured[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN];	///< Configured delay per enable, in ms.
+
+	void record(uint64_t time, EventType type, uint8_t index, uint16_t value);
+	static bool _TimerCallback(void *p);
+	bool tick();
+
+	class Timeline;	///< Console command to show the timeline and delays.
+};
+
+#endif /* SRC_COMPONENTS_POWER_TIMELINE_POWER_TIMELINE_H_ */
@@ -0,0 +1,222 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sampling_scheduler.h"
+#include <algorithm>
+#include <hires_timer/hires_timer.h>
+
+SamplingScheduler::SamplingScheduler() : started(false) {
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+}
+
+SamplingScheduler::~SamplingScheduler() {
+	configASSERT(0); // Unsupported, the bus tasks reference this instance.
+}
+
+int SamplingScheduler::addBus(const std::string &name) {
+	if (this->started)
+		throw std::domain_error("Buses must be added before the sampling scheduler starts");
+
+	Bus bus;
+	bus.name = name;
+	bus.priority = TASK_PRIORITY_BACKGROUND;
+	bus.window_start = 0;
+	bus.busy = 0;
+	bus.utilization = 0;
+	bus.windows = 0;
+	this->buses.push_back(bus);
+	return this->buses.size() - 1;
+}
+
+void SamplingScheduler::addSource(const std::string &name, uint32_t period_ms, CostClass cost, int bus, Sampler sampler) {
+	if (this->started)
+		throw std::domain_error("Sources must be added before the sampling scheduler starts");
+	if (bus < 0 || (size_t)bus >= this->buses.size())
+		throw std::domain_error(stdsprintf("Unknown bus %d for source %s", bus, name.c_str()));
+	if (period_ms < portTICK_PERIOD_MS)
+		throw std::domain_error(stdsprintf("Source %s has a period shorter than a tick", name.c_str()));
+
+	Source source;
+	source.name = name;
+	source.period_ms = period_ms;
+	source.cost = cost;
+	source.bus = bus;
+	source.sampler = sampler;
+	source.backoff = 0;
+	source.release = 0;
+	source.samples = 0;
+	source.missed = 0;
+	source.jitter_max = 0;
+	source.jitter_sum = 0;
+	source.cost_max = 0;
+	this->sources.push_back(source);
+
+	// Keep the bus source list in rate-monotonic order.
+	std::vector<size_t> &list = this->buses[bus].sources;
+	list.push_back(this->sources.size() - 1);
+	std::stable_sort(list.begin(), list.end(), [this](size_t a, size_t b) -> bool {
+		return this->sources[a].period_ms < this->sources[b].period_ms;
+	});
+}
+
+void SamplingScheduler::start() {
+	if (this->started)
+		return;
+	this->started = true;
+
+	// Rank buses by their shortest period, the fastest bus gets the driver priority.
+	std::vector<size_t> order;
+	for (size_t i = 0; i < this->buses.size(); ++i)
+		if (!this->buses[i].sources.empty())
+			order.push_back(i);
+	std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) -> bool {
+		return this->sources[this->buses[a].sources.front()].period_ms < this->sources[this->buses[b].sources.front()].period_ms;
+	});
+
+	BaseType_t priority = TASK_PRIORITY_DRIVER;
+	uint32_t last_period = 0;
+	for (size_t i : order) {
+		Bus &bus = this->buses[i];
+		uint32_t period = this->sources[bus.sources.front()].period_ms;
+		if (last_period && period > last_period && priority > TASK_PRIORITY_BACKGROUND)
+			priority--;
+		last_period = period;
+		bus.priority = priority;
+
+		const uint64_t now = HiResTimer::now();
+		bus.window_start = now;
+		for (size_t s : bus.sources)
+			this->sources[s].release = now;
+
+		runTask("smp_" + bus.name, bus.priority, [this, i]() -> void { this->run(i); });
+	}
+}
+
+void SamplingScheduler::run(size_t index) {
+	Bus &bus = this->buses[index];
+	const uint64_t counts_per_tick = HiResTimer::usToCounts(portTICK_PERIOD_MS * 1000);
+
+	while (true) {
+		// Sleep until the earliest release on this bus.
+		uint64_t next = UINT64_MAX;
+		for (size_t s : bus.sources)
+			next = std::min(next, this->sources[s].release);
+
+		uint64_t now = HiResTimer::now();
+		if (next > now) {
+			vTaskDelay((next - now + counts_per_tick - 1) / counts_per_tick);
+			now = HiResTimer::now();
+		}
+
+		// One transaction window: every due source, shortest period first.
+		const uint64_t window_begin = now;
+		for (size_t s : bus.sources) {
+			Source &source = this->sources[s];
+			if (source.release > now)
+				continue;
+
+			const uint64_t begin = HiResTimer::now();
+			source.sampler();
+			const uint64_t end = HiResTimer::now();
+
+			const uint64_t period = HiResTimer::usToCounts((uint64_t)source.period_ms * 1000 << source.backoff);
+			MutexGuard<false> lock(this->mutex, true);
+			const uint64_t jitter = begin - source.release;
+			source.samples++;
+			source.jitter_sum += jitter;
+			source.jitter_max = std::max(source.jitter_max, jitter);
+			source.cost_max = std::max(source.cost_max, end - begin);
+
+			// A sample that ends past the next release missed its deadline, skip to the next free release.
+			source.release += period;
+			if (end > source.release) {
+				source.missed++;
+				source.release += ((end - source.release) / period + 1) * period;
+			}
+		}
+
+		const uint64_t window_end = HiResTimer::now();
+		bus.busy += window_end - window_begin;
+		bus.windows++;
+
+		const uint64_t elapsed = window_end - bus.window_start;
+		if (elapsed >= HiResTimer::usToCounts(LOAD_WINDOW_MS * 1000)) {
+			MutexGuard<false> lock(this->mutex, true);
+			bus.utilization = bus.busy * 100 / elapsed;
+			bus.busy = 0;
+			bus.window_start = window_end;
+			this->adjustBackoff(bus);
+		}
+	}
+}
+
+void SamplingScheduler::adjustBackoff(Bus &bus) {
+	// Hysteresis between 25% and 50% so the bus doesn't oscillate.
+	for (size_t s : bus.sources) {
+		Source &source = this->sources[s];
+		if (source.cost == COST_REGISTER)
+			continue;
+		if (bus.utilization > 50 && source.backoff < MAX_BACKOFF)
+			source.backoff++;
+		else if (bus.utilization < 25 && source.backoff > 0)
+			source.backoff--;
+	}
+}
+
+/// A console command to report sampling statistics.
+class SamplingScheduler::Status : public CommandParser::Command {
+public:
+	Status(SamplingScheduler &scheduler) : scheduler(scheduler) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show bus utilization and per source period, jitter and missed deadlines.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const char *costs[] = {"reg", "bus"};
+		SamplingScheduler &s = this->scheduler;
+
+		std::string out;
+		MutexGuard<false> lock(s.mutex, true);
+		for (const Bus &bus : s.buses) {
+			out += stdsprintf("%s: priority %ld, %hhu%% busy, %lu windows\n",
+					bus.name.c_str(), bus.priority, bus.utilization, bus.windows);
+			for (size_t i : bus.sources) {
+				const Source &src = s.sources[i];
+				out += stdsprintf("  %-12s %4s %6lu ms x%-2u %8lu samples %6lu missed, jitter avg %llu us max %llu us, cost max %llu us\n",
+						src.name.c_str(), costs[src.cost], src.period_ms, 1 << src.backoff, src.samples, src.missed,
+						src.samples ? HiResTimer::countsToUs(src.jitter_sum / src.samples) : 0,
+						HiResTimer::countsToUs(src.jitter_max), HiResTimer::countsToUs(src.cost_max));
+			}
+		}
+		lock.release();
+		console->write(out);
+	}
+
+private:
+	SamplingScheduler &scheduler;
+};
+
+void SamplingScheduler::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<SamplingScheduler::Status>(*this));
+}
+
+void SamplingScheduler::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+}
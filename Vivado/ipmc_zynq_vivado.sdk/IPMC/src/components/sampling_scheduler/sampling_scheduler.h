@@ -0,0 +1,121 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SAMPLING_SCHEDULER_SAMPLING_SCHEDULER_H_
+#define SRC_COMPONENTS_SAMPLING_SCHEDULER_SAMPLING_SCHEDULER_H_
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <services/console/command_parser.h>
+
+/**
+ * Rate-monotonic sampling of sensors from several buses.
+ *
+ * Every source declares a period, a cost class and the bus it lives on.  Each
+ * bus gets one task, prioritized rate-monotonically by the shortest period on
+ * it, which runs every due source back to back in a single transaction
+ * window, shortest period first.  Sources on a bus that spends more than half
+ * its time busy back off to up to 8x their declared period, except for
+ * COST_REGISTER sources which are assumed critical and never back off.
+ *
+ * Sources and buses must be added before start().
+ */
+class SamplingScheduler final : public ConsoleCommandSupport {
+public:
+	//! How expensive a sample is, which decides whether it may back off.
+	enum CostClass {
+		COST_REGISTER,	///< A memory mapped read, microseconds.  Never backs off.
+		COST_BUS,		///< A transaction on a shared bus or FIFO, hundreds of microseconds.
+	};
+
+	//! Takes a sample and forwards it to its consumer.
+	typedef std::function<void(void)> Sampler;
+
+	SamplingScheduler();
+	virtual ~SamplingScheduler();
+
+	/**
+	 * Add a bus, sources on the same bus share one task and never overlap.
+	 * @param name Bus name, used for the task name and reports.
+	 * @return Bus handle.
+	 */
+	int addBus(const std::string &name);
+
+	/**
+	 * Add a sampled source.
+	 * @param name Source name, for reports.
+	 * @param period_ms Sampling period, at least one tick.
+	 * @param cost Cost class of one sample.
+	 * @param bus Bus handle from addBus().
+	 * @param sampler Called with the bus window open to take a sample.
+	 * @throw std::domain_error if the bus is unknown or the scheduler has started.
+	 */
+	void addSource(const std::string &name, uint32_t period_ms, CostClass cost, int bus, Sampler sampler);
+
+	//! Assign priorities and start one task per bus.
+	void start();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	static const uint8_t MAX_BACKOFF = 3;		///< Backoff limit, as a power of two of the period.
+	static const uint32_t LOAD_WINDOW_MS = 1000;	///< Bus utilization is evaluated over this window.
+
+	//! A sampled source and its statistics, times in global timer counts.
+	struct Source {
+		std::string name;		///< Source name.
+		uint32_t period_ms;		///< Declared period.
+		CostClass cost;			///< Cost class.
+		int bus;				///< Owning bus.
+		Sampler sampler;		///< Sampling function.
+		uint8_t backoff;		///< Current backoff, period is period_ms << backoff.
+		uint64_t release;		///< Next release time.
+		uint32_t samples;		///< Samples taken.
+		uint32_t missed;		///< Samples that finished after the next release.
+		uint64_t jitter_max;	///< Largest start delay after release.
+		uint64_t jitter_sum;	///< Sum of start delays.
+		uint64_t cost_max;		///< Longest sample.
+	};
+
+	//! A bus with its own sampling task.
+	struct Bus {
+		std::string name;				///< Bus name.
+		std::vector<size_t> sources;	///< Sources, shortest period first.
+		BaseType_t priority;			///< Assigned task priority.
+		uint64_t window_start;			///< Start of the current utilization window.
+		uint64_t busy;					///< Busy time in the current window.
+		uint8_t utilization;			///< Utilization of the last window, percent.
+		uint32_t windows;				///< Transaction windows run.
+	};
+
+	SemaphoreHandle_t mutex;		///< Protects statistics while reporting.
+	std::vector<Source> sources;	///< All sources.
+	std::vector<Bus> buses;			///< All buses.
+	bool started;					///< Set by start().
+
+	void run(size_t bus);
+	void adjustBackoff(Bus &bus);
+
+	class Status;	///< Console command to report sources and buses.
+};
+
+#endif /* SRC_COMPONENTS_SAMPLING_SCHEDULER_SAMPLING_SCHEDULER_H_ */
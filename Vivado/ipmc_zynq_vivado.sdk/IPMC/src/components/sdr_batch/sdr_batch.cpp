@@ -0,0 +1,138 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sdr_batch.h"
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+
+SDRBatch::SDRBatch(SensorDataRepository &repo) : repo(repo), reservation(0), count(0) {
+	this->restart();
+}
+
+//! Start over with an empty staging area.
+void SDRBatch::restart() {
+	this->staged = std::unique_ptr<SensorDataRepository>(new SensorDataRepository());
+	this->reservation = this->staged->reserve();
+	this->count = 0;
+}
+
+void SDRBatch::add(const SensorDataRecord &sdr) {
+	this->staged->add(sdr, this->reservation);
+	this->count++;
+}
+
+void SDRBatch::add(const std::vector<uint8_t> &sdrs) {
+	this->staged->u8import(sdrs);
+
+	// Each record is a 5 byte header, whose last byte is the body length, and its body.
+	for (size_t offset = 0; offset + 5 <= sdrs.size(); offset += 5 + sdrs[offset + 4])
+		this->count++;
+}
+
+uint64_t SDRBatch::commit() {
+	const uint64_t start = HiResTimer::now();
+	if (this->count)
+		this->repo.u8import(this->staged->u8export());
+	const uint64_t elapsed = HiResTimer::now() - start;
+
+	this->restart();
+	return elapsed;
+}
+
+std::vector< std::vector<uint8_t> > SDRBatch::split(const std::vector<uint8_t> &sdrs) {
+	std::vector< std::vector<uint8_t> > records;
+
+	size_t offset = 0;
+	while (offset + 5 <= sdrs.size()) {
+		const size_t length = 5 + sdrs[offset + 4];
+		if (offset + length > sdrs.size())
+			break;
+		records.emplace_back(sdrs.begin() + offset, sdrs.begin() + offset + length);
+		offset += length;
+	}
+	return records;
+}
+
+std::string SDRBatch::Bench::getHelpText(const std::string &command) const {
+	return command + " [$rounds]\n\n"
+			"Time loading the Device SDRs into a scratch repository record by record (parse\n"
+			"and reserved add), with one import, and through an SDRBatch, both into an empty\n"
+			"repository (init) and over a copy of the same records (u8import merge).\n"
+			"Defaults to 10 rounds.\n";
+}
+
+void SDRBatch::Bench::execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+	uint32_t rounds = 10;
+	if (parameters.nargs() > 1 && !parameters.parseParameters(1, true, &rounds)) {
+		console->write("Invalid parameters, see help.\n");
+		return;
+	}
+	if (!rounds) {
+		console->write("At least one round is required.\n");
+		return;
+	}
+
+	const std::vector<uint8_t> sdrs = this->repo.u8export();
+	const std::vector< std::vector<uint8_t> > records = SDRBatch::split(sdrs);
+
+	enum { PER_RECORD, SINGLE_IMPORT, BATCH, PATHS };
+	static const char *paths[PATHS] = {"per record", "single import", "batch"};
+
+	std::string out = stdsprintf("%u records, %u bytes, %lu rounds.\n", records.size(), sdrs.size(), rounds);
+	out += "path,init_us,merge_us\n";
+	for (int path = 0; path < PATHS; ++path) {
+		uint64_t totals[2] = {0, 0};
+		for (int merge = 0; merge < 2; ++merge) {
+			for (uint32_t round = 0; round < rounds; ++round) {
+				SensorDataRepository scratch;
+				if (merge)
+					scratch.u8import(sdrs);
+
+				const uint64_t start = HiResTimer::now();
+				if (path == PER_RECORD) {
+					// As sdr_init.cpp did before batching: parse, then add under a reservation, retrying if cancelled.
+					SensorDataRepository::reservation_t reservation = scratch.reserve();
+					for (const std::vector<uint8_t> &record : records) {
+						std::shared_ptr<SensorDataRecord> sdr = SensorDataRecord::interpret(record);
+						if (!sdr)
+							continue;
+						while (true) {
+							try {
+								scratch.add(*sdr, reservation);
+								break;
+							}
+							catch (SensorDataRepository::reservation_cancelled_error) {
+								reservation = scratch.reserve();
+							}
+						}
+					}
+				} else if (path == SINGLE_IMPORT) {
+					scratch.u8import(sdrs);
+				} else {
+					SDRBatch batch(scratch);
+					for (const std::vector<uint8_t> &record : records)
+						batch.add(record);
+					batch.commit();
+				}
+				totals[merge] += HiResTimer::now() - start;
+			}
+		}
+		out += stdsprintf("%s,%llu,%llu\n", paths[path],
+				HiResTimer::countsToUs(totals[0] / rounds), HiResTimer::countsToUs(totals[1] / rounds));
+	}
+	console->write(out);
+}
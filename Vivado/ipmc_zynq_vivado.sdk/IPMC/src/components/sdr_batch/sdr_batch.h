@@ -0,0 +1,91 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SDR_BATCH_SDR_BATCH_H_
+#define SRC_COMPONENTS_SDR_BATCH_SDR_BATCH_H_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <services/console/command_parser.h>
+#include <services/ipmi/sdr/sensor_data_record.h>
+#include <services/ipmi/sdr/sensor_data_repository.h>
+
+/**
+ * Stage sensor data records and commit them to a repository in one go.
+ *
+ * Adding records one by one to a shared repository needs a reservation per
+ * attempt, and every Reserve SDR Repository from the shelf manager cancels
+ * it, which costs a reservation_cancelled_error throw and a retry each time.
+ * Records staged here go into a private repository nobody else can reserve,
+ * and commit() merges all of them into the target with a single import, so
+ * the target sees one update no matter how many records there are.
+ *
+ * Records replace those with the same key, as with SensorDataRepository::add().
+ */
+class SDRBatch final {
+public:
+	//! @param repo The repository commit() merges into.
+	SDRBatch(SensorDataRepository &repo);
+
+	//! Stage a record.
+	void add(const SensorDataRecord &sdr);
+
+	//! Stage records in SensorDataRepository::u8export() format.
+	void add(const std::vector<uint8_t> &sdrs);
+
+	//! Number of records staged, replaced ones included.
+	inline size_t size() const { return this->count; };
+
+	/**
+	 * Merge all staged records into the target and clear the staging area.
+	 * @return How long the merge took, in global timer counts.
+	 */
+	uint64_t commit();
+
+	/**
+	 * Split an exported repository into its records.
+	 * @param sdrs The exported repository, as by SensorDataRepository::u8export().
+	 * @return One raw record, header included, per entry.
+	 */
+	static std::vector< std::vector<uint8_t> > split(const std::vector<uint8_t> &sdrs);
+
+	class Bench;	///< Console command to compare batched and per record updates.
+
+private:
+	SensorDataRepository &repo;						///< Commit target.
+	std::unique_ptr<SensorDataRepository> staged;	///< Staged records.
+	SensorDataRepository::reservation_t reservation;	///< Our reservation on staged, never cancelled.
+	size_t count;									///< Records staged.
+
+	void restart();
+};
+
+/// A console command to compare batched and per record repository updates.
+class SDRBatch::Bench : public CommandParser::Command {
+public:
+	//! @param repo The repository whose records are used as the workload.
+	Bench(SensorDataRepository &repo) : repo(repo) {};
+
+	virtual std::string getHelpText(const std::string &command) const;
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters);
+
+private:
+	SensorDataRepository &repo;	///< Workload source.
+};
+
+#endif /* SRC_COMPONENTS_SDR_BATCH_SDR_BATCH_H_ */
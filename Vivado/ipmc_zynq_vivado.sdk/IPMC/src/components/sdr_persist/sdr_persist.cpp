@@ -0,0 +1,203 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sdr_persist.h"
+#include <string.h>
+#include <libs/printf.h>
+#include <crc32/crc32.h>
+#include <sdr_batch/sdr_batch.h>
+
+/*
+ * Allocation layout, multibyte fields little endian:
+ *
+ *   Header: "SDRP", format version, reserved, record count (16 bit),
+ *           length of the entries (32 bit), CRC-32 of the entries (32 bit).
+ *   Entry:  record version, reserved, record length (16 bit),
+ *           CRC-32 of the record (32 bit), then the record itself.
+ */
+static const uint8_t SDRP_MAGIC[4] = { 'S', 'D', 'R', 'P' };
+static const size_t SDRP_HEADER_SIZE = 16;
+static const size_t SDRP_ENTRY_HEADER_SIZE = 8;
+
+static inline uint32_t get16(const std::vector<uint8_t> &data, size_t offset) {
+	return data[offset] | (data[offset+1] << 8);
+}
+
+static inline uint32_t get32(const std::vector<uint8_t> &data, size_t offset) {
+	return data[offset] | (data[offset+1] << 8) | (data[offset+2] << 16) | (static_cast<uint32_t>(data[offset+3]) << 24);
+}
+
+static inline void put16(std::vector<uint8_t> &data, size_t offset, uint32_t value) {
+	data[offset] = value & 0xff;
+	data[offset+1] = (value >> 8) & 0xff;
+}
+
+static inline void put32(std::vector<uint8_t> &data, size_t offset, uint32_t value) {
+	put16(data, offset, value & 0xffff);
+	put16(data, offset+2, value >> 16);
+}
+
+//! Check for our header, as opposed to a raw u8export() from before this format.
+static bool hasHeader(const std::vector<uint8_t> &image) {
+	return image.size() >= SDRP_HEADER_SIZE && memcmp(image.data(), SDRP_MAGIC, sizeof(SDRP_MAGIC)) == 0;
+}
+
+//! Collect the {length, CRC} of each entry of an image, as far as they are in bounds.
+static std::vector< std::pair<uint32_t, uint32_t> > entrySignatures(const std::vector<uint8_t> &image) {
+	std::vector< std::pair<uint32_t, uint32_t> > signatures;
+	if (!hasHeader(image))
+		return signatures;
+
+	size_t offset = SDRP_HEADER_SIZE;
+	while (offset + SDRP_ENTRY_HEADER_SIZE <= image.size()) {
+		const uint32_t length = get16(image, offset+2);
+		if (offset + SDRP_ENTRY_HEADER_SIZE + length > image.size())
+			break;
+		signatures.emplace_back(length, get32(image, offset+4));
+		offset += SDRP_ENTRY_HEADER_SIZE + length;
+	}
+	return signatures;
+}
+
+SDRPersistence::SDRPersistence(PersistentStorage &storage, uint16_t allocation, LogTree &log)
+	: allocation(storage, allocation), log(log), fetched(false), intact(false) {
+}
+
+//! Read the allocation, once.
+void SDRPersistence::fetch() {
+	if (this->fetched)
+		return;
+	this->image = this->allocation.getData();
+	this->fetched = true;
+	this->intact = hasHeader(this->image) && this->image[4] == FORMAT_VERSION &&
+			SDRP_HEADER_SIZE + get32(this->image, 8) == this->image.size() &&
+			crc32(this->image.data() + SDRP_HEADER_SIZE, this->image.size() - SDRP_HEADER_SIZE) == get32(this->image, 12);
+}
+
+//! Build the image for a repository.
+std::vector<uint8_t> SDRPersistence::encode(const std::vector<uint8_t> &sdrs) {
+	const std::vector< std::vector<uint8_t> > records = SDRBatch::split(sdrs);
+
+	size_t size = SDRP_HEADER_SIZE;
+	for (const std::vector<uint8_t> &record : records)
+		size += SDRP_ENTRY_HEADER_SIZE + record.size();
+
+	std::vector<uint8_t> image(size, 0);
+	memcpy(image.data(), SDRP_MAGIC, sizeof(SDRP_MAGIC));
+	image[4] = FORMAT_VERSION;
+	put16(image, 6, records.size());
+	put32(image, 8, size - SDRP_HEADER_SIZE);
+
+	size_t offset = SDRP_HEADER_SIZE;
+	for (const std::vector<uint8_t> &record : records) {
+		image[offset] = RECORD_VERSION;
+		put16(image, offset+2, record.size());
+		put32(image, offset+4, crc32(record.data(), record.size()));
+		memcpy(image.data() + offset + SDRP_ENTRY_HEADER_SIZE, record.data(), record.size());
+		offset += SDRP_ENTRY_HEADER_SIZE + record.size();
+	}
+
+	put32(image, 12, crc32(image.data() + SDRP_HEADER_SIZE, size - SDRP_HEADER_SIZE));
+	return image;
+}
+
+std::vector<uint8_t> SDRPersistence::load() {
+	this->fetch();
+	const std::vector<uint8_t> &image = this->image;
+
+	if (image.empty())
+		return std::vector<uint8_t>();
+
+	if (!hasHeader(image)) {
+		this->log.log("Stored SDRs are in the unchecked legacy format, importing as is.", LogTree::LOG_NOTICE);
+		return image;
+	}
+
+	if (image[4] != FORMAT_VERSION) {
+		this->log.log(stdsprintf("Stored SDRs are in unknown format version %hhu, ignoring them.", image[4]), LogTree::LOG_WARNING);
+		return std::vector<uint8_t>();
+	}
+
+	if (!this->intact)
+		this->log.log("Stored SDRs fail their digest, checking records individually.", LogTree::LOG_WARNING);
+
+	std::vector<uint8_t> sdrs;
+	sdrs.reserve(image.size());
+
+	const size_t count = get16(image, 6);
+	size_t offset = SDRP_HEADER_SIZE;
+	size_t entry;
+	for (entry = 0; entry < count && offset + SDRP_ENTRY_HEADER_SIZE <= image.size(); ++entry) {
+		const uint8_t version = image[offset];
+		const size_t record_length = get16(image, offset+2);
+		const uint32_t crc = get32(image, offset+4);
+		const uint8_t *record = image.data() + offset + SDRP_ENTRY_HEADER_SIZE;
+
+		if (offset + SDRP_ENTRY_HEADER_SIZE + record_length > image.size())
+			break; // The length itself is damaged, there is nothing to resynchronize on.
+		offset += SDRP_ENTRY_HEADER_SIZE + record_length;
+
+		if (version != RECORD_VERSION) {
+			this->log.log(stdsprintf("Stored SDR %u has unknown record version %hhu, dropped.", entry, version), LogTree::LOG_ERROR);
+			continue;
+		}
+		if (crc32(record, record_length) != crc) {
+			this->log.log(stdsprintf("Stored SDR %u fails its CRC, dropped.", entry), LogTree::LOG_ERROR);
+			continue;
+		}
+		if (record_length < 5 || 5U + record[4] != record_length) {
+			this->log.log(stdsprintf("Stored SDR %u has an inconsistent length, dropped.", entry), LogTree::LOG_ERROR);
+			continue;
+		}
+
+		sdrs.insert(sdrs.end(), record, record + record_length);
+	}
+
+	if (entry != count)
+		this->log.log(stdsprintf("Stored SDRs are truncated after %u of %u records.", entry, count), LogTree::LOG_ERROR);
+
+	return sdrs;
+}
+
+bool SDRPersistence::store(const std::vector<uint8_t> &sdrs) {
+	this->fetch();
+	const std::vector<uint8_t> encoded = SDRPersistence::encode(sdrs);
+
+	// The digest covers every entry, headers included, so an intact image with an equal digest and size needs no write.
+	if (this->intact && this->image.size() == encoded.size() &&
+			get32(this->image, 12) == get32(encoded, 12)) {
+		this->log.log(stdsprintf("Stored SDRs are up to date (%u bytes), not rewritten.", encoded.size()), LogTree::LOG_DIAGNOSTIC);
+		return false;
+	}
+
+	// Report how much of the repository actually differs.
+	const std::vector< std::pair<uint32_t, uint32_t> > old_entries = entrySignatures(this->image);
+	const std::vector< std::pair<uint32_t, uint32_t> > new_entries = entrySignatures(encoded);
+	size_t changed = 0;
+	for (size_t i = 0; i < new_entries.size(); ++i)
+		if (i >= old_entries.size() || old_entries[i] != new_entries[i])
+			changed++;
+	if (old_entries.size() > new_entries.size())
+		changed += old_entries.size() - new_entries.size();
+
+	this->allocation.setData(encoded);
+	this->image = encoded;
+	this->intact = true;
+
+	this->log.log(stdsprintf("Stored %u SDRs (%u bytes), %u records changed.", new_entries.size(), encoded.size(), changed), LogTree::LOG_INFO);
+	return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SDR_PERSIST_SDR_PERSIST_H_
+#define SRC_COMPONENTS_SDR_PERSIST_SDR_PERSIST_H_
+
+#include <stdint.h>
+#include <vector>
+#include <libs/logtree/logtree.h>
+#include <services/persistentstorage/persistent_storage.h>
+
+/**
+ * Checksummed storage of the Device SDR repository in a persistent allocation.
+ *
+ * The allocation holds a header with the record count and a CRC-32 digest of
+ * everything after it, followed by one entry per record, each with its own
+ * versioned header and CRC-32.  Entries are stored in u8export() order, so a
+ * record that did not change keeps the same bytes at the same offset.
+ *
+ * store() compares the digest of the new image with the stored one and skips
+ * the write entirely when they match and the stored image is intact.  load() checks every entry and drops
+ * those that fail, so a corrupt record falls back to its compiled default
+ * instead of being imported, and is rewritten by the next store().
+ *
+ * Allocations still in the raw u8export() format are imported as they are and
+ * migrated by the next store().
+ */
+class SDRPersistence final {
+public:
+	/**
+	 * @param storage The persistent storage holding the repository.
+	 * @param allocation The allocation ID within storage.
+	 * @param log Where to report corrupt entries and writes.
+	 */
+	SDRPersistence(PersistentStorage &storage, uint16_t allocation, LogTree &log);
+
+	/**
+	 * Read the stored repository.
+	 * @return The records that passed their checks, in SensorDataRepository::u8export() format.
+	 */
+	std::vector<uint8_t> load();
+
+	/**
+	 * Store a repository, unless it is identical to the stored one.
+	 * @param sdrs The repository, as by SensorDataRepository::u8export().
+	 * @return true if the allocation was written, false if it was already up to date.
+	 */
+	bool store(const std::vector<uint8_t> &sdrs);
+
+	static const uint8_t FORMAT_VERSION = 1;	///< Version of the allocation header.
+	static const uint8_t RECORD_VERSION = 1;	///< Version of the entry headers.
+
+private:
+	VariablePersistentAllocation allocation;	///< The backing allocation.
+	LogTree &log;								///< Log target.
+	bool fetched;								///< image holds the allocation contents.
+	bool intact;								///< image is in the current format and matches its digest.
+	std::vector<uint8_t> image;					///< The allocation contents, as last read or written.
+
+	void fetch();
+	static std::vector<uint8_t> encode(const std::vector<uint8_t> &sdrs);
+};
+
+#endif /* SRC_COMPONENTS_SDR_PERSIST_SDR_PERSIST_H_ */
@@ -0,0 +1,348 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sensor_event_dispatcher.h"
+#include <payload_manager.h>
+#include <libs/printf.h>
+#include <services/ipmi/sensor/sensor.h>
+#include <services/ipmi/sensor/sensor_set.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_lut/sensor_lut.h>
+#include "xscugic.h"
+#include "ipmc.h"
+
+extern XScuGic xInterruptController;
+
+const uint32_t SensorEventDispatcher::latency_buckets_us[LATENCY_BUCKETS] = {50, 100, 250, 500, 1000};
+
+SensorEventDispatcher::SensorEventDispatcher(uint16_t device_id, uint32_t intr_id, LogTree &log, uint8_t priority) :
+	intr_id(intr_id), log(log), task(nullptr), pending(0), linked(0), irqs(0),
+	events("sensor_events.events"), unlinked("sensor_events.unlinked"),
+	latency_max(0), latency_sum(0), latency_count(0),
+	shadow_divergences("sensor_events.shadow_divergences"),
+	probe(nullptr), probe_ref(nullptr) {
+	for (size_t i = 0; i < MAX_CHANNELS; ++i) {
+		this->irq_time[i] = 0;
+		this->sensor_numbers[i] = -1;
+	}
+	for (size_t i = 0; i <= LATENCY_BUCKETS; ++i)
+		this->latency_histogram[i] = 0;
+	for (size_t i = 0; i < MAX_IRQ_HOOKS; ++i) {
+		this->irq_hooks[i] = nullptr;
+		this->irq_hook_refs[i] = nullptr;
+	}
+
+	if (XST_SUCCESS != IPMI_Sensor_Proc_Initialize(&this->proc, device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize IPMI_Sensor_Proc(%hu)", device_id));
+	if (this->proc.sensor_ch_cnt > MAX_CHANNELS)
+		throw std::runtime_error(stdsprintf("IPMI_Sensor_Proc(%hu) has more than %u channels", device_id, MAX_CHANNELS));
+
+	this->task = runTask("sensor_events", TASK_PRIORITY_DRIVER, [this]() -> void { this->run(); });
+
+	// Drop anything that was raised before we were listening, the latched status is still there.
+	IPMI_Sensor_Proc_Ack_IRQ(&this->proc, IPMI_Sensor_Proc_Get_IRQ_Status(&this->proc));
+
+	if (XST_SUCCESS != XScuGic_Connect(&xInterruptController, intr_id, SensorEventDispatcher::_InterruptHandler, (void*)this))
+		throw std::runtime_error("Unable to connect the sensor processor interrupt");
+	XScuGic_SetPriorityTriggerType(&xInterruptController, intr_id, priority, 0x3);
+	XScuGic_Enable(&xInterruptController, intr_id);
+}
+
+SensorEventDispatcher::~SensorEventDispatcher() {
+	XScuGic_Disable(&xInterruptController, this->intr_id);
+	XScuGic_Disconnect(&xInterruptController, this->intr_id);
+	vTaskDelete(this->task);
+}
+
+void SensorEventDispatcher::linkSensors(const std::vector<uint8_t> &sdrs) {
+	// Build the table from scratch, sensors may have been removed or renumbered.
+	int16_t sensor_numbers[MAX_CHANNELS];
+	for (size_t i = 0; i < MAX_CHANNELS; ++i)
+		sensor_numbers[i] = -1;
+
+	uint32_t linked = 0;
+	for (const SensorLUT::SDR01Info &info : SensorLUT::parseSDR01s(sdrs)) {
+		auto it = PayloadManager::adc_sensors.find(info.name);
+		if (it == PayloadManager::adc_sensors.end())
+			continue;
+
+		int ch = it->second.sensor_processor_id;
+		if (ch >= 0 && (uint32_t)ch < this->proc.sensor_ch_cnt) {
+			sensor_numbers[ch] = info.sensor_number;
+			linked |= 1UL << ch;
+		}
+	}
+
+	CriticalGuard critical(true);
+	for (size_t i = 0; i < MAX_CHANNELS; ++i)
+		this->sensor_numbers[i] = sensor_numbers[i];
+	this->linked = linked;
+	critical.release();
+
+	/* Linked channels are ours alone, the PayloadManager poll no longer sees
+	 * or re-arms their latched events.  Unlinked ones stay with it.
+	 */
+	IPMI_Sensor_Proc_Set_Event_Owner(&this->proc, linked);
+}
+
+void SensorEventDispatcher::_InterruptHandler(void *p) {
+	reinterpret_cast<SensorEventDispatcher*>(p)->interruptHandler();
+}
+
+void SensorEventDispatcher::interruptHandler() {
+	u32 status = IPMI_Sensor_Proc_Get_IRQ_Status(&this->proc);
+	IPMI_Sensor_Proc_Ack_IRQ(&this->proc, status);
+	this->irqs++;
+
+	// Only the first IRQ of a channel counts, the handler catches up on the rest.
+	uint64_t now = HiResTimer::now();
+	for (size_t i = 0; i < MAX_IRQ_HOOKS; ++i)
+		if (this->irq_hooks[i])
+			this->irq_hooks[i](status, now, this->irq_hook_refs[i]);
+	u32 fresh = status & ~this->pending;
+	while (fresh) {
+		u32 ch = __builtin_ctz(fresh);
+		fresh &= fresh - 1;
+		this->irq_time[ch] = now;
+	}
+	this->pending |= status;
+
+	BaseType_t woken = pdFALSE;
+	vTaskNotifyGiveFromISR(this->task, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+void SensorEventDispatcher::run() {
+	u16 assert_status[MAX_CHANNELS];
+	u16 deassert_status[MAX_CHANNELS];
+	uint64_t irq_time[MAX_CHANNELS];
+
+	TickType_t next_verify = xTaskGetTickCount() + pdMS_TO_TICKS(SHADOW_VERIFY_PERIOD);
+	while (true) {
+		/* Make sure the hardware still holds what the shadow claims, on a fixed
+		 * period so an event storm cannot starve the check.  This only reports,
+		 * restoring is left to the console command.
+		 */
+		TickType_t now = xTaskGetTickCount();
+		if ((int32_t)(next_verify - now) <= 0) {
+			this->verifyShadow(false);
+			next_verify = now + pdMS_TO_TICKS(SHADOW_VERIFY_PERIOD);
+			continue;
+		}
+
+		if (!ulTaskNotifyTake(pdTRUE, next_verify - now))
+			continue;
+
+		CriticalGuard critical(true);
+		u32 mask = this->pending & this->linked;
+		this->pending = 0;
+		for (u32 bits = mask; bits; bits &= bits - 1)
+			irq_time[__builtin_ctz(bits)] = this->irq_time[__builtin_ctz(bits)];
+		critical.release();
+
+		u32 active = IPMI_Sensor_Proc_Get_Latched_Event_Status_Mask(&this->proc, mask, assert_status, deassert_status);
+		IPMI_Sensor_Proc_Rearm_Event_Enable_Mask(&this->proc, active, assert_status, deassert_status);
+		while (active) {
+			u32 ch = __builtin_ctz(active);
+			active &= active - 1;
+
+			this->dispatch(ch, assert_status[ch], deassert_status[ch], irq_time[ch]);
+		}
+	}
+}
+
+uint32_t SensorEventDispatcher::verifyShadow(bool restore) {
+	uint32_t diverged = IPMI_Sensor_Proc_Verify_Shadow(&this->proc, restore);
+	if (diverged) {
+		this->shadow_divergences.increment();
+		this->log.log(stdsprintf("Sensor processor configuration diverged from its shadow on channels 0x%08lx%s.", diverged, restore ? ", restored" : ""), LogTree::LOG_WARNING);
+	}
+	return diverged;
+}
+
+/**
+ * Send the IPMI events for one channel.
+ *
+ * @param ch The sensor processor channel.
+ * @param assert_status Latched assertion events, by threshold event offset.
+ * @param deassert_status Latched deassertion events, by threshold event offset.
+ * @param irq_time When the IRQ for this channel was received.
+ */
+void SensorEventDispatcher::dispatch(uint32_t ch, uint16_t assert_status, uint16_t deassert_status, uint64_t irq_time) {
+	int16_t sensor_number = this->sensor_numbers[ch];
+	std::shared_ptr<Sensor> sensor = (sensor_number < 0) ? nullptr : ipmc_sensors.get(sensor_number);
+	if (!sensor) {
+		this->unlinked.increment();
+		this->log.log(stdsprintf("Dropped events 0x%03hx/0x%03hx of unlinked sensor processor channel %lu.", assert_status, deassert_status, ch), LogTree::LOG_DIAGNOSTIC);
+		return;
+	}
+
+	u16 reading;
+	u8 thr_status;
+	Thr_Cfg thr;
+	IPMI_Sensor_Proc_Get_Sensor_Reading(&this->proc, ch, &reading, &thr_status);
+	IPMI_Sensor_Proc_Get_Thr(&this->proc, ch, &thr);
+	const u16 thresholds[6] = {thr.LNC, thr.LCR, thr.LNR, thr.UNC, thr.UCR, thr.UNR};
+
+	// Without conversion tables we can only report the event offset.
+	std::shared_ptr<const SensorLUT::Table> table;
+	if (sensor_luts)
+		table = sensor_luts->getBySensorProcessorId(ch);
+
+	for (int direction = 0; direction < 2; ++direction) {
+		uint16_t status = direction ? deassert_status : assert_status;
+		while (status) {
+			uint8_t offset = __builtin_ctz(status);
+			status &= status - 1;
+
+			// Event data per IPMI v2.0 Table 29-6: trigger reading and trigger threshold.
+			std::vector<uint8_t> data(3, 0xFF);
+			data[0] = offset;
+			if (table) {
+				data[0] |= 0x50;
+				data[1] = table->toIPMI(reading);
+				data[2] = table->toIPMI(thresholds[offset / 2]);
+			}
+			sensor->sendEvent(direction ? Sensor::EVENT_DEASSERTION : Sensor::EVENT_ASSERTION, data);
+			this->events.increment();
+		}
+	}
+
+	const uint64_t sent_time = HiResTimer::now();
+	this->recordLatency(sent_time - irq_time);
+
+	CriticalGuard critical(true);
+	EventProbe probe = this->probe;
+	void *probe_ref = this->probe_ref;
+	critical.release();
+	if (probe)
+		probe(ch, irq_time, sent_time, probe_ref);
+}
+
+void SensorEventDispatcher::setEventProbe(EventProbe probe, void *ref) {
+	CriticalGuard critical(true);
+	this->probe = probe;
+	this->probe_ref = ref;
+}
+
+void SensorEventDispatcher::addIrqHook(IrqHook hook, void *ref) {
+	CriticalGuard critical(true);
+	for (size_t i = 0; i < MAX_IRQ_HOOKS; ++i) {
+		if (this->irq_hooks[i])
+			continue;
+		this->irq_hook_refs[i] = ref;
+		this->irq_hooks[i] = hook;
+		return;
+	}
+	critical.release();
+	throw std::runtime_error("No free sensor processor IRQ hook slot");
+}
+
+void SensorEventDispatcher::removeIrqHook(IrqHook hook, void *ref) {
+	CriticalGuard critical(true);
+	for (size_t i = 0; i < MAX_IRQ_HOOKS; ++i) {
+		if (this->irq_hooks[i] == hook && this->irq_hook_refs[i] == ref) {
+			this->irq_hooks[i] = nullptr;
+			this->irq_hook_refs[i] = nullptr;
+		}
+	}
+}
+
+void SensorEventDispatcher::recordLatency(uint64_t counts) {
+	if (counts > this->latency_max)
+		this->latency_max = counts;
+	this->latency_sum += counts;
+	this->latency_count++;
+
+	uint64_t us = HiResTimer::countsToUs(counts);
+	size_t bucket = 0;
+	while (bucket < LATENCY_BUCKETS && us > latency_buckets_us[bucket])
+		bucket++;
+	this->latency_histogram[bucket]++;
+}
+
+/// A console command to show dispatch statistics.
+class SensorEventDispatcher::Status : public CommandParser::Command {
+public:
+	Status(SensorEventDispatcher &dispatcher) : dispatcher(dispatcher) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show sensor processor event dispatch statistics and IRQ to event latency.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		SensorEventDispatcher &d = this->dispatcher;
+
+		std::string out = stdsprintf("IRQs: %lu, events: %llu, unlinked: %llu\n", d.irqs, d.events.get(), d.unlinked.get());
+		if (d.latency_count)
+			out += stdsprintf("Latency: avg %llu us, max %llu us\n",
+					HiResTimer::countsToUs(d.latency_sum / d.latency_count), HiResTimer::countsToUs(d.latency_max));
+		for (size_t i = 0; i < LATENCY_BUCKETS; ++i)
+			out += stdsprintf("  <= %4lu us: %lu\n", latency_buckets_us[i], d.latency_histogram[i]);
+		out += stdsprintf("   > %4lu us: %lu\n", latency_buckets_us[LATENCY_BUCKETS-1], d.latency_histogram[LATENCY_BUCKETS]);
+
+		const IPMI_Sensor_Proc_Shadow *shadow = d.proc.Shadow;
+		if (shadow)
+			out += stdsprintf("Shadow: %lu writes, %lu skipped, %lu reads saved, %llu divergences\n",
+					shadow->RegWrites, shadow->RegWritesSkipped, shadow->RegReadsSaved, d.shadow_divergences.get());
+
+		out += "Links:";
+		for (size_t ch = 0; ch < d.proc.sensor_ch_cnt; ++ch)
+			if (d.sensor_numbers[ch] >= 0)
+				out += stdsprintf(" %u->%hd", ch, d.sensor_numbers[ch]);
+		out += "\n";
+		console->write(out);
+	}
+
+private:
+	SensorEventDispatcher &dispatcher;
+};
+
+/// A console command to verify the shadow registers.
+class SensorEventDispatcher::Verify : public CommandParser::Command {
+public:
+	Verify(SensorEventDispatcher &dispatcher) : dispatcher(dispatcher) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [restore]\n\n"
+				"Compare the sensor processor configuration registers against the driver shadow,\n"
+				"optionally rewriting diverged channels.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		bool restore = parameters.nargs() > 1 && parameters.parameters[1] == "restore";
+		uint32_t diverged = this->dispatcher.verifyShadow(restore);
+		if (diverged)
+			console->write(stdsprintf("Diverged channels: 0x%08lx%s\n", diverged, restore ? " (restored)" : ""));
+		else
+			console->write("Shadow matches the hardware.\n");
+	}
+
+private:
+	SensorEventDispatcher &dispatcher;
+};
+
+void SensorEventDispatcher::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<SensorEventDispatcher::Status>(*this));
+	parser.registerCommand(prefix + "verify", std::make_shared<SensorEventDispatcher::Verify>(*this));
+}
+
+void SensorEventDispatcher::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "verify", nullptr);
+}
@@ -0,0 +1,175 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SENSOR_EVENT_DISPATCHER_SENSOR_EVENT_DISPATCHER_H_
+#define SRC_COMPONENTS_SENSOR_EVENT_DISPATCHER_SENSOR_EVENT_DISPATCHER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include "ipmi_sensor_proc.h"
+
+/**
+ * Interrupt driven IPMI event generation from the PL sensor processor.
+ *
+ * The ISR only snapshots and acknowledges the IRQ bitmap.  A driver priority
+ * task then reads the latched event status of the flagged channels alone,
+ * re-arms them and sends the matching IPMI platform events, so quiet
+ * channels cost nothing.
+ *
+ * Latency is measured from the sensor processor IRQ to the event being
+ * handed to the IPMI sensor for transmission.
+ *
+ * The task also verifies the driver's shadow registers against the hardware
+ * every SHADOW_VERIFY_PERIOD, busy or not, and reports divergence.
+ */
+class SensorEventDispatcher final : public ConsoleCommandSupport {
+public:
+	//! Maximum number of sensor processor channels supported.
+	static const size_t MAX_CHANNELS = 32;
+
+	//! Interval between shadow register verification passes, in milliseconds.
+	static const uint32_t SHADOW_VERIFY_PERIOD = 10000;
+
+	/**
+	 * Take over the sensor processor interrupt.
+	 *
+	 * @param device_id The IPMI_Sensor_Proc device ID.
+	 * @param intr_id The sensor processor interrupt ID.
+	 * @param log The log tree to report to.
+	 * @param priority GIC priority of the interrupt.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	SensorEventDispatcher(uint16_t device_id, uint32_t intr_id, LogTree &log, uint8_t priority = 0xA0);
+	virtual ~SensorEventDispatcher();
+
+	/**
+	 * Link sensor processor channels to IPMI sensor numbers.
+	 *
+	 * PayloadManager ADC sensors are matched to their SDRs by name.  This is
+	 * meant to be called whenever the SDR repository was (re)loaded.
+	 *
+	 * Linked channels are claimed from the sensor processor driver, so the
+	 * PayloadManager poll stops consuming their latched events.  Events of
+	 * unlinked channels are left to the PayloadManager.
+	 *
+	 * @param sdrs The exported SDR repository, as by SensorDataRepository::u8export().
+	 */
+	void linkSensors(const std::vector<uint8_t> &sdrs);
+
+	/**
+	 * Compare the sensor processor shadow registers against the hardware.
+	 *
+	 * @param restore Rewrite diverged channels from the shadow.
+	 * @return Bitmap of diverged channels.
+	 */
+	uint32_t verifyShadow(bool restore);
+
+	/**
+	 * Observes dispatched events, called from the dispatcher task.
+	 *
+	 * @param ch The sensor processor channel.
+	 * @param irq_time Global timer count of the sensor processor IRQ.
+	 * @param sent_time Global timer count the IPMI events were handed over.
+	 * @param ref The reference passed to setEventProbe().
+	 */
+	typedef void (*EventProbe)(uint32_t ch, uint64_t irq_time, uint64_t sent_time, void *ref);
+
+	/**
+	 * Install an event probe, used for latency measurements.
+	 * @param probe The probe, nullptr to remove.
+	 * @param ref Opaque probe argument.
+	 */
+	void setEventProbe(EventProbe probe, void *ref);
+
+	//! Maximum number of interrupt hooks.
+	static const size_t MAX_IRQ_HOOKS = 2;
+
+	/**
+	 * Observes sensor processor interrupts, called from interrupt context
+	 * right after the IRQ was acknowledged.  Must be short and ISR safe.
+	 *
+	 * @param status The IRQ bitmap that was acknowledged.
+	 * @param irq_time Global timer count of the interrupt.
+	 * @param ref The reference passed to addIrqHook().
+	 */
+	typedef void (*IrqHook)(uint32_t status, uint64_t irq_time, void *ref);
+
+	/**
+	 * Install an interrupt hook, used to act on or snapshot state at the
+	 * instant of an event.  Hooks run in installation order, so latency
+	 * critical hooks should be installed first.
+	 *
+	 * @param hook The hook.
+	 * @param ref Opaque hook argument.
+	 * @throw std::runtime_error if all hook slots are taken.
+	 */
+	void addIrqHook(IrqHook hook, void *ref);
+
+	/**
+	 * Remove an interrupt hook.
+	 * @param hook The hook, as passed to addIrqHook().
+	 * @param ref The hook argument, as passed to addIrqHook().
+	 */
+	void removeIrqHook(IrqHook hook, void *ref);
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! Upper bounds of the latency histogram buckets, in microseconds.
+	static const uint32_t latency_buckets_us[];
+	static const size_t LATENCY_BUCKETS = 5;
+
+	IPMI_Sensor_Proc proc;				///< Low level driver instance.
+	uint32_t intr_id;					///< Sensor processor interrupt ID.
+	LogTree &log;						///< Log target.
+	TaskHandle_t task;					///< Deferred handler task.
+
+	volatile uint32_t pending;			///< Channels flagged by the ISR, not yet serviced.
+	uint64_t irq_time[MAX_CHANNELS];	///< Global timer count of the first unserviced IRQ per channel.
+	volatile int16_t sensor_numbers[MAX_CHANNELS]; ///< IPMI sensor number per channel, -1 if unlinked.
+	volatile uint32_t linked;			///< Channels with an IPMI sensor, owned by the dispatcher.
+
+	volatile uint32_t irqs;				///< Interrupts serviced, updated from ISR context.
+	StatCounter events;					///< IPMI events sent.
+	StatCounter unlinked;				///< Events dropped, channel has no IPMI sensor.
+	uint64_t latency_max;				///< Longest IRQ to event latency, in global timer counts.
+	uint64_t latency_sum;				///< Sum of IRQ to event latencies, in global timer counts.
+	uint32_t latency_count;				///< Number of latencies summed.
+	uint32_t latency_histogram[LATENCY_BUCKETS + 1]; ///< Latency histogram, last bucket is overflow.
+	StatCounter shadow_divergences;		///< Verification passes that found diverged channels.
+	EventProbe probe;					///< Event observer, may be nullptr.
+	void *probe_ref;					///< Event observer argument.
+	IrqHook irq_hooks[MAX_IRQ_HOOKS];	///< Interrupt observers, nullptr if the slot is free.
+	void *irq_hook_refs[MAX_IRQ_HOOKS];	///< Interrupt observer arguments.
+
+	void run();
+	void dispatch(uint32_t ch, uint16_t assert_status, uint16_t deassert_status, uint64_t irq_time);
+	void recordLatency(uint64_t counts);
+	static void _InterruptHandler(void *p);
+	void interruptHandler();
+
+	class Status;	///< Console command to show dispatch statistics.
+	class Verify;	///< Console command to verify the shadow registers.
+};
+
+#endif /* SRC_COMPONENTS_SENSOR_EVENT_DISPATCHER_SENSOR_EVENT_DISPATCHER_H_ */
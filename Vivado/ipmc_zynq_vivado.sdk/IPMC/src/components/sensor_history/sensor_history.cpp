@@ -0,0 +1,288 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sensor_history.h"
+#include <string.h>
+#include <algorithm>
+#include <payload_manager.h>
+#include <hires_timer/hires_timer.h>
+
+const SensorHistory::Level SensorHistory::levels[SensorHistory::LEVELS] = {
+	{      10, 256,   1 },	// 2.56 seconds of raw samples.
+	{    1000, 600, 100 },	// 10 minutes.
+	{   60000, 720,  60 },	// 12 hours.
+	{ 3600000, 168,  60 },	// 7 days.
+};
+
+SensorHistory::SensorHistory() :
+	storage(nullptr), storage_size(0),
+	update_max(0), update_sum(0), update_count(0) {
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	size_t buckets_per_track = 0;
+	for (size_t level = 0; level < LEVELS; ++level)
+		buckets_per_track += levels[level].buckets;
+
+	this->tracks.resize(PayloadManager::adc_sensors.size());
+	this->storage_size = buckets_per_track * this->tracks.size();
+	this->storage = new Bucket[this->storage_size];
+	memset(this->storage, 0, this->storage_size * sizeof(Bucket));
+
+	Bucket *next = this->storage;
+	auto it = PayloadManager::adc_sensors.begin();
+	for (Track &track : this->tracks) {
+		track.name = it->second.name;
+		track.adc = &it->second.adc;
+		track.frame_channel = (it->second.sensor_processor_id < (int)(ADCFrameReader::MAX_DEVICES * 8)) ? it->second.sensor_processor_id : -1;
+		for (size_t level = 0; level < LEVELS; ++level) {
+			track.ring[level] = next;
+			next += levels[level].buckets;
+			track.head[level] = 0;
+			track.filled[level] = 0;
+			memset(&track.pending[level], 0, sizeof(Bucket));
+		}
+		++it;
+	}
+}
+
+SensorHistory::~SensorHistory() {
+	vSemaphoreDelete(this->mutex);
+	delete[] this->storage;
+}
+
+void SensorHistory::push(Track &track, size_t level, const Bucket &bucket) {
+	track.ring[level][track.head[level]] = bucket;
+	if (++track.head[level] == levels[level].buckets)
+		track.head[level] = 0;
+	if (track.filled[level] < levels[level].buckets)
+		track.filled[level]++;
+
+	if (level + 1 == LEVELS)
+		return;
+
+	// Fold the bucket's mean into the next level.
+	Bucket &pending = track.pending[level + 1];
+	uint16_t mean = bucket.mean();
+	if (pending.count == 0) {
+		pending.min = bucket.min;
+		pending.max = bucket.max;
+		pending.sum = mean;
+	} else {
+		pending.min = std::min(pending.min, bucket.min);
+		pending.max = std::max(pending.max, bucket.max);
+		pending.sum += mean;
+	}
+
+	if (++pending.count == levels[level + 1].ratio) {
+		this->push(track, level + 1, pending);
+		pending.count = 0;
+	}
+}
+
+void SensorHistory::addSample(size_t sensor, uint16_t code) {
+	if (sensor >= this->tracks.size())
+		return;
+
+	Bucket bucket = { code, code, code, 1, 0 };
+	MutexGuard<false> lock(this->mutex, true);
+
+	// Only the store update is benchmarked, ADC access times are not ours to bound.
+	const uint64_t start = HiResTimer::now();
+	this->push(this->tracks[sensor], 0, bucket);
+	const uint64_t elapsed = HiResTimer::now() - start;
+
+	if (elapsed > this->update_max)
+		this->update_max = elapsed;
+	this->update_sum += elapsed;
+	this->update_count++;
+}
+
+void SensorHistory::sample(size_t sensor) {
+	if (sensor < this->tracks.size())
+		this->addSample(sensor, this->tracks[sensor].adc->readRaw());
+}
+
+void SensorHistory::addFrame(const ADCFrameReader::Frame &frame) {
+	for (size_t sensor = 0; sensor < this->tracks.size(); ++sensor) {
+		const int ch = this->tracks[sensor].frame_channel;
+		if (ch >= 0 && (size_t)ch / 8 < frame.devices)
+			this->addSample(sensor, frame.get(ch / 8, ch % 8));
+	}
+}
+
+size_t SensorHistory::getBuckets(size_t sensor, size_t level, Bucket *buckets, size_t count) {
+	if (sensor >= this->tracks.size() || level >= LEVELS)
+		return 0;
+
+	MutexGuard<false> lock(this->mutex, true);
+	const Track &track = this->tracks[sensor];
+	count = std::min<size_t>(count, track.filled[level]);
+	size_t slot = track.head[level];
+	for (size_t i = 0; i < count; ++i) {
+		slot = (slot ? slot : levels[level].buckets) - 1;
+		buckets[i] = track.ring[level][slot];
+	}
+	return count;
+}
+
+std::vector<std::string> SensorHistory::getSensorNames() const {
+	std::vector<std::string> names;
+	for (const Track &track : this->tracks)
+		names.push_back(track.name);
+	return names;
+}
+
+VFS::File SensorHistory::createFile() {
+	size_t file_size = sizeof(FileHeader) + this->tracks.size() * sizeof(SensorHeader) + this->storage_size * sizeof(Bucket);
+
+	return VFS::File(
+		[this, file_size](uint8_t *buffer, size_t size) -> size_t {
+			if (size < file_size)
+				return 0;
+			memset(buffer, 0, file_size);
+
+			FileHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "SHST", 4);
+			header.version = 1;
+			header.sensors = this->tracks.size();
+			header.levels = LEVELS;
+			header.bucket_size = sizeof(Bucket);
+			memcpy(header.level, levels, sizeof(levels));
+			memcpy(buffer, &header, sizeof(header));
+
+			MutexGuard<false> lock(this->mutex, true);
+			SensorHeader *sensors = reinterpret_cast<SensorHeader*>(buffer + sizeof(FileHeader));
+			Bucket *out = reinterpret_cast<Bucket*>(sensors + this->tracks.size());
+			for (const Track &track : this->tracks) {
+				strncpy(sensors->name, track.name.c_str(), NAME_LENGTH);
+				for (size_t level = 0; level < LEVELS; ++level) {
+					sensors->filled[level] = track.filled[level];
+
+					// Oldest first: the head is the oldest slot once the ring wrapped.
+					const size_t n = levels[level].buckets;
+					size_t first = (track.filled[level] == n) ? track.head[level] : 0;
+					for (size_t i = 0; i < n; ++i)
+						*out++ = track.ring[level][(first + i) % n];
+				}
+				sensors++;
+			}
+
+			return file_size;
+		},
+		[](uint8_t *buffer, size_t size) -> size_t {
+			return 0; // Read only.
+		},
+		file_size);
+}
+
+/// A console command to print the history of a sensor.
+class SensorHistory::Show : public CommandParser::Command {
+public:
+	Show(SensorHistory &history) : history(history) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $sensor [$level [$count]]\n\n"
+				"Print the newest $count (default 10) buckets of a sensor at a resolution level\n"
+				"(0: 10ms, 1: 1s, 2: 1min, 3: 1h, default 1), newest first.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		std::string name;
+		uint8_t level = 1;
+		uint16_t count = 10;
+
+		bool ok;
+		if (parameters.nargs() == 2)
+			ok = parameters.parseParameters(1, true, &name);
+		else if (parameters.nargs() == 3)
+			ok = parameters.parseParameters(1, true, &name, &level);
+		else if (parameters.nargs() == 4)
+			ok = parameters.parseParameters(1, true, &name, &level, &count);
+		else
+			ok = false;
+		if (!ok || level >= LEVELS) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		std::vector<std::string> names = this->history.getSensorNames();
+		auto it = std::find(names.begin(), names.end(), name);
+		if (it == names.end()) {
+			console->write("Unknown sensor.\n");
+			return;
+		}
+		const size_t sensor = it - names.begin();
+		const ADC::Channel &adc = *this->history.tracks[sensor].adc;
+
+		std::vector<Bucket> buckets(count);
+		count = this->history.getBuckets(sensor, level, buckets.data(), count);
+
+		std::string out = stdsprintf("%s, %lu ms buckets:\n", name.c_str(), levels[level].period_ms);
+		for (size_t i = 0; i < count; ++i) {
+			const Bucket &b = buckets[i];
+			out += stdsprintf("  -%-6u min %8.3f  avg %8.3f  max %8.3f\n", i,
+					adc.rawToFloat(b.min), adc.rawToFloat(b.mean()), adc.rawToFloat(b.max));
+		}
+		console->write(out);
+	}
+
+private:
+	SensorHistory &history;
+};
+
+/// A console command to show the memory budget and update cost.
+class SensorHistory::Info : public CommandParser::Command {
+public:
+	Info(SensorHistory &history) : history(history) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the history levels, memory usage and per sample update cost.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		SensorHistory &h = this->history;
+
+		std::string out = stdsprintf("%u sensors, %u bytes of buckets (%u bytes each)\n",
+				h.tracks.size(), h.getMemoryUsage(), sizeof(Bucket));
+		for (size_t level = 0; level < LEVELS; ++level)
+			out += stdsprintf("  level %u: %lu ms x %hu buckets\n", level, levels[level].period_ms, levels[level].buckets);
+
+		uint64_t max = h.update_max, sum = h.update_sum;
+		uint32_t count = h.update_count;
+		if (count) {
+			out += stdsprintf("%lu updates, avg %llu ns, max %llu ns\n",
+					count, HiResTimer::countsToUs(sum * 1000 / count), HiResTimer::countsToUs(max * 1000));
+		}
+		console->write(out);
+	}
+
+private:
+	SensorHistory &history;
+};
+
+void SensorHistory::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "show", std::make_shared<SensorHistory::Show>(*this));
+	parser.registerCommand(prefix + "info", std::make_shared<SensorHistory::Info>(*this));
+}
+
+void SensorHistory::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "show", nullptr);
+	parser.registerCommand(prefix + "info", nullptr);
+}
@@ -0,0 +1,175 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SENSOR_HISTORY_SENSOR_HISTORY_H_
+#define SRC_COMPONENTS_SENSOR_HISTORY_SENSOR_HISTORY_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <drivers/generics/adc.h>
+#include <adc_frame/adc_frame.h>
+#include <services/console/command_parser.h>
+#include <services/ftp/ftp.h>
+
+/**
+ * Fixed memory, multi-resolution history of every PayloadManager ADC sensor.
+ *
+ * Each sensor has a cascade of rings (10 ms, 1 s, 1 min and 1 h buckets by
+ * default, see levels[]).  Each bucket keeps the min, max and mean of the raw
+ * ADC codes it covers.  A full bucket is folded into the next level, so a
+ * sample costs one bucket write plus, occasionally, a fold per level.  All
+ * memory is allocated once at construction.
+ */
+class SensorHistory final : public ConsoleCommandSupport {
+public:
+	//! One aggregated bucket of raw ADC codes.
+	struct Bucket {
+		uint16_t min;	///< Smallest code.
+		uint16_t max;	///< Largest code.
+		uint32_t sum;	///< Sum of the child means (or samples, at level 0).
+		uint16_t count;	///< Number of children summed.
+		uint16_t reserved;
+
+		//! The mean code of this bucket.
+		inline uint16_t mean() const { return this->count ? this->sum / this->count : 0; };
+	};
+
+	//! Configuration of one resolution level.
+	struct Level {
+		uint32_t period_ms;	///< Time covered by one bucket.
+		uint16_t buckets;	///< Ring size.
+		uint16_t ratio;		///< Buckets of the previous level per bucket (1 at level 0).
+	};
+
+	static const size_t LEVELS = 4;			///< Number of resolution levels.
+	static const Level levels[LEVELS];		///< The resolution levels, finest first.
+	static const size_t NAME_LENGTH = 16;	///< Sensor name length in the exported file.
+
+	/**
+	 * Allocate history for every PayloadManager ADC sensor.
+	 * @note PayloadManager::addADCSensor() must have been called for all sensors.
+	 * @note Samples are fed by the owner, usually through sample() from a SamplingScheduler.
+	 */
+	SensorHistory();
+	virtual ~SensorHistory();
+
+	/**
+	 * Add a sample for a sensor, this is the only update path.
+	 *
+	 * @param sensor Sensor index, in getSensorNames() order.
+	 * @param code Raw ADC code.
+	 */
+	void addSample(size_t sensor, uint16_t code);
+
+	/**
+	 * Read a sensor's ADC channel and add the sample.
+	 * @param sensor Sensor index, in getSensorNames() order.
+	 */
+	void sample(size_t sensor);
+
+	/**
+	 * Add a sample for every sensor read by the AD7689 sequencers, out of one
+	 * frame so that they are all from the same scan.
+	 *
+	 * Sensors are located by their sensor processor channel, eight per device.
+	 *
+	 * @param frame A coherent frame.
+	 */
+	void addFrame(const ADCFrameReader::Frame &frame);
+
+	//! The sensor is sampled by addFrame() rather than sample().
+	inline bool isInFrame(size_t sensor) const { return sensor < this->tracks.size() && this->tracks[sensor].frame_channel >= 0; };
+
+	//! The sampling period the finest level expects.
+	inline uint32_t getSamplePeriod() const { return levels[0].period_ms; };
+
+	/**
+	 * Copy the newest buckets of a sensor level, newest first.
+	 *
+	 * @param sensor Sensor index.
+	 * @param level Resolution level.
+	 * @param buckets Filled with up to count buckets.
+	 * @param count Maximum number of buckets to copy.
+	 * @return Number of buckets copied.
+	 */
+	size_t getBuckets(size_t sensor, size_t level, Bucket *buckets, size_t count);
+
+	//! Sensor names, in index order.
+	std::vector<std::string> getSensorNames() const;
+
+	//! Memory used by the rings, in bytes.
+	inline size_t getMemoryUsage() const { return this->storage_size * sizeof(Bucket); };
+
+	/**
+	 * Create a VFS file exporting the complete history.
+	 *
+	 * The file is a FileHeader, then FileHeader::sensors SensorHeaders, then
+	 * for every sensor and level the ring of Buckets, oldest first.  Buckets
+	 * not filled yet have a count of 0.
+	 */
+	VFS::File createFile();
+
+	//! Header of the exported file, all fields little endian.
+	struct __attribute__((packed)) FileHeader {
+		char magic[4];				///< "SHST"
+		uint16_t version;			///< File format version, currently 1.
+		uint16_t sensors;			///< Number of sensors.
+		uint16_t levels;			///< Number of levels.
+		uint16_t bucket_size;		///< sizeof(Bucket)
+		Level level[LEVELS];		///< Level configuration.
+	};
+
+	//! Per sensor header of the exported file.
+	struct __attribute__((packed)) SensorHeader {
+		char name[NAME_LENGTH];		///< Sensor name, zero padded.
+		uint16_t filled[LEVELS];	///< Valid buckets per level.
+	};
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! History of one sensor.
+	struct Track {
+		std::string name;					///< Sensor name.
+		const ADC::Channel *adc;			///< The sensor ADC channel.
+		int frame_channel;					///< Sensor processor channel for addFrame(), -1 if not on an AD7689.
+		Bucket *ring[LEVELS];				///< Ring per level, in storage.
+		uint16_t head[LEVELS];				///< Next slot per level.
+		uint16_t filled[LEVELS];			///< Valid slots per level.
+		Bucket pending[LEVELS];				///< Bucket being folded per level (unused at level 0).
+	};
+
+	SemaphoreHandle_t mutex;	///< Protects the tracks.
+	std::vector<Track> tracks;	///< One per sensor.
+	Bucket *storage;			///< All rings.
+	size_t storage_size;		///< Buckets in storage.
+
+	uint64_t update_max;		///< Longest addSample() update, in global timer counts.
+	uint64_t update_sum;		///< Sum of update durations.
+	uint32_t update_count;		///< Updates.
+
+	void push(Track &track, size_t level, const Bucket &bucket);
+
+	class Show;	///< Console command to print a sensor history.
+	class Info;	///< Console command to show memory and update cost.
+};
+
+#endif /* SRC_COMPONENTS_SENSOR_HISTORY_SENSOR_HISTORY_H_ */
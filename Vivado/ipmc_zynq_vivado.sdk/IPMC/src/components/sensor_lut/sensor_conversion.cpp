@@ -0,0 +1,118 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sensor_conversion.h"
+#include <math.h>
+#include <algorithm>
+
+double SensorConversion::Linear::toFloat(uint8_t raw) const {
+	double v = this->m * (double)raw;
+	v += this->b * pow(10, this->b_exp);
+	v *= pow(10, this->r_exp);
+	return v;
+}
+
+uint8_t SensorConversion::Linear::toIPMI(double value) const {
+	if (this->m == 0)
+		return 0;
+
+	double v = value / pow(10, this->r_exp);
+	v -= this->b * pow(10, this->b_exp);
+	v /= this->m;
+	v = trunc(v);
+
+	if (v <= 0)
+		return 0;
+	if (v >= 255)
+		return 255;
+	return (uint8_t)v;
+}
+
+//! Sign extend a two's complement value of the given bit width.
+static inline int16_t signExtend(uint16_t value, unsigned bits) {
+	const uint16_t sign = 1 << (bits - 1);
+	value &= (1 << bits) - 1;
+	return (value ^ sign) - sign;
+}
+
+bool SensorConversion::Linear::fromSDR01(const std::vector<uint8_t> &sdr, Linear &linear) {
+	// Offsets are from the IPMI v2.0 Full Sensor Record (Table 43-1), zero based.
+	if (sdr.size() < 48 || sdr[3] != 0x01)
+		return false;
+	if ((sdr[20] >> 6) != 0)
+		return false; // Not unsigned
+	if (sdr[23] != 0)
+		return false; // Not linear
+
+	linear.m = signExtend(sdr[24] | ((sdr[25] & 0xC0) << 2), 10);
+	linear.b = signExtend(sdr[26] | ((sdr[27] & 0xC0) << 2), 10);
+	linear.r_exp = signExtend(sdr[29] >> 4, 4);
+	linear.b_exp = signExtend(sdr[29] & 0x0F, 4);
+	return true;
+}
+
+SensorConversion::Table::Table(std::function<double(uint16_t)> code_to_real, const Linear &linear) :
+	linear(linear), monotonic(true) {
+	auto convert = [&code_to_real, &linear](uint32_t code) -> uint8_t {
+		return linear.toIPMI(code_to_real(code));
+	};
+
+	for (size_t bucket = 0; bucket < FORWARD_SIZE; ++bucket) {
+		this->forward[bucket] = convert(bucket << FORWARD_SHIFT);
+		if (bucket && this->forward[bucket] < this->forward[bucket-1])
+			this->monotonic = false;
+	}
+	this->max_raw = convert(0xFFFF);
+	if (this->max_raw < this->forward[FORWARD_SIZE-1])
+		this->monotonic = false;
+
+	// Lowest code reaching each raw value, by bisection since the conversion is monotonic.
+	this->reverse[0] = 0;
+	for (size_t raw = 1; raw < 256; ++raw) {
+		uint32_t lo = 0, hi = 0x10000;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			if (convert(mid) >= raw)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		this->reverse[raw] = (lo > 0xFFFF) ? 0xFFFF : lo;
+	}
+}
+
+std::vector<SensorConversion::SDR01Info> SensorConversion::parseSDR01s(const std::vector<uint8_t> &sdrs) {
+	std::vector<SDR01Info> records;
+	for (size_t offset = 0; offset + 5 <= sdrs.size(); ) {
+		size_t length = 5 + sdrs[offset+4];
+		if (offset + length > sdrs.size())
+			break;
+
+		if (sdrs[offset+3] == 0x01 && length >= 48) {
+			std::vector<uint8_t> sdr(sdrs.begin() + offset, sdrs.begin() + offset + length);
+			size_t id_length = std::min<size_t>(sdr[47] & 0x1F, length - 48);
+
+			SDR01Info info;
+			info.name = std::string(sdr.begin() + 48, sdr.begin() + 48 + id_length);
+			info.sensor_number = sdr[7];
+			info.linear_valid = Linear::fromSDR01(sdr, info.linear);
+			records.push_back(info);
+		}
+		offset += length;
+	}
+	return records;
+}
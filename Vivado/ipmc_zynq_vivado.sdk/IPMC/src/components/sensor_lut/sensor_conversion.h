@@ -0,0 +1,133 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SENSOR_LUT_SENSOR_CONVERSION_H_
+#define SRC_COMPONENTS_SENSOR_LUT_SENSOR_CONVERSION_H_
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * SDR linear conversion math and the precomputed conversion tables built on it.
+ *
+ * This is the part of SensorLUT that only depends on the standard library,
+ * so it can be built and checked on a host, see sensor_conversion_test.cpp.
+ */
+class SensorConversion {
+public:
+	/**
+	 * IPMI linear conversion factors, y = (M*x + B*10^Bexp) * 10^Rexp.
+	 *
+	 * The math deliberately matches LinearConverter in doc/SDR Calculator.html,
+	 * including truncation when converting to the IPMI raw value.
+	 */
+	struct Linear {
+		int16_t m;		///< 10-bit signed M.
+		int16_t b;		///< 10-bit signed B.
+		int8_t b_exp;	///< 4-bit signed B exponent.
+		int8_t r_exp;	///< 4-bit signed result exponent.
+
+		//! Convert an IPMI raw value to a real value.
+		double toFloat(uint8_t raw) const;
+		//! Convert a real value to an IPMI raw value, saturating to [0,255].
+		uint8_t toIPMI(double value) const;
+
+		bool operator==(const Linear &other) const {
+			return this->m == other.m && this->b == other.b && this->b_exp == other.b_exp && this->r_exp == other.r_exp;
+		};
+
+		/**
+		 * Extract the conversion from a raw Full Sensor Record (type 01h).
+		 *
+		 * @param sdr The raw record, including its header.
+		 * @param linear Filled with the conversion factors.
+		 * @return false if the record isn't an unsigned, linear full sensor record.
+		 */
+		static bool fromSDR01(const std::vector<uint8_t> &sdr, Linear &linear);
+	};
+
+	//! The fields of a raw Full Sensor Record (type 01h) the board components need.
+	struct SDR01Info {
+		std::string name;		///< ID string.
+		uint8_t sensor_number;	///< Sensor number.
+		bool linear_valid;		///< Whether linear holds an unsigned linear conversion.
+		Linear linear;			///< Conversion factors.
+	};
+
+	/**
+	 * Walk an exported SDR repository and extract every full sensor record.
+	 * @param sdrs The exported SDR repository, as by SensorDataRepository::u8export().
+	 * @return One entry per full sensor record, in repository order.
+	 */
+	static std::vector<SDR01Info> parseSDR01s(const std::vector<uint8_t> &sdrs);
+
+	/**
+	 * Conversion tables for one sensor.
+	 *
+	 * The forward table holds the IPMI raw value at the start of every
+	 * 2^FORWARD_SHIFT code bucket and the reverse table holds the lowest code
+	 * reaching each IPMI raw value.  As long as the conversion is monotonic a
+	 * reading is one forward lookup plus one reverse compare (more only if a
+	 * bucket spans several IPMI steps), with no float math.
+	 */
+	class Table {
+	public:
+		static const size_t FORWARD_SHIFT = 4;							///< log2 of codes per forward bucket.
+		static const size_t FORWARD_SIZE = 65536 >> FORWARD_SHIFT;		///< Forward table entries.
+
+		/**
+		 * Build the tables.
+		 *
+		 * @param code_to_real Converts an ADC code to a real value.
+		 * @param linear The SDR conversion.
+		 */
+		Table(std::function<double(uint16_t)> code_to_real, const Linear &linear);
+
+		//! Convert an ADC code to an IPMI raw value.
+		inline uint8_t toIPMI(uint16_t code) const {
+			uint8_t raw = this->forward[code >> FORWARD_SHIFT];
+			while (raw < this->max_raw && code >= this->reverse[raw + 1])
+				raw++;
+			return raw;
+		};
+
+		/**
+		 * Convert an IPMI raw value, such as a threshold, to the lowest ADC
+		 * code that reads as at least that value.
+		 *
+		 * @return The code, or 0xFFFF if no code below it reaches the value.
+		 */
+		inline uint16_t toCode(uint8_t raw) const { return this->reverse[raw]; };
+
+		//! The SDR conversion this table was built for.
+		inline const Linear& getLinear() const { return this->linear; };
+
+		//! false if the conversion was not monotonic and the tables are unreliable.
+		inline bool isMonotonic() const { return this->monotonic; };
+
+	private:
+		uint8_t forward[FORWARD_SIZE];	///< IPMI raw value at the start of each code bucket.
+		uint16_t reverse[256];			///< Lowest code reaching each IPMI raw value.
+		uint8_t max_raw;				///< IPMI raw value of the highest code.
+		Linear linear;					///< The SDR conversion used.
+		bool monotonic;					///< Whether the conversion was monotonic.
+	};
+};
+
+#endif /* SRC_COMPONENTS_SENSOR_LUT_SENSOR_CONVERSION_H_ */
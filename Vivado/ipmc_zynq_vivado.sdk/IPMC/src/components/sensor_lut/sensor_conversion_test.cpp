@@ -0,0 +1,152 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sensor_conversion_test.cpp
+ *
+ * Host round trip test of SensorConversion, not part of the firmware build.
+ *
+ * Build and run from this directory with:
+ *   g++ -std=c++11 -Wall sensor_conversion.cpp sensor_conversion_test.cpp -o sensor_conversion_test && ./sensor_conversion_test
+ */
+
+#include "sensor_conversion.h"
+#include <stdio.h>
+#include <math.h>
+
+static unsigned failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("%s:%d: %s failed: ", __FILE__, __LINE__, #cond); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+//! A conversion as the board uses them: a full scale voltage behind a divider, and its SDR factors.
+struct Case {
+	const char *name;
+	double full_scale;				///< Real value at ADC code 0x10000.
+	double offset;					///< Real value at ADC code 0.
+	SensorConversion::Linear linear;
+};
+
+static const Case cases[] = {
+	{ "+12VPYLD", 2.5 * 6.0,   0.0,   {  79,   0, 0, -3 } },
+	{ "+3.3V",    2.5 * 2.0,   0.0,   {  20,   0, 0, -3 } },
+	{ "T_TOP",    250.0,    -50.0,    {   1, -50, 0,  0 } },
+	{ "offset",   2.5,        0.0,    {  10, 100, -1, -3 } },
+	{ "coarse",   2.5,        0.0,    { 500,   0, 0, -3 } },
+};
+
+//! Every ADC code must convert through the tables exactly as through the direct math.
+static void testForward(const Case &c, const SensorConversion::Table &table) {
+	unsigned mismatches = 0;
+	for (uint32_t code = 0; code <= 0xFFFF; ++code) {
+		const uint8_t direct = c.linear.toIPMI(c.offset + c.full_scale * code / 65536.0);
+		if (table.toIPMI(code) != direct)
+			mismatches++;
+	}
+	CHECK(mismatches == 0, "%s: %u codes convert differently", c.name, mismatches);
+}
+
+//! Every threshold code must be the first code reading at least that raw value.
+static void testReverse(const Case &c, const SensorConversion::Table &table) {
+	for (unsigned raw = 1; raw < 256; ++raw) {
+		const uint16_t code = table.toCode(raw);
+		if (code == 0xFFFF) {
+			CHECK(table.toIPMI(0xFFFF) < raw || table.toCode(raw - 1) == 0xFFFF || table.toIPMI(0xFFFF) == raw,
+					"%s: raw %u unreachable but reached by code 0xFFFF", c.name, raw);
+			break;
+		}
+		CHECK(table.toIPMI(code) >= raw, "%s: code %hu for raw %u reads %hhu", c.name, code, raw, table.toIPMI(code));
+		if (code)
+			CHECK(table.toIPMI(code - 1) < raw, "%s: code %hu for raw %u is not the first", c.name, code, raw);
+	}
+}
+
+//! Raw values must survive a trip through real values, nudged half a step to stay clear of truncation.
+static void testLinearRoundTrip(const Case &c) {
+	const double step = c.linear.toFloat(1) - c.linear.toFloat(0);
+	for (unsigned raw = 0; raw < 256; ++raw) {
+		const uint8_t back = c.linear.toIPMI(c.linear.toFloat(raw) + step / 2);
+		CHECK(back == raw, "%s: raw %u comes back as %hhu", c.name, raw, back);
+	}
+}
+
+//! Build a minimal Full Sensor Record carrying a conversion and an ID string.
+static std::vector<uint8_t> makeSDR01(const SensorConversion::Linear &l, uint8_t number, const std::string &name) {
+	std::vector<uint8_t> sdr(48, 0);
+	sdr[2] = 0x51;
+	sdr[3] = 0x01;
+	sdr[7] = number;
+	sdr[24] = l.m & 0xff;
+	sdr[25] = (l.m >> 2) & 0xC0;
+	sdr[26] = l.b & 0xff;
+	sdr[27] = (l.b >> 2) & 0xC0;
+	sdr[29] = ((l.r_exp & 0x0F) << 4) | (l.b_exp & 0x0F);
+	sdr[47] = 0xC0 | name.size();
+	sdr.insert(sdr.end(), name.begin(), name.end());
+	sdr[4] = sdr.size() - 5;
+	return sdr;
+}
+
+//! Conversions must come back out of exported records unchanged, signs and all.
+static void testSDRDecode() {
+	std::vector<uint8_t> sdrs;
+	for (const Case &c : cases) {
+		const std::vector<uint8_t> sdr = makeSDR01(c.linear, &c - cases, c.name);
+		sdrs.insert(sdrs.end(), sdr.begin(), sdr.end());
+	}
+	const SensorConversion::Linear negative = { -300, -512, -8, 7 };
+	const std::vector<uint8_t> sdr = makeSDR01(negative, 99, "negative");
+	sdrs.insert(sdrs.end(), sdr.begin(), sdr.end());
+
+	const std::vector<SensorConversion::SDR01Info> infos = SensorConversion::parseSDR01s(sdrs);
+	CHECK(infos.size() == sizeof(cases) / sizeof(cases[0]) + 1, "%u records parsed", (unsigned)infos.size());
+	for (size_t i = 0; i < infos.size() && i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		CHECK(infos[i].name == cases[i].name, "record %u is named %s", (unsigned)i, infos[i].name.c_str());
+		CHECK(infos[i].sensor_number == i, "record %u has number %hhu", (unsigned)i, infos[i].sensor_number);
+		CHECK(infos[i].linear_valid && infos[i].linear == cases[i].linear, "%s: conversion differs", cases[i].name);
+	}
+	if (infos.size() == sizeof(cases) / sizeof(cases[0]) + 1)
+		CHECK(infos.back().linear_valid && infos.back().linear == negative, "negative factors differ");
+}
+
+//! A falling conversion must be flagged.
+static void testNonMonotonic() {
+	const SensorConversion::Linear linear = { 10, 0, 0, -3 };
+	const SensorConversion::Table table([](uint16_t code) -> double { return 2.5 - 2.5 * code / 65536.0; }, linear);
+	CHECK(!table.isMonotonic(), "falling conversion not flagged");
+}
+
+int main() {
+	for (const Case &c : cases) {
+		const SensorConversion::Table table([&c](uint16_t code) -> double { return c.offset + c.full_scale * code / 65536.0; }, c.linear);
+		CHECK(table.isMonotonic(), "%s: not monotonic", c.name);
+		testForward(c, table);
+		testReverse(c, table);
+		testLinearRoundTrip(c);
+	}
+	testSDRDecode();
+	testNonMonotonic();
+
+	printf("%s, %u failures\n", failures ? "FAILED" : "PASSED", failures);
+	return failures ? 1 : 0;
+}
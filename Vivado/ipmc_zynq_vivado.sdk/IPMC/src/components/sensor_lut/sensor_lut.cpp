@@ -0,0 +1,196 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sensor_lut.h"
+#include <payload_manager.h>
+#include <libs/printf.h>
+#include "xtime_l.h"
+
+SensorLUT::SensorLUT() :
+	rebuilds("sensor_lut.rebuilds") {
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+}
+
+SensorLUT::~SensorLUT() {
+	vSemaphoreDelete(this->mutex);
+}
+
+size_t SensorLUT::rebuild(const std::vector<uint8_t> &sdrs) {
+	// Collect the linear conversion of every named full sensor record.
+	std::map<std::string, Linear> linears;
+	for (const SDR01Info &info : SensorLUT::parseSDR01s(sdrs))
+		if (info.linear_valid)
+			linears[info.name] = info.linear;
+
+	// Drop the tables of sensors whose record is gone or no longer linear.
+	MutexGuard<false> lock(this->mutex, true);
+	for (auto it = this->entries.begin(); it != this->entries.end();) {
+		if (linears.count(it->first)) {
+			++it;
+			continue;
+		}
+		if (it->second.sensor_processor_id >= 0 && (size_t)it->second.sensor_processor_id < MAX_CHANNELS)
+			this->channels[it->second.sensor_processor_id] = nullptr;
+		it = this->entries.erase(it);
+	}
+	lock.release();
+
+	size_t built = 0;
+	for (auto &it : PayloadManager::adc_sensors) {
+		auto linear = linears.find(it.first);
+		if (linear == linears.end())
+			continue;
+
+		lock.acquire();
+		auto entry = this->entries.find(it.first);
+		const bool unchanged = entry != this->entries.end() && entry->second.table->getLinear() == linear->second;
+		lock.release();
+		if (unchanged)
+			continue;
+
+		// Building touches every code bucket, don't hold the lock meanwhile.
+		const ADC::Channel &adc = it.second.adc;
+		std::shared_ptr<const Table> table = std::make_shared<const Table>([&adc](uint16_t code) -> double { return adc.rawToFloat(code); }, linear->second);
+
+		lock.acquire();
+		Entry &e = this->entries[it.first];
+		e.table = table;
+		e.sensor_processor_id = it.second.sensor_processor_id;
+		if (e.sensor_processor_id >= 0 && (size_t)e.sensor_processor_id < MAX_CHANNELS)
+			this->channels[e.sensor_processor_id] = table;
+		lock.release();
+
+		built++;
+	}
+
+	this->rebuilds.increment(built);
+	return built;
+}
+
+std::shared_ptr<const SensorLUT::Table> SensorLUT::get(const std::string &name) {
+	MutexGuard<false> lock(this->mutex, true);
+	auto it = this->entries.find(name);
+	if (it == this->entries.end())
+		return nullptr;
+	return it->second.table;
+}
+
+std::shared_ptr<const SensorLUT::Table> SensorLUT::getBySensorProcessorId(int sensor_processor_id) {
+	if (sensor_processor_id < 0 || (size_t)sensor_processor_id >= MAX_CHANNELS)
+		return nullptr;
+
+	MutexGuard<false> lock(this->mutex, true);
+	return this->channels[sensor_processor_id];
+}
+
+/// A console command to list the conversion tables.
+class SensorLUT::Info : public CommandParser::Command {
+public:
+	Info(SensorLUT &lut) : lut(lut) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"List the precomputed sensor conversion tables.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		MutexGuard<false> lock(this->lut.mutex, true);
+		std::string out;
+		for (auto &it : this->lut.entries) {
+			const Table &table = *it.second.table;
+			const Linear &l = table.getLinear();
+			out += stdsprintf("%-12s sp %2d  M %4hd B %4hd Bexp %2hhd Rexp %2hhd  codes %5hu..%5hu%s\n",
+					it.first.c_str(), it.second.sensor_processor_id, l.m, l.b, l.b_exp, l.r_exp,
+					table.toCode(1), table.toCode(255), table.isMonotonic() ? "" : "  NOT MONOTONIC");
+		}
+		lock.release();
+		console->write(out);
+	}
+
+private:
+	SensorLUT &lut;
+};
+
+/// A console command to check the tables against the direct conversion.
+class SensorLUT::Verify : public CommandParser::Command {
+public:
+	Verify(SensorLUT &lut) : lut(lut) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " [$sensor]\n\n"
+				"Check every ADC code of a sensor (or of all sensors) against the float conversion\n"
+				"and report mismatches and the time spent by each method.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		for (auto &it : PayloadManager::adc_sensors) {
+			if (parameters.nargs() > 1 && parameters.parameters[1] != it.first)
+				continue;
+
+			std::shared_ptr<const Table> table = this->lut.get(it.first);
+			if (!table)
+				continue;
+
+			const ADC::Channel &adc = it.second.adc;
+			const Linear &linear = table->getLinear();
+			uint32_t mismatches = 0, threshold_mismatches = 0;
+			uint32_t lut_sum = 0, direct_sum = 0;
+
+			XTime start, mid, end;
+			XTime_GetTime(&start);
+			for (uint32_t code = 0; code <= 0xFFFF; ++code)
+				lut_sum += table->toIPMI(code);
+			XTime_GetTime(&mid);
+			for (uint32_t code = 0; code <= 0xFFFF; ++code)
+				direct_sum += linear.toIPMI(adc.rawToFloat(code));
+			XTime_GetTime(&end);
+
+			if (lut_sum != direct_sum) {
+				for (uint32_t code = 0; code <= 0xFFFF; ++code)
+					if (table->toIPMI(code) != linear.toIPMI(adc.rawToFloat(code)))
+						mismatches++;
+			}
+
+			// Every threshold code must be the first one reading at least the threshold.
+			for (size_t raw = 1; raw < 256; ++raw) {
+				uint16_t code = table->toCode(raw);
+				if (code == 0xFFFF)
+					break;
+				if (table->toIPMI(code) < raw || (code && table->toIPMI(code - 1) >= raw))
+					threshold_mismatches++;
+			}
+
+			console->write(stdsprintf("%-12s %lu mismatches, %lu threshold mismatches, lut %llu us, direct %llu us\n",
+					it.first.c_str(), mismatches, threshold_mismatches,
+					(mid - start) * 1000000 / COUNTS_PER_SECOND, (end - mid) * 1000000 / COUNTS_PER_SECOND));
+		}
+	}
+
+private:
+	SensorLUT &lut;
+};
+
+void SensorLUT::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "info", std::make_shared<SensorLUT::Info>(*this));
+	parser.registerCommand(prefix + "verify", std::make_shared<SensorLUT::Verify>(*this));
+}
+
+void SensorLUT::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "info", nullptr);
+	parser.registerCommand(prefix + "verify", nullptr);
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SENSOR_LUT_SENSOR_LUT_H_
+#define SRC_COMPONENTS_SENSOR_LUT_SENSOR_LUT_H_
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <services/console/command_parser.h>
+#include "sensor_conversion.h"
+
+/**
+ * Precomputed ADC code to IPMI raw value conversion for linear sensors.
+ *
+ * Turning an ADC reading into the 8-bit IPMI raw value normally goes through
+ * the ADC::Channel float scaling (or its std::function callbacks) and then
+ * the SDR M/B/Bexp/Rexp formula.  Since both are fixed until the SDRs
+ * change, SensorLUT evaluates them once per sensor when SDRs are loaded and
+ * serves readings and thresholds from tables afterwards.
+ */
+class SensorLUT final : public SensorConversion, public ConsoleCommandSupport {
+public:
+	static const size_t MAX_CHANNELS = 32;	///< Sensor processor channels indexed for getBySensorProcessorId().
+
+	SensorLUT();
+	virtual ~SensorLUT();
+
+	/**
+	 * Rebuild tables for every PayloadManager ADC sensor whose SDR changed,
+	 * and drop those whose SDR is gone or no longer linear.
+	 *
+	 * Sensors are matched to SDRs by ID string.  This is meant to be called
+	 * whenever the SDR repository changed.
+	 *
+	 * @param sdrs The exported SDR repository, as by SensorDataRepository::u8export().
+	 * @return Number of tables (re)built.
+	 */
+	size_t rebuild(const std::vector<uint8_t> &sdrs);
+
+	/**
+	 * Retrieve the tables of a sensor.
+	 *
+	 * The returned tables stay valid even if they are rebuilt meanwhile, so
+	 * the hot path should fetch them once and use them for a whole pass.
+	 *
+	 * @param name The sensor (and SDR) name.
+	 * @return The tables, or an empty pointer if the sensor has none.
+	 */
+	std::shared_ptr<const Table> get(const std::string &name);
+
+	/**
+	 * Retrieve the tables of a sensor by its sensor processor channel.
+	 * @note This is an indexed load, meant for the reading paths.
+	 * @return The tables, or an empty pointer if the channel has none.
+	 */
+	std::shared_ptr<const Table> getBySensorProcessorId(int sensor_processor_id);
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! Tables for one ADC sensor.
+	struct Entry {
+		std::shared_ptr<const Table> table;	///< Current tables.
+		int sensor_processor_id;			///< Sensor processor channel, or -1.
+	};
+
+	SemaphoreHandle_t mutex;					///< Protects entries.
+	std::map<std::string, Entry> entries;		///< Tables by sensor name.
+	std::shared_ptr<const Table> channels[MAX_CHANNELS];	///< Tables by sensor processor channel.
+	StatCounter rebuilds;						///< Tables built.
+
+	class Info;		///< Console command to list the tables.
+	class Verify;	///< Console command to check tables against the direct math.
+};
+
+#endif /* SRC_COMPONENTS_SENSOR_LUT_SENSOR_LUT_H_ */
@@ -0,0 +1,383 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "soft_fault_policy.h"
+#include <libs/printf.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_event_dispatcher/sensor_event_dispatcher.h>
+
+SoftFaultPolicy::SoftFaultPolicy(uint16_t proc_device_id, uint16_t zone_device_id, SensorEventDispatcher &dispatcher, HiResTimer &timer, LogTree &log) :
+	dispatcher(dispatcher), timer(timer), log(log), task(nullptr),
+	rule_count(0), armed(0), task_rules(0), task_pending(0), task_irq_time(0),
+	force_off(nullptr), force_off_ref(nullptr),
+	watch_handle(-1), watching(false), watched(false), trips(0), unreported(0), unwatched(0) {
+	if (XST_SUCCESS != IPMI_Sensor_Proc_Initialize(&this->proc, proc_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize IPMI_Sensor_Proc(%hu)", proc_device_id));
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&this->mz, zone_device_id))
+		throw std::runtime_error(stdsprintf("Unable to initialize Mgmt_Zone_Ctrl(%hu)", zone_device_id));
+
+	this->mutex = xSemaphoreCreateMutex();
+	configASSERT(this->mutex);
+
+	this->task = runTask("softfault", TASK_PRIORITY_DRIVER, [this]() -> void { this->run(); });
+	this->dispatcher.addIrqHook(SoftFaultPolicy::_IrqHook, this);
+}
+
+SoftFaultPolicy::~SoftFaultPolicy() {
+	this->dispatcher.removeIrqHook(SoftFaultPolicy::_IrqHook, this);
+	this->timer.removePeriodic(this->watch_handle);
+	vTaskDelete(this->task);
+	vSemaphoreDelete(this->mutex);
+}
+
+size_t SoftFaultPolicy::addRule(const Rule &rule) {
+	if (rule.channel >= this->proc.sensor_ch_cnt || rule.channel >= 32)
+		throw std::domain_error(stdsprintf("Sensor processor channel %hhu is out of range", rule.channel));
+	if (!rule.thresholds || rule.thresholds > (THR_UNR | (THR_UNR - 1)))
+		throw std::domain_error(stdsprintf("Invalid threshold mask 0x%02hhx", rule.thresholds));
+	if (rule.action == ACTION_SOFT_FAULT && (!rule.zones || (rule.zones >> this->mz.mz_cnt)))
+		throw std::domain_error(stdsprintf("Invalid zone mask 0x%08lx", rule.zones));
+
+	MutexGuard<false> lock(this->mutex, true);
+	const size_t index = this->rule_count;
+	if (index >= MAX_RULES)
+		throw std::domain_error(stdsprintf("At most %u soft fault rules are supported", MAX_RULES));
+	this->rules[index] = rule;
+
+	CriticalGuard critical(true);
+	if (rule.path == PATH_TASK)
+		this->task_rules |= 1UL << index;
+	this->rule_count = index + 1;
+	this->armed |= 1UL << index;
+	return index;
+}
+
+void SoftFaultPolicy::setPath(size_t rule, Path path) {
+	MutexGuard<false> lock(this->mutex, true);
+	if (rule >= this->rule_count)
+		throw std::domain_error(stdsprintf("No soft fault rule %u", rule));
+
+	CriticalGuard critical(true);
+	this->rules[rule].path = path;
+	if (path == PATH_TASK)
+		this->task_rules |= 1UL << rule;
+	else
+		this->task_rules &= ~(1UL << rule);
+}
+
+void SoftFaultPolicy::setForceOff(ForceOff force_off, void *ref) {
+	CriticalGuard critical(true);
+	this->force_off = force_off;
+	this->force_off_ref = ref;
+}
+
+void SoftFaultPolicy::setReconcile(Reconcile reconcile) {
+	MutexGuard<false> lock(this->mutex, true);
+	this->reconcile = reconcile;
+}
+
+/**
+ * Check which of the given rules are over their thresholds.
+ *
+ * @param channels Channels worth reading, rules on other channels are skipped.
+ * @param rules Rules to check.
+ * @return The rules that tripped.
+ */
+uint32_t SoftFaultPolicy::evaluate(uint32_t channels, uint32_t rules) {
+	uint32_t tripped = 0;
+	for (; rules; rules &= rules - 1) {
+		const size_t i = __builtin_ctz(rules);
+		const Rule &rule = this->rules[i];
+		if (!((channels >> rule.channel) & 1))
+			continue;
+
+		u16 reading;
+		u8 thr_status;
+		if (XST_SUCCESS == IPMI_Sensor_Proc_Get_Sensor_Reading(&this->proc, rule.channel, &reading, &thr_status)
+				&& (thr_status & rule.thresholds))
+			tripped |= 1UL << i;
+	}
+	return tripped;
+}
+
+/**
+ * Act on tripped rules and start watching the power enables.
+ * @note Called from interrupt context on the ISR path, or from the task in a
+ *       critical section on the task path, which then picks up the results itself.
+ */
+void SoftFaultPolicy::act(uint32_t tripped, Path path, uint64_t irq_time) {
+	this->armed &= ~tripped;
+	this->unreported |= tripped;
+	this->trips++;
+
+	u32 zones = 0;
+	bool force = false;
+	for (uint32_t bits = tripped; bits; bits &= bits - 1) {
+		const Rule &rule = this->rules[__builtin_ctz(bits)];
+		if (rule.action == ACTION_SOFT_FAULT)
+			zones |= rule.zones;
+		else
+			force = true;
+	}
+
+	const u32 enables = Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&this->mz);
+	if (force && this->force_off)
+		this->force_off(this->force_off_ref);
+	for (int z = this->mz.mz_cnt - 1; z >= 0; --z)
+		if ((zones >> z) & 1)
+			Mgmt_Zone_Ctrl_Dispatch_Soft_Fault(&this->mz, z);
+	const uint64_t now = HiResTimer::now();
+
+	if (this->watching || this->watched) {
+		// The trip is still acted on and logged, it just isn't timed.
+		this->unwatched++;
+		if (path == PATH_ISR)
+			vTaskNotifyGiveFromISR(this->task, nullptr);
+		return;
+	}
+
+	Trip &trip = this->trip;
+	trip.rules = tripped;
+	trip.path = path;
+	trip.irq_time = irq_time;
+	trip.action_time = now;
+	trip.first_off = 0;
+	trip.settled = 0;
+	trip.deadline = now + HiResTimer::usToCounts(WATCH_MS * 1000);
+	trip.enables = zones ? enables : 0;
+	trip.zones = zones;
+
+	if (trip.enables)
+		this->watch_handle = this->timer.addPeriodicFromISR(WATCH_US, SoftFaultPolicy::_WatchCallback, this);
+	if (this->watch_handle >= 0) {
+		this->watching = true;
+	} else {
+		// Nothing to watch, or no timer slot.
+		if (!trip.enables)
+			trip.settled = now;
+		this->watched = true;
+		if (path == PATH_ISR)
+			vTaskNotifyGiveFromISR(this->task, nullptr);
+	}
+}
+
+void SoftFaultPolicy::_IrqHook(uint32_t status, uint64_t irq_time, void *ref) {
+	reinterpret_cast<SoftFaultPolicy*>(ref)->irqHook(status, irq_time);
+}
+
+void SoftFaultPolicy::irqHook(uint32_t status, uint64_t irq_time) {
+	const uint32_t tripped = this->evaluate(status, this->armed & ~this->task_rules);
+	if (tripped)
+		this->act(tripped, PATH_ISR, irq_time);
+
+	uint32_t task_channels = 0;
+	for (uint32_t bits = this->armed & this->task_rules; bits; bits &= bits - 1)
+		task_channels |= 1UL << this->rules[__builtin_ctz(bits)].channel;
+	task_channels &= status;
+	if (task_channels) {
+		if (!this->task_pending)
+			this->task_irq_time = irq_time;
+		this->task_pending |= task_channels;
+		vTaskNotifyGiveFromISR(this->task, nullptr);
+	}
+}
+
+bool SoftFaultPolicy::_WatchCallback(void *p) {
+	return reinterpret_cast<SoftFaultPolicy*>(p)->watch();
+}
+
+//! Poll the power enables after a trip, runs in interrupt context.
+bool SoftFaultPolicy::watch() {
+	Trip &trip = this->trip;
+	const uint64_t now = HiResTimer::now();
+
+	const u32 on = Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&this->mz) & trip.enables;
+	if (!trip.first_off && on != trip.enables)
+		trip.first_off = now;
+
+	bool settled = !on;
+	for (u32 z = 0; settled && z < this->mz.mz_cnt; ++z)
+		if ((trip.zones >> z) & 1)
+			settled = Mgmt_Zone_Ctrl_Get_MZ_Status(&this->mz, z) == MZ_PWR_OFF;
+	if (settled)
+		trip.settled = now;
+
+	if (!settled && now < trip.deadline)
+		return true;
+
+	this->watch_handle = -1;
+	this->watching = false;
+	this->watched = true;
+	vTaskNotifyGiveFromISR(this->task, nullptr);
+	return false;
+}
+
+void SoftFaultPolicy::run() {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, (this->armed != (1UL << this->rule_count) - 1) ? pdMS_TO_TICKS(REARM_MS) : portMAX_DELAY);
+
+		CriticalGuard critical(true);
+		const uint32_t channels = this->task_pending;
+		const uint64_t irq_time = this->task_irq_time;
+		this->task_pending = 0;
+		if (channels) {
+			const uint32_t tripped = this->evaluate(channels, this->armed & this->task_rules);
+			if (tripped)
+				this->act(tripped, PATH_TASK, irq_time);
+		}
+
+		const uint32_t reported = this->unreported;
+		this->unreported = 0;
+		const bool measured = this->watched;
+		const Trip trip = this->trip;
+		this->watched = false;
+		const uint32_t disarmed = ((1UL << this->rule_count) - 1) & ~this->armed;
+		critical.release();
+
+		MutexGuard<false> lock(this->mutex, true);
+		if (measured) {
+			std::string names;
+			for (uint32_t bits = trip.rules; bits; bits &= bits - 1)
+				names += (names.empty() ? "" : ", ") + this->rules[__builtin_ctz(bits)].name;
+			const char *path = trip.path == PATH_ISR ? "ISR" : "task";
+
+			std::string msg = stdsprintf("Soft fault %s acted from the %s path %llu us after the IRQ", names.c_str(), path,
+					HiResTimer::countsToUs(trip.action_time - trip.irq_time));
+			if (trip.first_off) {
+				this->latency[trip.path].add(HiResTimer::countsToUs(trip.first_off - trip.irq_time));
+				msg += stdsprintf(", first power enable off after %llu us", HiResTimer::countsToUs(trip.first_off - trip.irq_time));
+			}
+			if (trip.settled) {
+				this->settle[trip.path].add(HiResTimer::countsToUs(trip.settled - trip.irq_time));
+				msg += stdsprintf(", all off after %llu us.", HiResTimer::countsToUs(trip.settled - trip.irq_time));
+			} else {
+				msg += stdsprintf(", still on after %lu ms (PE 0x%08lx).", WATCH_MS, Mgmt_Zone_Ctrl_Get_Pwr_En_Status(&this->mz));
+			}
+			this->log.log(msg, trip.settled ? LogTree::LOG_WARNING : LogTree::LOG_ERROR);
+		}
+
+		Reconcile reconcile = this->reconcile;
+		std::vector<Rule> tripped_rules;
+		for (uint32_t bits = reported; bits; bits &= bits - 1) {
+			const Rule &rule = this->rules[__builtin_ctz(bits)];
+			tripped_rules.push_back(rule);
+			if (rule.action == ACTION_FORCE_OFF && !this->force_off)
+				this->log.log(stdsprintf("Soft fault %s tripped but no force off callback is set.", rule.name.c_str()), LogTree::LOG_ERROR);
+		}
+
+		// Re-arm the rules whose thresholds have cleared.
+		for (uint32_t bits = disarmed; bits; bits &= bits - 1) {
+			const size_t i = __builtin_ctz(bits);
+			if (this->evaluate(1UL << this->rules[i].channel, 1UL << i))
+				continue;
+
+			CriticalGuard rearm(true);
+			this->armed |= 1UL << i;
+			rearm.release();
+			this->log.log(stdsprintf("Soft fault %s re-armed, threshold cleared.", this->rules[i].name.c_str()), LogTree::LOG_NOTICE);
+		}
+		lock.release();
+
+		// The policy's consequences for the rest of the firmware are settled at task level.
+		if (reconcile)
+			for (const Rule &rule : tripped_rules)
+				reconcile(rule);
+	}
+}
+
+/// A console command to show the rules and trip latencies.
+class SoftFaultPolicy::Status : public CommandParser::Command {
+public:
+	Status(SoftFaultPolicy &policy) : policy(policy) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the soft fault rules and the latency from the sensor processor IRQ to the\n"
+				"first power enable turning off, per path.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const char *thresholds[] = {"LNC", "LCR", "LNR", "UNC", "UCR", "UNR"};
+		SoftFaultPolicy &p = this->policy;
+
+		std::string out = stdsprintf("Trips: %lu, untimed: %lu\n", p.trips, p.unwatched);
+		MutexGuard<false> lock(p.mutex, true);
+		for (size_t i = 0; i < p.rule_count; ++i) {
+			const Rule &rule = p.rules[i];
+			out += stdsprintf("%u: %-12s ch%-2hhu", i, rule.name.c_str(), rule.channel);
+			for (size_t bit = 0; bit < 6; ++bit)
+				if (rule.thresholds & (1 << bit))
+					out += std::string(" ") + thresholds[bit];
+			if (rule.action == ACTION_SOFT_FAULT)
+				out += stdsprintf(" -> soft fault zones 0x%02lx", rule.zones);
+			else
+				out += " -> force off";
+			out += stdsprintf(", %s path, %s\n", rule.path == PATH_ISR ? "ISR" : "task",
+					((p.armed >> i) & 1) ? "armed" : "tripped");
+		}
+		out += p.latency[PATH_ISR].format("ISR path, first off");
+		out += p.settle[PATH_ISR].format("ISR path, all off");
+		out += p.latency[PATH_TASK].format("Task path, first off");
+		out += p.settle[PATH_TASK].format("Task path, all off");
+		lock.release();
+
+		console->write(out);
+	}
+
+private:
+	SoftFaultPolicy &policy;
+};
+
+/// A console command to move a rule between the ISR and task paths.
+class SoftFaultPolicy::SetPath : public CommandParser::Command {
+public:
+	SetPath(SoftFaultPolicy &policy) : policy(policy) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + " $rule isr|task\n\n"
+				"Act on a rule from the sensor processor interrupt or from the policy task,\n"
+				"to compare the latencies of both paths.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		uint32_t rule;
+		std::string path;
+		if (!parameters.parseParameters(1, true, &rule, &path) || (path != "isr" && path != "task")) {
+			console->write("Invalid parameters, see help.\n");
+			return;
+		}
+
+		try {
+			this->policy.setPath(rule, path == "isr" ? PATH_ISR : PATH_TASK);
+		} catch (std::exception &e) {
+			console->write(std::string(e.what()) + "\n");
+		}
+	}
+
+private:
+	SoftFaultPolicy &policy;
+};
+
+void SoftFaultPolicy::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<SoftFaultPolicy::Status>(*this));
+	parser.registerCommand(prefix + "path", std::make_shared<SoftFaultPolicy::SetPath>(*this));
+}
+
+void SoftFaultPolicy::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+	parser.registerCommand(prefix + "path", nullptr);
+}
@@ -0,0 +1,188 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SOFT_FAULT_POLICY_SOFT_FAULT_POLICY_H_
+#define SRC_COMPONENTS_SOFT_FAULT_POLICY_SOFT_FAULT_POLICY_H_
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <latency_histogram/latency_histogram.h>
+#include "ipmi_sensor_proc.h"
+#include "mgmt_zone_ctrl.h"
+
+class HiResTimer;
+class SensorEventDispatcher;
+
+/**
+ * Sensor threshold to power down fast path for soft fault policies.
+ *
+ * Hard faults are handled by the zone controller itself, but policies such as
+ * powering down on an over-temperature are soft faults that used to wait for
+ * a task to wake, parse the event and call into the payload manager.  A rule
+ * ties a sensor processor channel and threshold to a soft fault on a set of
+ * zones, or to a forced power down through an ISR safe callback.
+ *
+ * Rules on the ISR path act from the sensor processor interrupt, through a
+ * SensorEventDispatcher IRQ hook.  Rules on the task path act from a driver
+ * priority task instead, which is the old behaviour and serves as reference.
+ * Either way a rule disarms when it trips and the task re-arms it once the
+ * threshold has cleared, logging the trip on the way.
+ *
+ * After acting, the power enables are watched from a HiResTimer callback, so
+ * the latency from the threshold crossing (the sensor processor IRQ) to the
+ * first power enable deasserting is measured for both paths.
+ *
+ * @note The channel's assertion event must be enabled, as by its SDR, or the
+ *       sensor processor won't raise an interrupt for it.
+ */
+class SoftFaultPolicy final : public ConsoleCommandSupport {
+public:
+	static const size_t MAX_RULES = 8;			///< Maximum number of rules.
+	static const uint32_t WATCH_US = 25;		///< Power enable polling period after a trip.
+	static const uint32_t WATCH_MS = 200;		///< Give up watching the power enables after this long.
+	static const uint32_t REARM_MS = 100;		///< Threshold polling period while a rule is disarmed.
+
+	//! What a tripped rule does.
+	enum Action {
+		ACTION_SOFT_FAULT,	///< Dispatch a soft fault to the rule's zones.
+		ACTION_FORCE_OFF,	///< Call the force off callback, see setForceOff().
+	};
+
+	//! Where a rule acts.
+	enum Path {
+		PATH_ISR,	///< From the sensor processor interrupt.
+		PATH_TASK,	///< From the policy task.
+	};
+
+	//! A soft fault rule.
+	struct Rule {
+		std::string name;		///< Name for the log and console.
+		uint8_t channel;		///< Sensor processor channel.
+		uint8_t thresholds;		///< Threshold status bits that trip the rule, as IPMI_Sensor_Proc_Get_Sensor_Reading().
+		Action action;			///< What to do.
+		uint32_t zones;			///< Zones to soft fault, for ACTION_SOFT_FAULT.
+		Path path;				///< Where to act.
+	};
+
+	//! Threshold status bits, as IPMI_Sensor_Proc_Get_Sensor_Reading().
+	enum Threshold : uint8_t {
+		THR_LNC = 1 << 0,
+		THR_LCR = 1 << 1,
+		THR_LNR = 1 << 2,
+		THR_UNC = 1 << 3,
+		THR_UCR = 1 << 4,
+		THR_UNR = 1 << 5,
+	};
+
+	//! ISR safe power down, for ACTION_FORCE_OFF.
+	typedef void (*ForceOff)(void *ref);
+
+	//! Called from the policy task after a trip was measured.
+	typedef std::function<void(const Rule &rule)> Reconcile;
+
+	/**
+	 * @param proc_device_id The IPMI_Sensor_Proc device ID.
+	 * @param zone_device_id The Mgmt_Zone_Ctrl device ID.
+	 * @param dispatcher The dispatcher to hook the sensor processor IRQ from.
+	 * @param timer The timer pacing the power enable watch.
+	 * @param log The log tree to report to.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	SoftFaultPolicy(uint16_t proc_device_id, uint16_t zone_device_id, SensorEventDispatcher &dispatcher, HiResTimer &timer, LogTree &log);
+	virtual ~SoftFaultPolicy();
+
+	/**
+	 * Add a rule, armed immediately.
+	 * @return The rule index.
+	 * @throw std::domain_error on an invalid rule or if there is no room left.
+	 */
+	size_t addRule(const Rule &rule);
+
+	//! Move a rule to the ISR or the task path.
+	void setPath(size_t rule, Path path);
+
+	//! Set the force off callback, nullptr to clear.
+	void setForceOff(ForceOff force_off, void *ref);
+
+	//! Set the task level follow-up of a trip, e.g. to align the payload manager, nullptr to clear.
+	void setReconcile(Reconcile reconcile);
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	//! A trip being watched, shared between the interrupts and the task.
+	struct Trip {
+		uint32_t rules;			///< Rules that tripped.
+		Path path;				///< Path that acted.
+		uint64_t irq_time;		///< Sensor processor IRQ.
+		uint64_t action_time;	///< Soft fault or force off issued.
+		uint64_t first_off;		///< First watched power enable deasserted, 0 if not seen.
+		uint64_t settled;		///< Everything off, 0 on timeout.
+		uint64_t deadline;		///< Watch timeout.
+		u32 enables;			///< Power enables on when the action was issued.
+		u32 zones;				///< Zones expected to turn off.
+	};
+
+	IPMI_Sensor_Proc proc;				///< Low level sensor processor driver, read only.
+	Mgmt_Zone_Ctrl mz;					///< Low level zone controller driver.
+	SensorEventDispatcher &dispatcher;	///< IRQ hook provider.
+	HiResTimer &timer;					///< Watch timer.
+	LogTree &log;						///< Log target.
+	TaskHandle_t task;					///< Policy task.
+	SemaphoreHandle_t mutex;			///< Protects the rule list and task side state.
+
+	Rule rules[MAX_RULES];				///< Rules, read from interrupt context.
+	volatile uint32_t rule_count;		///< Valid rules.
+	volatile uint32_t armed;			///< Rules that may trip.
+	volatile uint32_t task_rules;		///< Rules on the task path.
+	volatile uint32_t task_pending;		///< Task path channels with an IRQ not yet handled.
+	uint64_t task_irq_time;				///< IRQ time of the oldest pending task path channel.
+	ForceOff force_off;					///< Force off callback.
+	void *force_off_ref;				///< Force off callback argument.
+	Reconcile reconcile;				///< Task level follow-up.
+
+	Trip trip;							///< Trip being watched.
+	int watch_handle;					///< Watch timer handle, -1 if not watching.
+	volatile bool watching;				///< The watch timer is running.
+	volatile bool watched;				///< A watched trip is waiting for the task.
+	volatile uint32_t trips;			///< Trips since boot.
+	volatile uint32_t unreported;		///< Rules that tripped and weren't logged yet.
+	volatile uint32_t unwatched;		///< Trips while another was being watched.
+
+	LatencyHistogram latency[2];		///< IRQ to first power enable off, per Path.
+	LatencyHistogram settle[2];			///< IRQ to everything off, per Path.
+
+	uint32_t evaluate(uint32_t channels, uint32_t rules);
+	void act(uint32_t tripped, Path path, uint64_t irq_time);
+	static void _IrqHook(uint32_t status, uint64_t irq_time, void *ref);
+	void irqHook(uint32_t status, uint64_t irq_time);
+	static bool _WatchCallback(void *p);
+	bool watch();
+	void run();
+
+	class Status;	///< Console command to show rules and latencies.
+	class SetPath;	///< Console command to move a rule between paths.
+};
+
+#endif /* SRC_COMPONENTS_SOFT_FAULT_POLICY_SOFT_FAULT_POLICY_H_ */
@@ -0,0 +1,87 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_SPSC_RING_SPSC_RING_H_
+#define SRC_COMPONENTS_SPSC_RING_SPSC_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A lock-free single producer, single consumer ring of fixed capacity.
+ *
+ * Meant for handing data from interrupt context to a task without masking
+ * interrupts: the producer only writes head, the consumer only writes tail,
+ * and each publishes with release semantics.  Items are written and read in
+ * place through reserve()/commit() and front()/pop() to avoid copies in the
+ * ISR.
+ *
+ * @note Several ISRs at the same GIC priority count as a single producer, as
+ *       they cannot preempt each other.
+ */
+template <typename T, size_t N>
+class SPSCRing final {
+	static_assert(N && !(N & (N - 1)), "The capacity must be a power of two");
+
+public:
+	SPSCRing() : head(0), tail(0), dropped(0) {};
+
+	/**
+	 * Producer: get the next free slot, without publishing it.
+	 * @return The slot, or nullptr if the ring is full, which counts as a drop.
+	 */
+	T *reserve() {
+		if (this->head - __atomic_load_n(&this->tail, __ATOMIC_ACQUIRE) >= N) {
+			this->dropped++;
+			return nullptr;
+		}
+		return &this->items[this->head % N];
+	};
+
+	//! Producer: publish the slot returned by reserve().
+	void commit() {
+		__atomic_store_n(&this->head, this->head + 1, __ATOMIC_RELEASE);
+	};
+
+	//! Consumer: the oldest item, or nullptr if the ring is empty.
+	const T *front() const {
+		if (__atomic_load_n(&this->head, __ATOMIC_ACQUIRE) == this->tail)
+			return nullptr;
+		return &this->items[this->tail % N];
+	};
+
+	//! Consumer: release the item returned by front().
+	void pop() {
+		__atomic_store_n(&this->tail, this->tail + 1, __ATOMIC_RELEASE);
+	};
+
+	//! Items waiting, either side.
+	inline size_t size() const { return __atomic_load_n(&this->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&this->tail, __ATOMIC_ACQUIRE); };
+
+	//! Items lost because the ring was full.
+	inline uint32_t getDropped() const { return this->dropped; };
+
+	static const size_t CAPACITY = N;	///< Ring capacity.
+
+private:
+	T items[N];					///< Item storage.
+	uint32_t head;				///< Items produced, written by the producer only.
+	uint32_t tail;				///< Items consumed, written by the consumer only.
+	volatile uint32_t dropped;	///< Items lost, written by the producer only.
+};
+
+#endif /* SRC_COMPONENTS_SPSC_RING_SPSC_RING_H_ */
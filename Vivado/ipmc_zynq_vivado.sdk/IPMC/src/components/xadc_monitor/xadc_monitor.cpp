@@ -0,0 +1,241 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "xadc_monitor.h"
+#include <libs/printf.h>
+#include "xscugic.h"
+
+extern XScuGic xInterruptController;
+
+//! Per rail hardware resources, in Rail order.  Alarm bits follow the same order.
+static const struct {
+	u8 channel;			///< XADCPS_CH_* data channel.
+	u32 seq;			///< XADCPS_SEQ_CH_* sequencer bit.
+	u16 enable;			///< XADCPS_CFR1_ALM_* alarm enable.
+	u8 upper;			///< XADCPS_ATR_* upper threshold.
+	u8 lower;			///< XADCPS_ATR_* lower threshold.
+} rails[XADCMonitor::RAIL_COUNT] = {
+	{ XADCPS_CH_TEMP,    XADCPS_SEQ_CH_TEMP,    XADCPS_CFR1_ALM_TEMP_MASK,    XADCPS_ATR_TEMP_UPPER,    XADCPS_ATR_TEMP_LOWER },
+	{ XADCPS_CH_VCCINT,  XADCPS_SEQ_CH_VCCINT,  XADCPS_CFR1_ALM_VCCINT_MASK,  XADCPS_ATR_VCCINT_UPPER,  XADCPS_ATR_VCCINT_LOWER },
+	{ XADCPS_CH_VCCAUX,  XADCPS_SEQ_CH_VCCAUX,  XADCPS_CFR1_ALM_VCCAUX_MASK,  XADCPS_ATR_VCCAUX_UPPER,  XADCPS_ATR_VCCAUX_LOWER },
+	{ XADCPS_CH_VBRAM,   XADCPS_SEQ_CH_VBRAM,   XADCPS_CFR1_ALM_VBRAM_MASK,   XADCPS_ATR_VBRAM_UPPER_,  XADCPS_ATR_VBRAM_LOWER },
+	{ XADCPS_CH_VCCPINT, XADCPS_SEQ_CH_VCCPINT, XADCPS_CFR1_ALM_VCCPINT_MASK, XADCPS_ATR_VCCPINT_UPPER, XADCPS_ATR_VCCPINT_LOWER },
+	{ XADCPS_CH_VCCPAUX, XADCPS_SEQ_CH_VCCPAUX, XADCPS_CFR1_ALM_VCCPAUX_MASK, XADCPS_ATR_VCCPAUX_UPPER, XADCPS_ATR_VCCPAUX_LOWER },
+	{ XADCPS_CH_VCCPDRO, XADCPS_SEQ_CH_VCCPDRO, XADCPS_CFR1_ALM_VCCPDRO_MASK, XADCPS_ATR_VCCPDRO_UPPER, XADCPS_ATR_VCCPDRO_LOWER },
+};
+
+//! Alarm interrupts handled, the rail alarms and over-temperature.
+static const u32 alarm_intr_mask = XADCPS_INTX_ALM_ALL_MASK | XADCPS_INTX_OT_MASK;
+
+const char *XADCMonitor::rail_names[XADCMonitor::RAIL_COUNT] = {
+	"TEMP", "VCCINT", "VCCAUX", "VCCBRAM", "VCCPINT", "VCCPAUX", "VCCPDRO",
+};
+
+const XADCMonitor::Limits XADCMonitor::default_limits[XADCMonitor::RAIL_COUNT] = {
+	{ 75.0, 85.0 },		// Alarm at 85C, released below 75C.
+	{ 0.95, 1.05 },
+	{ 1.71, 1.89 },
+	{ 0.95, 1.05 },
+	{ 0.95, 1.05 },
+	{ 1.71, 1.89 },
+	{ 1.14, 1.89 },		// Covers DDR3L through LPDDR2/DDR2 I/O.
+};
+
+XADCMonitor::XADCMonitor(uint16_t device_id, uint32_t intr_id, ADC &reader, LogTree &log, uint8_t averaging, const Limits *limits, uint8_t priority) :
+	intr_id(intr_id), reader(reader), log(log), task(nullptr), averaging(averaging),
+	callback(nullptr), callback_ref(nullptr),
+	refreshes(0), pending(0), masked(0), irqs(0), alarms("xadc.alarms") {
+	if (averaging < XADCPS_AVG_16_SAMPLES || averaging > XADCPS_AVG_256_SAMPLES)
+		throw std::domain_error("XADC averaging must be 16, 64 or 256 samples");
+
+	for (size_t i = 0; i < RAIL_COUNT; ++i) {
+		this->limits[i] = limits ? limits[i] : default_limits[i];
+		this->raw[i] = 0;
+	}
+
+	XAdcPs_Config *config = XAdcPs_LookupConfig(device_id);
+	if (!config || XST_SUCCESS != XAdcPs_CfgInitialize(&this->xadc, config, config->BaseAddress))
+		throw std::runtime_error(stdsprintf("Unable to initialize XAdcPs(%hu)", device_id));
+
+	// Reconfigure from safe mode with alarms off, as the sequencer may not change while running.
+	XAdcPs_SetSequencerMode(&this->xadc, XADCPS_SEQ_MODE_SAFE);
+	XAdcPs_SetAlarmEnables(&this->xadc, 0);
+
+	u32 seq = XADCPS_SEQ_CH_CALIB;
+	u16 enables = XADCPS_CFR1_OT_MASK;
+	for (size_t i = 0; i < RAIL_COUNT; ++i) {
+		seq |= rails[i].seq;
+		enables |= rails[i].enable;
+
+		const Limits &l = this->limits[i];
+		if (i == RAIL_TEMP) {
+			XAdcPs_SetAlarmThreshold(&this->xadc, rails[i].upper, XAdcPs_TemperatureToRaw(l.upper));
+			XAdcPs_SetAlarmThreshold(&this->xadc, rails[i].lower, XAdcPs_TemperatureToRaw(l.lower));
+		} else {
+			XAdcPs_SetAlarmThreshold(&this->xadc, rails[i].upper, XAdcPs_VoltageToRaw(l.upper));
+			XAdcPs_SetAlarmThreshold(&this->xadc, rails[i].lower, XAdcPs_VoltageToRaw(l.lower));
+		}
+	}
+
+	XAdcPs_SetAvg(&this->xadc, averaging);
+	if (XST_SUCCESS != XAdcPs_SetSeqAvgEnables(&this->xadc, seq) ||
+		XST_SUCCESS != XAdcPs_SetSeqChEnables(&this->xadc, seq))
+		throw std::runtime_error("Unable to configure the XADC sequencer");
+	XAdcPs_SetCalibEnables(&this->xadc, XADCPS_CFR1_CAL_ADC_GAIN_OFFSET_MASK | XADCPS_CFR1_CAL_PS_GAIN_OFFSET_MASK);
+	XAdcPs_SetAlarmEnables(&this->xadc, enables);
+	XAdcPs_SetSequencerMode(&this->xadc, XADCPS_SEQ_MODE_CONTINPASS);
+
+	this->task = runTask("xadc_alarms", TASK_PRIORITY_DRIVER, [this]() -> void { this->run(); });
+
+	XAdcPs_IntrDisable(&this->xadc, XADCPS_INTX_ALL_MASK);
+	XAdcPs_IntrClear(&this->xadc, XADCPS_INTX_ALL_MASK);
+	if (XST_SUCCESS != XScuGic_Connect(&xInterruptController, intr_id, XADCMonitor::_InterruptHandler, (void*)this))
+		throw std::runtime_error("Unable to connect the XADC interrupt");
+	XScuGic_SetPriorityTriggerType(&xInterruptController, intr_id, priority, 0x1);
+	XScuGic_Enable(&xInterruptController, intr_id);
+	XAdcPs_IntrEnable(&this->xadc, alarm_intr_mask);
+}
+
+XADCMonitor::~XADCMonitor() {
+	XAdcPs_IntrDisable(&this->xadc, XADCPS_INTX_ALL_MASK);
+	XScuGic_Disable(&xInterruptController, this->intr_id);
+	XScuGic_Disconnect(&xInterruptController, this->intr_id);
+	vTaskDelete(this->task);
+}
+
+void XADCMonitor::setAlarmCallback(AlarmCallback callback, void *ref) {
+	CriticalGuard critical(true);
+	this->callback = callback;
+	this->callback_ref = ref;
+}
+
+void XADCMonitor::refresh() {
+	// Through the shared driver, so these transactions take turns with its other users.
+	for (size_t i = 0; i < RAIL_COUNT; ++i)
+		this->raw[i] = ADC::Channel(this->reader, rails[i].channel).readRaw();
+	this->refreshes++;
+}
+
+float XADCMonitor::get(Rail rail) const {
+	if (rail >= RAIL_COUNT)
+		throw std::domain_error("Invalid XADC rail");
+	if (rail == RAIL_TEMP)
+		return XAdcPs_RawToTemperature(this->raw[rail]);
+	return XAdcPs_RawToVoltage(this->raw[rail]);
+}
+
+uint32_t XADCMonitor::getActiveAlarms() {
+	// The alarm outputs are mirrored in the interface status register, no command FIFO access needed.
+	return XAdcPs_ReadReg(this->xadc.Config.BaseAddress, XADCPS_MSTS_OFFSET) & alarm_intr_mask;
+}
+
+void XADCMonitor::_InterruptHandler(void *p) {
+	reinterpret_cast<XADCMonitor*>(p)->interruptHandler();
+}
+
+void XADCMonitor::interruptHandler() {
+	u32 status = XAdcPs_IntrGetStatus(&this->xadc) & alarm_intr_mask & ~this->masked;
+	XAdcPs_IntrClear(&this->xadc, status);
+	this->irqs++;
+	if (!status)
+		return;
+
+	// Alarms stay up until the rail recovers, mask them until the task sees them release.
+	XAdcPs_IntrDisable(&this->xadc, status);
+	this->masked |= status;
+	this->pending |= status;
+
+	if (this->callback)
+		this->callback(status, this->callback_ref);
+
+	BaseType_t woken = pdFALSE;
+	vTaskNotifyGiveFromISR(this->task, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+void XADCMonitor::run() {
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, this->masked ? pdMS_TO_TICKS(RELEASE_POLL_MS) : portMAX_DELAY);
+
+		CriticalGuard critical(true);
+		u32 raised = this->pending;
+		this->pending = 0;
+		critical.release();
+
+		// Values are from the last refresh(), this task must not use the command FIFO.
+		for (u32 bits = raised; bits; bits &= bits - 1) {
+			u32 alarm = __builtin_ctz(bits);
+			this->alarms.increment();
+			if (alarm == RAIL_COUNT)
+				this->log.log("XADC over-temperature alarm asserted.", LogTree::LOG_CRITICAL);
+			else
+				this->log.log(stdsprintf("XADC %s alarm asserted, last reading %.3f.", rail_names[alarm], this->get((Rail)alarm)), LogTree::LOG_ERROR);
+		}
+
+		u32 released = this->masked & ~this->getActiveAlarms();
+		if (released) {
+			for (u32 bits = released; bits; bits &= bits - 1) {
+				u32 alarm = __builtin_ctz(bits);
+				this->log.log(stdsprintf("XADC %s alarm released.", (alarm == RAIL_COUNT) ? "over-temperature" : rail_names[alarm]), LogTree::LOG_NOTICE);
+			}
+
+			CriticalGuard unmask(true);
+			this->masked &= ~released;
+			XAdcPs_IntrClear(&this->xadc, released);
+			XAdcPs_IntrEnable(&this->xadc, released);
+		}
+	}
+}
+
+/// A console command to show the monitored rails and alarms.
+class XADCMonitor::Status : public CommandParser::Command {
+public:
+	Status(XADCMonitor &monitor) : monitor(monitor) {};
+
+	virtual std::string getHelpText(const std::string &command) const {
+		return command + "\n\n"
+				"Show the cached XADC sequencer results, alarm limits and active alarms.\n";
+	}
+
+	virtual void execute(std::shared_ptr<ConsoleSvc> console, const CommandParser::CommandParameters &parameters) {
+		static const uint16_t averages[] = {1, 16, 64, 256};
+		XADCMonitor &m = this->monitor;
+		uint32_t active = m.getActiveAlarms();
+
+		std::string out = stdsprintf("Continuous sequencer, %hu sample averaging, %lu refreshes, %lu interrupts\n",
+				averages[m.averaging], m.refreshes, m.irqs);
+		for (size_t i = 0; i < RAIL_COUNT; ++i) {
+			const char *unit = (i == RAIL_TEMP) ? "C" : "V";
+			out += stdsprintf("  %-8s %8.3f%s  [%.3f%s, %.3f%s]%s\n", rail_names[i], m.get((Rail)i), unit,
+					m.limits[i].lower, unit, m.limits[i].upper, unit, (active & (1 << i)) ? "  ALARM" : "");
+		}
+		if (active & XADCPS_INTX_OT_MASK)
+			out += "Over-temperature alarm active!\n";
+		console->write(out);
+	}
+
+private:
+	XADCMonitor &monitor;
+};
+
+void XADCMonitor::registerConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", std::make_shared<XADCMonitor::Status>(*this));
+}
+
+void XADCMonitor::deregisterConsoleCommands(CommandParser &parser, const std::string &prefix) {
+	parser.registerCommand(prefix + "status", nullptr);
+}
@@ -0,0 +1,139 @@
+/*
+ * This file is part of the ZYNQ-IPMC Framework.
+ *
+ * The ZYNQ-IPMC Framework is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ZYNQ-IPMC Framework is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the ZYNQ-IPMC Framework.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRC_COMPONENTS_XADC_MONITOR_XADC_MONITOR_H_
+#define SRC_COMPONENTS_XADC_MONITOR_XADC_MONITOR_H_
+
+#include <stdint.h>
+#include <string>
+#include <core.h>
+#include <libs/logtree/logtree.h>
+#include <services/console/command_parser.h>
+#include <drivers/generics/adc.h>
+#include "xadcps.h"
+
+/**
+ * Continuous XADC monitoring with hardware averaging and alarms.
+ *
+ * The XADC is put in continuous sequencer mode over the on-chip supplies and
+ * the die temperature, with on-chip averaging.  Conversions then never need a
+ * request, and the hardware compares every result against the alarm
+ * thresholds.  Alarms raise the XADC interrupt, where an optional callback
+ * can react in interrupt context before a task logs the event.
+ *
+ * Results are cached by refresh().  The command FIFO is shared with the PSXADC
+ * driver, whose channels (e.g. the VCCINT sensor) are read from other tasks,
+ * and FIFO transactions can't interleave.  refresh() therefore reads through
+ * that driver and serializes on its lock.  Only the constructor uses the FIFO
+ * directly, before anything else samples the XADC.
+ */
+class XADCMonitor final : public ConsoleCommandSupport {
+public:
+	//! Monitored on-chip channels.
+	enum Rail {
+		RAIL_TEMP,		///< Die temperature.
+		RAIL_VCCINT,	///< PL internal supply.
+		RAIL_VCCAUX,	///< PL auxiliary supply.
+		RAIL_VCCBRAM,	///< PL block RAM supply.
+		RAIL_VCCPINT,	///< PS internal supply.
+		RAIL_VCCPAUX,	///< PS auxiliary supply.
+		RAIL_VCCPDRO,	///< PS DDR I/O supply.
+		RAIL_COUNT,
+	};
+
+	//! Alarm limits of a rail, volts or degrees Celsius.
+	struct Limits {
+		float lower;	///< Lower alarm, for RAIL_TEMP the alarm release (hysteresis) point.
+		float upper;	///< Upper alarm.
+	};
+
+	/**
+	 * Called in interrupt context when alarms assert.
+	 * @param alarms Asserted alarms, as XADCPS_INTX_* bits.
+	 * @param ref The reference passed to setAlarmCallback().
+	 */
+	typedef void (*AlarmCallback)(uint32_t alarms, void *ref);
+
+	/**
+	 * Configure the XADC sequencer and alarms and take over its interrupt.
+	 *
+	 * @param device_id The XAdcPs device ID.
+	 * @param intr_id The XADC interrupt ID.
+	 * @param reader The driver sharing the XADC command FIFO, refresh() reads through it.
+	 * @param log The log tree to report to.
+	 * @param averaging XADCPS_AVG_16_SAMPLES, XADCPS_AVG_64_SAMPLES or XADCPS_AVG_256_SAMPLES.
+	 * @param limits Alarm limits per rail, nullptr for the board defaults.
+	 * @param priority GIC priority of the interrupt.
+	 * @throw std::runtime_error on initialization failures.
+	 */
+	XADCMonitor(uint16_t device_id, uint32_t intr_id, ADC &reader, LogTree &log, uint8_t averaging = XADCPS_AVG_64_SAMPLES,
+			const Limits *limits = nullptr, uint8_t priority = 0xA0);
+	virtual ~XADCMonitor();
+
+	//! Default alarm limits, Zynq-7000 recommended operating ranges.
+	static const Limits default_limits[RAIL_COUNT];
+
+	/**
+	 * Set a callback to run in interrupt context when alarms assert.
+	 * @param callback The callback, nullptr to remove.
+	 * @param ref Opaque callback argument.
+	 */
+	void setAlarmCallback(AlarmCallback callback, void *ref);
+
+	//! Read the latest sequencer results into the cache.
+	void refresh();
+
+	//! Cached value of a rail, in volts or degrees Celsius.
+	float get(Rail rail) const;
+
+	//! Alarms currently active, as XADCPS_INTX_* bits.
+	uint32_t getActiveAlarms();
+
+	// From base class ConsoleCommandSupport:
+	virtual void registerConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+	virtual void deregisterConsoleCommands(CommandParser &parser, const std::string &prefix = "");
+
+private:
+	static const char *rail_names[RAIL_COUNT];
+	static const uint32_t RELEASE_POLL_MS = 1000;	///< Interval to check whether masked alarms released.
+
+	XAdcPs xadc;						///< Low level driver instance.
+	uint32_t intr_id;					///< XADC interrupt ID.
+	ADC &reader;						///< Shared command FIFO access.
+	LogTree &log;						///< Log target.
+	TaskHandle_t task;					///< Deferred alarm handler task.
+	uint8_t averaging;					///< Configured averaging.
+	Limits limits[RAIL_COUNT];			///< Configured alarm limits.
+
+	AlarmCallback callback;				///< Interrupt context alarm callback.
+	void *callback_ref;					///< Callback argument.
+
+	volatile uint16_t raw[RAIL_COUNT];	///< Cached sequencer results.
+	volatile uint32_t refreshes;		///< Number of refresh() calls.
+	volatile uint32_t pending;			///< Alarms raised by the ISR, not yet logged.
+	volatile uint32_t masked;			///< Alarm interrupts masked until the alarm releases.
+	volatile uint32_t irqs;				///< Interrupts serviced.
+	StatCounter alarms;					///< Alarm assertions.
+
+	void run();
+	static void _InterruptHandler(void *p);
+	void interruptHandler();
+
+	class Status;	///< Console command to show rails and alarms.
+};
+
+#endif /* SRC_COMPONENTS_XADC_MONITOR_XADC_MONITOR_H_ */
@@ -31,111 +31,38 @@
 #include <vector>
 
 #include <services/ipmi/ipmbsvc/ipmbsvc.h>
-#include <services/ipmi/ipmi_formats.h>
 #include <services/persistentstorage/persistent_storage.h>
 #include <misc/version.h>
+#include <libs/printf.h>
+#include <fru_image/fru_image.h>
+#include <fru_persist/fru_persist.h>
 #include "ipmc.h"
 
-/**
- * Generate the appropriate headers (up to and excluding Record Format Version)
- * and add the PICMG multirecord to the provided FRU Data vector.
- *
- * @param fruarea The FRU Data area to be appended.
- * @param mrdata The multirecord to be added.
- * @param last_record true if the "end of list" flag should be set on this record, else false.
- * @param record_format The record format version, if not default.
- */
-static void addPICMGMultirecord(std::vector<uint8_t> &fruarea, std::vector<uint8_t> mrdata, bool last_record, uint8_t record_format = 2) {
-	static const std::vector<uint8_t> mrheader{
-		0xC0, // "OEM", specified
-		0x00, // [7] 1b=EOL (set later);  [3:0] record_format (set later)
-		0, // Length (placeholder)
-		0, // Record checksum (placeholder)
-		0, // Header checksum (placeholder)
-		0x5A, // Mfgr: PICMG, specified
-		0x31, // Mfgr: PICMG, specified
-		0x00, // Mfgr: PICMG, specified
-	};
-
-	mrdata.insert(mrdata.begin(), mrheader.begin(), mrheader.end());
-	mrdata[1] = (last_record ? 0x80 : 0) | record_format;
-	mrdata[2] = mrdata.size() - 5 /* Apparently this is record DATA length. */;
-	mrdata[3] = IPMIMessage::checksum(std::vector<uint8_t>(std::next(mrdata.begin(), 5), mrdata.end()));
-	mrdata[4] = IPMIMessage::checksum(std::vector<uint8_t>(mrdata.begin(), std::next(mrdata.begin(), 5)));
-
-	fruarea.insert(fruarea.end(), mrdata.begin(), mrdata.end());
-}
+FRUPersistence *fru_persistence = nullptr;
 
 void initFruData(bool reinit) {
-	std::vector<uint8_t> tlstring;
-
 	std::shared_ptr<const VersionInfo> version = VersionInfo::get_running_version();
-
-	std::vector<uint8_t> board_info;
-	board_info.push_back(0x01); // Format Version
-	board_info.push_back(0x00); // Length Placeholder
-	board_info.push_back(25);   // Language Code (English)
-	board_info.push_back(0x00); // Mfg Date/Time (Unspecified)
-	board_info.push_back(0x00); // Mfg Date/Time (Unspecified)
-	board_info.push_back(0x00); // Mfg Date/Time (Unspecified)
-	tlstring = encodeIpmiTypeLengthField("University of Wisconsin");
-	board_info.insert(board_info.end(), tlstring.begin(), tlstring.end()); // Board Mfgr.
-	tlstring = encodeIpmiTypeLengthField("ZYNQ IPMC");
-	board_info.insert(board_info.end(), tlstring.begin(), tlstring.end()); // Board Product Name
-	tlstring = encodeIpmiTypeLengthField(std::to_string(IPMC_SERIAL));
-	board_info.insert(board_info.end(), tlstring.begin(), tlstring.end()); // Board Serial
-	tlstring = encodeIpmiTypeLengthField(std::string("IPMC Rev") + std::to_string(IPMC_HW_REVISION));
-	board_info.insert(board_info.end(), tlstring.begin(), tlstring.end()); // Board Part Number
-	tlstring = encodeIpmiTypeLengthField(version ? version->version.tag : "UNKNOWN");
-	board_info.insert(board_info.end(), tlstring.begin(), tlstring.end()); // FRU File ID (in our case generating software)
-	board_info.push_back(0xC1); // End of T/L Records.
-	board_info.push_back(0); // Ensure at least one pad, to be used for checksum.
-	while (board_info.size() % 8)
-		board_info.push_back(0); // Pad.
-	board_info[1] = board_info.size()/8; // Update length
-	board_info.pop_back(); // Remove one pad for checksum.
-	board_info.push_back(IPMIMessage::checksum(board_info));
-
-
-	std::vector<uint8_t> product_info;
-	product_info.push_back(0x01); // Format Version
-	product_info.push_back(0x00); // Length Placeholder
-	product_info.push_back(25);   // Language Code (English)
-	tlstring = encodeIpmiTypeLengthField("University of Wisconsin");
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // Mfgr Name
-	tlstring = encodeIpmiTypeLengthField("ZYNQ IPMC");
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // Product Name
-	tlstring = encodeIpmiTypeLengthField(std::string("IPMC Rev") + std::to_string(IPMC_HW_REVISION));
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // Product Part/Model Number
-	tlstring = encodeIpmiTypeLengthField(std::to_string(IPMC_HW_REVISION));
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // Product Version
-		tlstring = encodeIpmiTypeLengthField(std::to_string(IPMC_SERIAL));
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // Product Serial
-	product_info.push_back(0xC0); // Asset Tag (NULL)
-	tlstring = encodeIpmiTypeLengthField(version ? version->version.tag : "UNKNOWN");
-	product_info.insert(product_info.end(), tlstring.begin(), tlstring.end()); // FRU File ID (in our case generating software)
-	product_info.push_back(0xC1); // End of T/L Records.
-	product_info.push_back(0); // Ensure at least one pad, to be used for checksum.
-	while (product_info.size() % 8)
-		product_info.push_back(0); // Pad.
-	product_info[1] = product_info.size()/8; // Update length
-	product_info.pop_back(); // Remove one pad for checksum.
-	product_info.push_back(IPMIMessage::checksum(product_info));
-
-
-	fru_data.resize(8);
-	fru_data[0] = 0x01; // Common Header Format Version
-	fru_data[1] = 0x00; // Internal Use Area Offset (multiple of 8 bytes)
-	fru_data[2] = 0x00; // Chassis Info Area Offset (multiple of 8 bytes)
-	fru_data[3] = 0x01; // Board Area Offset (multiple of 8 bytes)
-	fru_data[4] = 0x01 + board_info.size()/8; // Product Info Area Offset (multiple of 8 bytes)
-	fru_data[5] = 0x01 + board_info.size()/8 + product_info.size()/8; // Multi-Record Area Offset (multiple of 8 bytes)
-	fru_data[6] = 0x00; // PAD, write as 00h
-	fru_data[7] = 0x00;
-	fru_data[7] = IPMIMessage::checksum(fru_data); // Checksum
-
-	fru_data.insert(fru_data.end(), board_info.begin(), board_info.end());
-	fru_data.insert(fru_data.end(), product_info.begin(), product_info.end());
+	const std::string file_id = version ? version->version.tag : "UNKNOWN"; // FRU File ID (in our case generating software)
+
+	FRUImage image;
+
+	FRUImage::InfoArea board_info = image.boardArea(FRUImage::LANGUAGE_ENGLISH, 0 /* Mfg Date/Time (Unspecified) */);
+	board_info.field("University of Wisconsin"); // Board Mfgr.
+	board_info.field("ZYNQ IPMC"); // Board Product Name
+	board_info.field(std::to_string(IPMC_SERIAL)); // Board Serial
+	board_info.field(std::string("IPMC Rev") + std::to_string(IPMC_HW_REVISION)); // Board Part Number
+	board_info.field(file_id);
+	board_info.close();
+
+	FRUImage::InfoArea product_info = image.productArea(FRUImage::LANGUAGE_ENGLISH);
+	product_info.field("University of Wisconsin"); // Mfgr Name
+	product_info.field("ZYNQ IPMC"); // Product Name
+	product_info.field(std::string("IPMC Rev") + std::to_string(IPMC_HW_REVISION)); // Product Part/Model Number
+	product_info.field(std::to_string(IPMC_HW_REVISION)); // Product Version
+	product_info.field(std::to_string(IPMC_SERIAL)); // Product Serial
+	product_info.field(""); // Asset Tag (NULL)
+	product_info.field(file_id);
+	product_info.close();
 
 	/* Board Point-to-Point Connectivity Record
 	 *
@@ -145,34 +72,42 @@ void initFruData(bool reinit) {
 	 * defined in the Payload Manager instead.
 	 */
 	{
-		std::vector<uint8_t> bp2pcr{0x14, 0, 0};
-		for (uint8_t i = 0xF0; i < 0xFF; ++i) {
+		configASSERT(payload_manager); // We should be called only after this is initialized.
+		std::vector<LinkDescriptor> links = payload_manager->getLinks();
+
+		/* OEM Link Types F0h and up refer to the GUIDs of the record in order,
+		 * so list those up to the highest one in use.  Registered GUIDs above
+		 * it are not advertised, since no link refers to them.
+		 */
+		uint8_t guids = 0;
+		for (const LinkDescriptor &link : links)
+			if (link.LinkType >= 0xF0 && link.LinkType < 0xFF && link.LinkType - 0xF0 + 1 > guids)
+				guids = link.LinkType - 0xF0 + 1;
+
+		// As before, the list stops at the first OEM Link Type without a registered GUID.
+		std::vector<uint8_t> guid_data;
+		for (uint8_t i = 0; i < guids; ++i) {
 			try {
-				std::vector<uint8_t> guid = LinkDescriptor::lookup_oem_LinkType_guid(i);
-				bp2pcr[2]++; // Increment number of GUIDs in record.
-				bp2pcr.insert(bp2pcr.end(), guid.begin(), guid.end()); // Add GUID to record.
+				std::vector<uint8_t> guid = LinkDescriptor::lookup_oem_LinkType_guid(0xF0 + i);
+				guid_data.insert(guid_data.end(), guid.begin(), guid.end());
 			} catch (std::out_of_range) {
+				LOG["fru_data"].log(stdsprintf("OEM Link Type 0x%02x is used by a link but has no registered GUID, GUIDs from it on are not listed.", 0xF0 + i), LogTree::LOG_ERROR);
+				guids = i;
 				break;
 			}
 		}
 
-		configASSERT(payload_manager); // We should be called only after this is initialized.
-
-		std::vector<LinkDescriptor> links = payload_manager->getLinks();
-		for (auto it = links.begin(), eit = links.end(); it != eit; ++it) {
-			if (bp2pcr.size() > 255 /* record data limit */ - 3 /* MultiRec OEM ID header */ - 4 /* next link descriptor size */ - 1 /* safety margin */) {
-				// We filled up this record we need to start a new one.
-				addPICMGMultirecord(fru_data, bp2pcr, false);
-				// Start new record, zero GUIDs in further records, they all fit in one (barely).
-				bp2pcr = std::vector<uint8_t>{0x14, 0, 0};
-			}
+		FRUImage::PICMGRecord bp2pcr = image.picmgRecord(0x14, 0);
+		bp2pcr.put({guids});
+		bp2pcr.put(guid_data);
 
-			std::vector<uint8_t> ld_vec(*it);
-			bp2pcr.insert(bp2pcr.end(), ld_vec.begin(), ld_vec.end());
-		}
+		// Records are split between link descriptors when full, with zero GUIDs in further records.
+		bp2pcr.continueWith({0});
+		for (LinkDescriptor &link : links)
+			bp2pcr.item(std::vector<uint8_t>(link));
 
 		// We have at least one link or at least one GUID, or just need to say we have none.
-		addPICMGMultirecord(fru_data, bp2pcr, false /* We are not the last record in the FRU Data. */);
+		bp2pcr.close();
 	}
 
 	/* Carrier Activation and Current Management record
@@ -181,23 +116,30 @@ void initFruData(bool reinit) {
 	 * This is supposed to specify the maximum power we can provide to our AMCs,
 	 * and be used for validating our AMC modules' power requirements.
 	 */
-	addPICMGMultirecord(fru_data, std::vector<uint8_t>{0x17, 0, 0x3f /* ~75W for all AMCs (and self..?) LSB */, 0 /* MSB */, 5, 0}, true);
+	image.picmgRecord(0x17, 0).put({0x3f /* ~75W for all AMCs (and self..?) LSB */, 0 /* MSB */, 5, 0}).close();
 
-	runTask("persist_fru", TASK_PRIORITY_SERVICE, [reinit]() -> void {
-		safe_init_static_mutex(fru_data_mutex, false);
+	// The last record gets the end of list flag here.
+	std::vector<uint8_t> built = image.finish();
+	safe_init_static_mutex(fru_data_mutex, false);
+	{
 		MutexGuard<false> lock(fru_data_mutex, true);
-		VariablePersistentAllocation fru_persist(*persistent_storage, PersistentStorageAllocations::WISC_FRU_DATA);
+		fru_data = std::move(built);
+	}
 
-		// If not reinitializing, and there's an area to read, replace ours, else write.
-		std::vector<uint8_t> persist_data = fru_persist.getData();
-		if (persist_data.size() && !reinit) {
-			fru_data = persist_data;
+	runTask("persist_fru", TASK_PRIORITY_SERVICE, [reinit]() -> void {
+		{
+			MutexGuard<false> lock(fru_data_mutex, true);
+			if (!fru_persistence) {
+				fru_persistence = new FRUPersistence(*persistent_storage, PersistentStorageAllocations::WISC_FRU_DATA, fru_data, fru_data_mutex, LOG["fru_persist"]);
+				fru_persistence->registerConsoleCommands(console_command_parser, "frupersist.");
+			}
 		}
 
-		// Store the newly initialized Device SDRs
-		fru_persist.setData(fru_data);
+		// If not reinitializing, and there's valid stored data, replace ours.  It is only written back if it differs.
+		fru_persistence->load(reinit);
 		std::string out;
 #if 0
+		MutexGuard<false> lock(fru_data_mutex, true);
 		for (auto it = fru_data.begin(), eit = fru_data.end(); it != eit; ++it) {
 			out += stdsprintf("%02hhx", *it);
 		}
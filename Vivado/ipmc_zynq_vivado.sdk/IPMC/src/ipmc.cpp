@@ -30,6 +30,7 @@
 #include <sys/time.h>
 #include <payload_manager.h>
 #include "ipmc.h"
+#include "board_zones.h"
 
 /* Include FreeRTOS */
 #include <FreeRTOS.h>
@@ -41,7 +42,6 @@
 #include <drivers/ps_uart/ps_uart.h>
 #include <drivers/ps_xadc/ps_xadc.h>
 #include <drivers/pl_gpio/pl_gpio.h>
-#include <drivers/pl_i2c/pl_i2c.h>
 #include <drivers/pl_led/pl_led.h>
 #include <drivers/pl_spi/pl_spi.h>
 #include <drivers/pl_uart/pl_uart.h>
@@ -72,10 +72,44 @@
 #include <libs/logtree/logtree.h>
 #include <libs/xilinx_image/xilinx_image.h>
 
+/* Include board components */
+#include <adc_frame/adc_frame.h>
+#include <adc_capture/adc_capture.h>
+#include <hires_timer/hires_timer.h>
+#include <sensor_lut/sensor_lut.h>
+#include <sensor_event_dispatcher/sensor_event_dispatcher.h>
+#include <sensor_history/sensor_history.h>
+#include <sampling_scheduler/sampling_scheduler.h>
+#include <xadc_monitor/xadc_monitor.h>
+#include <i2c_queue/i2c_queue.h>
+#include <fault_injector/fault_injector.h>
+#include <power_timeline/power_timeline.h>
+#include <hardfault_capture/hardfault_capture.h>
+#include <soft_fault_policy/soft_fault_policy.h>
+#include <adaptive_sampler/adaptive_sampler.h>
+#include <pg_monitor/pg_monitor.h>
+#include <derived_sensors/derived_sensors.h>
+#include <sdr_batch/sdr_batch.h>
+
 // Application specific variables
 std::vector<AD7689*> adc;
+ADCFrameReader *adc_frames	= nullptr;
+HiResTimer *hires_timer		= nullptr;
+ADCCapture *adc_capture		= nullptr;
+SensorLUT *sensor_luts		= nullptr;
+SensorEventDispatcher *sensor_events = nullptr;
+SensorHistory *sensor_history = nullptr;
+SamplingScheduler *sampling = nullptr;
+XADCMonitor *xadc_monitor = nullptr;
+FaultInjector *fault_injector = nullptr;
+PowerTimeline *power_timeline = nullptr;
+HardFaultCapture *hardfault_capture = nullptr;
+SoftFaultPolicy *soft_faults = nullptr;
+AdaptiveSampler *adaptive_sampler = nullptr;
+PowerGoodMonitor *pg_monitor = nullptr;
+DerivedSensors *derived_sensors = nullptr;
 PSXADC *xadc		= nullptr;
-PLI2C *i2cmgmt		= nullptr;
+I2CQueue *i2cmgmt	= nullptr;
 PLGPIO *handle_gpio	= nullptr;
 ESM *esm			= nullptr;
 ELM *elm			= nullptr;
@@ -147,13 +181,42 @@ void driverInit() {
 		adc.push_back(ad7689);
 	}
 
+	adc_frames = new ADCFrameReader({XPAR_AD7689_S_0_DEVICE_ID, XPAR_AD7689_S_1_DEVICE_ID});
+	if (!adc_frames) throw std::runtime_error("Failed to create adc_frames instance");
+	adc_frames->registerConsoleCommands(console_command_parser, "adc.");
+
+	hires_timer = new HiResTimer();
+	if (!hires_timer) throw std::runtime_error("Failed to create hires_timer instance");
+
+	// Captures cover adc_0, which has the payload rails.
+	adc_capture = new ADCCapture(XPAR_AD7689_S_0_DEVICE_ID, XPAR_XDMAPS_0_DEVICE_ID, 0, *hires_timer);
+	if (!adc_capture) throw std::runtime_error("Failed to create adc_capture instance");
+	adc_capture->registerConsoleCommands(console_command_parser, "adc.capture.");
+
 	xadc = new PSXADC(XPAR_XADCPS_0_DEVICE_ID);
 	if (!xadc) throw std::runtime_error("Failed to create xadc instance");
 
+	// Run the XADC sequencer continuously with hardware alarms, xadc reads then return cached results.
+	xadc_monitor = new XADCMonitor(XPAR_XADCPS_0_DEVICE_ID, XPAR_XADCPS_INT_ID, *xadc, LOG["xadc"]);
+	if (!xadc_monitor) throw std::runtime_error("Failed to create xadc_monitor instance");
+	xadc_monitor->registerConsoleCommands(console_command_parser, "xadc.");
+
+	// A die over-temperature soft faults every zone from the alarm interrupt, the zones power down in reverse order.
+	static Mgmt_Zone_Ctrl xadc_ot_zones;
+	if (XST_SUCCESS != Mgmt_Zone_Ctrl_Initialize(&xadc_ot_zones, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID))
+		throw std::runtime_error("Unable to initialize Mgmt_Zone_Ctrl for the XADC over-temperature alarm");
+	xadc_monitor->setAlarmCallback([](uint32_t alarms, void *ref) -> void {
+		if (!(alarms & XADCPS_INTX_OT_MASK))
+			return;
+		for (int z = BoardZones::ZONE_COUNT - 1; z >= 0; --z)
+			Mgmt_Zone_Ctrl_Dispatch_Soft_Fault(reinterpret_cast<Mgmt_Zone_Ctrl*>(ref), z);
+	}, &xadc_ot_zones);
+
 	handle_gpio = new PLGPIO(PLGPIO::CHANNEL1, XPAR_AXI_GPIO_HNDL_SW_DEVICE_ID, XPAR_FABRIC_AXI_GPIO_HNDL_SW_IP2INTC_IRPT_INTR);
 	if (!handle_gpio) throw std::runtime_error("Failed to create handle_gpio instance");
 
-	i2cmgmt = new PLI2C(XPAR_AXI_IIC_MGMT_DEVICE_ID, XPAR_FABRIC_AXI_IIC_MGMT_IIC2INTC_IRPT_INTR);
+	// Transactions on the management bus are queued and chained from the ISR, blocking users share the queue.
+	i2cmgmt = new I2CQueue(XPAR_AXI_IIC_MGMT_DEVICE_ID, XPAR_FABRIC_AXI_IIC_MGMT_IIC2INTC_IRPT_INTR);
 	if (!i2cmgmt) throw std::runtime_error("Failed to create i2cmgmt instance");
 #ifdef ENABLE_DRIVER_COMMAND_SUPPORT
 	i2cmgmt->registerConsoleCommands(console_command_parser, "i2cmgmt.");
@@ -166,18 +229,110 @@ void driverInit() {
 	ADC::Channel::Callback tmp36   = [](float r) -> float  { return (r - 0.5) * 100.0; };
 	ADC::Channel::Callback tmp36_r = [](float r) -> float  { return (r/100.0) + 0.5; };
 
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+12VPYLD",  ADC::Channel(*adc[0], 0, 5.640),           0, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+5VPYLD",   ADC::Channel(*adc[0], 4, 2.400),           4, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+3.3VPYLD", ADC::Channel(*adc[0], 6, 1.600),           6, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+3.3VMP",   ADC::Channel(*adc[0], 7, 1.600),           7, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+12VPYLD",  ADC::Channel(*adc[0], 0, 5.640),          BoardZones::HF_12VPYLD, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+5VPYLD",   ADC::Channel(*adc[0], 4, 2.400),          BoardZones::HF_5VPYLD, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+3.3VPYLD", ADC::Channel(*adc[0], 6, 1.600),          BoardZones::HF_3V3PYLD, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+3.3VMP",   ADC::Channel(*adc[0], 7, 1.600),          BoardZones::HF_3V3MP, 0));
 
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("T_BOT",     ADC::Channel(*adc[1], 0, tmp36, tmp36_r),  8, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+1.0VETH",  ADC::Channel(*adc[1], 2),                 10, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+2.5VETH",  ADC::Channel(*adc[1], 4, 1.216),          12, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+1.2VPHY",  ADC::Channel(*adc[1], 5),                 13, 0));
-	PayloadManager::addADCSensor(PayloadManager::ADCSensor("T_TOP",     ADC::Channel(*adc[1], 7, tmp36, tmp36_r), 15, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("T_BOT",     ADC::Channel(*adc[1], 0, tmp36, tmp36_r), BoardZones::HF_T_BOT, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+1.0VETH",  ADC::Channel(*adc[1], 2),                 BoardZones::HF_1V0ETH, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+2.5VETH",  ADC::Channel(*adc[1], 4, 1.216),          BoardZones::HF_2V5ETH, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("+1.2VPHY",  ADC::Channel(*adc[1], 5),                 BoardZones::HF_1V2PHY, 0));
+	PayloadManager::addADCSensor(PayloadManager::ADCSensor("T_TOP",     ADC::Channel(*adc[1], 7, tmp36, tmp36_r), BoardZones::HF_T_TOP, 0));
 
 	PayloadManager::addADCSensor(PayloadManager::ADCSensor("VCCINT",    ADC::Channel(*xadc, XADCPS_CH_VCCINT),    -1, 0));
+
+	// Conversion tables are built once the SDRs are loaded, see initDeviceSDRs().
+	sensor_luts = new SensorLUT();
+	if (!sensor_luts) throw std::runtime_error("Failed to create sensor_luts instance");
+	sensor_luts->registerConsoleCommands(console_command_parser, "sensorlut.");
+
+	// Threshold events are interrupt driven, channels are linked to sensors once the SDRs are loaded.
+	sensor_events = new SensorEventDispatcher(XPAR_IPMI_SENSOR_PROC_0_DEVICE_ID, XPAR_FABRIC_IPMI_SENSOR_PROC_0_IRQ_O_INTR, LOG["sensor_events"]);
+	if (!sensor_events) throw std::runtime_error("Failed to create sensor_events instance");
+	sensor_events->registerConsoleCommands(console_command_parser, "sensorevents.");
+
+	// Over-temperature soft faults act straight from the sensor processor interrupt, so install them first.
+	soft_faults = new SoftFaultPolicy(XPAR_IPMI_SENSOR_PROC_0_DEVICE_ID, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, *sensor_events, *hires_timer, LOG["softfault"]);
+	if (!soft_faults) throw std::runtime_error("Failed to create soft_faults instance");
+	const uint32_t all_zones = (1 << BoardZones::ZONE_COUNT) - 1;
+	soft_faults->addRule({"T_TOP UNR", BoardZones::HF_T_TOP, SoftFaultPolicy::THR_UNR, SoftFaultPolicy::ACTION_SOFT_FAULT, all_zones, SoftFaultPolicy::PATH_ISR});
+	soft_faults->addRule({"T_BOT UNR", BoardZones::HF_T_BOT, SoftFaultPolicy::THR_UNR, SoftFaultPolicy::ACTION_SOFT_FAULT, all_zones, SoftFaultPolicy::PATH_ISR});
+	soft_faults->registerConsoleCommands(console_command_parser, "softfault.");
+
+	// Hard fault context is snapshotted from interrupt context, before the rails have settled.
+	hardfault_capture = new HardFaultCapture(XPAR_IPMI_SENSOR_PROC_0_DEVICE_ID, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, sensor_events, *hires_timer, LOG["hardfault"]);
+	if (!hardfault_capture) throw std::runtime_error("Failed to create hardfault_capture instance");
+	hardfault_capture->registerConsoleCommands(console_command_parser, "hardfault.");
+
+	// Replays waveforms into the ADC overrides to time the hard fault path end to end.
+	fault_injector = new FaultInjector({XPAR_AD7689_S_0_DEVICE_ID, XPAR_AD7689_S_1_DEVICE_ID}, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, *hires_timer, LOG["fault_injector"]);
+	if (!fault_injector) throw std::runtime_error("Failed to create fault_injector instance");
+	fault_injector->registerConsoleCommands(console_command_parser, "fault.");
+
+	// Power level changes arm a timeline of the zone controller sequencing.
+	power_timeline = new PowerTimeline(XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, *hires_timer, LOG["power_timeline"]);
+	if (!power_timeline) throw std::runtime_error("Failed to create power_timeline instance");
+	power_timeline->registerConsoleCommands(console_command_parser, "zonectrl.");
+
+	// Glitch statistics of every power enable, the hard fault input of every ADC sensor and the payload power goods.
+	pg_monitor = new PowerGoodMonitor(XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, *hires_timer, LOG["pg_monitor"]);
+	if (!pg_monitor) throw std::runtime_error("Failed to create pg_monitor instance");
+	pg_monitor->registerConsoleCommands(console_command_parser, "pgmon.");
+
+	for (const BoardZones::Enable &enable : BoardZones::enables)
+		pg_monitor->addRail(std::string(enable.rail) + " EN", PowerGoodMonitor::SOURCE_PWREN, enable.pin);
+	for (auto &it : PayloadManager::adc_sensors)
+		if (it.second.sensor_processor_id >= 0 && it.second.sensor_processor_id < 32)
+			pg_monitor->addRail(it.first + " HF", PowerGoodMonitor::SOURCE_HARDFAULT, it.second.sensor_processor_id, false);
+#ifdef XPAR_PYLD_PWR_CTRL_0_DEVICE_ID
+	pg_monitor->addPowerControllerSource(XPAR_PYLD_PWR_CTRL_0_DEVICE_ID);
+#endif
+
+	// Keep a multi-resolution history of all ADC sensors, this must follow the addADCSensor() calls.
+	sensor_history = new SensorHistory();
+	if (!sensor_history) throw std::runtime_error("Failed to create sensor_history instance");
+	sensor_history->registerConsoleCommands(console_command_parser, "history.");
+
+	// Virtual sensors computed from the ADC sensors, their SDRs are in sdr_init.cpp.
+	derived_sensors = new DerivedSensors(LOG["derived_sensors"]);
+	if (!derived_sensors) throw std::runtime_error("Failed to create derived_sensors instance");
+	derived_sensors->registerConsoleCommands(console_command_parser, "derived.");
+	derived_sensors->output("T_DELTA", derived_sensors->op(DerivedSensors::OP_SUB, derived_sensors->input("T_TOP"), derived_sensors->input("T_BOT")));
+	derived_sensors->output("+12VPYLD dV/dt", derived_sensors->op(DerivedSensors::OP_DERIVATIVE, derived_sensors->input("+12VPYLD")));
+
+	// Device SDRs are committed through an SDRBatch, this compares it with record by record updates.
+	console_command_parser.registerCommand("sdr.bench", std::make_shared<SDRBatch::Bench>(device_sdr_repo));
+
+	// The AD7689 sequencers run fast only near thresholds and during zone transitions.
+	adaptive_sampler = new AdaptiveSampler({XPAR_AD7689_S_0_DEVICE_ID, XPAR_AD7689_S_1_DEVICE_ID}, XPAR_IPMI_SENSOR_PROC_0_DEVICE_ID, XPAR_MGMT_ZONE_CTRL_0_DEVICE_ID, LOG["adaptive_sampler"]);
+	if (!adaptive_sampler) throw std::runtime_error("Failed to create adaptive_sampler instance");
+	adaptive_sampler->registerConsoleCommands(console_command_parser, "adcrate.");
+
+	// All periodic sensor sampling goes through the scheduler, one task per bus.
+	sampling = new SamplingScheduler();
+	if (!sampling) throw std::runtime_error("Failed to create sampling instance");
+	sampling->registerConsoleCommands(console_command_parser, "sampling.");
+
+	const int ad7689_bus = sampling->addBus("ad7689");
+	const int xadc_bus = sampling->addBus("xadc");
+	// The AD7689 sensors are sampled from one coherent frame, which the derived sensors then see through the history.
+	sampling->addSource("adc_frame", sensor_history->getSamplePeriod(), SamplingScheduler::COST_REGISTER, ad7689_bus, []() -> void {
+		static ADCFrameReader::Frame frame;
+		if (adc_frames->readFrame(frame))
+			sensor_history->addFrame(frame);
+	});
+	std::vector<std::string> history_sensors = sensor_history->getSensorNames();
+	for (size_t i = 0; i < history_sensors.size(); ++i) {
+		if (sensor_history->isInFrame(i))
+			continue;
+		sampling->addSource(history_sensors[i], sensor_history->getSamplePeriod(), SamplingScheduler::COST_REGISTER,
+				(history_sensors[i] == "VCCINT") ? xadc_bus : ad7689_bus, [i]() -> void { sensor_history->sample(i); });
+	}
+	sampling->addSource("derived", sensor_history->getSamplePeriod(), SamplingScheduler::COST_REGISTER, ad7689_bus, []() -> void { derived_sensors->evaluate(); });
+	sampling->addSource("adaptive_rate", 10, SamplingScheduler::COST_REGISTER, ad7689_bus, []() -> void { adaptive_sampler->evaluate(); });
+	sampling->addSource("xadc_monitor", 500, SamplingScheduler::COST_BUS, xadc_bus, []() -> void { xadc_monitor->refresh(); });
+	sampling->start();
 }
 
 
@@ -252,6 +407,11 @@ void serviceInit() {
 
 		// Start FTP server
 		VFS::addFile("virtual/esm.bin", esm->createFlashFile());
+		VFS::addFile("virtual/adc_capture.bin", adc_capture->createFile());
+		VFS::addFile("virtual/sensor_history.bin", sensor_history->createFile());
+		VFS::addFile("virtual/fault_waveform.bin", fault_injector->createFile());
+		VFS::addFile("virtual/power_timeline.bin", power_timeline->createFile());
+		VFS::addFile("virtual/pg_monitor.bin", pg_monitor->createFile());
 		new FTPServer(Auth::validateCredentials, LOG["ftp"]);
 
 	});
@@ -22,10 +22,45 @@
 #ifndef SRC_IPMC_H_
 #define SRC_IPMC_H_
 
+class ADCFrameReader;
+class HiResTimer;
+class ADCCapture;
+class SensorLUT;
+class SensorEventDispatcher;
+class SensorHistory;
+class SamplingScheduler;
+class XADCMonitor;
+class FaultInjector;
+class PowerTimeline;
+class HardFaultCapture;
+class SoftFaultPolicy;
+class AdaptiveSampler;
+class PowerGoodMonitor;
+class DerivedSensors;
+class FRUPersistence;
+
+// Implemented in ipmc.cpp:
+extern ADCFrameReader *adc_frames;
+extern HiResTimer *hires_timer;
+extern ADCCapture *adc_capture;
+extern SensorLUT *sensor_luts;
+extern SensorEventDispatcher *sensor_events;
+extern SensorHistory *sensor_history;
+extern SamplingScheduler *sampling;
+extern XADCMonitor *xadc_monitor;
+extern FaultInjector *fault_injector;
+extern PowerTimeline *power_timeline;
+extern HardFaultCapture *hardfault_capture;
+extern SoftFaultPolicy *soft_faults;
+extern AdaptiveSampler *adaptive_sampler;
+extern PowerGoodMonitor *pg_monitor;
+extern DerivedSensors *derived_sensors;
+
 // Implemented in sdr_init.cpp:
 void initDeviceSDRs(bool reinit);
 
 // Implemented in fru_data_init.cpp:
 void initFruData(bool reinit);
+extern FRUPersistence *fru_persistence;
 
 #endif /* SRC_IPMC_H_ */
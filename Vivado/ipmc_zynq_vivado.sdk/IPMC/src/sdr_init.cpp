@@ -48,31 +48,40 @@
 #include <services/ipmi/sensor/severity_sensor.h>
 #include <services/ipmi/sensor/threshold_sensor.h>
 #include <services/persistentstorage/persistent_storage.h>
+#include <sensor_lut/sensor_lut.h>
+#include <sensor_event_dispatcher/sensor_event_dispatcher.h>
+#include <derived_sensors/derived_sensors.h>
+#include <sdr_batch/sdr_batch.h>
+#include <sdr_persist/sdr_persist.h>
+#include <hires_timer/hires_timer.h>
+#include <libs/printf.h>
 #include "ipmc.h"
+#include "board_sdrs.h"
+
+//! How often the Device SDRs are checked for changes made behind our back, in ms.
+static const uint32_t SDR_WATCH_PERIOD = 1000;
 
 /**
- * Local function to help add sensor records to the repository.
- * @param repo Target repository to add sensors to.
- * @param sdr The sensor data record that will get added.
- * @param reservation First reservation id, will be replaced with the next one after update.
+ * Precompute the conversions of any sensor whose SDR changed and link the
+ * event sources, for the Device SDRs as they are now.
+ *
+ * @param sdrs The exported SDR repository, as by SensorDataRepository::u8export().
  */
-static void addToSDRRepo(SensorDataRepository &repo, const SensorDataRecord &sdr, SensorDataRepository::reservation_t &reservation) {
-	while (true) {
-		try {
-			repo.add(sdr, reservation);
-			return;
-		}
-		catch (SensorDataRepository::reservation_cancelled_error) {
-			reservation = repo.reserve();
-		}
-	}
+static void linkDeviceSDRs(const std::vector<uint8_t> &sdrs) {
+	if (sensor_luts)
+		sensor_luts->rebuild(sdrs);
+	if (sensor_events)
+		sensor_events->linkSensors(sdrs);
+	if (derived_sensors)
+		derived_sensors->linkSensors(sdrs);
 }
 
 //! Initialize Device SDRs for this controller.
 void initDeviceSDRs(bool reinit) {
-	SensorDataRepository::reservation_t reservation = device_sdr_repo.reserve();
+	// Stage everything and commit once, rather than fighting shelf manager reservations per record.
+	SDRBatch batch(device_sdr_repo);
 
-#define ADD_TO_REPO(sdr) addToSDRRepo(device_sdr_repo, sdr, reservation)
+#define ADD_TO_REPO(sdr) batch.add(sdr)
 
 	{
 		// Management Controller Device Locator Record for ourself.
@@ -125,570 +134,53 @@ void initDeviceSDRs(bool reinit) {
 			ipmc_sensors.add(std::make_shared<HotswapSensor>(hotswap.recordKey(), LOG["sensors"]["Hotswap"]));
 	}
 
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=3&s-na=%2B12VPYLD&s-no=2&s-t=0x02&s-u-p=4&lnrf=10.8&lcrf=11.1&lncf=11.4&uncf=12.6&ucrf=12.9&unrf=13.2&nominalf=12&hystpi=1&hystni=1&minf=0&granularity=0.06
-		sensor.initializeBlank("+12VPYLD");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(2);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 15.3 (Volts) with 0.06 Volts granularity.
-		sensor.conversion_m(6);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-2);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(200); // 12 Volts
-		sensor.threshold_unr_rawvalue(220); // 13.2 Volts
-		sensor.threshold_ucr_rawvalue(215); // 12.9 Volts
-		sensor.threshold_unc_rawvalue(210); // 12.6 Volts
-		sensor.threshold_lnc_rawvalue(190); // 11.4 Volts
-		sensor.threshold_lcr_rawvalue(185); // 11.1 Volts
-		sensor.threshold_lnr_rawvalue(180); // 10.8 Volts
-		sensor.hysteresis_high(1); // +0.06 Volts
-		sensor.hysteresis_low(1); // -0.06 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+12VPYLD"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B5VPYLD&s-no=3&s-t=0x02&s-u-p=4&lnrf=4.5&lcrf=4.625&lncf=4.75&uncf=5.25&ucrf=5.375&unrf=5.5&nominalf=5&hystpi=1&hystni=1&minf=0&granularity=0.0226
-		sensor.initializeBlank("+5VPYLD");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(3);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 5.763 (Volts) with 0.0226 Volts granularity.
-		sensor.conversion_m(226);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-4);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(221); // 5 Volts
-		sensor.threshold_unr_rawvalue(243); // 5.5 Volts
-		sensor.threshold_ucr_rawvalue(237); // 5.375 Volts
-		sensor.threshold_unc_rawvalue(232); // 5.25 Volts
-		sensor.threshold_lnc_rawvalue(210); // 4.75 Volts
-		sensor.threshold_lcr_rawvalue(204); // 4.625 Volts
-		sensor.threshold_lnr_rawvalue(199); // 4.5 Volts
-		sensor.hysteresis_high(1); // +0.0226 Volts
-		sensor.hysteresis_low(1); // -0.0226 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+5VPYLD"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B3.3VPYLD&s-no=4&s-t=0x02&s-u-p=4&lnrf=2.97&lcrf=3.0525&lncf=3.135&uncf=3.465&ucrf=3.5475&unrf=3.63&nominalf=3.3&hystpi=1&hystni=1&minf=0&granularity=0.0149
-		sensor.initializeBlank("+3.3VPYLD");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(4);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 3.7995 (Volts) with 0.0149 Volts granularity.
-		sensor.conversion_m(149);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-4);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(221); // 3.3 Volts
-		sensor.threshold_unr_rawvalue(243); // 3.63 Volts
-		sensor.threshold_ucr_rawvalue(238); // 3.5475 Volts
-		sensor.threshold_unc_rawvalue(232); // 3.465 Volts
-		sensor.threshold_lnc_rawvalue(210); // 3.135 Volts
-		sensor.threshold_lcr_rawvalue(204); // 3.0525 Volts
-		sensor.threshold_lnr_rawvalue(199); // 2.97 Volts
-		sensor.hysteresis_high(1); // +0.0149 Volts
-		sensor.hysteresis_low(1); // -0.0149 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+3.3VPYLD"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B3.3VMP&s-no=5&s-t=0x02&s-u-p=4&lnrf=2.97&lcrf=3.0525&lncf=3.135&uncf=3.465&ucrf=3.5475&unrf=3.63&nominalf=3.3&hystpi=1&hystni=1&minf=0&granularity=0.0149
-		sensor.initializeBlank("+3.3VMP");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(5);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 3.7995 (Volts) with 0.0149 Volts granularity.
-		sensor.conversion_m(149);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-4);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(221); // 3.3 Volts
-		sensor.threshold_unr_rawvalue(243); // 3.63 Volts
-		sensor.threshold_ucr_rawvalue(238); // 3.5475 Volts
-		sensor.threshold_unc_rawvalue(232); // 3.465 Volts
-		sensor.threshold_lnc_rawvalue(210); // 3.135 Volts
-		sensor.threshold_lcr_rawvalue(204); // 3.0525 Volts
-		sensor.threshold_lnr_rawvalue(199); // 2.97 Volts
-		sensor.hysteresis_high(1); // +0.0149 Volts
-		sensor.hysteresis_low(1); // -0.0149 Volts
+	// The threshold sensor records are built at compile time from board_sdrs.h.
+	for (size_t i = 0; i < BoardSDRs::SENSOR_COUNT; ++i) {
+		const BoardSDRs::Image &image = BoardSDRs::images.images[i];
+		SensorDataRecord01 sensor(std::vector<uint8_t>(image.bytes, image.bytes + BoardSDRs::length(image)));
 		ADD_TO_REPO(sensor);
 		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+3.3VMP"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B1.0VETH&s-no=6&s-t=0x02&s-u-p=4&lnrf=0.9&lcrf=0.925&lncf=0.95&uncf=1.05&ucrf=1.075&unrf=1.1&nominalf=1&hystpi=1&hystni=1&minf=0&granularity=0.02
-		sensor.initializeBlank("+1.0VETH");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(6);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 5.1 (Volts) with 0.02 Volts granularity.
-		sensor.conversion_m(2);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-2);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(50); // 1 Volts
-		sensor.threshold_unr_rawvalue(55); // 1.1 Volts
-		sensor.threshold_ucr_rawvalue(53); // 1.075 Volts
-		sensor.threshold_unc_rawvalue(52); // 1.05 Volts
-		sensor.threshold_lnc_rawvalue(47); // 0.95 Volts
-		sensor.threshold_lcr_rawvalue(46); // 0.925 Volts
-		sensor.threshold_lnr_rawvalue(45); // 0.9 Volts
-		sensor.hysteresis_high(1); // +0.02 Volts
-		sensor.hysteresis_low(1); // -0.02 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+1.0VETH"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B2.5VETH&s-no=7&s-t=0x02&s-u-p=4&lnrf=2.25&lcrf=2.3125&lncf=2.375&uncf=2.625&ucrf=2.6875&unrf=2.75&nominalf=2.5&hystpi=1&hystni=1&minf=0&granularity=0.0113
-		sensor.initializeBlank("+2.5VETH");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(7);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 2.8815 (Volts) with 0.0113 Volts granularity.
-		sensor.conversion_m(113);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-4);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(221); // 2.5 Volts
-		sensor.threshold_unr_rawvalue(243); // 2.75 Volts
-		sensor.threshold_ucr_rawvalue(237); // 2.6875 Volts
-		sensor.threshold_unc_rawvalue(232); // 2.625 Volts
-		sensor.threshold_lnc_rawvalue(210); // 2.375 Volts
-		sensor.threshold_lcr_rawvalue(204); // 2.3125 Volts
-		sensor.threshold_lnr_rawvalue(199); // 2.25 Volts
-		sensor.hysteresis_high(1); // +0.0113 Volts
-		sensor.hysteresis_low(1); // -0.0113 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+2.5VETH"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=%2B1.2VPHY&s-no=8&s-t=0x02&s-u-p=4&lnrf=1.08&lcrf=1.11&lncf=1.14&uncf=1.26&ucrf=1.29&unrf=1.32&nominalf=1.2&hystpi=1&hystni=1&minf=0&granularity=0.0055
-		sensor.initializeBlank("+1.2VPHY");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(8);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x02); // Voltage
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fff); // LNR, LCR, LNC, UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(4); // Volts
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (Volts) to 1.4025 (Volts) with 0.0055 Volts granularity.
-		sensor.conversion_m(55);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-4);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(218); // 1.2 Volts
-		sensor.threshold_unr_rawvalue(240); // 1.32 Volts
-		sensor.threshold_ucr_rawvalue(234); // 1.29 Volts
-		sensor.threshold_unc_rawvalue(229); // 1.26 Volts
-		sensor.threshold_lnc_rawvalue(207); // 1.14 Volts
-		sensor.threshold_lcr_rawvalue(201); // 1.11 Volts
-		sensor.threshold_lnr_rawvalue(196); // 1.08 Volts
-		sensor.hysteresis_high(1); // +0.0055 Volts
-		sensor.hysteresis_low(1); // -0.0055 Volts
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["+1.2VPHY"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=T_TOP&s-no=9&s-t=0x01&s-u-p=1&uncf=40&ucrf=45&unrf=50&nominalf=30&hystpi=1&hystni=1&minf=0&granularity=0.5
-		sensor.initializeBlank("T_TOP");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(9);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x01); // Temperature
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fc0); // UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fc0); // UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(1); // degrees C
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (degrees C) to 127.5 (degrees C) with 0.5 degrees C granularity.
-		sensor.conversion_m(5);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-1);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(60); // 30 degrees C
-		sensor.threshold_unr_rawvalue(100); // 50 degrees C
-		sensor.threshold_ucr_rawvalue(90); // 45 degrees C
-		sensor.threshold_unc_rawvalue(80); // 40 degrees C
-		sensor.threshold_lnc_rawvalue(0); // null degrees C
-		sensor.threshold_lcr_rawvalue(0); // null degrees C
-		sensor.threshold_lnr_rawvalue(0); // null degrees C
-		sensor.hysteresis_high(1); // +0.5 degrees C
-		sensor.hysteresis_low(1); // -0.5 degrees C
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["T_TOP"]));
-	}
-
-	{
-		SensorDataRecord01 sensor;
-		// SDR Calculator.html#precision=4&s-na=T_BOT&s-no=10&s-t=0x01&s-u-p=1&uncf=40&ucrf=45&unrf=50&nominalf=30&hystpi=1&hystni=1&minf=0&granularity=0.5
-		sensor.initializeBlank("T_BOT");
-		sensor.sensor_owner_id(0); // Tag as "self". This will be auto-calculated in "Get SDR" commands.
-		sensor.sensor_owner_channel(0); // See above.
-		sensor.sensor_owner_lun(0); // Generally zero
-		sensor.sensor_number(10);
-		sensor.entity_id(0xA0);
-		sensor.entity_instance(0x60);
-		//sensor.sensor_setable(false); // Default, Unsupported
-		//sensor.initialize_scanning_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_events_enabled(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_thresholds(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_hysteresis(false); // Default (An Init Agent is not required.)
-		//sensor.initialize_sensor_type(false); // Default (An Init Agent is not required.)
-		sensor.ignore_if_entity_absent(true);
-		sensor.events_enabled_default(true);
-		sensor.scanning_enabled_default(true);
-		sensor.sensor_auto_rearm(true);
-		sensor.sensor_hysteresis_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_threshold_access_support(SensorDataRecordReadableSensor::ACCESS_READWRITE);
-		sensor.sensor_event_message_control_support(SensorDataRecordReadableSensor::EVTCTRL_GRANULAR);
-		sensor.sensor_type_code(0x01); // Temperature
-		sensor.event_type_reading_code(SensorDataRecordReadableSensor::EVENT_TYPE_THRESHOLD_SENSOR);
-		sensor.threshold_comparisons_returned(0x3f); // All comparisons returned
-		sensor.assertion_lower_threshold_reading_mask(0x0fc0); // UNC, UCR, UNR assertions supported.
-		sensor.deassertion_upper_threshold_reading_mask(0x0fc0); // UNC, UCR, UNR deassertions supported.
-		sensor.discrete_reading_setable_threshold_reading_mask(0x3f3f); // All thresholds are configurable.
-		sensor.units_numeric_format(SensorDataRecord01::UNITS_UNSIGNED);
-		sensor.units_rate_unit(SensorDataRecordReadableSensor::RATE_UNIT_NONE);
-		sensor.units_base_unit(1); // degrees C
-		sensor.units_modifier_unit(0); // unspecified
-		sensor.units_modifier_unit_method(SensorDataRecordReadableSensor::MODIFIER_UNIT_NONE);
-		sensor.linearization(SensorDataRecord01::LIN_LINEAR);
-		// IPMI Specifies a linearization function of: y = L[(Mx + (B * 10^(Bexp) ) ) * 10^(Rexp) ]
-		// Our settings produce a valid range of 0 (degrees C) to 127.5 (degrees C) with 0.5 degrees C granularity.
-		sensor.conversion_m(5);
-		sensor.conversion_b(0);
-		sensor.conversion_b_exp(0);
-		sensor.conversion_r_exp(-1);
-		sensor.sensor_direction(SensorDataRecordReadableSensor::DIR_UNSPECIFIED);
-		//sensor.normal_min_specified(false); // Default
-		//sensor.normal_min_rawvalue(0); // Unspecified
-		//sensor.normal_max_specified(false); // Default
-		//sensor.normal_max_rawvalue(0); // Unspecified
-		sensor.nominal_reading_specified(true);
-		sensor.nominal_reading_rawvalue(60); // 30 degrees C
-		sensor.threshold_unr_rawvalue(100); // 50 degrees C
-		sensor.threshold_ucr_rawvalue(90); // 45 degrees C
-		sensor.threshold_unc_rawvalue(80); // 40 degrees C
-		sensor.threshold_lnc_rawvalue(0); // null degrees C
-		sensor.threshold_lcr_rawvalue(0); // null degrees C
-		sensor.threshold_lnr_rawvalue(0); // null degrees C
-		sensor.hysteresis_high(1); // +0.5 degrees C
-		sensor.hysteresis_low(1); // -0.5 degrees C
-		ADD_TO_REPO(sensor);
-		if (!ipmc_sensors.get(sensor.sensor_number()))
-			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"]["T_BOT"]));
+			ipmc_sensors.add(std::make_shared<ThresholdSensor>(sensor.recordKey(), LOG["sensors"][BoardSDRs::sensors[i].name]));
 	}
 
 #undef ADD_TO_REPO
 
+	const size_t staged = batch.size();
+	const uint64_t commit_counts = batch.commit();
+	LOG["sensors"].log(stdsprintf("Committed %u Device SDRs in %llu us.", staged, HiResTimer::countsToUs(commit_counts)), LogTree::LOG_DIAGNOSTIC);
+
 	runTask("persist_sdr", TASK_PRIORITY_SERVICE, [reinit]() -> void {
-		VariablePersistentAllocation sdr_persist(*persistent_storage, PersistentStorageAllocations::WISC_SDR_REPOSITORY);
+		SDRPersistence sdr_persist(*persistent_storage, PersistentStorageAllocations::WISC_SDR_REPOSITORY, LOG["sdr_persist"]);
 		// If not reinitializing, merge in saved configuration, overwriting matching records.
 		if (!reinit) {
-			device_sdr_repo.u8import(sdr_persist.getData());
+			device_sdr_repo.u8import(sdr_persist.load());
 			// Now that we've merged in our stored settings, we'll have to update the linkages (and sensor processor settings) again.
 			if (payload_manager)
 				payload_manager->refreshSensorLinkage();
 			// else: It'll get run after payload_manager is initialized anyway.
 		}
 
-		// Store the newly initialized Device SDRs
-		sdr_persist.setData(device_sdr_repo.u8export());
+		// Store the newly initialized Device SDRs, if they differ from what is stored already.
+		std::vector<uint8_t> sdrs = device_sdr_repo.u8export();
+		sdr_persist.store(sdrs);
+
+		// The SDRs are final now, precompute the conversions of anything that changed and link event sources.
+		linkDeviceSDRs(sdrs);
+
+		/* Shelf manager writes, later imports and threshold changes go straight
+		 * to the repository without telling anyone, so watch it for changes.
+		 */
+		runTask("sdr_watch", TASK_PRIORITY_BACKGROUND, [sdrs]() -> void {
+			std::vector<uint8_t> linked = sdrs;
+			while (true) {
+				vTaskDelay(pdMS_TO_TICKS(SDR_WATCH_PERIOD));
+				std::vector<uint8_t> current = device_sdr_repo.u8export();
+				if (current != linked) {
+					linked.swap(current);
+					linkDeviceSDRs(linked);
+				}
+			}
+		});
 	});
 }
 
@@ -26,6 +26,11 @@ extern "C" {
 #include "xil_types.h"
 #include "xstatus.h"
 
+/************************** Constant Definitions ***************************/
+
+/* Maximum number of channels covered by the shadow register cache */
+#define IPMI_SENSOR_PROC_SHADOW_MAX_CH	(32)
+
 /**************************** Type Definitions *****************************/
 
 /**
@@ -38,18 +43,6 @@ typedef struct {
 	u32 SENSOR_DATA_WIDTH; /* Sensor bit width */
 } IPMI_SENSOR_PROC_Config;
 
-/**
- * The IPMI_Sensor_Proc driver instance data. The user is required to allocate
- * a variable of this type for every IPMI_Sensor_Proc device in the system.
- * A pointer to a variable of this type is then passed to the driver API functions.
- **/
-typedef struct {
-	UINTPTR BaseAddress; /* Device base address */
-	u32 IsReady; /* Device is initialized and ready */
-	u32 sensor_ch_cnt;  /* Number of sensors supported in FW*/
-	u32 sensor_data_width;  /* Sensor bit width */
-} IPMI_Sensor_Proc;
-
 /**
  * Threshold Configuration
  **/
@@ -70,6 +63,41 @@ typedef struct {
     u16 hyst_neg; /* Raw Negative-going Threshold Hysteresis Value */
 } Hyst_Cfg;
 
+/**
+ * Shadow copy of the channel configuration registers.
+ *
+ * Configuration writes go through to the hardware and are mirrored here, so
+ * reads can be served from RAM and unchanged writes skipped.  There is one
+ * shadow per device, shared by every instance that drives it, so the driver
+ * accesses it with interrupts masked and it is safe to use from any context.
+ **/
+typedef struct {
+	u32 ThrValid; /* Bitmap of channels with a valid threshold shadow */
+	u32 HystValid; /* Bitmap of channels with a valid hysteresis shadow */
+	u32 EnValid; /* Bitmap of channels with a valid event enable shadow */
+	u32 EventOwner; /* Bitmap of channels whose latched events belong to an event owner */
+	Thr_Cfg Thr[IPMI_SENSOR_PROC_SHADOW_MAX_CH]; /* Threshold shadow */
+	Hyst_Cfg Hyst[IPMI_SENSOR_PROC_SHADOW_MAX_CH]; /* Hysteresis shadow */
+	u16 AssertEn[IPMI_SENSOR_PROC_SHADOW_MAX_CH]; /* Assertion event enable shadow */
+	u16 DeassertEn[IPMI_SENSOR_PROC_SHADOW_MAX_CH]; /* Deassertion event enable shadow */
+	u32 RegWrites; /* Register writes issued */
+	u32 RegWritesSkipped; /* Register writes skipped, value unchanged */
+	u32 RegReadsSaved; /* Register reads served from the shadow */
+} IPMI_Sensor_Proc_Shadow;
+
+/**
+ * The IPMI_Sensor_Proc driver instance data. The user is required to allocate
+ * a variable of this type for every IPMI_Sensor_Proc device in the system.
+ * A pointer to a variable of this type is then passed to the driver API functions.
+ **/
+typedef struct {
+	UINTPTR BaseAddress; /* Device base address */
+	u32 IsReady; /* Device is initialized and ready */
+	u32 sensor_ch_cnt;  /* Number of sensors supported in FW*/
+	u32 sensor_data_width;  /* Sensor bit width */
+	IPMI_Sensor_Proc_Shadow *Shadow; /* Shadow registers of this device */
+} IPMI_Sensor_Proc;
+
 /****************************************************************************/
 /**
 * Initialize the IPMI_Sensor_Proc instance provided by the caller based on
@@ -106,7 +134,7 @@ XStatus IPMI_Sensor_Proc_Initialize(IPMI_Sensor_Proc *InstancePtr, u16 DeviceId)
 * 		caller. Further calls to manipulate the instance/driver through
 * 		the IPMI_Sensor_Proc API must be made with this pointer.
 *
-* @note		None.
+* @note		The shadow registers are invalidated.
 *
 *****************************************************************************/
 void IPMI_Sensor_Proc_Reset(IPMI_Sensor_Proc *InstancePtr);
@@ -133,7 +161,7 @@ void IPMI_Sensor_Proc_Reset(IPMI_Sensor_Proc *InstancePtr);
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Written through, registers already holding the value are skipped.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Set_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, const Hyst_Cfg * cfg);
@@ -158,7 +186,7 @@ XStatus IPMI_Sensor_Proc_Set_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Served from the shadow registers once they are known.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Get_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Hyst_Cfg * cfg);
@@ -184,7 +212,7 @@ XStatus IPMI_Sensor_Proc_Get_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Written through, registers already holding the value are skipped.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Set_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, const Thr_Cfg * cfg);
@@ -210,7 +238,7 @@ XStatus IPMI_Sensor_Proc_Set_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Served from the shadow registers once they are known.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Get_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Thr_Cfg * cfg);
@@ -260,7 +288,7 @@ XStatus IPMI_Sensor_Proc_Get_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Written through, registers already holding the value are skipped.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Set_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
@@ -311,7 +339,7 @@ XStatus IPMI_Sensor_Proc_Set_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		None.
+* @note		Served from the shadow registers once they are known.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Get_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
@@ -364,7 +392,8 @@ a* 		bit  4: re-arm assertion event for lower non-recoverable going low
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		Threshold based sensor, with manual re-arm.
+* @note		Threshold based sensor, with manual re-arm.  Channels claimed
+* 		with IPMI_Sensor_Proc_Set_Event_Owner are left alone.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Rearm_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
@@ -415,7 +444,8 @@ XStatus IPMI_Sensor_Proc_Rearm_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
 * @return   - XST_INVALID_PARAM if ch parameter out of bound
 * 			- XST_SUCCESS otherwise
 *
-* @note		Threshold based sensor, with manual re-arm.
+* @note		Threshold based sensor, with manual re-arm.  Channels claimed
+* 		with IPMI_Sensor_Proc_Set_Event_Owner read back as no events.
 *
 *****************************************************************************/
 XStatus IPMI_Sensor_Proc_Get_Latched_Event_Status(const IPMI_Sensor_Proc *InstancePtr,
@@ -482,6 +512,120 @@ XStatus IPMI_Sensor_Proc_Get_Current_Event_Status(const IPMI_Sensor_Proc *Instan
 XStatus IPMI_Sensor_Proc_Get_Sensor_Reading(const IPMI_Sensor_Proc *InstancePtr,
 		const u32 ch, u16 * sensor_reading, u8 * thr_status );
 
+/****************************************************************************/
+/**
+* Read back latched event status of a set of channels
+*
+* Only the channels flagged in ch_mask are accessed, so this is meant to be
+* driven by the IRQ status bitmap: quiet channels cost no bus accesses.
+*
+* @param	InstancePtr is a pointer to an IPMI_Sensor_Proc instance. The memory
+* 		the pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @param 	Bitmap of sensor channels to read, bit n is channel n
+*
+* @param 	Array of sensor_ch_cnt entries receiving the assert status, see
+* 		IPMI_Sensor_Proc_Get_Latched_Event_Status. Entries of channels
+* 		not flagged in ch_mask are left untouched.
+*
+* @param 	Array of sensor_ch_cnt entries receiving the deassert status
+*
+* @return   Bitmap of the flagged channels that had any latched event
+*
+* @note		Threshold based sensor, with manual re-arm.
+*
+*****************************************************************************/
+u32 IPMI_Sensor_Proc_Get_Latched_Event_Status_Mask(const IPMI_Sensor_Proc *InstancePtr,
+		u32 ch_mask, u16 * assert_status, u16 * deassert_status );
+
+/****************************************************************************/
+/**
+* Re-arm the latched events of a set of channels
+*
+* The counterpart of IPMI_Sensor_Proc_Get_Latched_Event_Status_Mask, used by
+* the event owner.  Owned channels are re-armed as well.
+*
+* @param	InstancePtr is a pointer to an IPMI_Sensor_Proc instance. The memory
+* 		the pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @param 	Bitmap of sensor channels to re-arm, bit n is channel n
+*
+* @param 	Array of sensor_ch_cnt entries with the assert re-arm bits, see
+* 		IPMI_Sensor_Proc_Rearm_Event_Enable
+*
+* @param 	Array of sensor_ch_cnt entries with the deassert re-arm bits
+*
+* @note		Threshold based sensor, with manual re-arm.
+*
+*****************************************************************************/
+void IPMI_Sensor_Proc_Rearm_Event_Enable_Mask(const IPMI_Sensor_Proc *InstancePtr,
+		u32 ch_mask, const u16 * assert_rearm, const u16 * deassert_rearm );
+
+/****************************************************************************/
+/**
+* Claim the latched events of a set of channels
+*
+* Latched events are consumed by reading and re-arming them, so two consumers
+* of one channel race each other.  Once claimed, a channel reads back no
+* latched events through IPMI_Sensor_Proc_Get_Latched_Event_Status and
+* ignores IPMI_Sensor_Proc_Rearm_Event_Enable, leaving it to the owner's
+* mask based calls.  The claim is per device and survives shadow resets.
+*
+* @param	InstancePtr is a pointer to an IPMI_Sensor_Proc instance. The memory
+* 		the pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @param 	Bitmap of owned sensor channels, replacing the previous one
+*
+* @note		Devices without a shadow cannot be claimed.
+*
+*****************************************************************************/
+void IPMI_Sensor_Proc_Set_Event_Owner(const IPMI_Sensor_Proc *InstancePtr, u32 ch_mask);
+
+/****************************************************************************/
+/**
+* Compare the shadow registers against the hardware
+*
+* Every valid shadow entry is read back from the hardware, this is the only
+* place apart from cold reads where configuration registers are read.  Use it
+* periodically or on demand to detect divergence, for instance after the
+* core was reset behind the driver's back.
+*
+* @param	InstancePtr is a pointer to an IPMI_Sensor_Proc instance. The memory
+* 		the pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @param 	If non-zero, diverged channels are rewritten from the shadow
+*
+* @return   Bitmap of channels whose hardware configuration diverged
+*
+* @note		None.
+*
+*****************************************************************************/
+u32 IPMI_Sensor_Proc_Verify_Shadow(const IPMI_Sensor_Proc *InstancePtr, int restore);
+
+/****************************************************************************/
+/**
+* Invalidate the shadow registers
+*
+* The next read of each register goes to the hardware again.
+*
+* @param	InstancePtr is a pointer to an IPMI_Sensor_Proc instance. The memory
+* 		the pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @note		None.
+*
+*****************************************************************************/
+void IPMI_Sensor_Proc_Invalidate_Shadow(const IPMI_Sensor_Proc *InstancePtr);
+
 /****************************************************************************/
 /**
 * Read pending IRQ status
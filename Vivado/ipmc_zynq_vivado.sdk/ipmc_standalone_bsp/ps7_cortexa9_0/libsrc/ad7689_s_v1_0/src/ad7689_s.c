@@ -297,6 +297,89 @@ XStatus AD7689_S_Get_Reading(AD7689_S *InstancePtr, u8 slave, u8 ch, u16 *val)
 	return XST_SUCCESS;
 }
 
+/******************************************************************************/
+/**
+* Read a coherent snapshot of all channels of all slave interfaces
+*
+* The read is bracketed by the ch0 conversion counter.  If the sequencer
+* started a new scan while the channels were being read the snapshot is torn
+* and is retried, up to AD7689_S_SNAPSHOT_RETRIES times.
+*
+* @param	InstancePtr is a pointer to an AD7689_S instance. The memory the
+*		pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the driver through the AD7689_S API must be
+*		made with this pointer.
+*
+* @param 	vals is the destination array, filled as vals[slave * AD7689_S_CH_CNT + ch]
+*
+* @param 	val_cnt is the number of entries in vals, must be at least
+* 			SlaveCount * AD7689_S_CH_CNT
+*
+* @param 	conv_cnt is pointer to the conversion counter the snapshot belongs to (may be NULL)
+*
+* @param 	retries is pointer to the number of retries that were required (may be NULL)
+*
+* @return   - XST_INVALID_PARAM if vals is too small
+* 			- XST_FAILURE if no coherent snapshot could be taken
+* 			- XST_SUCCESS otherwise
+*
+* @note		Register reads have no side effects, no locking is required.
+*
+******************************************************************************/
+XStatus AD7689_S_Get_Readings(AD7689_S *InstancePtr, u16 *vals, u32 val_cnt, u32 *conv_cnt, u32 *retries)
+{
+	u32 attempt, slave, ch;
+	u32 cnt_start, cnt_end;
+
+	if (val_cnt < InstancePtr->SlaveCount * AD7689_S_CH_CNT) return XST_INVALID_PARAM;
+
+	for (attempt = 0; attempt <= AD7689_S_SNAPSHOT_RETRIES; attempt++) {
+		cnt_start = AD7689_S_ReadReg(InstancePtr->BaseAddress, SAMPLE_CH0_CNT_REG);
+
+		for (slave = 0; slave < InstancePtr->SlaveCount; slave++)
+			for (ch = 0; ch < AD7689_S_CH_CNT; ch++)
+				vals[slave * AD7689_S_CH_CNT + ch] = (u16)AD7689_S_ReadReg(InstancePtr->BaseAddress, ADC_VAL_OFFSET + ADC_SLAVE_OFFSET * slave + (ch << 2));
+
+		cnt_end = AD7689_S_ReadReg(InstancePtr->BaseAddress, SAMPLE_CH0_CNT_REG);
+
+		if (cnt_start == cnt_end) {
+			if (conv_cnt) *conv_cnt = cnt_end;
+			if (retries) *retries = attempt;
+			return XST_SUCCESS;
+		}
+	}
+
+	if (retries) *retries = attempt;
+	return XST_FAILURE;
+}
+
+/******************************************************************************/
+/**
+* Get the bus address of the raw AD conversion result registers of a slave
+*
+* The AD7689_S_CH_CNT result registers of a slave interface are contiguous,
+* 32-bit wide and side effect free, so they can be copied as a block by a bus
+* master such as the PS DMA controller.
+*
+* @param	InstancePtr is a pointer to an AD7689_S instance. The memory the
+*		pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the driver through the AD7689_S API must be
+*		made with this pointer.
+*
+* @param 	slave is the target slave interface
+*
+* @return   Address of the channel 0 result register, or 0 if slave is out of bound
+*
+* @note		None
+*
+******************************************************************************/
+UINTPTR AD7689_S_Get_Readings_Addr(AD7689_S *InstancePtr, u8 slave)
+{
+	if (slave >= InstancePtr->SlaveCount) return 0;
+
+	return InstancePtr->BaseAddress + ADC_VAL_OFFSET + ADC_SLAVE_OFFSET * slave;
+}
+
 /******************************************************************************/
 /**
 * Set per channel enable/disable override mask
@@ -26,6 +26,14 @@ extern "C" {
 #include "xil_types.h"
 #include "xstatus.h"
 
+/************************** Constant Definitions ***************************/
+
+/* Channels per slave interface: 0-7 are ADC inputs, 8 is ADC internal temperature */
+#define AD7689_S_CH_CNT				(9)
+
+/* Number of times a torn snapshot is retried before giving up */
+#define AD7689_S_SNAPSHOT_RETRIES	(4)
+
 /**************************** Type Definitions *****************************/
 
 /**
@@ -61,6 +69,10 @@ u32 AD7689_S_Get_Conv_Cnt(AD7689_S *InstancePtr);
 
 XStatus AD7689_S_Get_Reading(AD7689_S *InstancePtr, u8 slave, u8 ch, u16 *val);
 
+XStatus AD7689_S_Get_Readings(AD7689_S *InstancePtr, u16 *vals, u32 val_cnt, u32 *conv_cnt, u32 *retries);
+
+UINTPTR AD7689_S_Get_Readings_Addr(AD7689_S *InstancePtr, u8 slave);
+
 void AD7689_S_Set_Ch_Ovrrd_Enables(AD7689_S *InstancePtr, u32 enables);
 
 u32 AD7689_S_Get_Ch_Ovrrd_Enables(AD7689_S *InstancePtr);
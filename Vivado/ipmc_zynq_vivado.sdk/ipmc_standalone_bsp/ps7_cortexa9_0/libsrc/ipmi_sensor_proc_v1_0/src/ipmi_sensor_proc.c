@@ -18,6 +18,7 @@
 /***************************** Include Files *******************************/
 #include "xparameters.h"
 #include "xil_io.h"
+#include "xpseudo_asm.h"
 
 #include "ipmi_sensor_proc.h"
 
@@ -71,6 +72,42 @@ extern IPMI_SENSOR_PROC_Config IPMI_SENSOR_PROC_ConfigTable[];
 #define IPMI_Sensor_Proc_ReadReg(BaseAddress, RegOffset) \
 	Xil_In32((BaseAddress) + (RegOffset))
 
+/* One shadow per device, shared by all instances driving it */
+static IPMI_Sensor_Proc_Shadow IPMI_Sensor_Proc_Shadows[XPAR_IPMI_SENSOR_PROC_NUM_INSTANCES];
+
+#define SHADOW_BIT(ch) (((ch) < IPMI_SENSOR_PROC_SHADOW_MAX_CH) ? (1UL << (ch)) : 0)
+
+/*
+ * The shadow is shared by tasks and interrupt handlers, so each access to a
+ * channel's entry and its registers runs with IRQ and FIQ masked.  Otherwise
+ * a preempted Set_Thr leaves a half written Thr_Cfg for the next reader.
+ */
+#define IRQ_FIQ_MASK 0xC0U
+
+#define SHADOW_LOCK(currmask) do { \
+		(currmask) = mfcpsr(); \
+		mtcpsr((currmask) | IRQ_FIQ_MASK); \
+	} while (0)
+
+#define SHADOW_UNLOCK(currmask) mtcpsr(currmask)
+
+/* Write a configuration register unless the shadow says it already holds val */
+static void IPMI_Sensor_Proc_Shadow_Write(const IPMI_Sensor_Proc *InstancePtr, u32 valid, u16 *shadow, u32 reg, u16 val)
+{
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+
+	if (valid && *shadow == val) {
+		Shadow->RegWritesSkipped++;
+		return;
+	}
+
+	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, reg, val);
+	if (Shadow) {
+		*shadow = val;
+		Shadow->RegWrites++;
+	}
+}
+
 IPMI_SENSOR_PROC_Config *IPMI_Sensor_Proc_LookupConfig(u16 DeviceId)
 {
 	IPMI_SENSOR_PROC_Config *CfgPtr = NULL;
@@ -89,6 +126,8 @@ IPMI_SENSOR_PROC_Config *IPMI_Sensor_Proc_LookupConfig(u16 DeviceId)
 int IPMI_Sensor_Proc_CfgInitialize(IPMI_Sensor_Proc * InstancePtr, IPMI_SENSOR_PROC_Config * Config,
 			UINTPTR EffectiveAddr)
 {
+	int Index;
+
 	/* Assert arguments */
 	Xil_AssertNonvoid(InstancePtr != NULL);
 
@@ -98,6 +137,15 @@ int IPMI_Sensor_Proc_CfgInitialize(IPMI_Sensor_Proc * InstancePtr, IPMI_SENSOR_P
 	InstancePtr->sensor_ch_cnt = Config->SENSOR_CH_CNT;
 	InstancePtr->sensor_data_width = Config->SENSOR_DATA_WIDTH;
 
+	/* Devices outside the configuration table run without a shadow */
+	InstancePtr->Shadow = NULL;
+	for (Index = 0; Index < XPAR_IPMI_SENSOR_PROC_NUM_INSTANCES; Index++) {
+		if (IPMI_SENSOR_PROC_ConfigTable[Index].BaseAddress == EffectiveAddr) {
+			InstancePtr->Shadow = &IPMI_Sensor_Proc_Shadows[Index];
+			break;
+		}
+	}
+
 	/*
 	 * Indicate the instance is now ready to use, initialized without error
 	 */
@@ -134,16 +182,32 @@ void IPMI_Sensor_Proc_Reset(IPMI_Sensor_Proc *InstancePtr)
 {
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, RESET_REG, 1);
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, RESET_REG, 0);
+
+	/* The configuration registers are back to their defaults */
+	IPMI_Sensor_Proc_Invalidate_Shadow(InstancePtr);
 }
 
 
 XStatus IPMI_Sensor_Proc_Set_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, const Hyst_Cfg * cfg)
 {
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 valid, currmask;
+
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, HYST_POS_REG + ch * 4, cfg->hyst_pos);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, HYST_NEG_REG + ch * 4, cfg->hyst_neg);
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, HYST_POS_REG + ch * 4, cfg->hyst_pos);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, HYST_NEG_REG + ch * 4, cfg->hyst_neg);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	valid = Shadow->HystValid & SHADOW_BIT(ch);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Hyst[ch].hyst_pos, HYST_POS_REG + ch * 4, cfg->hyst_pos);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Hyst[ch].hyst_neg, HYST_NEG_REG + ch * 4, cfg->hyst_neg);
+	Shadow->HystValid |= SHADOW_BIT(ch);
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
@@ -151,11 +215,28 @@ XStatus IPMI_Sensor_Proc_Set_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32
 
 XStatus IPMI_Sensor_Proc_Get_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Hyst_Cfg * cfg)
 {
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
-	cfg->hyst_pos = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_POS_REG + ch * 4);
-	cfg->hyst_neg = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_NEG_REG + ch * 4);
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		cfg->hyst_pos = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_POS_REG + ch * 4);
+		cfg->hyst_neg = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_NEG_REG + ch * 4);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	if (Shadow->HystValid & SHADOW_BIT(ch)) {
+		Shadow->RegReadsSaved += 2;
+	} else {
+		Shadow->Hyst[ch].hyst_pos = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_POS_REG + ch * 4);
+		Shadow->Hyst[ch].hyst_neg = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, HYST_NEG_REG + ch * 4);
+		Shadow->HystValid |= SHADOW_BIT(ch);
+	}
+	*cfg = Shadow->Hyst[ch];
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
@@ -163,30 +244,68 @@ XStatus IPMI_Sensor_Proc_Get_Hyst(const IPMI_Sensor_Proc *InstancePtr, const u32
 
 XStatus IPMI_Sensor_Proc_Set_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, const Thr_Cfg * cfg)
 {
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 valid, currmask;
+
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UNR_REG + ch * 4, cfg->UNR);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UCR_REG + ch * 4, cfg->UCR);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UNC_REG + ch * 4, cfg->UNC);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LNR_REG + ch * 4, cfg->LNR);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LCR_REG + ch * 4, cfg->LCR);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LNC_REG + ch * 4, cfg->LNC);
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UNR_REG + ch * 4, cfg->UNR);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UCR_REG + ch * 4, cfg->UCR);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, UNC_REG + ch * 4, cfg->UNC);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LNR_REG + ch * 4, cfg->LNR);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LCR_REG + ch * 4, cfg->LCR);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, LNC_REG + ch * 4, cfg->LNC);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	valid = Shadow->ThrValid & SHADOW_BIT(ch);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].UNR, UNR_REG + ch * 4, cfg->UNR);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].UCR, UCR_REG + ch * 4, cfg->UCR);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].UNC, UNC_REG + ch * 4, cfg->UNC);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].LNR, LNR_REG + ch * 4, cfg->LNR);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].LCR, LCR_REG + ch * 4, cfg->LCR);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->Thr[ch].LNC, LNC_REG + ch * 4, cfg->LNC);
+	Shadow->ThrValid |= SHADOW_BIT(ch);
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
 
-XStatus IPMI_Sensor_Proc_Get_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Thr_Cfg * cfg)
+static void IPMI_Sensor_Proc_Read_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Thr_Cfg * cfg)
 {
-	if (ch > (InstancePtr->sensor_ch_cnt-1))
-		return XST_INVALID_PARAM;
-
 	cfg->UNR = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, UNR_REG + ch * 4);
 	cfg->UCR = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, UCR_REG + ch * 4);
 	cfg->UNC = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, UNC_REG + ch * 4);
 	cfg->LNR = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, LNR_REG + ch * 4);
 	cfg->LCR = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, LCR_REG + ch * 4);
 	cfg->LNC = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, LNC_REG + ch * 4);
+}
+
+XStatus IPMI_Sensor_Proc_Get_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32 ch, Thr_Cfg * cfg)
+{
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
+	if (ch > (InstancePtr->sensor_ch_cnt-1))
+		return XST_INVALID_PARAM;
+
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		IPMI_Sensor_Proc_Read_Thr(InstancePtr, ch, cfg);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	if (Shadow->ThrValid & SHADOW_BIT(ch)) {
+		Shadow->RegReadsSaved += 6;
+	} else {
+		IPMI_Sensor_Proc_Read_Thr(InstancePtr, ch, &Shadow->Thr[ch]);
+		Shadow->ThrValid |= SHADOW_BIT(ch);
+	}
+	*cfg = Shadow->Thr[ch];
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
@@ -195,11 +314,24 @@ XStatus IPMI_Sensor_Proc_Get_Thr(const IPMI_Sensor_Proc *InstancePtr, const u32
 XStatus IPMI_Sensor_Proc_Set_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
 		const u32 ch, const u16 assert_en, const u16 deassert_en )
 {
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 valid, currmask;
+
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_ASSERT_EN_REG + ch * 4, assert_en);
-	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_DEASSERT_EN_REG + ch * 4, deassert_en);
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_ASSERT_EN_REG + ch * 4, assert_en);
+		IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_DEASSERT_EN_REG + ch * 4, deassert_en);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	valid = Shadow->EnValid & SHADOW_BIT(ch);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->AssertEn[ch], EV_ASSERT_EN_REG + ch * 4, assert_en);
+	IPMI_Sensor_Proc_Shadow_Write(InstancePtr, valid, &Shadow->DeassertEn[ch], EV_DEASSERT_EN_REG + ch * 4, deassert_en);
+	Shadow->EnValid |= SHADOW_BIT(ch);
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
@@ -208,31 +340,82 @@ XStatus IPMI_Sensor_Proc_Set_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
 XStatus IPMI_Sensor_Proc_Get_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
 		const u32 ch, u16 * assert_en, u16 * deassert_en )
 {
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
-	*assert_en = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_ASSERT_EN_REG + ch * 4);
-	*deassert_en = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_DEASSERT_EN_REG + ch * 4);
+	if (!Shadow || !SHADOW_BIT(ch)) {
+		*assert_en = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_ASSERT_EN_REG + ch * 4);
+		*deassert_en = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_DEASSERT_EN_REG + ch * 4);
+		return XST_SUCCESS;
+	}
+
+	SHADOW_LOCK(currmask);
+	if (Shadow->EnValid & SHADOW_BIT(ch)) {
+		Shadow->RegReadsSaved += 2;
+	} else {
+		Shadow->AssertEn[ch] = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_ASSERT_EN_REG + ch * 4);
+		Shadow->DeassertEn[ch] = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_DEASSERT_EN_REG + ch * 4);
+		Shadow->EnValid |= SHADOW_BIT(ch);
+	}
+	*assert_en = Shadow->AssertEn[ch];
+	*deassert_en = Shadow->DeassertEn[ch];
+	SHADOW_UNLOCK(currmask);
 
 	return XST_SUCCESS;
 }
 
 
-XStatus IPMI_Sensor_Proc_Rearm_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
+/* Pulse the re-arm registers of one channel */
+static void IPMI_Sensor_Proc_Rearm(const IPMI_Sensor_Proc *InstancePtr,
 		const u32 ch, const u16 assert_rearm, const u16 deassert_rearm )
 {
-	if (ch > (InstancePtr->sensor_ch_cnt-1))
-		return XST_INVALID_PARAM;
-
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_ASSERT_REARM_REG + ch * 4, assert_rearm);
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_ASSERT_REARM_REG + ch * 4, 0);
 
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_DEASSERT_REARM_REG + ch * 4, deassert_rearm);
 	IPMI_Sensor_Proc_WriteReg(InstancePtr->BaseAddress, EV_DEASSERT_REARM_REG + ch * 4, 0);
+}
+
+/* Channels serviced by an event owner are hidden from the per channel calls */
+#define EVENT_OWNED(InstancePtr, ch) ((InstancePtr)->Shadow && ((InstancePtr)->Shadow->EventOwner & SHADOW_BIT(ch)))
+
+XStatus IPMI_Sensor_Proc_Rearm_Event_Enable(const IPMI_Sensor_Proc *InstancePtr,
+		const u32 ch, const u16 assert_rearm, const u16 deassert_rearm )
+{
+	if (ch > (InstancePtr->sensor_ch_cnt-1))
+		return XST_INVALID_PARAM;
+
+	if (!EVENT_OWNED(InstancePtr, ch))
+		IPMI_Sensor_Proc_Rearm(InstancePtr, ch, assert_rearm, deassert_rearm);
 
 	return XST_SUCCESS;
 }
 
+void IPMI_Sensor_Proc_Rearm_Event_Enable_Mask(const IPMI_Sensor_Proc *InstancePtr,
+		u32 ch_mask, const u16 * assert_rearm, const u16 * deassert_rearm )
+{
+	u32 ch;
+
+	if (InstancePtr->sensor_ch_cnt < 32)
+		ch_mask &= (1 << InstancePtr->sensor_ch_cnt) - 1;
+
+	while (ch_mask) {
+		ch = __builtin_ctz(ch_mask);
+		ch_mask &= ch_mask - 1;
+
+		IPMI_Sensor_Proc_Rearm(InstancePtr, ch, assert_rearm[ch], deassert_rearm[ch]);
+	}
+}
+
+void IPMI_Sensor_Proc_Set_Event_Owner(const IPMI_Sensor_Proc *InstancePtr, u32 ch_mask)
+{
+	if (InstancePtr->Shadow)
+		InstancePtr->Shadow->EventOwner = ch_mask;
+}
+
 
 
 XStatus IPMI_Sensor_Proc_Get_Latched_Event_Status(const IPMI_Sensor_Proc *InstancePtr,
@@ -241,12 +424,40 @@ XStatus IPMI_Sensor_Proc_Get_Latched_Event_Status(const IPMI_Sensor_Proc *Instan
 	if (ch > (InstancePtr->sensor_ch_cnt-1))
 		return XST_INVALID_PARAM;
 
+	if (EVENT_OWNED(InstancePtr, ch)) {
+		*assert_status = 0;
+		*deassert_status = 0;
+		return XST_SUCCESS;
+	}
+
 	*assert_status = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_ASSERT_ST_REG + ch * 4);
 	*deassert_status = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_DEASSERT_ST_REG + ch * 4);
 
 	return XST_SUCCESS;
 }
 
+u32 IPMI_Sensor_Proc_Get_Latched_Event_Status_Mask(const IPMI_Sensor_Proc *InstancePtr,
+		u32 ch_mask, u16 * assert_status, u16 * deassert_status )
+{
+	u32 ch, active = 0;
+
+	if (InstancePtr->sensor_ch_cnt < 32)
+		ch_mask &= (1 << InstancePtr->sensor_ch_cnt) - 1;
+
+	while (ch_mask) {
+		ch = __builtin_ctz(ch_mask);
+		ch_mask &= ch_mask - 1;
+
+		assert_status[ch] = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_ASSERT_ST_REG + ch * 4);
+		deassert_status[ch] = IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, EV_DEASSERT_ST_REG + ch * 4);
+
+		if (assert_status[ch] || deassert_status[ch])
+			active |= 1 << ch;
+	}
+
+	return active;
+}
+
 XStatus IPMI_Sensor_Proc_Get_Current_Event_Status(const IPMI_Sensor_Proc *InstancePtr,
 		const u32 ch, u16 * assert_status, u16 * deassert_status )
 {
@@ -273,6 +484,84 @@ XStatus IPMI_Sensor_Proc_Get_Sensor_Reading(const IPMI_Sensor_Proc *InstancePtr,
 	return XST_SUCCESS;
 }
 
+u32 IPMI_Sensor_Proc_Verify_Shadow(const IPMI_Sensor_Proc *InstancePtr, int restore)
+{
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 ch, bit, currmask, diverged = 0;
+	u32 base = InstancePtr->BaseAddress;
+
+	if (!Shadow)
+		return 0;
+
+	for (ch = 0; ch < InstancePtr->sensor_ch_cnt && ch < IPMI_SENSOR_PROC_SHADOW_MAX_CH; ch++) {
+		bit = SHADOW_BIT(ch);
+
+		/* One channel at a time, so interrupts are not held off for long */
+		SHADOW_LOCK(currmask);
+
+		if (Shadow->ThrValid & bit) {
+			const Thr_Cfg *thr = &Shadow->Thr[ch];
+			if (IPMI_Sensor_Proc_ReadReg(base, UNR_REG + ch * 4) != thr->UNR ||
+				IPMI_Sensor_Proc_ReadReg(base, UCR_REG + ch * 4) != thr->UCR ||
+				IPMI_Sensor_Proc_ReadReg(base, UNC_REG + ch * 4) != thr->UNC ||
+				IPMI_Sensor_Proc_ReadReg(base, LNR_REG + ch * 4) != thr->LNR ||
+				IPMI_Sensor_Proc_ReadReg(base, LCR_REG + ch * 4) != thr->LCR ||
+				IPMI_Sensor_Proc_ReadReg(base, LNC_REG + ch * 4) != thr->LNC)
+				diverged |= bit;
+		}
+
+		if (Shadow->HystValid & bit) {
+			if (IPMI_Sensor_Proc_ReadReg(base, HYST_POS_REG + ch * 4) != Shadow->Hyst[ch].hyst_pos ||
+				IPMI_Sensor_Proc_ReadReg(base, HYST_NEG_REG + ch * 4) != Shadow->Hyst[ch].hyst_neg)
+				diverged |= bit;
+		}
+
+		if (Shadow->EnValid & bit) {
+			if (IPMI_Sensor_Proc_ReadReg(base, EV_ASSERT_EN_REG + ch * 4) != Shadow->AssertEn[ch] ||
+				IPMI_Sensor_Proc_ReadReg(base, EV_DEASSERT_EN_REG + ch * 4) != Shadow->DeassertEn[ch])
+				diverged |= bit;
+		}
+
+		if (restore && (diverged & bit)) {
+			if (Shadow->ThrValid & bit) {
+				IPMI_Sensor_Proc_WriteReg(base, UNR_REG + ch * 4, Shadow->Thr[ch].UNR);
+				IPMI_Sensor_Proc_WriteReg(base, UCR_REG + ch * 4, Shadow->Thr[ch].UCR);
+				IPMI_Sensor_Proc_WriteReg(base, UNC_REG + ch * 4, Shadow->Thr[ch].UNC);
+				IPMI_Sensor_Proc_WriteReg(base, LNR_REG + ch * 4, Shadow->Thr[ch].LNR);
+				IPMI_Sensor_Proc_WriteReg(base, LCR_REG + ch * 4, Shadow->Thr[ch].LCR);
+				IPMI_Sensor_Proc_WriteReg(base, LNC_REG + ch * 4, Shadow->Thr[ch].LNC);
+			}
+			if (Shadow->HystValid & bit) {
+				IPMI_Sensor_Proc_WriteReg(base, HYST_POS_REG + ch * 4, Shadow->Hyst[ch].hyst_pos);
+				IPMI_Sensor_Proc_WriteReg(base, HYST_NEG_REG + ch * 4, Shadow->Hyst[ch].hyst_neg);
+			}
+			if (Shadow->EnValid & bit) {
+				IPMI_Sensor_Proc_WriteReg(base, EV_ASSERT_EN_REG + ch * 4, Shadow->AssertEn[ch]);
+				IPMI_Sensor_Proc_WriteReg(base, EV_DEASSERT_EN_REG + ch * 4, Shadow->DeassertEn[ch]);
+			}
+		}
+
+		SHADOW_UNLOCK(currmask);
+	}
+
+	return diverged;
+}
+
+void IPMI_Sensor_Proc_Invalidate_Shadow(const IPMI_Sensor_Proc *InstancePtr)
+{
+	IPMI_Sensor_Proc_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
+	if (!Shadow)
+		return;
+
+	SHADOW_LOCK(currmask);
+	Shadow->ThrValid = 0;
+	Shadow->HystValid = 0;
+	Shadow->EnValid = 0;
+	SHADOW_UNLOCK(currmask);
+}
+
 u32 IPMI_Sensor_Proc_Get_IRQ_Status(const IPMI_Sensor_Proc *InstancePtr)
 {
 	return  IPMI_Sensor_Proc_ReadReg(InstancePtr->BaseAddress, IRQ_REQ_REG);
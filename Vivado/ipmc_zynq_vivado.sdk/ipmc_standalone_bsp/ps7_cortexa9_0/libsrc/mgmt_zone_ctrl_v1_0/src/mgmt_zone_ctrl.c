@@ -19,6 +19,7 @@
 #include "mgmt_zone_ctrl.h"
 #include "xparameters.h"
 #include "xil_io.h"
+#include "xpseudo_asm.h"
 
 #define MZ_COUNT_MAX 		(16)
 #define MZ_POWER_EN_COUNT 	(32)
@@ -75,6 +76,131 @@ extern Mgmt_Zone_Ctrl_Config Mgmt_Zone_Ctrl_ConfigTable[];
 #define Mgmt_Zone_Ctrl_ReadReg(BaseAddress, RegOffset) \
 	Xil_In32((BaseAddress) + (RegOffset))
 
+/* One shadow per device, shared by all instances driving it */
+static Mgmt_Zone_Ctrl_Shadow Mgmt_Zone_Ctrl_Shadows[XPAR_MGMT_ZONE_CTRL_NUM_INSTANCES];
+
+#define SHADOW_MZ_BIT(mz) (((mz) < MGMT_ZONE_CTRL_SHADOW_MAX_MZ) ? (1UL << (mz)) : 0)
+#define SHADOW_PWREN_BIT(idx) (1UL << (idx))
+
+/*
+ * The status cache is used from tasks and interrupt handlers, so its checks
+ * and updates run with IRQ and FIQ masked, as the BSP cache code does.
+ */
+#define IRQ_FIQ_MASK 0xC0U
+
+#define SHADOW_LOCK(currmask) do { \
+		(currmask) = mfcpsr(); \
+		mtcpsr((currmask) | IRQ_FIQ_MASK); \
+	} while (0)
+
+#define SHADOW_UNLOCK(currmask) mtcpsr(currmask)
+
+/* Write a configuration register unless the shadow says it already holds val */
+static void Mgmt_Zone_Ctrl_Shadow_Write(const Mgmt_Zone_Ctrl *InstancePtr, u32 valid, u32 *shadow, u32 reg, u32 val)
+{
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+
+	if (valid && *shadow == val) {
+		Shadow->RegWritesSkipped++;
+		return;
+	}
+
+	Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, reg, val);
+	if (Shadow) {
+		*shadow = val;
+		Shadow->RegWrites++;
+	}
+}
+
+/* Drop all cached zone states, any computation in flight will not be cached */
+static void Mgmt_Zone_Ctrl_Invalidate_Status(const Mgmt_Zone_Ctrl *InstancePtr)
+{
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
+	if (!Shadow)
+		return;
+
+	SHADOW_LOCK(currmask);
+	Shadow->StatusGen++;
+	Shadow->StatusValid = 0;
+	SHADOW_UNLOCK(currmask);
+}
+
+/*
+ * Power enable ownership (CFG_1) and, if cfg0 is not NULL, its timer (CFG_0),
+ * from the shadow when known.  Zone state queries fill the shadow from
+ * interrupt context too, so it is checked and filled under the lock.
+ */
+static u32 Mgmt_Zone_Ctrl_Get_PwrEn_Cfg(const Mgmt_Zone_Ctrl *InstancePtr, int idx, u32 *cfg0)
+{
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	u32 cfg1, currmask;
+
+	if (!Shadow) {
+		if (cfg0)
+			*cfg0 = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		return Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+	}
+
+	SHADOW_LOCK(currmask);
+	if (Shadow->PwrEnValid & SHADOW_PWREN_BIT(idx)) {
+		Shadow->RegReadsSaved += cfg0 ? 2 : 1;
+	} else {
+		Shadow->PwrEnCfg0[idx] = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		Shadow->PwrEnCfg1[idx] = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		Shadow->PwrEnValid |= SHADOW_PWREN_BIT(idx);
+	}
+	if (cfg0)
+		*cfg0 = Shadow->PwrEnCfg0[idx];
+	cfg1 = Shadow->PwrEnCfg1[idx];
+	SHADOW_UNLOCK(currmask);
+
+	return cfg1;
+}
+
+/* Derive the zone state from the individual status of the power enables it owns */
+static MZ_pwr Mgmt_Zone_Ctrl_Read_MZ_Status(const Mgmt_Zone_Ctrl *InstancePtr, u32 MZ)
+{
+	 MZ_pwr mz_pwr = MZ_PWR_OFF;
+	 u32 mz_pwr_on_cnt = 0;
+	 u32 mz_pwr_trans_on_cnt = 0;
+	 u32 mz_pwr_trans_off_cnt = 0;
+	 u32 mz_pwr_off_cnt = 0;
+
+	for (int idx = 0; idx < 32; idx++)
+	{
+		u32 pwr_en_cfg_1 = Mgmt_Zone_Ctrl_Get_PwrEn_Cfg(InstancePtr, idx, NULL);
+
+		u32 pwr_en_cfg_mz = pwr_en_cfg_1 & 0xFFFF;
+
+		if ((pwr_en_cfg_mz & (1 << MZ)) != 0)
+		{
+			u32 pwr_en_indiv_status =  Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_INDIV_STATUS_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+
+			if (pwr_en_indiv_status == MZ_PWR_ON)
+				mz_pwr_on_cnt++;
+			else if (pwr_en_indiv_status == MZ_PWR_TRANS_ON)
+				mz_pwr_trans_on_cnt++;
+			else if (pwr_en_indiv_status == MZ_PWR_TRANS_OFF)
+				mz_pwr_trans_off_cnt++;
+			else
+				mz_pwr_off_cnt++;
+		}
+	}
+
+    if (mz_pwr_trans_on_cnt != 0)
+        mz_pwr = MZ_PWR_TRANS_ON;
+    else if (mz_pwr_trans_off_cnt != 0)
+        mz_pwr = MZ_PWR_TRANS_OFF;
+    else if (mz_pwr_on_cnt != 0)
+        mz_pwr = MZ_PWR_ON;
+    else
+        mz_pwr = MZ_PWR_OFF;
+
+	return mz_pwr;
+}
+
 /******************************************************************************/
 /**
 * Lookup the device configuration based on the unique device ID.  The table
@@ -140,6 +266,8 @@ Mgmt_Zone_Ctrl_Config *Mgmt_Zone_Ctrl_LookupConfig(u16 DeviceId)
 int Mgmt_Zone_Ctrl_CfgInitialize(Mgmt_Zone_Ctrl * InstancePtr, Mgmt_Zone_Ctrl_Config * Config,
 			UINTPTR EffectiveAddr)
 {
+	int Index;
+
 	/* Assert arguments */
 	Xil_AssertNonvoid(InstancePtr != NULL);
 
@@ -150,6 +278,15 @@ int Mgmt_Zone_Ctrl_CfgInitialize(Mgmt_Zone_Ctrl * InstancePtr, Mgmt_Zone_Ctrl_Co
 	InstancePtr->hf_cnt = Config->HF_CNT;
 	InstancePtr->pwren_cnt = Config->PWREN_CNT;
 
+	/* Devices outside the configuration table run without a shadow */
+	InstancePtr->Shadow = NULL;
+	for (Index = 0; Index < XPAR_MGMT_ZONE_CTRL_NUM_INSTANCES; Index++) {
+		if (Mgmt_Zone_Ctrl_ConfigTable[Index].BaseAddress == EffectiveAddr) {
+			InstancePtr->Shadow = &Mgmt_Zone_Ctrl_Shadows[Index];
+			break;
+		}
+	}
+
 	/*
 	 * Indicate the instance is now ready to use, initialized without error
 	 */
@@ -217,6 +354,10 @@ u64 Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(Mgmt_Zone_Ctrl *InstancePtr)
 
 void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_config * cfg)
 {
+	 Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	 u32 mz_valid, pwr_en_valid;
+	 u32 writes, currmask;
+
 	 u32 hw_pwr_en_lvl_and_drive;
 	 u32 hw_pwr_en_tmr;
 	 u32 hw_pwr_en_cfg1;
@@ -225,9 +366,17 @@ void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_con
 	 u32 hard_fault_mask_1 = (u32)(cfg->hardfault_mask >> 32); // upper 32-bit word
 	 u32 hw_mz_holdoff = cfg->fault_holdoff * CORE_CLK_FREQ_IN_MHZ/1000; // units specified in miliseconds
 
-	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG, hard_fault_mask_0);
-	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG, hard_fault_mask_1);
-	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG, hw_mz_holdoff);
+	 if (!Shadow || !SHADOW_MZ_BIT(MZ)) {
+		 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG, hard_fault_mask_0);
+		 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG, hard_fault_mask_1);
+		 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG, hw_mz_holdoff);
+	 } else {
+		 mz_valid = Shadow->MZValid & SHADOW_MZ_BIT(MZ);
+		 Mgmt_Zone_Ctrl_Shadow_Write(InstancePtr, mz_valid, &Shadow->HfMask0[MZ], MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG, hard_fault_mask_0);
+		 Mgmt_Zone_Ctrl_Shadow_Write(InstancePtr, mz_valid, &Shadow->HfMask1[MZ], MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG, hard_fault_mask_1);
+		 Mgmt_Zone_Ctrl_Shadow_Write(InstancePtr, mz_valid, &Shadow->Holdoff[MZ], MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG, hw_mz_holdoff);
+		 Shadow->MZValid |= SHADOW_MZ_BIT(MZ);
+	 }
 
 	 for (int idx = 0; idx < 32; idx++)
 	 {
@@ -238,8 +387,24 @@ void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_con
 
 			 hw_pwr_en_cfg1 = (hw_pwr_en_lvl_and_drive << 16 ) | (1 << MZ);
 
-			 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_tmr);
-			 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_cfg1);
+			 if (!Shadow) {
+				 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_tmr);
+				 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_cfg1);
+				 continue;
+			 }
+
+			 // Zone state queries fill this shadow from interrupt context too
+			 SHADOW_LOCK(currmask);
+			 writes = Shadow->RegWrites;
+			 pwr_en_valid = Shadow->PwrEnValid & SHADOW_PWREN_BIT(idx);
+			 Mgmt_Zone_Ctrl_Shadow_Write(InstancePtr, pwr_en_valid, &Shadow->PwrEnCfg0[idx], PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_tmr);
+			 Mgmt_Zone_Ctrl_Shadow_Write(InstancePtr, pwr_en_valid, &Shadow->PwrEnCfg1[idx], PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET, hw_pwr_en_cfg1);
+			 Shadow->PwrEnValid |= SHADOW_PWREN_BIT(idx);
+
+			 // Power enable ownership or behaviour changed, cached zone states no longer apply
+			 if (writes != Shadow->RegWrites)
+				 Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
+			 SHADOW_UNLOCK(currmask);
 		 }
 	 }
 }
@@ -247,21 +412,37 @@ void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_con
 
 void Mgmt_Zone_Ctrl_Get_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, MZ_config * cfg)
 {
+	 Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	 u32 hard_fault_mask_0_reg, hard_fault_mask_1_reg, hw_mz_holdoff_reg;
+
+	 if (Shadow && (Shadow->MZValid & SHADOW_MZ_BIT(MZ))) {
+		 hard_fault_mask_0_reg = Shadow->HfMask0[MZ];
+		 hard_fault_mask_1_reg = Shadow->HfMask1[MZ];
+		 hw_mz_holdoff_reg = Shadow->Holdoff[MZ];
+		 Shadow->RegReadsSaved += 3;
+	 } else {
+		 hard_fault_mask_0_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG);
+		 hard_fault_mask_1_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG);
+		 hw_mz_holdoff_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG);
+
+		 if (Shadow && SHADOW_MZ_BIT(MZ)) {
+			 Shadow->HfMask0[MZ] = hard_fault_mask_0_reg;
+			 Shadow->HfMask1[MZ] = hard_fault_mask_1_reg;
+			 Shadow->Holdoff[MZ] = hw_mz_holdoff_reg;
+			 Shadow->MZValid |= SHADOW_MZ_BIT(MZ);
+		 }
+	 }
 
-	 u32 hard_fault_mask_0_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG);
-	 u32 hard_fault_mask_1_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG);
 	 u64 hard_fault_mask = ((((u64)hard_fault_mask_1_reg) << 32) | hard_fault_mask_0_reg);
 
 	 cfg->hardfault_mask = hard_fault_mask;
-
-	 u32 hw_mz_holdoff_reg = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG);
 	 cfg->fault_holdoff = hw_mz_holdoff_reg / (CORE_CLK_FREQ_IN_MHZ/1000);
 
 
 	for (int idx = 0; idx < 32; idx++)
 	{
-		u32 pwr_en_cfg_0 =  Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET);
-		u32 pwr_en_cfg_1 =  Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		u32 pwr_en_cfg_0;
+		u32 pwr_en_cfg_1 = Mgmt_Zone_Ctrl_Get_PwrEn_Cfg(InstancePtr, idx, &pwr_en_cfg_0);
 
 		u32 pwr_en_cfg_mz = pwr_en_cfg_1 & 0xFFFF;
 
@@ -282,45 +463,56 @@ void Mgmt_Zone_Ctrl_Get_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, MZ_config *
 
  MZ_pwr Mgmt_Zone_Ctrl_Get_MZ_Status(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ)
 {
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	MZ_pwr mz_pwr;
+	u32 aggr, mz_status, currmask;
 
-	 MZ_pwr mz_pwr = MZ_PWR_OFF;
-	 u32 mz_pwr_on_cnt = 0;
-	 u32 mz_pwr_trans_on_cnt = 0;
-	 u32 mz_pwr_trans_off_cnt = 0;
-	 u32 mz_pwr_off_cnt = 0;
+	if (!Shadow || !SHADOW_MZ_BIT(MZ))
+		return Mgmt_Zone_Ctrl_Read_MZ_Status(InstancePtr, MZ);
 
-	for (int idx = 0; idx < 32; idx++)
-	{
-		u32 pwr_en_cfg_1 =  Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+	/*
+	 * Check, read and store in one go, so an invalidation from an interrupt
+	 * can't land between reading the power enables and caching the result.
+	 */
+	SHADOW_LOCK(currmask);
+
+	// Every power enable transition shows up in the aggregate status
+	aggr = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_AGGR_STATUS);
+	if (aggr != Shadow->AggrStatus) {
+		Shadow->AggrStatus = aggr;
+		Shadow->StatusGen++;
+		Shadow->StatusValid = 0;
+	}
 
-		u32 pwr_en_cfg_mz = pwr_en_cfg_1 & 0xFFFF;
+	/*
+	 * A zone can leave a stable state before any enable moves, e.g. a hard
+	 * fault shutdown waiting out its off delays, which only the zone's own
+	 * power status shows.
+	 */
+	mz_status = Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_PWR_STATUS_REG);
+	if (mz_status != Shadow->MZPwrStatus[MZ])
+		Shadow->StatusValid &= ~SHADOW_MZ_BIT(MZ);
+
+	if (Shadow->StatusValid & SHADOW_MZ_BIT(MZ)) {
+		Shadow->StatusHits++;
+		mz_pwr = (MZ_pwr)Shadow->Status[MZ];
+		SHADOW_UNLOCK(currmask);
+		return mz_pwr;
+	}
 
-		if ((pwr_en_cfg_mz & (1 << MZ)) != 0)
-		{
-			u32 pwr_en_indiv_status =  Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_0_INDIV_STATUS_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+	Shadow->StatusMisses++;
+	mz_pwr = Mgmt_Zone_Ctrl_Read_MZ_Status(InstancePtr, MZ);
 
-			if (pwr_en_indiv_status == MZ_PWR_ON)
-				mz_pwr_on_cnt++;
-			else if (pwr_en_indiv_status == MZ_PWR_TRANS_ON)
-				mz_pwr_trans_on_cnt++;
-			else if (pwr_en_indiv_status == MZ_PWR_TRANS_OFF)
-				mz_pwr_trans_off_cnt++;
-			else
-				mz_pwr_off_cnt++;
-		}
+	// Only stable states are cached, a zone in transition can finish without any status change
+	if (mz_pwr == MZ_PWR_ON || mz_pwr == MZ_PWR_OFF) {
+		Shadow->Status[MZ] = mz_pwr;
+		Shadow->MZPwrStatus[MZ] = mz_status;
+		Shadow->StatusValid |= SHADOW_MZ_BIT(MZ);
 	}
 
-    if (mz_pwr_trans_on_cnt != 0)
-        mz_pwr = MZ_PWR_TRANS_ON;
-    else if (mz_pwr_trans_off_cnt != 0)
-        mz_pwr = MZ_PWR_TRANS_OFF;
-    else if (mz_pwr_on_cnt != 0)
-        mz_pwr = MZ_PWR_ON;
-    else
-        mz_pwr = MZ_PWR_OFF;
+	SHADOW_UNLOCK(currmask);
 
 	return mz_pwr;
-
 }
 
  u32 Mgmt_Zone_Ctrl_Get_Pwr_En_Status(Mgmt_Zone_Ctrl *InstancePtr)
@@ -331,16 +523,19 @@ void Mgmt_Zone_Ctrl_Get_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, MZ_config *
 void Mgmt_Zone_Ctrl_Pwr_ON_Seq(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ)
 {
 	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_PWR_ON_INIT_REG, 1 << MZ);
+	 Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 void Mgmt_Zone_Ctrl_Pwr_OFF_Seq(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ)
 {
 	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_PWR_OFF_INIT_REG, 1 << MZ);
+	 Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 void Mgmt_Zone_Ctrl_Dispatch_Soft_Fault(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ)
 {
 	 Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, MZ * MZ_2_MZ_ADDR_OFFSET + MZ_0_SOFT_FAULT_REG, 1 << MZ);
+	 Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 void Mgmt_Zone_Ctrl_Set_IRQ_Enables(Mgmt_Zone_Ctrl *InstancePtr, u32 irq_enables)
@@ -365,6 +560,7 @@ u32 Mgmt_Zone_Ctrl_Get_IRQ_Status(Mgmt_Zone_Ctrl *InstancePtr)
 
 void Mgmt_Zone_Ctrl_Set_Enable_Override(Mgmt_Zone_Ctrl *InstancePtr, u32 enables) {
     Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_OVRD_REG, enables);
+    Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 u32 Mgmt_Zone_Ctrl_Get_Enable_Override(Mgmt_Zone_Ctrl *InstancePtr) {
@@ -373,6 +569,7 @@ u32 Mgmt_Zone_Ctrl_Get_Enable_Override(Mgmt_Zone_Ctrl *InstancePtr) {
 
 void Mgmt_Zone_Ctrl_Set_Override_Drive(Mgmt_Zone_Ctrl *InstancePtr, u32 drive) {
     Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_OVRD_DRIVE_REG, drive);
+    Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 u32 Mgmt_Zone_Ctrl_Get_Override_Drive(Mgmt_Zone_Ctrl *InstancePtr) {
@@ -381,6 +578,7 @@ u32 Mgmt_Zone_Ctrl_Get_Override_Drive(Mgmt_Zone_Ctrl *InstancePtr) {
 
 void Mgmt_Zone_Ctrl_Set_Override_Level(Mgmt_Zone_Ctrl *InstancePtr, u32 level) {
     Mgmt_Zone_Ctrl_WriteReg(InstancePtr->BaseAddress, PWR_EN_OVRD_LVL_REG, level);
+    Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
 }
 
 u32 Mgmt_Zone_Ctrl_Get_Override_Level(Mgmt_Zone_Ctrl *InstancePtr) {
@@ -390,3 +588,71 @@ u32 Mgmt_Zone_Ctrl_Get_Override_Level(Mgmt_Zone_Ctrl *InstancePtr) {
 u32 Mgmt_Zone_Ctrl_Get_Override_Input(Mgmt_Zone_Ctrl *InstancePtr) {
     return Mgmt_Zone_Ctrl_ReadReg(InstancePtr->BaseAddress, PWR_EN_OVRD_READ_REG);
 }
+
+u32 Mgmt_Zone_Ctrl_Verify_Shadow(Mgmt_Zone_Ctrl *InstancePtr, int restore)
+{
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	u32 base = InstancePtr->BaseAddress;
+	u32 diverged = 0;
+	u32 mz, idx, cfg0, cfg1, currmask;
+
+	if (!Shadow)
+		return 0;
+
+	for (mz = 0; mz < InstancePtr->mz_cnt && mz < MGMT_ZONE_CTRL_SHADOW_MAX_MZ; mz++) {
+		if (!(Shadow->MZValid & SHADOW_MZ_BIT(mz)))
+			continue;
+
+		if (Mgmt_Zone_Ctrl_ReadReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG) != Shadow->HfMask0[mz] ||
+			Mgmt_Zone_Ctrl_ReadReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG) != Shadow->HfMask1[mz] ||
+			Mgmt_Zone_Ctrl_ReadReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG) != Shadow->Holdoff[mz]) {
+			diverged |= SHADOW_MZ_BIT(mz);
+			if (restore) {
+				Mgmt_Zone_Ctrl_WriteReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_0_REG, Shadow->HfMask0[mz]);
+				Mgmt_Zone_Ctrl_WriteReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_MASK_1_REG, Shadow->HfMask1[mz]);
+				Mgmt_Zone_Ctrl_WriteReg(base, mz * MZ_2_MZ_ADDR_OFFSET + MZ_0_HARD_FAULT_HOLDOFF_REG, Shadow->Holdoff[mz]);
+			}
+		}
+	}
+
+	for (idx = 0; idx < MGMT_ZONE_CTRL_SHADOW_MAX_PWREN; idx++) {
+		// One power enable at a time, zone state queries may fill these from interrupt context
+		SHADOW_LOCK(currmask);
+		if (!(Shadow->PwrEnValid & SHADOW_PWREN_BIT(idx))) {
+			SHADOW_UNLOCK(currmask);
+			continue;
+		}
+
+		cfg0 = Mgmt_Zone_Ctrl_ReadReg(base, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		cfg1 = Mgmt_Zone_Ctrl_ReadReg(base, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET);
+		if (cfg0 != Shadow->PwrEnCfg0[idx] || cfg1 != Shadow->PwrEnCfg1[idx]) {
+			// Charged to the zones owning the enable, by the shadow and by the hardware
+			diverged |= (Shadow->PwrEnCfg1[idx] | cfg1) & 0xFFFF;
+			if (restore) {
+				Mgmt_Zone_Ctrl_WriteReg(base, PWR_EN_0_CFG_0_REG + idx*PWR_2_PWR_ADDR_OFFSET, Shadow->PwrEnCfg0[idx]);
+				Mgmt_Zone_Ctrl_WriteReg(base, PWR_EN_0_CFG_1_REG + idx*PWR_2_PWR_ADDR_OFFSET, Shadow->PwrEnCfg1[idx]);
+			}
+		}
+		SHADOW_UNLOCK(currmask);
+	}
+
+	if (diverged)
+		Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
+
+	return diverged;
+}
+
+void Mgmt_Zone_Ctrl_Invalidate_Shadow(Mgmt_Zone_Ctrl *InstancePtr)
+{
+	Mgmt_Zone_Ctrl_Shadow *Shadow = InstancePtr->Shadow;
+	u32 currmask;
+
+	if (!Shadow)
+		return;
+
+	SHADOW_LOCK(currmask);
+	Shadow->MZValid = 0;
+	Shadow->PwrEnValid = 0;
+	Mgmt_Zone_Ctrl_Invalidate_Status(InstancePtr);
+	SHADOW_UNLOCK(currmask);
+}
@@ -26,6 +26,11 @@ extern "C" {
 #include "xil_types.h"
 #include "xstatus.h"
 
+/************************** Constant Definitions ***************************/
+
+#define MGMT_ZONE_CTRL_SHADOW_MAX_MZ	(16)
+#define MGMT_ZONE_CTRL_SHADOW_MAX_PWREN	(32)
+
 /**************************** Type Definitions *****************************/
 
 /**
@@ -39,6 +44,38 @@ typedef struct {
 	u32 PWREN_CNT; /* Number of power enable pins supported in FW*/
 } Mgmt_Zone_Ctrl_Config;
 
+/**
+ * Shadow copy of the management zone configuration registers, and a cache of
+ * the zone power states.
+ *
+ * Configuration writes go through to the hardware and are mirrored here, so
+ * reads can be served from RAM and unchanged writes skipped.  Stable zone
+ * states (on or off) are cached until PWR_EN_AGGR_STATUS or the zone's power
+ * status register changes, or the driver starts a sequence.  There is one shadow per device, shared by every instance that
+ * drives it.  Zone state queries may come from interrupt context and fill the
+ * power enable shadow, so it and the status cache are only touched with IRQ
+ * and FIQ masked.
+ **/
+typedef struct {
+	u32 MZValid; /* Bitmap of MZs with a valid fault mask and holdoff shadow */
+	u32 PwrEnValid; /* Bitmap of power enables with a valid CFG_0/CFG_1 shadow */
+	u32 HfMask0[MGMT_ZONE_CTRL_SHADOW_MAX_MZ]; /* Hard fault mask, lower word */
+	u32 HfMask1[MGMT_ZONE_CTRL_SHADOW_MAX_MZ]; /* Hard fault mask, upper word */
+	u32 Holdoff[MGMT_ZONE_CTRL_SHADOW_MAX_MZ]; /* Hard fault holdoff, in core clocks */
+	u32 PwrEnCfg0[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN]; /* Power enable timer, in core clocks */
+	u32 PwrEnCfg1[MGMT_ZONE_CTRL_SHADOW_MAX_PWREN]; /* Power enable level, drive and MZ ownership */
+	volatile u32 StatusValid; /* Bitmap of MZs with a cached power state */
+	volatile u32 StatusGen; /* Incremented on every status invalidation */
+	volatile u32 AggrStatus; /* PWR_EN_AGGR_STATUS when last checked */
+	u8 Status[MGMT_ZONE_CTRL_SHADOW_MAX_MZ]; /* Cached MZ_pwr of each zone */
+	u32 MZPwrStatus[MGMT_ZONE_CTRL_SHADOW_MAX_MZ]; /* MZ_n_PWR_STATUS the cached state was read with */
+	u32 RegWrites; /* Register writes issued */
+	u32 RegWritesSkipped; /* Register writes skipped, value unchanged */
+	u32 RegReadsSaved; /* Register reads served from the shadow */
+	u32 StatusHits; /* Zone state queries served from the cache */
+	u32 StatusMisses; /* Zone state queries that read the power enables */
+} Mgmt_Zone_Ctrl_Shadow;
+
 /**
  * The Mgmt_Zone_Ctrl driver instance data. The user is required to allocate a
  * variable of this type for every Mgmt_Zone_Ctrl device in the system. A pointer
@@ -50,6 +87,7 @@ typedef struct {
 	u32 mz_cnt;  /* Number of MZs supported in FW*/
 	u32 hf_cnt;  /* Number of hard faults supported in FW */
 	u32 pwren_cnt; /* Number of power enable pins supported in FW*/
+	Mgmt_Zone_Ctrl_Shadow *Shadow; /* Shadow registers of this device */
 } Mgmt_Zone_Ctrl;
 
 /**
@@ -145,7 +183,7 @@ u64 Mgmt_Zone_Ctrl_Get_Hard_Fault_Status(Mgmt_Zone_Ctrl *InstancePtr);
 * 		    PWREN_cfg_t pwren_cfg[32]; - if individual element of PWREN_cfg_t set to zero
 * 		    							 then it's not controlled by this MZ
 *
-* @note		None.
+* @note		Registers already holding the requested value are not written.
 *
 *****************************************************************************/
 void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_config * cfg);
@@ -164,7 +202,7 @@ void Mgmt_Zone_Ctrl_Set_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, const MZ_con
 *
 * @param Management Zone Configuration
 *
-* @note		None.
+* @note		Served from the shadow registers once they are known.
 *
 *****************************************************************************/
 void Mgmt_Zone_Ctrl_Get_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, MZ_config * cfg);
@@ -183,7 +221,8 @@ void Mgmt_Zone_Ctrl_Get_MZ_Cfg(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ, MZ_config *
 *
 * @return enum MZ_pwr
 *
-* @note		None.
+* @note		Stable states are served from the status cache.  This costs a
+*		PWR_EN_AGGR_STATUS and a zone power status read.
 *
 *****************************************************************************/
 MZ_pwr Mgmt_Zone_Ctrl_Get_MZ_Status(Mgmt_Zone_Ctrl *InstancePtr, u32 MZ);
@@ -387,6 +426,41 @@ u32 Mgmt_Zone_Ctrl_Get_Override_Level(Mgmt_Zone_Ctrl *InstancePtr);
 *****************************************************************************/
 u32 Mgmt_Zone_Ctrl_Get_Override_Input(Mgmt_Zone_Ctrl *InstancePtr);
 
+/****************************************************************************/
+/**
+* Verify the shadow registers against the hardware
+*
+* @param	InstancePtr is a pointer to an Mgmt_Zone_Ctrl instance. The memory the
+*		pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @param Nonzero to write the shadow values back to diverged registers
+*
+* @return Bitmap of MZs whose configuration, or that of a power enable they
+*		own, diverged
+*
+* @note		None.
+*
+*****************************************************************************/
+u32 Mgmt_Zone_Ctrl_Verify_Shadow(Mgmt_Zone_Ctrl *InstancePtr, int restore);
+
+/****************************************************************************/
+/**
+* Invalidate the shadow registers and the zone status cache
+*
+* The next read of each register goes to the hardware again.
+*
+* @param	InstancePtr is a pointer to an Mgmt_Zone_Ctrl instance. The memory the
+*		pointer references must be pre-allocated by the caller. Further
+*		calls to manipulate the instance/driver through the Mgmt_Zone_Ctrl API
+*		must be made with this pointer.
+*
+* @note		None.
+*
+*****************************************************************************/
+void Mgmt_Zone_Ctrl_Invalidate_Shadow(Mgmt_Zone_Ctrl *InstancePtr);
+
 #ifdef __cplusplus
 }
 #endif